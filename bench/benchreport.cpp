@@ -0,0 +1,57 @@
+#include "benchreport.h"
+#include <algorithm>
+
+namespace {
+qint64 percentile(const QVector<qint64> &sorted, double p)
+{
+    if (sorted.isEmpty()) return 0;
+    int index = qBound(0, int(p * (sorted.size() - 1) + 0.5), int(sorted.size()) - 1);
+    return sorted[index];
+}
+
+QString formatNs(qint64 ns)
+{
+    if (ns >= 1000000000) return QString::number(ns / 1e9, 'f', 2) + " s";
+    if (ns >= 1000000) return QString::number(ns / 1e6, 'f', 2) + " ms";
+    if (ns >= 1000) return QString::number(ns / 1e3, 'f', 2) + " us";
+    return QString::number(ns) + " ns";
+}
+}
+
+QTextStream &benchOut()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+void printBenchHeader()
+{
+    benchOut() << qSetFieldWidth(28) << Qt::left << "benchmark"
+               << qSetFieldWidth(10) << Qt::right << "rows"
+               << qSetFieldWidth(8) << "ops"
+               << qSetFieldWidth(14) << "ops/s"
+               << qSetFieldWidth(12) << "p50"
+               << qSetFieldWidth(12) << "p90"
+               << qSetFieldWidth(12) << "p99"
+               << qSetFieldWidth(12) << "max"
+               << qSetFieldWidth(14) << "allocs/op"
+               << qSetFieldWidth(0) << "\n";
+}
+
+void printBenchResult(BenchResult result)
+{
+    std::sort(result.samples.begin(), result.samples.end());
+    int ops = result.samples.size();
+    double opsPerSecond = result.totalNs > 0 ? ops * 1e9 / result.totalNs : 0;
+    benchOut() << qSetFieldWidth(28) << Qt::left << result.name
+               << qSetFieldWidth(10) << Qt::right << result.rows
+               << qSetFieldWidth(8) << ops
+               << qSetFieldWidth(14) << QString::number(opsPerSecond, 'f', 1)
+               << qSetFieldWidth(12) << formatNs(percentile(result.samples, 0.50))
+               << qSetFieldWidth(12) << formatNs(percentile(result.samples, 0.90))
+               << qSetFieldWidth(12) << formatNs(percentile(result.samples, 0.99))
+               << qSetFieldWidth(12) << formatNs(result.samples.isEmpty() ? 0 : result.samples.last())
+               << qSetFieldWidth(14) << QString::number(ops ? double(result.allocations) / ops : 0, 'f', 1)
+               << qSetFieldWidth(0) << "\n";
+    benchOut().flush();
+}
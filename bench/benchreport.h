@@ -0,0 +1,23 @@
+#ifndef BENCHREPORT_H
+#define BENCHREPORT_H
+
+#include <QString>
+#include <QTextStream>
+#include <QVector>
+
+// The results table shared by carpool_bench and carpool_loadgen: one row per
+// benchmark or operation type with throughput, latency percentiles and heap
+// allocations per operation.
+struct BenchResult {
+    QString name;
+    int rows = 0;
+    QVector<qint64> samples;    // nanoseconds per operation
+    qint64 totalNs = 0;         // time the operations took, for ops/s
+    quint64 allocations = 0;
+};
+
+QTextStream &benchOut();
+void printBenchHeader();
+void printBenchResult(BenchResult result);
+
+#endif // BENCHREPORT_H
@@ -0,0 +1,463 @@
+// Microbenchmarks for the load, save, search and booking paths.
+//
+//   carpool_bench [--rows 1000,100000,1000000] [--filter <substring>] [--seed <n>]
+//
+// "--rows 100000 --filter search/route" is the route search latency check:
+// typed prefixes, one-letter prefixes, two-word queries and re-indexing a
+// ride on a popular route, each of which should stay well under a
+// millisecond at 100k rides.
+//
+// Each benchmark times every operation individually and reports throughput,
+// latency percentiles and heap allocations per operation. Allocations are
+// counted process-wide, so the persistence thread's work during booking is
+// included.
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include "benchreport.h"
+#include "carpoolclient.h"
+#include "carpoolserver.h"
+#include "carpoolservice.h"
+#include "metrics.h"
+#include "routeindex.h"
+#include "snapshot.h"
+#include "syntheticdata.h"
+
+namespace {
+std::atomic<quint64> allocationCount(0);
+}
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *block = std::malloc(size ? size : 1)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete(void *block, std::size_t) noexcept
+{
+    std::free(block);
+}
+
+namespace {
+typedef BenchResult Result;
+
+QTextStream &out() { return benchOut(); }
+void report(const Result &result) { printBenchResult(result); }
+
+QString filter;
+
+bool selected(const QString &name)
+{
+    return filter.isEmpty() || name.contains(filter);
+}
+
+// Runs op(i) for i in [0, ops), timing each call. setup(i), if given, runs
+// before each call outside the timed region and its allocations.
+void run(const QString &name, int rows, int ops, const std::function<void(int)> &op,
+         const std::function<void(int)> &setup = nullptr)
+{
+    if (!selected(name)) return;
+
+    Result result;
+    result.name = name;
+    result.rows = rows;
+    result.samples.reserve(ops);
+
+    QElapsedTimer timer;
+    for (int i = 0; i < ops; i++) {
+        if (setup) setup(i);
+        quint64 allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        timer.start();
+        op(i);
+        qint64 elapsed = timer.nsecsElapsed();
+        result.allocations += allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        result.samples.append(elapsed);
+        result.totalNs += elapsed;
+    }
+    report(result);
+}
+
+// Whole-data-set operations get fewer repetitions as the data grows
+int repetitions(int rows)
+{
+    return rows >= 1000000 ? 3 : rows >= 100000 ? 5 : 20;
+}
+
+void benchmarkRows(int rows, quint32 seed, const QString &workDir)
+{
+    SyntheticData::Options options;
+    options.rides = rows;
+    options.users = qMax(100, rows / 4);
+    options.seed = seed;
+
+    UserDirectory users;
+    RideRepository rides;
+    SyntheticData::populate(users, rides, options);
+
+    const QString snapshotPath = workDir + "/carpool.dat";
+    const QString usersPath = workDir + "/users.txt";
+    const QString ridesPath = workDir + "/rides.txt";
+    const int wholeSetOps = repetitions(rows);
+
+    // Save paths
+    QByteArray snapshot;
+    run("save/binary-serialize", rows, wholeSetOps, [&](int) {
+        snapshot = Snapshot::serialize(users, rides, 0);
+    });
+    Snapshot::writeFile(snapshotPath, Snapshot::serialize(users, rides, 0));
+    run("save/rides-text", rows, wholeSetOps, [&](int) {
+        snapshot = Snapshot::serializeRidesText(rides, 0);
+    });
+    Snapshot::writeFile(usersPath, Snapshot::serializeUsersText(users, 0));
+    Snapshot::writeFile(ridesPath, Snapshot::serializeRidesText(rides, 0));
+    snapshot.clear();
+
+    // Load paths, each into an empty directory/repository
+    QScopedPointer<UserDirectory> loadedUsers;
+    QScopedPointer<RideRepository> loadedRides;
+    auto freshTargets = [&](int) {
+        loadedRides.reset(new RideRepository);
+        loadedUsers.reset(new UserDirectory);
+    };
+    run("load/binary-snapshot", rows, wholeSetOps, [&](int) {
+        Snapshot::load(snapshotPath, *loadedUsers, *loadedRides, nullptr);
+    }, freshTargets);
+    run("load/users-text", options.users, wholeSetOps, [&](int) {
+        Snapshot::loadUsersText(usersPath, *loadedUsers, nullptr);
+    }, freshTargets);
+    run("load/rides-text", rows, wholeSetOps, [&](int) {
+        Snapshot::loadRidesText(ridesPath, *loadedRides, nullptr);
+    }, freshTargets);
+    loadedRides.reset();
+    loadedUsers.reset();
+
+    // Query paths
+    const int passengers = SyntheticData::passengerCount(options);
+    run("search/available-rides", rows, wholeSetOps, [&](int i) {
+        // What the book-ride page does: walk the open rides and filter
+        int userId = internString(SyntheticData::passengerName(i % passengers));
+        int visible = 0;
+        for (Ride* ride : rides.openRides()) {
+            if (!ride->isFull() && !ride->hasPassenger(userId)) visible++;
+        }
+        Q_UNUSED(visible);
+    });
+
+    QRandomGenerator random(seed);
+    const QStringList &cities = SyntheticData::cities();
+    run("search/route-prefix", rows, 1000, [&](int i) {
+        QString city = cities[SyntheticData::pickCity(random)].toLower();
+        rides.searchOpenRides(city.left(1 + i % city.size()));
+    });
+    run("search/route-two-words", rows, 1000, [&](int) {
+        QString from = cities[SyntheticData::pickCity(random)];
+        QString to = cities[SyntheticData::pickCity(random)];
+        rides.searchOpenRides(from + " to " + to.left(3));
+    });
+    run("search/route-one-letter", rows, 1000, [&](int i) {
+        // The widest prefixes, as the first key is typed
+        rides.searchOpenRides(QString(QChar('a' + i % 26)));
+    });
+    {
+        // A ride leaving and re-entering the open list, e.g. filling up and
+        // then losing a passenger; popular routes have the longest lists
+        RouteIndex index;
+        QVector<Ride*> indexed;
+        indexed.reserve(rides.openRides().size());
+        for (Ride* ride : rides.openRides()) {
+            index.insert(ride->getId(), ride->getRouteId());
+            indexed.append(ride);
+        }
+        if (!indexed.isEmpty()) {
+            run("search/route-index-update", rows, 1000, [&](int i) {
+                const Ride* ride = indexed[int(quint64(i) * 7919 % quint64(indexed.size()))];
+                index.remove(ride->getId(), ride->getRouteId());
+                index.insert(ride->getId(), ride->getRouteId());
+            });
+        }
+    }
+
+    const qint64 now = Ride::currentTime();
+    run("search/departing-6h", rows, 1000, [&](int i) {
+        qint64 from = now + (i % (30 * 24)) * 3600;
+        rides.openRidesDepartingBetween(from, from + 6 * 3600);
+    });
+    run("search/latest-unrated", rows, 1000, [&](int i) {
+        rides.latestUnratedRideForPassenger(internString(SyntheticData::passengerName(i % passengers)));
+    });
+
+    // Pickup and drop-off within 2 km of points around the popular cities
+    run("search/nearby-2km", rows, 1000, [&](int i) {
+        int from = i % 4;
+        GeoPoint origin = SyntheticData::cityLocation(from);
+        GeoPoint destination = SyntheticData::cityLocation((from + 1 + i / 4 % 3) % 4);
+        origin.latitudeE6 += (i * 7919) % 60000 - 30000;
+        destination.longitudeE6 += (i * 104729) % 60000 - 30000;
+        rides.openRidesNear(origin, destination, 2000);
+    });
+
+    // Live prices for the whole book-ride list in one FareEngine batch,
+    // against quoting the rides one at a time
+    {
+        const FareEngine fares;
+        QVector<const Ride*> open;
+        open.reserve(rides.openRides().size());
+        for (Ride* ride : rides.openRides()) {
+            open.append(ride);
+        }
+        QVector<Money> quotes;
+        run("fares/quote-open-batch", rows, wholeSetOps, [&](int) {
+            fares.quote(open, &quotes);
+        });
+        run("fares/quote-open-single", rows, wholeSetOps, [&](int) {
+            quotes.resize(open.size());
+            for (int r = 0; r < open.size(); r++) {
+                quotes[r] = fares.quote(open[r]);
+            }
+        });
+    }
+
+    // Per-segment seats of a long, partly booked multi-stop ride: check a
+    // leg has a seat on every segment, take it and give it back
+    {
+        const int segments = 64;
+        SeatSegments seats(segments);
+        for (int s = 0; s + 8 <= segments; s += 3) {
+            seats.add(s, s + 8, 1);
+        }
+        run("seats/leg-64-stops", rows, 100000, [&](int i) {
+            int from = (i * 7) % (segments - 1);
+            int to = from + 1 + (i * 13) % (segments - from);
+            if (seats.maxOver(from, to) < 4) {
+                seats.add(from, to, 1);
+                seats.add(from, to, -1);
+            }
+        });
+    }
+
+    // What instrumenting a hot path costs, per thousand events
+    run("metrics/count-x1000", rows, 1000, [&](int) {
+        for (int n = 0; n < 1000; n++) Metrics::count(Metrics::RideLookups);
+    });
+    run("metrics/record-x1000", rows, 1000, [&](int i) {
+        for (int n = 0; n < 1000; n++) Metrics::record(Metrics::ListRefreshNs, quint64(i * 1000 + n));
+    });
+
+    users.clear();
+    rides.clear();
+
+    // Booking through the service, journal and persistence thread included
+    if (selected("book/service")) {
+        CarpoolService service(workDir + "/journal.txt", snapshotPath);
+        service.open();
+
+        const QList<Ride*> openRides = service.rides().openRides().values();
+        int booked = 0;
+        run("book/service", rows, qMin(10000, int(openRides.size())), [&](int i) {
+            User* passenger = service.users().find(SyntheticData::passengerName(random.bounded(passengers)),
+                                                   "passenger");
+            Ride* ride = openRides[i];
+            if (service.bookRide(passenger, ride) == CarpoolService::Ok) booked++;
+        });
+        out() << "    (" << booked << " bookings succeeded)\n";
+        service.close();
+    }
+
+    // Concurrent sessions: batches of requests skewed towards the first
+    // (most contended) open rides, decided in parallel by the BookingEngine
+    if (selected("book/batch")) {
+        CarpoolService service(workDir + "/journal.txt", snapshotPath);
+        service.open();
+
+        const QList<Ride*> openRides = service.rides().openRides().values();
+        QVector<QPair<User*, Ride*>> batch;
+        int accepted = 0;
+        run("book/batch-10k", rows, 5, [&](int) {
+            for (CarpoolService::Status status : service.bookRides(batch)) {
+                if (status == CarpoolService::Ok) accepted++;
+            }
+        }, [&](int) {
+            batch.clear();
+            for (int i = 0; i < 10000 && !openRides.isEmpty(); i++) {
+                double u = random.generateDouble();
+                Ride* ride = openRides[int(u * u * u * openRides.size())];
+                User* passenger = service.users().find(
+                    SyntheticData::passengerName(random.bounded(passengers)), "passenger");
+                batch.append(qMakePair(passenger, ride));
+            }
+        });
+        out() << "    (" << accepted << " bookings accepted)\n";
+        service.close();
+    }
+
+    // Auto-assignment: a queue of passenger requests for popular routes
+    // and a departure window, filled by the SeatMatcher in one pass
+    if (selected("match/batch")) {
+        CarpoolService service(workDir + "/journal.txt", snapshotPath);
+        service.open();
+
+        QVector<SeatMatcher::Request> requests;
+        int matched = 0;
+        const qint64 start = Ride::currentTime();
+        run("match/batch-10k", rows, 5, [&](int) {
+            for (CarpoolService::Status status : service.matchRides(requests)) {
+                if (status == CarpoolService::Ok) matched++;
+            }
+        }, [&](int) {
+            requests.clear();
+            for (int i = 0; i < 10000; i++) {
+                int from = SyntheticData::pickCity(random);
+                int to = SyntheticData::pickCity(random);
+                SeatMatcher::Request request;
+                request.passenger = service.users().find(
+                    SyntheticData::passengerName(random.bounded(passengers)), "passenger");
+                request.route = cities[from] + " to " + cities[to];
+                request.earliest = start + random.bounded(30 * 24) * 3600;
+                request.latest = request.earliest + 48 * 3600;
+                request.maxFare = 1000 + random.bounded(1000);
+                requests.append(request);
+            }
+        });
+        out() << "    (" << matched << " seats filled)\n";
+        service.close();
+    }
+
+    // The same through a CarpoolServer: client threads each log in as a
+    // series of passengers and pipeline BOOK requests over the local socket
+    if (selected("server/book")) {
+        CarpoolService service(workDir + "/journal.txt", snapshotPath);
+        service.open();
+        CarpoolServer server(service);
+        const QString name = "carpool-bench-" + QString::number(QCoreApplication::applicationPid());
+        if (server.listen(name)) {
+            QVector<int> rideIds;
+            for (Ride* ride : service.rides().openRides()) {
+                rideIds.append(ride->getId());
+            }
+
+            const int clients = 8;
+            const int passengersPerClient = qMin(500, passengers / clients);
+            const int window = 64;      // requests in flight per client
+            QVector<QVector<qint64>> samples(clients);
+            QVector<int> accepted(clients, 0);
+
+            QEventLoop loop;
+            int running = clients;
+            QList<QThread*> threads;
+            Result result;
+            result.name = "server/book";
+            result.rows = rows;
+            quint64 allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            QElapsedTimer wall;
+            wall.start();
+            for (int c = 0; c < clients && !rideIds.isEmpty(); c++) {
+                QThread *thread = QThread::create([&, c]() {
+                    CarpoolClient client;
+                    if (!client.connectToServer(name)) return;
+                    QRandomGenerator clientRandom(seed + c);
+                    QElapsedTimer clock;
+                    clock.start();
+
+                    struct InFlight { quint64 id; qint64 sentNs; bool isBooking; };
+                    QQueue<InFlight> inFlight;
+                    auto receive = [&]() {
+                        InFlight request = inFlight.dequeue();
+                        CarpoolClient::Reply reply = client.wait(request.id);
+                        if (!request.isBooking) return;
+                        samples[c].append(clock.nsecsElapsed() - request.sentNs);
+                        if (reply.op == "OK") accepted[c]++;
+                    };
+                    auto send = [&](const QString &op, const QStringList &args) {
+                        inFlight.enqueue({client.send(op, args), clock.nsecsElapsed(), op == "BOOK"});
+                        if (inFlight.size() >= window) receive();
+                    };
+
+                    // Up to MaxActiveRides bookings per passenger
+                    for (int p = 0; p < passengersPerClient; p++) {
+                        send("LOGIN", {"passenger", SyntheticData::passengerName(p * clients + c), "secret"});
+                        for (int b = 0; b < CarpoolService::MaxActiveRides; b++) {
+                            send("BOOK", {QString::number(rideIds[clientRandom.bounded(rideIds.size())])});
+                        }
+                    }
+                    while (!inFlight.isEmpty()) receive();
+                });
+                QObject::connect(thread, &QThread::finished, &loop, [&]() {
+                    if (--running == 0) loop.quit();
+                });
+                threads.append(thread);
+                thread->start();
+            }
+            if (!threads.isEmpty()) loop.exec();
+            result.totalNs = wall.nsecsElapsed();
+            result.allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            qDeleteAll(threads);
+
+            int bookings = 0;
+            for (int c = 0; c < clients; c++) {
+                result.samples += samples[c];
+                bookings += accepted[c];
+            }
+            report(result);
+            out() << "    (" << bookings << " bookings accepted, " << clients << " clients)\n";
+        }
+        server.close();
+        service.close();
+    }
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QList<int> rowCounts = {1000, 100000, 1000000};
+    quint32 seed = 42;
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i] == "--rows" && i + 1 < args.size()) {
+            rowCounts.clear();
+            for (const QString &count : args[++i].split(",", Qt::SkipEmptyParts)) {
+                rowCounts.append(count.toInt());
+            }
+        } else if (args[i] == "--filter" && i + 1 < args.size()) {
+            filter = args[++i];
+        } else if (args[i] == "--seed" && i + 1 < args.size()) {
+            seed = args[++i].toUInt();
+        } else {
+            out() << "usage: carpool_bench [--rows 1000,100000,1000000] [--filter <substring>] [--seed <n>]\n";
+            return 2;
+        }
+    }
+
+    printBenchHeader();
+
+    for (int rows : rowCounts) {
+        // Each size gets its own files; the service also reads its
+        // fallback text files from the working directory
+        QTemporaryDir workDir;
+        if (!workDir.isValid()) return 1;
+        QDir::setCurrent(workDir.path());
+        benchmarkRows(rows, seed, workDir.path());
+    }
+    return 0;
+}
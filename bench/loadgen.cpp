@@ -0,0 +1,157 @@
+// Load generator for sizing: drives the booking, cancellation and rating
+// rules with the traffic mix users produce (see WorkloadGenerator).
+//
+//   carpool_loadgen [--ops <n>] [--seed <n>] [--record <trace>] [--replay <trace>]
+//                   [--server <socket name>]
+//
+// Without --server the operations run against a CarpoolService on fresh
+// files in a temporary directory; with it they go to a running
+// carpool_server. --record writes every generated operation to a trace
+// file and --replay runs a recorded trace instead of generating one. A
+// replay against the same starting state reproduces the run exactly.
+//
+// Reports throughput and latency percentiles per operation type. A type's
+// ops/s is the rate of one client doing only that; "all" is the whole run
+// over wall-clock time. LOGIN is the authenticate() a client needs
+// whenever the acting user changes.
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QScopedPointer>
+#include <QTemporaryDir>
+#include "benchreport.h"
+#include "carpoolservice.h"
+#include "workload.h"
+
+namespace {
+int usage()
+{
+    benchOut() << "usage: carpool_loadgen [--ops <n>] [--seed <n>] [--record <trace>] [--replay <trace>]"
+                  " [--server <socket name>]\n";
+    return 2;
+}
+
+void addSample(QMap<QString, BenchResult> &results, const QString &type, qint64 ns)
+{
+    BenchResult &result = results[type];
+    result.name = type;
+    result.samples.append(ns);
+    result.totalNs += ns;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    int operations = 100000;
+    quint32 seed = 42;
+    QString recordPath;
+    QString replayPath;
+    QString serverName;
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); i++) {
+        if (i + 1 >= args.size()) return usage();
+        if (args[i] == "--ops") {
+            operations = args[++i].toInt();
+        } else if (args[i] == "--seed") {
+            seed = args[++i].toUInt();
+        } else if (args[i] == "--record") {
+            recordPath = args[++i];
+        } else if (args[i] == "--replay") {
+            replayPath = args[++i];
+        } else if (args[i] == "--server") {
+            serverName = args[++i];
+        } else {
+            return usage();
+        }
+    }
+
+    QList<WorkloadOp> trace;
+    if (!replayPath.isEmpty()) {
+        trace = Workload::readTrace(replayPath);
+        operations = trace.size();
+    }
+
+    QFile recording(recordPath);
+    if (!recordPath.isEmpty() && !recording.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        benchOut() << "cannot write " << recordPath << "\n";
+        return 1;
+    }
+
+    // The service also reads fallback text files from the working
+    // directory, so a local run works in a directory of its own
+    QTemporaryDir workDir;
+    QScopedPointer<CarpoolService> service;
+    if (!serverName.isEmpty()) {
+        service.reset(new CarpoolService(QString(), QString()));
+        if (!service->connectToServer(serverName)) {
+            benchOut() << "no carpool server on " << serverName << "\n";
+            return 1;
+        }
+    } else {
+        if (!workDir.isValid()) return 1;
+        QDir::setCurrent(workDir.path());
+        service.reset(new CarpoolService(workDir.path() + "/journal.txt", workDir.path() + "/carpool.dat"));
+        service->open();
+    }
+
+    WorkloadGenerator generator(seed);
+    QMap<QString, BenchResult> results;
+    QMap<QString, QMap<QString, int>> failures;     // type -> status -> count
+    BenchResult all;
+    all.name = "all";
+    QString loggedIn;
+    QElapsedTimer wall;
+    QElapsedTimer timer;
+    wall.start();
+
+    for (int i = 0; i < operations; i++) {
+        const WorkloadOp op = trace.isEmpty() ? generator.next() : trace[i];
+        if (recording.isOpen()) {
+            recording.write(Workload::format(i + 1, op));
+        }
+
+        // Switching user costs a login, as it would for a real client
+        const QString actor = op.userType + ":" + op.username;
+        if (op.type != "REGISTER" && actor != loggedIn) {
+            timer.start();
+            User* user = service->authenticate(op.username, Workload::password(), op.userType);
+            addSample(results, "LOGIN", timer.nsecsElapsed());
+            loggedIn = user ? actor : QString();
+        }
+
+        timer.start();
+        CarpoolService::Status status = Workload::execute(*service, op);
+        qint64 elapsed = timer.nsecsElapsed();
+        addSample(results, op.type, elapsed);
+        all.samples.append(elapsed);
+
+        if (status != CarpoolService::Ok) {
+            failures[op.type][CarpoolService::describe(status)]++;
+        }
+        if (trace.isEmpty()) {
+            generator.completed(op, status, *service);
+        }
+    }
+    all.totalNs = wall.nsecsElapsed();
+    recording.close();
+
+    printBenchHeader();
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        it->rows = operations;
+        printBenchResult(*it);
+        const QMap<QString, int> &failed = failures.value(it.key());
+        for (auto reason = failed.constBegin(); reason != failed.constEnd(); ++reason) {
+            benchOut() << "    " << reason.value() << " x " << reason.key() << "\n";
+        }
+    }
+    all.rows = operations;
+    printBenchResult(all);
+
+    service->close();
+    return 0;
+}
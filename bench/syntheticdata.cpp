@@ -0,0 +1,116 @@
+#include "syntheticdata.h"
+#include "ride.h"
+#include "user.h"
+
+namespace {
+const char *const VehicleTypes[] = {"Car", "Car", "Car", "Bike", "Van"};
+const char *const VehicleClasses[] = {"Economy", "Economy", "Standard", "Luxury"};
+const qint64 QuarterHour = 15 * 60;
+const int DepartureWindowDays = 30;
+}
+
+const QStringList &SyntheticData::cities()
+{
+    static const QStringList names = {
+        "Lahore", "Karachi", "Islamabad", "Rawalpindi", "Faisalabad", "Multan",
+        "Peshawar", "Quetta", "Sialkot", "Gujranwala", "Hyderabad", "Bahawalpur",
+        "Sargodha", "Sukkur", "Abbottabad", "Murree", "Jhelum", "Sahiwal",
+        "Okara", "Kasur", "Mardan", "Gujrat", "Sheikhupura", "Rahim Yar Khan"
+    };
+    return names;
+}
+
+GeoPoint SyntheticData::cityLocation(int city)
+{
+    static const double centres[][2] = {
+        {31.5204, 74.3587}, {24.8607, 67.0011}, {33.6844, 73.0479}, {33.5651, 73.0169},
+        {31.4504, 73.1350}, {30.1575, 71.5249}, {34.0151, 71.5249}, {30.1798, 66.9750},
+        {32.4945, 74.5229}, {32.1877, 74.1945}, {25.3960, 68.3578}, {29.3956, 71.6836},
+        {32.0740, 72.6861}, {27.7052, 68.8574}, {34.1688, 73.2215}, {33.9070, 73.3943},
+        {32.9425, 73.7257}, {30.6682, 73.1114}, {30.8138, 73.4534}, {31.1187, 74.4630},
+        {34.1986, 72.0404}, {32.5731, 74.0789}, {31.7167, 73.9850}, {28.4202, 70.2952}
+    };
+    return GeoPoint::fromDegrees(centres[city][0], centres[city][1]);
+}
+
+int SyntheticData::pickCity(QRandomGenerator &random)
+{
+    // Squaring a uniform value puts most picks on the first few cities
+    double u = random.generateDouble();
+    return int(u * u * cities().size());
+}
+
+int SyntheticData::passengerCount(const Options &options)
+{
+    return qMax(1, options.users - captainCount(options));
+}
+
+int SyntheticData::captainCount(const Options &options)
+{
+    return qMax(1, int(options.users * options.captainShare));
+}
+
+void SyntheticData::populate(UserDirectory &users, RideRepository &rides, const Options &options)
+{
+    QRandomGenerator random(options.seed);
+    const int captains = captainCount(options);
+    const int passengers = passengerCount(options);
+
+    users.reserve(users.size() + captains + passengers);
+    for (int i = 0; i < captains; i++) {
+        Captain* captain = users.create<Captain>(captainName(i), "secret",
+                                                 VehicleTypes[random.bounded(5)],
+                                                 VehicleClasses[random.bounded(4)]);
+        captain->adjustBalance(toMoney(random.bounded(5000)));
+        if (!users.add(captain)) users.destroy(captain);
+    }
+    for (int i = 0; i < passengers; i++) {
+        Passenger* passenger = users.create<Passenger>(passengerName(i), "secret");
+        passenger->adjustBalance(toMoney(1000 + random.bounded(100000)));
+        if (!users.add(passenger)) users.destroy(passenger);
+    }
+
+    const QStringList &names = cities();
+    const qint64 now = Ride::currentTime();
+    // Pickup and drop-off points come from their own stream, so the rest
+    // of the data is the same as before rides had locations
+    QRandomGenerator placeRandom(options.seed ^ 0x9e3779b9u);
+    auto nearCity = [&placeRandom](int city) {
+        GeoPoint centre = cityLocation(city);
+        return GeoPoint(centre.latitudeE6 + placeRandom.bounded(-CitySpreadMicrodegrees, CitySpreadMicrodegrees),
+                        centre.longitudeE6 + placeRandom.bounded(-CitySpreadMicrodegrees, CitySpreadMicrodegrees));
+    };
+    rides.reserve(rides.size() + options.rides);
+    for (int i = 0; i < options.rides; i++) {
+        int from = pickCity(random);
+        int to = pickCity(random);
+        if (to == from) to = (from + 1 + random.bounded(names.size() - 1)) % names.size();
+
+        qint64 departure = now + random.bounded(DepartureWindowDays * 24 * 4) * QuarterHour;
+        qint64 returning = random.bounded(2) ? Ride::NoTime
+                                             : departure + (1 + random.bounded(12)) * 3600;
+        int seats = 1 + random.bounded(4);
+        int captain = random.bounded(captains);
+
+        Ride* ride = rides.create(captainName(captain), QString(), names[from] + " to " + names[to],
+                                  departure, returning,
+                                  VehicleTypes[random.bounded(5)], VehicleClasses[random.bounded(4)],
+                                  seats, 100.0 + random.bounded(1900));
+        ride->setEndpoints(nearCity(from), nearCity(to));
+        if (!rides.add(ride)) {
+            rides.destroy(ride);
+            continue;
+        }
+
+        bool completed = random.generateDouble() < options.completedShare;
+        if (completed || random.generateDouble() < options.bookedShare) {
+            int booked = completed ? seats : 1 + random.bounded(seats);
+            for (int seat = 0; seat < booked; seat++) {
+                rides.book(ride, internString(passengerName(random.bounded(passengers))));
+            }
+        }
+        if (completed) {
+            rides.complete(ride);
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SYNTHETICDATA_H
+#define SYNTHETICDATA_H
+
+#include <QRandomGenerator>
+#include <QString>
+#include <QStringList>
+#include "userdirectory.h"
+#include "riderepository.h"
+
+// Deterministic synthetic users and rides for the benchmarks. Route
+// popularity is skewed (a few city pairs carry most rides), and rides are
+// spread over open, partly booked and completed states so every index and
+// query path sees realistic data.
+class SyntheticData {
+public:
+    struct Options {
+        int users = 1000;
+        int rides = 1000;
+        double captainShare = 0.1;      // of users
+        double completedShare = 0.2;    // of rides
+        double bookedShare = 0.3;       // of rides that aren't completed
+        quint32 seed = 42;
+    };
+
+    static void populate(UserDirectory &users, RideRepository &rides, const Options &options);
+
+    static QString passengerName(int index) { return QString("passenger%1").arg(index); }
+    static QString captainName(int index) { return QString("captain%1").arg(index); }
+    static int passengerCount(const Options &options);
+    static int captainCount(const Options &options);
+
+    // Cities used in routes, most popular first
+    static const QStringList &cities();
+    // A city index skewed towards the popular ones
+    static int pickCity(QRandomGenerator &random);
+    // The city's centre; rides pick up and drop off within CitySpread of it
+    static GeoPoint cityLocation(int city);
+    static const int CitySpreadMicrodegrees = 90000;    // about 10 km
+};
+
+#endif // SYNTHETICDATA_H
@@ -0,0 +1,209 @@
+#include "workload.h"
+#include "journal.h"
+#include "ride.h"
+#include "syntheticdata.h"
+#include <algorithm>
+
+namespace {
+// Users to register before the rest of the mix starts
+const int MinCaptains = 10;
+const int MinPassengers = 50;
+
+const char *const VehicleTypes[] = {"Car", "Car", "Bike", "Van"};
+const char *const VehicleClasses[] = {"Economy", "Standard", "Luxury"};
+
+// Departures are spread over a fixed month so a seed gives the same
+// trace whenever it runs
+const qint64 DepartureBase = Ride::parseTime("2030-01-01 06:00");
+
+template <typename T, typename Predicate>
+void removeWhere(QVector<T> &items, Predicate predicate)
+{
+    items.erase(std::remove_if(items.begin(), items.end(), predicate), items.end());
+}
+}
+
+WorkloadOp WorkloadGenerator::next()
+{
+    if (!queued.isEmpty()) {
+        return queued.takeFirst();
+    }
+    if (captains.size() < MinCaptains) return registration("captain");
+    if (passengers.size() < MinPassengers) return registration("passenger");
+
+    // A burst: many passengers going for the same new ride at once
+    if (burstRemaining > 0) {
+        burstRemaining--;
+        return booking(pick(passengers), burstRide);
+    }
+
+    const int roll = random.bounded(100);
+    if (roll < 2) {
+        return registration(random.bounded(4) == 0 ? "captain" : "passenger");
+    }
+    if (roll < 10) {
+        bool captain = random.bounded(4) == 0;
+        const QStringList &names = captain ? captains : passengers;
+        return {"TOPUP", captain ? "captain" : "passenger", pick(names),
+                {QString::number(500 + random.bounded(4500))}};
+    }
+    if (roll < 20 || rides.isEmpty()) {
+        const QStringList &cities = SyntheticData::cities();
+        int from = SyntheticData::pickCity(random);
+        int to = (from + 1 + random.bounded(int(cities.size() - 1))) % cities.size();
+        qint64 departure = DepartureBase + random.bounded(30 * 24 * 4) * 15 * 60;
+        QString returning = random.bounded(2) ? QString()
+                                              : Ride::formatTime(departure + (1 + random.bounded(12)) * 3600);
+        return {"CREATE", "captain", pick(captains),
+                {cities[from] + " to " + cities[to], Ride::formatTime(departure), returning,
+                 QString::number(1 + random.bounded(4)), QString::number(200 + random.bounded(1800))}};
+    }
+    if (roll < 55) {
+        if (random.bounded(10) == 0) {
+            burstRide = rides.last().id;
+            burstRemaining = 3 + random.bounded(6);
+            return booking(pick(passengers), burstRide);
+        }
+        return booking(pick(passengers), rides[random.bounded(int(rides.size()))].id);
+    }
+    if (roll < 70 && !bookings.isEmpty()) {
+        const Booking &cancelled = bookings[random.bounded(int(bookings.size()))];
+        return {"CANCEL", "passenger", cancelled.passenger, {QString::number(cancelled.rideId)}};
+    }
+    if (roll < 73) {
+        const RideInfo &ride = rides[random.bounded(int(rides.size()))];
+        return {"CANCELRIDE", "captain", ride.captain, {QString::number(ride.id)}};
+    }
+    if (roll < 83) {
+        const RideInfo &ride = rides[random.bounded(int(rides.size()))];
+        return {"COMPLETE", "captain", ride.captain, {QString::number(ride.id)}};
+    }
+    if (!unrated.isEmpty()) {
+        // Either side of a completed ride rates the other
+        const Booking &done = unrated[random.bounded(int(unrated.size()))];
+        QString stars = QString::number(1 + random.bounded(5));
+        if (random.bounded(2)) {
+            return {"RATE", "passenger", done.passenger, {QString::number(done.rideId), stars}};
+        }
+        return {"RATE", "captain", done.captain, {QString::number(done.rideId), stars}};
+    }
+    return booking(pick(passengers), rides[random.bounded(int(rides.size()))].id);
+}
+
+void WorkloadGenerator::completed(const WorkloadOp &op, CarpoolService::Status status,
+                                  const CarpoolService &service)
+{
+    const bool ok = status == CarpoolService::Ok;
+    const int rideId = op.args.value(0).toInt();
+
+    if (op.type == "REGISTER") {
+        // A name left by an earlier run still logs in with the same password
+        if (ok || status == CarpoolService::UsernameTaken) {
+            (op.userType == "captain" ? captains : passengers).append(op.username);
+            if (ok && op.userType == "passenger") {
+                queued.append({"TOPUP", "passenger", op.username,
+                               {QString::number(1000 + random.bounded(9000))}});
+            }
+        }
+    } else if (op.type == "CREATE" && ok) {
+        // The new ride is the captain's newest active one
+        User* captain = service.users().find(op.username, "captain");
+        int newest = 0;
+        for (Ride* ride : service.rides().activeRidesForCaptain(captain ? captain->getUsernameId() : 0)) {
+            newest = qMax(newest, ride->getId());
+        }
+        if (newest > 0) rides.append({newest, op.username});
+    } else if (op.type == "BOOK" && ok) {
+        const Ride* ride = service.rides().find(rideId);
+        bookings.append({op.username, ride ? ride->getCaptain() : QString(), rideId});
+    } else if (op.type == "CANCEL" && ok) {
+        removeWhere(bookings, [&](const Booking &booking) {
+            return booking.rideId == rideId && booking.passenger == op.username;
+        });
+    } else if (op.type == "CANCELRIDE" && ok) {
+        removeWhere(rides, [&](const RideInfo &ride) { return ride.id == rideId; });
+        removeWhere(bookings, [&](const Booking &booking) { return booking.rideId == rideId; });
+    } else if (op.type == "COMPLETE" && ok) {
+        removeWhere(rides, [&](const RideInfo &ride) { return ride.id == rideId; });
+        for (const Booking &booking : bookings) {
+            if (booking.rideId == rideId) unrated.append(booking);
+        }
+        removeWhere(bookings, [&](const Booking &booking) { return booking.rideId == rideId; });
+    } else if (op.type == "RATE") {
+        // One rating per ride and side, whatever the outcome
+        const bool byPassenger = op.userType == "passenger";
+        removeWhere(unrated, [&](const Booking &booking) {
+            return booking.rideId == rideId &&
+                   (byPassenger ? booking.passenger : booking.captain) == op.username;
+        });
+    }
+
+    // Nothing left to book once every ride is gone
+    if (rides.isEmpty()) burstRemaining = 0;
+}
+
+WorkloadOp WorkloadGenerator::registration(const QString &userType)
+{
+    WorkloadOp op;
+    op.type = "REGISTER";
+    op.userType = userType;
+    op.username = QString("load%1%2").arg(userType == "captain" ? "c" : "p").arg(registered++);
+    if (userType == "captain") {
+        op.args = QStringList{VehicleTypes[random.bounded(4)], VehicleClasses[random.bounded(3)]};
+    }
+    return op;
+}
+
+WorkloadOp WorkloadGenerator::booking(const QString &passenger, int rideId)
+{
+    return {"BOOK", "passenger", passenger, {QString::number(rideId)}};
+}
+
+CarpoolService::Status Workload::execute(CarpoolService &service, const WorkloadOp &op)
+{
+    const QStringList &args = op.args;
+    if (op.type == "REGISTER") {
+        if (op.userType == "captain") {
+            return service.registerCaptain(op.username, password(), args.value(0), args.value(1));
+        }
+        return service.registerPassenger(op.username, password());
+    }
+
+    User* user = service.users().find(op.username, op.userType);
+    Ride* ride = service.rides().find(args.value(0).toInt());
+    if (op.type == "TOPUP") return service.addBalance(user, args.value(0).toDouble());
+    if (op.type == "CREATE") {
+        return service.createRide(user, args.value(0), args.value(1), args.value(2),
+                                  args.value(3).toInt(), args.value(4).toDouble());
+    }
+    if (op.type == "BOOK") return service.bookRide(user, ride);
+    if (op.type == "CANCEL") return service.cancelBooking(user, ride);
+    if (op.type == "CANCELRIDE") return service.cancelRide(user, ride);
+    if (op.type == "COMPLETE") return service.completeRide(user, ride);
+    if (op.type == "RATE") {
+        int stars = args.value(1).toInt();
+        return op.userType == "captain" ? service.ratePassenger(user, ride, stars)
+                                        : service.rateCaptain(user, ride, stars);
+    }
+    return CarpoolService::BadRequest;
+}
+
+QByteArray Workload::format(quint64 index, const WorkloadOp &op)
+{
+    return Journal::format(index, op.type, QStringList{op.userType, op.username} + op.args);
+}
+
+QList<WorkloadOp> Workload::readTrace(const QString &path)
+{
+    QList<WorkloadOp> ops;
+    for (const JournalEntry &entry : Journal::readAll(path)) {
+        if (entry.args.size() < 2) continue;
+        WorkloadOp op;
+        op.type = entry.op;
+        op.userType = entry.args[0];
+        op.username = entry.args[1];
+        op.args = entry.args.mid(2);
+        ops.append(op);
+    }
+    return ops;
+}
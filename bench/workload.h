@@ -0,0 +1,80 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <QHash>
+#include <QList>
+#include <QRandomGenerator>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "carpoolservice.h"
+
+// One user action from the load generator, e.g. a passenger booking a ride.
+// In a trace file it is a journal-style line:
+//   "<n>,<TYPE>,<user type>,<username>,<args...>"
+// with the arguments of the matching CarpoolService call:
+//   REGISTER   [vehicle type, vehicle class]     TOPUP      amount
+//   CREATE     route, departure, return, seats, fare
+//   BOOK, CANCEL, CANCELRIDE, COMPLETE   ride id
+//   RATE       ride id, stars
+struct WorkloadOp {
+    QString type;
+    QString userType;
+    QString username;
+    QStringList args;
+};
+
+// Generates the traffic mix users produce: registrations, top-ups, ride
+// creation, bookings (partly in bursts on the newest ride), cancellations,
+// which draw penalties once a user's free ones are used up, completions
+// and ratings. It is driven by a seeded QRandomGenerator and by the results
+// of its own earlier operations, so a seed always yields the same
+// operations against the same starting state.
+class WorkloadGenerator {
+public:
+    explicit WorkloadGenerator(quint32 seed) : random(seed) {}
+
+    WorkloadOp next();
+    // Feeds back the result of the operation next() returned last
+    void completed(const WorkloadOp &op, CarpoolService::Status status, const CarpoolService &service);
+
+private:
+    struct Booking {
+        QString passenger;
+        QString captain;
+        int rideId;
+    };
+    struct RideInfo {
+        int id;
+        QString captain;
+    };
+
+    WorkloadOp registration(const QString &userType);
+    WorkloadOp booking(const QString &passenger, int rideId);
+    const QString &pick(const QStringList &names) { return names[random.bounded(int(names.size()))]; }
+
+    QRandomGenerator random;
+    QVector<WorkloadOp> queued;         // follow-ups, e.g. a new passenger's first top-up
+    int registered = 0;
+    QStringList passengers;
+    QStringList captains;
+    QVector<RideInfo> rides;            // created and not cancelled
+    QVector<Booking> bookings;          // on rides not completed yet
+    QVector<Booking> unrated;           // on completed rides
+    int burstRide = 0;                  // ride id of the burst in progress
+    int burstRemaining = 0;
+};
+
+namespace Workload {
+// Every generated user has this password
+inline QString password() { return "secret"; }
+
+// Runs op against a CarpoolService, local or connected to a server. Apart
+// from REGISTER, op's user must have logged in (authenticate()) first.
+CarpoolService::Status execute(CarpoolService &service, const WorkloadOp &op);
+
+QByteArray format(quint64 index, const WorkloadOp &op);
+QList<WorkloadOp> readTrace(const QString &path);
+}
+
+#endif // WORKLOAD_H
@@ -0,0 +1,179 @@
+#include "bookingengine.h"
+#include <QAtomicInt>
+#include <QHash>
+#include <QScopedArrayPointer>
+#include <QSemaphore>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#ifdef Q_PROCESSOR_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+// Spins this many times with a pause before yielding the CPU
+const int SpinsBeforeYield = 64;
+
+// The lock is held for a few instructions, so spinning usually wins; the
+// pause keeps a waiting core off the lock's cache line, and a waiter that
+// still loses (the holder was preempted) gives its time slice away
+void spinLock(QAtomicInt &lock)
+{
+    int spins = 0;
+    while (!lock.testAndSetAcquire(0, 1)) {
+        do {
+            if (++spins < SpinsBeforeYield) {
+#ifdef Q_PROCESSOR_X86
+                _mm_pause();
+#endif
+            } else {
+                QThread::yieldCurrentThread();
+            }
+        } while (lock.loadRelaxed() != 0);
+    }
+}
+
+// The seats of one ride taken so far in a batch
+struct SeatClaim {
+    QAtomicInt claimed;         // single-segment rides
+    QAtomicInt lock;            // guards segments
+    SeatSegments segments;      // multi-stop rides
+    int totalSeats = 0;
+
+    // Claims one seat on the leg unless one of its segments is full
+    bool claim(const Ride::Leg &leg) {
+        if (segments.segments() == 1) {
+            int current = claimed.loadAcquire();
+            while (current < totalSeats) {
+                if (claimed.testAndSetOrdered(current, current + 1, current)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        spinLock(lock);
+        bool free = segments.maxOver(leg.from, leg.to) < totalSeats;
+        if (free) segments.add(leg.from, leg.to, 1);
+        lock.storeRelease(0);
+        return free;
+    }
+    void giveBack(const Ride::Leg &leg) {
+        if (segments.segments() == 1) {
+            claimed.deref();
+            return;
+        }
+        spinLock(lock);
+        segments.add(leg.from, leg.to, -1);
+        lock.storeRelease(0);
+    }
+};
+}
+
+QVector<CarpoolService::Status> BookingEngine::reserve(const QVector<Request> &requests) const
+{
+    QVector<CarpoolService::Status> statuses(requests.size(), CarpoolService::Ok);
+
+    // Give every distinct ride one seat claim, starting from the seats it
+    // already has, and group the requests by passenger. Both maps are built
+    // here so the parallel part only reads plain arrays.
+    QHash<const Ride*, int> counterIndex;
+    QVector<int> counterOf(requests.size(), -1);
+    QHash<User*, int> groupIndex;
+    QVector<QVector<int>> groups;
+    for (int i = 0; i < requests.size(); i++) {
+        const Request &request = requests[i];
+        if (!request.passenger || request.passenger->getUserType() != "passenger") {
+            statuses[i] = CarpoolService::NotAPassenger;
+            continue;
+        }
+        if (!request.ride || rides.find(request.ride->getId()) != request.ride ||
+            request.ride->getIsCompleted()) {
+            statuses[i] = CarpoolService::RideNotFound;
+            continue;
+        }
+        if (!request.ride->isValidLeg(request.leg)) {
+            statuses[i] = CarpoolService::InvalidStops;
+            continue;
+        }
+
+        auto counter = counterIndex.constFind(request.ride);
+        if (counter == counterIndex.constEnd()) {
+            counter = counterIndex.insert(request.ride, counterIndex.size());
+        }
+        counterOf[i] = *counter;
+
+        auto group = groupIndex.constFind(request.passenger);
+        if (group == groupIndex.constEnd()) {
+            group = groupIndex.insert(request.passenger, groups.size());
+            groups.append(QVector<int>());
+        }
+        groups[*group].append(i);
+    }
+
+    QScopedArrayPointer<SeatClaim> claims(new SeatClaim[counterIndex.size()]);
+    for (auto it = counterIndex.constBegin(); it != counterIndex.constEnd(); ++it) {
+        const Ride *ride = it.key();
+        SeatClaim &claim = claims[it.value()];
+        claim.totalSeats = ride->getTotalSeats();
+        if (ride->getSegmentCount() == 1) {
+            claim.claimed.storeRelaxed(qMax(ride->getPeakOccupancy(), ride->getOccupiedSeats()));
+        } else {
+            claim.segments = ride->getSeatSegments();
+        }
+    }
+
+    // Decides one passenger's requests in order; only touches that
+    // passenger's statuses and the shared seat counters
+    CarpoolService::Status *results = statuses.data();
+    auto decideGroup = [&](const QVector<int> &group) {
+        User *passenger = requests[group.first()].passenger;
+        const int passengerId = passenger->getUsernameId();
+        Money held = 0;
+        int activeRides = rides.activeRideCount(passengerId);
+        QSet<const Ride*> booked;
+
+        for (int i : group) {
+            Ride *ride = requests[i].ride;
+            const Ride::Leg &leg = requests[i].leg;
+            const Money fare = fares.quote(ride, leg);
+            if (ride->hasPassenger(passengerId) || booked.contains(ride)) {
+                results[i] = CarpoolService::AlreadyBooked;
+            } else if (activeRides >= CarpoolService::MaxActiveRides) {
+                results[i] = CarpoolService::TooManyActiveRides;
+            } else if (!claims[counterOf[i]].claim(leg)) {
+                results[i] = CarpoolService::RideFull;
+            } else if (passenger->getBalanceMinor() - held < fare) {
+                claims[counterOf[i]].giveBack(leg);
+                results[i] = CarpoolService::InsufficientBalance;
+            } else {
+                held += fare;
+                activeRides++;
+                booked.insert(ride);
+            }
+        }
+    };
+
+    const int threads = qMin(QThread::idealThreadCount(), int(groups.size()));
+    if (requests.size() < ParallelThreshold || threads <= 1) {
+        for (const QVector<int> &group : groups) {
+            decideGroup(group);
+        }
+        return statuses;
+    }
+
+    // Interleave the groups over the workers; the calling thread takes the
+    // first share itself
+    QSemaphore finished;
+    auto decideShare = [&](int share) {
+        for (int g = share; g < groups.size(); g += threads) {
+            decideGroup(groups[g]);
+        }
+        finished.release();
+    };
+    for (int share = 1; share < threads; share++) {
+        QThreadPool::globalInstance()->start([&decideShare, share]() { decideShare(share); });
+    }
+    decideShare(0);
+    finished.acquire(threads);
+    return statuses;
+}
@@ -0,0 +1,40 @@
+#ifndef BOOKINGENGINE_H
+#define BOOKINGENGINE_H
+
+#include <QVector>
+#include "carpoolservice.h"
+
+// Decides a batch of seat bookings in parallel without overselling.
+//
+// Requests are grouped by passenger and the groups are spread over the
+// thread pool, so each passenger's balance, active-ride count and existing
+// seats are only ever looked at by one thread. The only shared state is one
+// seat claim per ride: a counter claimed with a compare-and-swap that never
+// goes past the ride's total seats, or for a multi-stop ride a copy of its
+// per-segment seats updated under a per-ride spin lock. A claim is given
+// back if the passenger turns out not to afford it. Contention is
+// therefore limited to popular rides.
+//
+// The engine only decides: the caller commits the accepted bookings on the
+// owning thread afterwards. Users and rides must not change during reserve(),
+// which holds as long as it runs on the thread that owns them.
+class BookingEngine {
+public:
+    typedef CarpoolService::Booking Request;
+
+    BookingEngine(const RideRepository &rides, const FareEngine &fares) : rides(rides), fares(fares) {}
+
+    // One status per request, in request order. When several requests of
+    // the same passenger compete for their balance or ride limit, earlier
+    // requests win.
+    QVector<CarpoolService::Status> reserve(const QVector<Request> &requests) const;
+
+private:
+    // Below this many requests the batch is decided on the calling thread
+    static const int ParallelThreshold = 256;
+
+    const RideRepository &rides;
+    const FareEngine &fares;
+};
+
+#endif // BOOKINGENGINE_H
@@ -0,0 +1,123 @@
+#include "carpoolclient.h"
+#include <QElapsedTimer>
+
+CarpoolClient::CarpoolClient(QObject *parent)
+    : QObject(parent)
+{
+    // Changes pushed while nobody is waiting arrive through the event loop
+    connect(&socket, &QLocalSocket::readyRead, this, &CarpoolClient::readIncoming);
+    connect(&socket, &QLocalSocket::disconnected, this, &CarpoolClient::disconnected);
+}
+
+bool CarpoolClient::connectToServer(const QString &serverName, int timeoutMs)
+{
+    socket.connectToServer(serverName);
+    return socket.waitForConnected(timeoutMs);
+}
+
+void CarpoolClient::disconnectFromServer()
+{
+    socket.disconnectFromServer();
+}
+
+bool CarpoolClient::isConnected() const
+{
+    return socket.state() == QLocalSocket::ConnectedState;
+}
+
+quint64 CarpoolClient::send(const QString &op, const QStringList &args)
+{
+    quint64 id = ++lastId;
+    socket.write(Journal::format(id, op, args));
+    socket.flush();
+    return id;
+}
+
+CarpoolClient::Reply CarpoolClient::wait(quint64 id, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    readIncoming();
+    while (!replies.contains(id)) {
+        int remaining = timeoutMs - int(timer.elapsed());
+        if (!isConnected() || remaining <= 0 || !socket.waitForReadyRead(remaining)) {
+            break;
+        }
+        readIncoming();
+    }
+    return replies.take(id);
+}
+
+void CarpoolClient::readIncoming()
+{
+    // A changeReceived() slot may spin an event loop; data arriving
+    // meanwhile is picked up by this loop rather than a nested call
+    if (reading) return;
+    reading = true;
+    do {
+        buffer += socket.readAll();
+        processBuffer();
+    } while (socket.bytesAvailable() > 0);
+    reading = false;
+}
+
+void CarpoolClient::processBuffer()
+{
+    int pos = 0;
+    while (pos < buffer.size()) {
+        if (bytesRemaining > 0) {
+            // Raw snapshot bytes following a SNAPSHOT header line
+            qint64 take = qMin<qint64>(bytesRemaining, buffer.size() - pos);
+            incoming.data.append(buffer.constData() + pos, int(take));
+            pos += int(take);
+            bytesRemaining -= take;
+            if (bytesRemaining == 0) complete();
+            continue;
+        }
+
+        int newline = buffer.indexOf('\n', pos);
+        if (newline < 0) break;
+        QByteArray line = buffer.mid(pos, newline - pos);
+        pos = newline + 1;
+
+        if (rowsRemaining > 0) {
+            incoming.rows.append(QString::fromUtf8(line).split(","));
+            if (--rowsRemaining == 0) complete();
+            continue;
+        }
+
+        JournalEntry entry;
+        if (!Journal::parse(line, &entry)) continue;
+
+        if (entry.sequence == 0 && entry.op == "CHANGE" && entry.args.size() >= 2) {
+            // 0,CHANGE,<sequence>,<op>,<args...>
+            JournalEntry change;
+            change.sequence = entry.args[0].toULongLong();
+            change.op = entry.args[1];
+            change.args = entry.args.mid(2);
+            emit changeReceived(change);
+            continue;
+        }
+
+        incoming = Reply();
+        incoming.id = entry.sequence;
+        incoming.op = entry.op;
+        incoming.args = entry.args;
+        if (entry.op == "ROWS" && !entry.args.isEmpty() && entry.args[0].toInt() > 0) {
+            rowsRemaining = entry.args[0].toInt();
+        } else if (entry.op == "SNAPSHOT" && !entry.args.isEmpty() && entry.args[0].toLongLong() > 0) {
+            bytesRemaining = entry.args[0].toLongLong();
+            incoming.data.reserve(int(bytesRemaining));
+        } else {
+            complete();
+        }
+    }
+    buffer.remove(0, pos);
+}
+
+void CarpoolClient::complete()
+{
+    replies.insert(incoming.id, incoming);
+    incoming = Reply();
+}
@@ -0,0 +1,64 @@
+#ifndef CARPOOLCLIENT_H
+#define CARPOOLCLIENT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QLocalSocket>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include "journal.h"
+
+// Connection to a CarpoolServer (see carpoolserver.h for the protocol).
+//
+// Requests can be pipelined: send() returns the request id straight away
+// and wait() blocks until that reply is in, collecting any replies and
+// pushed changes that arrive before it. call() is send() + wait(). The
+// blocking calls need no event loop, so a client can live on any thread.
+class CarpoolClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Reply {
+        quint64 id = 0;
+        QString op;                 // "OK", "ERR", "ROWS" or "SNAPSHOT"; empty if the connection failed
+        QStringList args;
+        QList<QStringList> rows;    // ROWS
+        QByteArray data;            // SNAPSHOT
+
+        bool isOk() const { return op == "OK" || op == "ROWS" || op == "SNAPSHOT"; }
+    };
+
+    explicit CarpoolClient(QObject *parent = nullptr);
+
+    bool connectToServer(const QString &serverName, int timeoutMs = 1000);
+    void disconnectFromServer();
+    bool isConnected() const;
+
+    quint64 send(const QString &op, const QStringList &args = QStringList());
+    Reply wait(quint64 id, int timeoutMs = 30000);
+    Reply call(const QString &op, const QStringList &args = QStringList()) { return wait(send(op, args)); }
+
+signals:
+    // A change the server committed, after the subscription's snapshot
+    void changeReceived(const JournalEntry &entry);
+    void disconnected();
+
+private:
+    void readIncoming();
+    void processBuffer();
+    void complete();
+
+    QLocalSocket socket;
+    QByteArray buffer;
+    bool reading = false;
+    quint64 lastId = 0;
+    Reply incoming;                 // reply still receiving rows or snapshot bytes
+    int rowsRemaining = 0;
+    qint64 bytesRemaining = 0;
+    QHash<quint64, Reply> replies;  // complete replies nobody has waited for yet
+};
+
+#endif // CARPOOLCLIENT_H
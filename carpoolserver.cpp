@@ -0,0 +1,402 @@
+#include "carpoolserver.h"
+#include "metrics.h"
+#include <QHash>
+#include <QLocalSocket>
+
+CarpoolServer::CarpoolServer(CarpoolService &service, QObject *parent)
+    : QObject(parent)
+    , service(service)
+{
+    connect(&server, &QLocalServer::newConnection, this, &CarpoolServer::acceptConnections);
+    connect(&service, &CarpoolService::committed, this, &CarpoolServer::broadcast);
+
+    // Bookings wait for the end of the current event loop pass, so those
+    // from every connection that was readable in it go out as one batch
+    bookingTimer.setSingleShot(true);
+    bookingTimer.setInterval(0);
+    connect(&bookingTimer, &QTimer::timeout, this, &CarpoolServer::flushBookings);
+}
+
+CarpoolServer::~CarpoolServer()
+{
+    close();
+}
+
+bool CarpoolServer::listen(const QString &name)
+{
+    // A socket file left by a crashed server would make listen() fail, but
+    // one that still answers belongs to a running server
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(200)) {
+        return false;
+    }
+    QLocalServer::removeServer(name);
+    return server.listen(name);
+}
+
+void CarpoolServer::close()
+{
+    flushBookings();
+    server.close();
+    for (Session *session : sessions) {
+        session->socket->disconnect(this);
+        session->socket->deleteLater();
+        delete session;
+    }
+    sessions.clear();
+}
+
+void CarpoolServer::acceptConnections()
+{
+    while (QLocalSocket *socket = server.nextPendingConnection()) {
+        Session *session = new Session;
+        session->socket = socket;
+        sessions.append(session);
+        connect(socket, &QLocalSocket::readyRead, this, [this, session]() { readRequests(session); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, session]() { endSession(session); });
+    }
+}
+
+void CarpoolServer::readRequests(Session *session)
+{
+    session->buffer += session->socket->readAll();
+
+    int pos = 0;
+    int newline;
+    while (session->open && (newline = session->buffer.indexOf('\n', pos)) >= 0) {
+        JournalEntry request;
+        if (Journal::parse(session->buffer.mid(pos, newline - pos), &request) && request.sequence > 0) {
+            handle(session, request);
+        }
+        pos = newline + 1;
+    }
+    session->buffer.remove(0, pos);
+}
+
+void CarpoolServer::endSession(Session *session)
+{
+    if (!session->open) return;
+    session->open = false;
+    sessions.removeOne(session);
+
+    // Bookings already queued still go through; nobody hears the result
+    for (PendingBooking &booking : pendingBookings) {
+        if (booking.session == session) booking.session = nullptr;
+    }
+    for (PendingMatch &match : pendingMatches) {
+        if (match.session == session) match.session = nullptr;
+    }
+    session->socket->disconnect(this);
+    session->socket->deleteLater();
+    // readRequests() may still be on the stack for this session
+    QTimer::singleShot(0, this, [session]() { delete session; });
+}
+
+void CarpoolServer::handle(Session *session, const JournalEntry &request)
+{
+    const quint64 id = request.sequence;
+    const QString &op = request.op;
+    const QStringList &args = request.args;
+
+    if (op == "BOOK" && !args.isEmpty()) {
+        const bool leg = args.size() >= 3;
+        pendingBookings.append({session, id, args[0].toInt(),
+                                leg ? args[1].toInt() : -1, leg ? args[2].toInt() : -1});
+        session->pendingBookings++;
+        bookingTimer.start();
+        return;
+    }
+    if (op == "MATCH" && args.size() >= 6) {
+        PendingMatch match;
+        match.session = session;
+        match.requestId = id;
+        match.request.route = args[0];
+        match.request.earliest = args[1].toLongLong();
+        match.request.latest = args[2].toLongLong();
+        match.request.vehicleType = args[3];
+        match.request.vehicleClass = args[4];
+        match.request.maxFare = args[5].toDouble();
+        pendingMatches.append(match);
+        session->pendingBookings++;
+        bookingTimer.start();
+        return;
+    }
+    // Anything else a client sends sees its earlier bookings decided
+    if (session->pendingBookings > 0) {
+        flushBookings();
+    }
+
+    if (op == "LOGIN" && args.size() >= 3) {
+        User *user = service.authenticate(args[1], args[2], args[0]);
+        // A subscription is one user's view; the next user subscribes anew
+        if (user != session->user) {
+            session->subscribed = false;
+        }
+        session->user = user;
+        if (session->user) {
+            reply(session, id, "OK", {QString::number(session->user->getBalanceMinor())});
+        } else {
+            replyStatus(session, id, CarpoolService::InvalidCredentials);
+        }
+    } else if (op == "LOGOUT") {
+        session->user = nullptr;
+        session->subscribed = false;
+        reply(session, id, "OK");
+    } else if (op == "REGISTER" && args.size() >= 3) {
+        if (args[0] == "captain") {
+            replyStatus(session, id, service.registerCaptain(args[1], args[2], args.value(3), args.value(4)));
+        } else {
+            replyStatus(session, id, service.registerPassenger(args[1], args[2]));
+        }
+    } else if (op == "TOPUP" && !args.isEmpty()) {
+        replyStatus(session, id, service.addBalance(session->user, toRupees(args[0].toLongLong())));
+    } else if (op == "LIST") {
+        QString query = args.value(0);
+        replyRides(session, id, query.isEmpty() ? service.rides().openRides().values()
+                                                : service.rides().searchOpenRides(query));
+    } else if (op == "NEAR" && args.size() >= 3) {
+        replyRides(session, id, service.rides().openRidesNear(GeoPoint::fromText(args[0]),
+                                                              GeoPoint::fromText(args[1]),
+                                                              args[2].toDouble()));
+    } else if (op == "HISTORY") {
+        // Archived rides stay paged in until the server's next checkpoint
+        service.loadRideHistory(session->user);
+        QList<Ride*> rides;
+        if (session->user) {
+            const int userId = session->user->getUsernameId();
+            for (Ride* ride : service.rides().completedRides()) {
+                if (ride->getCaptainId() == userId || ride->hasPassenger(userId)) {
+                    rides.append(ride);
+                }
+            }
+        }
+        replyRides(session, id, rides);
+    } else if (op == "CREATE" && args.size() >= 5) {
+        replyStatus(session, id, service.createRide(session->user, args[0], args[1], args[2],
+                                                    args[3].toInt(), args[4].toDouble(),
+                                                    GeoPoint::fromText(args.value(5)),
+                                                    GeoPoint::fromText(args.value(6))));
+    } else if (op == "SCHEDULE" && args.size() >= 6) {
+        replyStatus(session, id, service.createSchedule(session->user, args[0], args[1], args[2],
+                                                        RideSchedule::parseWeekdays(args[3]),
+                                                        args[4].toInt(), args[5].toDouble(),
+                                                        GeoPoint::fromText(args.value(6)),
+                                                        GeoPoint::fromText(args.value(7))));
+    } else if (op == "UNSCHEDULE" && !args.isEmpty()) {
+        replyStatus(session, id, service.cancelSchedule(session->user, args[0].toInt()));
+    } else if (op == "CANCEL" && !args.isEmpty()) {
+        double refund = 0;
+        double penalty = 0;
+        CarpoolService::Status status = service.cancelBooking(session->user, rideArg(args), &refund, &penalty);
+        replyStatus(session, id, status, {QString::number(toMoney(refund)), QString::number(toMoney(penalty))});
+    } else if (op == "CANCELRIDE" && !args.isEmpty()) {
+        replyStatus(session, id, service.cancelRide(session->user, rideArg(args)));
+    } else if (op == "COMPLETE" && !args.isEmpty()) {
+        replyStatus(session, id, service.completeRide(session->user, rideArg(args)));
+    } else if (op == "RATE" && args.size() >= 2) {
+        // The ride may have been archived since the client saw it; only the
+        // user's own history is paged back in, and other rides are unknown
+        service.loadRideHistory(session->user);
+        Ride* ride = service.rides().find(args[0].toInt());
+        if (ride && session->user) {
+            const int userId = session->user->getUsernameId();
+            if (ride->getCaptainId() != userId && !ride->hasPassenger(userId)) ride = nullptr;
+        }
+        int stars = args[1].toInt();
+        bool isCaptain = session->user && session->user->getUserType() == "captain";
+        replyStatus(session, id, isCaptain ? service.ratePassenger(session->user, ride, stars)
+                                           : service.rateCaptain(session->user, ride, stars));
+    } else if (op == "METRICS" && session->open) {
+        QList<QByteArray> lines = Metrics::report().split('\n');
+        lines.removeAll(QByteArray());
+        QByteArray out = Journal::format(id, "ROWS", {QString::number(lines.size())});
+        for (const QByteArray &line : lines) {
+            out += line + "\n";
+        }
+        session->socket->write(out);
+    } else if (op == "SUBSCRIBE" && !session->user) {
+        // The snapshot is a user's view
+        replyStatus(session, id, CarpoolService::InvalidCredentials);
+    } else if (op == "SUBSCRIBE") {
+        // Changes committed from here on follow the snapshot on this socket
+        QByteArray snapshot = service.replicaSnapshot(session->user);
+        session->socket->write(Journal::format(id, "SNAPSHOT", {QString::number(snapshot.size())}));
+        session->socket->write(snapshot);
+        session->subscribed = true;
+    } else {
+        replyStatus(session, id, CarpoolService::BadRequest);
+    }
+}
+
+void CarpoolServer::flushBookings()
+{
+    bookingTimer.stop();
+    flushMatches();
+    if (pendingBookings.isEmpty()) return;
+
+    QVector<PendingBooking> batch;
+    batch.swap(pendingBookings);
+
+    // Rides are looked up now; one may have been cancelled since the request
+    QVector<CarpoolService::Booking> bookings;
+    bookings.reserve(batch.size());
+    for (const PendingBooking &booking : batch) {
+        Ride *ride = service.rides().find(booking.rideId);
+        Ride::Leg leg = {booking.fromStop, booking.toStop};
+        if (booking.fromStop < 0) {
+            leg = ride ? ride->wholeTrip() : Ride::Leg{0, 1};
+        }
+        bookings.append({booking.session ? booking.session->user : nullptr, ride, leg});
+    }
+
+    const QVector<CarpoolService::Status> statuses = service.bookSeats(bookings);
+    for (int i = 0; i < batch.size(); i++) {
+        if (Session *session = batch[i].session) {
+            session->pendingBookings--;
+            replyStatus(session, batch[i].requestId, statuses[i]);
+        }
+    }
+}
+
+void CarpoolServer::flushMatches()
+{
+    if (pendingMatches.isEmpty()) return;
+
+    QVector<PendingMatch> batch;
+    batch.swap(pendingMatches);
+
+    QVector<SeatMatcher::Request> requests;
+    requests.reserve(batch.size());
+    for (PendingMatch &match : batch) {
+        match.request.passenger = match.session ? match.session->user : nullptr;
+        requests.append(match.request);
+    }
+
+    QVector<Ride*> matched;
+    const QVector<CarpoolService::Status> statuses = service.matchRides(requests, &matched);
+    for (int i = 0; i < batch.size(); i++) {
+        if (Session *session = batch[i].session) {
+            session->pendingBookings--;
+            replyStatus(session, batch[i].requestId, statuses[i],
+                        {QString::number(matched[i] ? matched[i]->getId() : 0)});
+        }
+    }
+}
+
+void CarpoolServer::broadcast(const QVector<JournalEntry> &entries)
+{
+    // Each subscriber gets its own user's view; sessions of the same user
+    // share the lines
+    QHash<const User*, QByteArray> views;
+    for (Session *session : sessions) {
+        if (!session->subscribed) continue;
+
+        auto view = views.find(session->user);
+        if (view == views.end()) {
+            QByteArray lines;
+            for (const JournalEntry &committed : entries) {
+                JournalEntry entry = committed;
+                if (replicaChange(session->user, &entry)) {
+                    lines += Journal::format(0, "CHANGE",
+                                             QStringList{QString::number(entry.sequence), entry.op} + entry.args);
+                }
+            }
+            view = views.insert(session->user, lines);
+        }
+        if (!view->isEmpty()) {
+            session->socket->write(*view);
+        }
+    }
+}
+
+bool CarpoolServer::replicaChange(const User *viewer, JournalEntry *entry) const
+{
+    const QString &op = entry->op;
+    QStringList &args = entry->args;
+    const QString viewerName = viewer->getUsername();
+
+    if (op == "USER" && args.size() > 4) {
+        // USER,<users.txt record>: no password, and only the viewer's own
+        // balance and cancellation count
+        args[2].clear();
+        if (args[1] != viewerName) {
+            args[3] = formatMoney(0);
+            args[4] = "0";
+        }
+        return true;
+    }
+    if (op == "TXN") {
+        // Only the viewer's postings, the rest under one other account
+        Ledger::Transaction transaction;
+        if (!Ledger::fromArgs(args, &transaction)) return false;
+        const QString account = Ledger::userAccount(viewer->getUserType(), viewerName);
+        Money amount = 0;
+        bool touched = false;
+        for (const Ledger::Posting &posting : transaction.postings) {
+            if (posting.account == account) {
+                amount += posting.amount;
+                touched = true;
+            }
+        }
+        if (!touched) return false;
+        args = QStringList{transaction.kind, account, QString::number(amount),
+                           Ledger::others(), QString::number(-amount)};
+        return true;
+    }
+    if (op == "BALANCE" || op == "CANCELCOUNT") {
+        return args.value(1) == viewerName;
+    }
+    if ((op != "COMPLETE" && op != "RATED" && op != "BOOK") || args.isEmpty()) {
+        return true;
+    }
+
+    // The entry is already applied, so the ride is as it ends up
+    const Ride *ride = service.rides().find(args[0].toInt());
+    const int viewerId = viewer->getUsernameId();
+    const bool captained = ride && ride->getCaptainId() == viewerId;
+    const bool involved = captained || (ride && ride->hasPassenger(viewerId));
+    if (op == "COMPLETE" && !involved) {
+        // A finished ride the viewer took no part in leaves the replica
+        entry->op = "DELETE";
+    } else if (op == "RATED" && !involved) {
+        return false;
+    } else if (op == "BOOK" && args.size() >= 5 && !captained && args[1] != viewerName) {
+        // What another passenger paid is between them and the captain
+        args[4] = "0";
+    }
+    return true;
+}
+
+Ride* CarpoolServer::rideArg(const QStringList &args) const
+{
+    return service.rides().find(args.value(0).toInt());
+}
+
+void CarpoolServer::replyRides(Session *session, quint64 id, const QList<Ride*> &rides)
+{
+    if (!session->open) return;
+
+    QByteArray out = Journal::format(id, "ROWS", {QString::number(rides.size())});
+    for (Ride* ride : rides) {
+        out += ride->toRecord().toUtf8() + "\n";
+    }
+    session->socket->write(out);
+}
+
+void CarpoolServer::reply(Session *session, quint64 id, const QString &op, const QStringList &args)
+{
+    if (session->open) {
+        session->socket->write(Journal::format(id, op, args));
+    }
+}
+
+void CarpoolServer::replyStatus(Session *session, quint64 id, CarpoolService::Status status,
+                                const QStringList &args)
+{
+    if (status == CarpoolService::Ok) {
+        reply(session, id, "OK", args);
+    } else {
+        reply(session, id, "ERR", {QString::number(status)});
+    }
+}
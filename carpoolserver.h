@@ -0,0 +1,127 @@
+#ifndef CARPOOLSERVER_H
+#define CARPOOLSERVER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QLocalServer>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include "carpoolservice.h"
+
+class QLocalSocket;
+
+// Serves a CarpoolService to many clients over a local socket, so several
+// operators (each MainWindow is one client) share one in-memory state and
+// one set of data files. Everything runs on the service's thread and is
+// driven by socket events; no request ever blocks on another client.
+//
+// The protocol is line based and uses the journal's layout,
+// "<id>,<OP>,<arg>,<arg>...\n". Requests carry a client-chosen id > 0:
+//
+//   LOGIN,<type>,<username>,<password>     LOGOUT
+//   REGISTER,passenger,<username>,<password>
+//   REGISTER,captain,<username>,<password>,<vehicle type>,<vehicle class>
+//   TOPUP,<amount in paisa>
+//   LIST[,<route query>]                   open rides, as rides.txt records
+//   HISTORY                                the user's completed rides, the same way
+//   CREATE,<route>,<departure>,<return>,<seats>,<fare>[,<origin>,<destination>]
+//                                          points as "lat;lon", either may be empty
+//   SCHEDULE,<route>,<first departure>,<return>,<weekdays>,<seats>,<fare>[,<origin>,<destination>]
+//                                          repeats on weekdays given as day numbers,
+//                                          "12345" for Monday to Friday
+//   UNSCHEDULE,<schedule id>               stops a schedule the user created
+//   NEAR,<origin>,<destination>,<radius m> open rides by pickup/drop-off distance,
+//                                          nearest first; destination may be empty
+//   BOOK,<ride id>[,<from stop>,<to stop>] a seat for the whole trip or a leg,
+//                                          charged at the FareEngine quote
+//   CANCEL,<ride id>                       (a booking)
+//   CANCELRIDE,<ride id>                   COMPLETE,<ride id>
+//   RATE,<ride id>,<stars>                 rates the other side of the ride
+//   MATCH,<route>,<earliest>,<latest>,<vehicle type>,<vehicle class>,<max fare>
+//                                          books a seat found by the SeatMatcher;
+//                                          times are Ride epochs, OK,<ride id>
+//   SUBSCRIBE                              snapshot, then every change, as the
+//                                          logged-in user's view: no passwords,
+//                                          and nothing of other users' money or
+//                                          finished rides; a login as someone
+//                                          else ends it
+//   METRICS                                the server's Metrics::report() lines, as ROWS
+//
+// Everything but LOGIN/REGISTER/LIST acts as the user the
+// connection logged in as. Replies echo the id: "<id>,OK[,...]",
+// "<id>,ERR,<CarpoolService::Status>", "<id>,ROWS,<n>" followed by n
+// lines, or "<id>,SNAPSHOT,<bytes>" followed by a binary snapshot.
+// Subscribers then get each committed journal entry, cut down to their
+// user's view, as "0,CHANGE,<sequence>,<op>,<args...>", always before the
+// reply to the request that caused it.
+//
+// BOOK and MATCH requests that arrive in the same event loop pass, from any
+// number of connections, are decided together by CarpoolService::bookSeats
+// and matchRides.
+class CarpoolServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QString defaultName() { return "carpool"; }
+
+    explicit CarpoolServer(CarpoolService &service, QObject *parent = nullptr);
+    ~CarpoolServer();
+
+    bool listen(const QString &name = defaultName());
+    void close();
+    int sessionCount() const { return sessions.size(); }
+
+private:
+    struct Session {
+        QLocalSocket *socket = nullptr;
+        QByteArray buffer;
+        User *user = nullptr;
+        bool open = true;
+        bool subscribed = false;
+        int pendingBookings = 0;     // BOOK and MATCH requests not answered yet
+    };
+    struct PendingBooking {
+        Session *session;       // null once the client has gone
+        quint64 requestId;
+        int rideId;
+        int fromStop;           // -1 for the whole trip
+        int toStop;
+    };
+    struct PendingMatch {
+        Session *session;       // null once the client has gone
+        quint64 requestId;
+        SeatMatcher::Request request;
+    };
+
+    void acceptConnections();
+    void readRequests(Session *session);
+    void endSession(Session *session);
+    void handle(Session *session, const JournalEntry &request);
+    void flushBookings();
+    void flushMatches();
+    void broadcast(const QVector<JournalEntry> &entries);
+    // Rewrites entry into what a subscriber logged in as viewer may see of
+    // it, like Snapshot::serialize does for the snapshot; false to leave
+    // it out
+    bool replicaChange(const User *viewer, JournalEntry *entry) const;
+
+    Ride* rideArg(const QStringList &args) const;
+    static void replyRides(Session *session, quint64 id, const QList<Ride*> &rides);
+    static void reply(Session *session, quint64 id, const QString &op,
+                      const QStringList &args = QStringList());
+    static void replyStatus(Session *session, quint64 id, CarpoolService::Status status,
+                            const QStringList &args = QStringList());
+
+    CarpoolService &service;
+    QLocalServer server;
+    QList<Session*> sessions;
+    QVector<PendingBooking> pendingBookings;
+    QVector<PendingMatch> pendingMatches;
+    QTimer bookingTimer;
+};
+
+#endif // CARPOOLSERVER_H
@@ -0,0 +1,1025 @@
+#include "carpoolservice.h"
+#include "bookingengine.h"
+#include "carpoolclient.h"
+#include "snapshot.h"
+#include <QThread>
+
+namespace {
+// How often journal entries are folded back into the snapshot
+const int CompactionIntervalMs = 5 * 60 * 1000;
+// How often schedules are checked for days entering the look-ahead window
+const int ScheduleIntervalMs = 60 * 60 * 1000;
+
+bool isPassenger(const User *user)
+{
+    return user && user->getUserType() == "passenger";
+}
+
+// The ledger audit log sits next to the journal
+QString auditPathFor(const QString &journalPath)
+{
+    int slash = journalPath.lastIndexOf('/');
+    return journalPath.left(slash + 1) + "ledger.txt";
+}
+
+// So does the ride archive
+QString archivePathFor(const QString &journalPath)
+{
+    int slash = journalPath.lastIndexOf('/');
+    return journalPath.left(slash + 1) + "archive.txt";
+}
+
+QString rideArg(const Ride *ride)
+{
+    return QString::number(ride ? ride->getId() : 0);
+}
+
+CarpoolService::Status statusOf(const CarpoolClient::Reply &reply, QStringList *result = nullptr)
+{
+    if (reply.op == "OK") {
+        if (result) *result = reply.args;
+        return CarpoolService::Ok;
+    }
+    if (reply.op == "ERR" && !reply.args.isEmpty()) {
+        return CarpoolService::Status(reply.args[0].toInt());
+    }
+    return CarpoolService::ServerUnavailable;
+}
+
+bool isCaptain(const User *user)
+{
+    return user && user->getUserType() == "captain";
+}
+
+// Journal entries, the protocol and the text files are ',' separated
+// lines, and ';' separates the items of a list field; none of them are
+// escaped, so text a user types must not contain them
+bool hasSeparator(const QStringList &fields)
+{
+    for (const QString &field : fields) {
+        for (QChar c : field) {
+            if (c == ',' || c == ';' || c == '\n' || c == '\r') return true;
+        }
+    }
+    return false;
+}
+}
+
+CarpoolService::CarpoolService(const QString &journalPath, const QString &snapshotPath, QObject *parent)
+    : QObject(parent)
+    , accounts(userDirectory)
+    , journalPath(journalPath)
+    , snapshotPath(snapshotPath)
+    , archivePath(archivePathFor(journalPath))
+    , persistence(journalPath, snapshotPath, auditPathFor(journalPath), archivePath)
+{
+    // All disk writes happen on the persistence thread
+    connect(&persistence, &PersistenceWorker::durable, this, &CarpoolService::onChangesDurable);
+    connect(&persistence, &PersistenceWorker::checkpointed, this, &CarpoolService::onCheckpointed);
+    connect(&persistence, &PersistenceWorker::writeFailed, this, &CarpoolService::persistenceFailed);
+
+    // Fold the journal into a fresh snapshot periodically so it never grows unbounded
+    connect(&compactionTimer, &QTimer::timeout, this, &CarpoolService::compactJournal);
+    connect(&scheduleTimer, &QTimer::timeout, this, &CarpoolService::materializeSchedules);
+}
+
+CarpoolService::~CarpoolService()
+{
+    close();
+}
+
+QString CarpoolService::describe(Status status)
+{
+    switch (status) {
+    case Ok: return QString();
+    case EmptyCredentials: return "Username and password cannot be empty";
+    case UsernameTaken: return "Username already exists";
+    case InvalidCredentials: return "Invalid username or password";
+    case NotAPassenger: return "No passenger logged in";
+    case NotACaptain: return "No captain logged in";
+    case InvalidAmount: return "Amount must be greater than zero";
+    case MissingRouteOrDeparture: return "Route and departure time are required";
+    case InvalidTimeFormat: return "Times must be in the format yyyy-MM-dd hh:mm";
+    case ReturnBeforeDeparture: return "Return time must be after the departure time";
+    case RideNotFound: return "This ride is no longer available";
+    case AlreadyBooked: return "You already booked this ride";
+    case TooManyActiveRides: return QString("You can only have %1 active rides at a time").arg(MaxActiveRides);
+    case RideFull: return "No seats available on this ride";
+    case InsufficientBalance: return "Insufficient balance";
+    case NotBooked: return "You don't have a seat on this ride";
+    case NotRideCaptain: return "This ride belongs to another captain";
+    case RideNotCompleted: return "Only completed rides can be rated";
+    case AlreadyRated: return "This ride has already been rated";
+    case InvalidRating: return "Ratings must be between 1 and 5 stars";
+    case NoPassengerToRate: return "No passenger to rate for this ride";
+    case NoMatchingRide: return "No open ride matches the request";
+    case BadRequest: return "The server did not understand the request";
+    case ServerUnavailable: return "The carpool server is not reachable";
+    case InvalidStops: return "Pick a boarding stop before the drop-off stop on this ride's route";
+    case NoScheduleDays: return "Pick at least one day for the ride to repeat on";
+    case ScheduleNotFound: return "This ride schedule no longer exists";
+    case InvalidCharacters: return "Names, passwords, vehicles and routes cannot contain commas, "
+                                   "semicolons or line breaks";
+    }
+    return QString();
+}
+
+void CarpoolService::open()
+{
+    if (isOpen || loader || client) return;
+
+    load();
+    startPersisting();
+}
+
+void CarpoolService::openInBackground()
+{
+    if (isOpen || loader || client) return;
+
+    // The loader thread owns the state until finishOpening(); change
+    // signals sent meanwhile would reach views on the wrong thread
+    blockSignals(true);
+    loadPercent.storeRelaxed(0);
+    loader = QThread::create([this]() { load(); });
+    loader->setObjectName("CarpoolLoader");
+    connect(loader, &QThread::finished, this, &CarpoolService::finishOpening);
+    loader->start();
+}
+
+void CarpoolService::load()
+{
+    Metrics::Timer timer(Metrics::LoadNs);
+    loadSnapshot();
+    replayJournal();
+    loadPercent.storeRelaxed(100);
+}
+
+void CarpoolService::startPersisting()
+{
+    persistence.start();
+    compactionTimer.start(CompactionIntervalMs);
+    scheduleTimer.start(ScheduleIntervalMs);
+    isOpen = true;
+    materializeSchedules();
+}
+
+void CarpoolService::finishOpening()
+{
+    if (!loader) return;
+
+    loader->wait();
+    delete loader;
+    loader = nullptr;
+    blockSignals(false);
+    startPersisting();
+    emit opened();
+}
+
+void CarpoolService::close()
+{
+    // Closing during a background load waits for it
+    finishOpening();
+
+    if (client) {
+        // Leaving on purpose isn't a lost connection
+        client->disconnect(this);
+        client->disconnectFromServer();
+        return;
+    }
+    if (!isOpen) return;
+
+    compactionTimer.stop();
+    scheduleTimer.stop();
+    // Write a full snapshot and wait for the worker to finish; the journal
+    // is empty afterwards
+    saveSnapshot();
+    persistence.stop();
+    isOpen = false;
+}
+
+bool CarpoolService::connectToServer(const QString &serverName)
+{
+    if (isOpen || loader || client) return false;
+
+    CarpoolClient *connection = new CarpoolClient(this);
+    connect(connection, &CarpoolClient::changeReceived, this, &CarpoolService::onServerChange);
+    if (!connection->connectToServer(serverName)) {
+        delete connection;
+        return false;
+    }
+
+    client = connection;
+    connect(client, &CarpoolClient::disconnected, this, [this]() {
+        emit persistenceFailed("Lost the connection to the carpool server");
+    });
+    return true;
+}
+
+bool CarpoolService::subscribe()
+{
+    // Another user's view must not outlive their login; the UI holds no
+    // rides or users across a login
+    if (replicaLoaded) {
+        replicaLoaded = false;
+        rideRepository.clear();
+        userDirectory.clear();
+        accounts.clear();
+        rideSchedules.clear();
+        historyLoaded.clear();
+        journalSequence = 0;
+    }
+
+    // Changes can arrive right behind the snapshot, before it is loaded;
+    // onServerChange() holds them back until then
+    CarpoolClient::Reply reply = client->call("SUBSCRIBE");
+    if (reply.op != "SNAPSHOT" ||
+        !Snapshot::loadData(reply.data, userDirectory, rideRepository, &journalSequence, &accounts,
+                            &rideSchedules)) {
+        queuedChanges.clear();
+        return false;
+    }
+
+    replicaLoaded = true;
+    for (const JournalEntry &entry : queuedChanges) {
+        onServerChange(entry);
+    }
+    queuedChanges.clear();
+    return true;
+}
+
+QByteArray CarpoolService::replicaSnapshot(const User *viewer) const
+{
+    return Snapshot::serialize(userDirectory, rideRepository, journalSequence, &accounts, &rideSchedules,
+                               viewer);
+}
+
+void CarpoolService::loadRideHistory(const User *user)
+{
+    if (!user || historyLoaded.contains(user->getUsernameId())) return;
+
+    if (client) {
+        // The replica keeps whatever the server sends for good
+        CarpoolClient::Reply reply = client->call("HISTORY");
+        if (reply.op != "ROWS") return;
+        for (const QStringList &record : reply.rows) {
+            Ride* ride = rideRepository.createFromRecord(record);
+            if (ride && (ride->getId() <= 0 || !rideRepository.add(ride))) {
+                rideRepository.destroy(ride);
+            }
+        }
+    } else {
+        const QString name = user->getUsername();
+        if (isCaptain(user)) {
+            pageInArchive([&name](const QStringList &record) { return record[0] == name; });
+        } else {
+            pageInArchive([&name](const QStringList &record) {
+                return record[12].split(";").contains(name);
+            });
+        }
+    }
+    historyLoaded.insert(user->getUsernameId());
+}
+
+Ride* CarpoolService::findRide(int id)
+{
+    Ride* ride = rideRepository.find(id);
+    // Ids below nextId() that aren't in memory are archived or deleted
+    if (!ride && !client && id > 0 && id < rideRepository.nextId()) {
+        const QString key = QString::number(id);
+        pageInArchive([&key](const QStringList &record) { return record[13] == key; });
+        ride = rideRepository.find(id);
+    }
+    return ride;
+}
+
+void CarpoolService::pageInArchive(const std::function<bool(const QStringList &)> &wanted)
+{
+    // A ride is archived again whenever it changes, so its last record wins
+    QMap<int, QStringList> records;
+    auto collect = [&](const JournalEntry &entry) {
+        if (entry.op == "RIDE" && entry.args.size() >= 14 && wanted(entry.args)) {
+            records.insert(entry.args[13].toInt(), entry.args);
+        }
+    };
+    for (const JournalEntry &entry : Journal::readAll(archivePath)) {
+        collect(entry);
+    }
+    // Lines the persistence thread hasn't written yet are newer still
+    for (const QByteArray &lines : unsavedArchive) {
+        for (const QByteArray &line : lines.split('\n')) {
+            JournalEntry entry;
+            if (Journal::parse(line, &entry)) collect(entry);
+        }
+    }
+
+    Metrics::count(Metrics::ArchivePageIns);
+    for (auto it = records.constBegin(); it != records.constEnd(); ++it) {
+        // Anything still in memory is at least as new as the archive
+        if (rideRepository.find(it.key())) continue;
+
+        Ride* ride = rideRepository.createFromRecord(it.value());
+        if (ride && rideRepository.add(ride)) {
+            rideRepository.setArchived(ride);
+            Metrics::count(Metrics::ArchivedRidesLoaded);
+        } else if (ride) {
+            rideRepository.destroy(ride);
+        }
+    }
+}
+
+CarpoolService::Status CarpoolService::remoteCall(const QString &op, const QStringList &args,
+                                                  QStringList *result)
+{
+    return statusOf(client->call(op, args), result);
+}
+
+void CarpoolService::onServerChange(const JournalEntry &entry)
+{
+    if (!replicaLoaded) {
+        queuedChanges.append(entry);
+        return;
+    }
+    // The snapshot already covers anything up to its sequence
+    if (entry.sequence <= journalSequence) return;
+    journalSequence = entry.sequence;
+    applyJournalEntry(entry);
+}
+
+User* CarpoolService::authenticate(const QString &username, const QString &password,
+                                   const QString &userType)
+{
+    if (client) {
+        if (remoteCall("LOGIN", {userType, username, password}) != Ok || !subscribe()) return nullptr;
+        return userDirectory.find(username, userType);
+    }
+
+    User* user = userDirectory.find(username, userType);
+    // In a real app, we'd hash the password and compare hashes
+    if (user && user->getPassword() == password) {
+        return user;
+    }
+    return nullptr;
+}
+
+CarpoolService::Status CarpoolService::registerPassenger(const QString &username, const QString &password)
+{
+    if (hasSeparator({username, password})) return InvalidCharacters;
+    if (client) return remoteCall("REGISTER", {"passenger", username, password});
+    if (username.isEmpty() || password.isEmpty()) return EmptyCredentials;
+    if (userDirectory.contains(username)) return UsernameTaken;
+
+    Passenger newPassenger(username, password);
+    commit("USER", newPassenger.toRecord().split(","));
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::registerCaptain(const QString &username, const QString &password,
+                                                       const QString &vehicleType, const QString &vehicleClass)
+{
+    if (hasSeparator({username, password, vehicleType, vehicleClass})) return InvalidCharacters;
+    if (client) return remoteCall("REGISTER", {"captain", username, password, vehicleType, vehicleClass});
+    if (username.isEmpty() || password.isEmpty()) return EmptyCredentials;
+    if (userDirectory.contains(username)) return UsernameTaken;
+
+    Captain newCaptain(username, password, vehicleType, vehicleClass);
+    commit("USER", newCaptain.toRecord().split(","));
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::addBalance(User *user, double amount)
+{
+    if (client) return remoteCall("TOPUP", {QString::number(toMoney(amount))});
+    if (!user) return InvalidCredentials;
+    Money deposit = toMoney(amount);
+    if (deposit <= 0) return InvalidAmount;
+
+    Ledger::Transaction topUp;
+    topUp.kind = "topup";
+    topUp.post(Ledger::userAccount(user->getUserType(), user->getUsername()), deposit);
+    topUp.post(Ledger::deposits(), -deposit);
+    commit({transaction(topUp)});
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::createRide(User *user, const QString &route, const QString &departureTime,
+                                                  const QString &returnTime, int seats, double fare,
+                                                  const GeoPoint &origin, const GeoPoint &destination)
+{
+    if (hasSeparator({route, departureTime, returnTime})) return InvalidCharacters;
+    if (client) {
+        return remoteCall("CREATE", {route, departureTime, returnTime, QString::number(seats),
+                                     QString::number(fare, 'f', 2), origin.toText(), destination.toText()});
+    }
+    Captain* captain = dynamic_cast<Captain*>(user);
+    if (!captain) return NotACaptain;
+    if (route.isEmpty() || departureTime.isEmpty()) return MissingRouteOrDeparture;
+
+    // Times are validated here once; the ride only stores the parsed values
+    qint64 departure = Ride::parseTime(departureTime);
+    qint64 returning = returnTime.isEmpty() ? Ride::NoTime : Ride::parseTime(returnTime);
+    if (departure == Ride::NoTime || (!returnTime.isEmpty() && returning == Ride::NoTime)) {
+        return InvalidTimeFormat;
+    }
+    if (returning != Ride::NoTime && returning < departure) {
+        return ReturnBeforeDeparture;
+    }
+
+    Ride newRide(captain->getUsername(), "", route, departure, returning,
+                 captain->getVehicleType(), captain->getVehicleClass(), seats, fare);
+    newRide.setId(rideRepository.nextId());
+    newRide.setEndpoints(origin, destination);
+    commit("RIDE", newRide.toRecord().split(","));
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::createSchedule(User *user, const QString &route,
+                                                      const QString &firstDeparture, const QString &returnTime,
+                                                      int weekdays, int seats, double fare,
+                                                      const GeoPoint &origin, const GeoPoint &destination)
+{
+    if (hasSeparator({route, firstDeparture, returnTime})) return InvalidCharacters;
+    if (client) {
+        return remoteCall("SCHEDULE", {route, firstDeparture, returnTime, RideSchedule::formatWeekdays(weekdays),
+                                       QString::number(seats), QString::number(fare, 'f', 2),
+                                       origin.toText(), destination.toText()});
+    }
+    Captain* captain = dynamic_cast<Captain*>(user);
+    if (!captain) return NotACaptain;
+    if (route.isEmpty() || firstDeparture.isEmpty()) return MissingRouteOrDeparture;
+
+    qint64 departure = Ride::parseTime(firstDeparture);
+    qint64 returning = returnTime.isEmpty() ? Ride::NoTime : Ride::parseTime(returnTime);
+    if (departure == Ride::NoTime || (!returnTime.isEmpty() && returning == Ride::NoTime)) {
+        return InvalidTimeFormat;
+    }
+    if (returning != Ride::NoTime && returning < departure) {
+        return ReturnBeforeDeparture;
+    }
+    if ((weekdays & 0x7F) == 0) return NoScheduleDays;
+
+    RideSchedule schedule;
+    schedule.id = rideSchedules.nextId();
+    schedule.captain = captain->getUsername();
+    schedule.route = route;
+    schedule.firstDay = RideSchedule::dayOf(departure);
+    schedule.departureMinutes = int((departure - schedule.firstDay * 86400) / 60);
+    schedule.returnOffsetMinutes = returning == Ride::NoTime ? -1 : int((returning - departure) / 60);
+    schedule.weekdays = weekdays & 0x7F;
+    schedule.seats = seats;
+    schedule.fare = fare;
+    schedule.origin = origin;
+    schedule.destination = destination;
+    schedule.materializedThrough = schedule.firstDay - 1;
+    commit("SCHEDULE", schedule.toArgs());
+    materializeSchedules();
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::cancelSchedule(User *captain, int scheduleId)
+{
+    if (client) return remoteCall("UNSCHEDULE", {QString::number(scheduleId)});
+    if (!isCaptain(captain)) return NotACaptain;
+    const RideSchedule *schedule = rideSchedules.find(scheduleId);
+    if (!schedule) return ScheduleNotFound;
+    if (schedule->captain != captain->getUsername()) return NotRideCaptain;
+
+    QVector<Change> changes = {Change("UNSCHEDULE", {QString::number(scheduleId)})};
+    for (Ride* ride : rideRepository.activeRidesForCaptain(captain->getUsernameId())) {
+        if (ride->getScheduleId() == scheduleId && ride->getPassengerId() == 0) {
+            changes.append(Change("DELETE", {QString::number(ride->getId())}));
+        }
+    }
+    commit(changes);
+    return Ok;
+}
+
+void CarpoolService::materializeSchedules()
+{
+    if (!isOpen || client) return;
+
+    const qint64 now = Ride::currentTime();
+    const qint64 today = RideSchedule::dayOf(now);
+    QVector<Change> changes;
+
+    // Instances whose time has passed without a booking were only there to
+    // be found; nothing about them is worth keeping
+    for (Ride* ride : rideRepository.openRidesDepartingBetween(Ride::NoTime + 1, now)) {
+        if (ride->getScheduleId() != 0 && ride->getPassengerId() == 0) {
+            changes.append(Change("DELETE", {QString::number(ride->getId())}));
+        }
+    }
+
+    // The rides aren't added until commit(), so ids are counted here
+    int nextId = rideRepository.nextId();
+    for (const RideSchedule &schedule : rideSchedules.all()) {
+        const qint64 through = qMin(today + ScheduleLookAheadDays, schedule.lastDay);
+        if (schedule.materializedThrough >= through) continue;
+        const Captain* captain = dynamic_cast<Captain*>(userDirectory.find(schedule.captain, "captain"));
+        if (!captain) continue;
+
+        // Days that went by while the service wasn't running are skipped,
+        // not created late
+        for (qint64 day = qMax(schedule.materializedThrough + 1, today); day <= through; day++) {
+            const qint64 departure = schedule.departureOn(day);
+            if (!schedule.runsOn(day) || departure < now) continue;
+
+            const qint64 returning = schedule.returnOffsetMinutes < 0
+                                         ? Ride::NoTime : departure + schedule.returnOffsetMinutes * 60;
+            Ride ride(captain->getUsername(), "", schedule.route, departure, returning,
+                      captain->getVehicleType(), captain->getVehicleClass(), schedule.seats, schedule.fare);
+            ride.setId(nextId++);
+            ride.setEndpoints(schedule.origin, schedule.destination);
+            ride.setScheduleId(schedule.id);
+            changes.append(Change("RIDE", ride.toRecord().split(",")));
+        }
+        changes.append(Change("SCHEDULED", {QString::number(schedule.id), RideSchedule::formatDay(through)}));
+    }
+    commit(changes);
+}
+
+Money CarpoolService::legFare(const Ride *ride, const Ride::Leg &leg)
+{
+    return FareEngine::legShare(toMoney(ride->getFare()), ride, leg);
+}
+
+Money CarpoolService::paidFare(const Ride *ride, int passengerId) const
+{
+    Money paid = ride->getPaidFare(passengerId);
+    return paid > 0 ? paid : legFare(ride, ride->getLeg(passengerId));
+}
+
+CarpoolService::Status CarpoolService::bookRide(User *passenger, Ride *ride)
+{
+    return bookRides({qMakePair(passenger, ride)}).first();
+}
+
+CarpoolService::Status CarpoolService::bookRide(User *passenger, Ride *ride, const Ride::Leg &leg)
+{
+    return bookSeats({Booking{passenger, ride, leg}}).first();
+}
+
+QVector<CarpoolService::Status> CarpoolService::bookRides(const QVector<QPair<User*, Ride*>> &bookings)
+{
+    QVector<Booking> seats;
+    seats.reserve(bookings.size());
+    for (const auto &booking : bookings) {
+        Ride *ride = booking.second;
+        seats.append({booking.first, ride, ride ? ride->wholeTrip() : Ride::Leg{0, 1}});
+    }
+    return bookSeats(seats);
+}
+
+QVector<CarpoolService::Status> CarpoolService::bookSeats(const QVector<Booking> &bookings)
+{
+    if (client) {
+        // Pipelined: every request is sent before the first reply is read
+        QVector<quint64> ids;
+        ids.reserve(bookings.size());
+        for (const Booking &booking : bookings) {
+            QStringList args = {rideArg(booking.ride)};
+            if (booking.ride && !(booking.leg == booking.ride->wholeTrip())) {
+                args << QString::number(booking.leg.from) << QString::number(booking.leg.to);
+            }
+            ids.append(client->send("BOOK", args));
+        }
+        QVector<Status> statuses;
+        statuses.reserve(ids.size());
+        for (quint64 id : ids) {
+            statuses.append(statusOf(client->wait(id)));
+        }
+        return statuses;
+    }
+
+    Metrics::Timer timer(Metrics::BookingBatchNs);
+
+    // Seats and balances are decided up front; committing can't fail, so
+    // every accepted booking goes to the journal in one batch
+    QVector<Status> statuses = BookingEngine(rideRepository, fareEngine).reserve(bookings);
+    QVector<Change> changes;
+    for (int i = 0; i < statuses.size(); i++) {
+        if (statuses[i] == Ok) {
+            appendBooking(changes, bookings[i]);
+            Metrics::count(Metrics::BookingsAccepted);
+        } else {
+            Metrics::count(Metrics::BookingsRejected);
+        }
+    }
+    commit(changes);
+    return statuses;
+}
+
+QVector<CarpoolService::Status> CarpoolService::matchRides(const QVector<SeatMatcher::Request> &requests,
+                                                          QVector<Ride*> *matched)
+{
+    QVector<Status> statuses(requests.size(), NoMatchingRide);
+    QVector<Ride*> picks(requests.size(), nullptr);
+
+    if (client) {
+        QVector<quint64> ids;
+        ids.reserve(requests.size());
+        for (const SeatMatcher::Request &request : requests) {
+            ids.append(client->send("MATCH", {request.route, QString::number(request.earliest),
+                                              QString::number(request.latest), request.vehicleType,
+                                              request.vehicleClass, QString::number(request.maxFare, 'f', 2)}));
+        }
+        for (int i = 0; i < ids.size(); i++) {
+            QStringList result;
+            statuses[i] = statusOf(client->wait(ids[i]), &result);
+            if (statuses[i] == Ok) picks[i] = rideRepository.find(result.value(0).toInt());
+        }
+    } else {
+        // Book whatever the matcher picked; a booking can still fail on
+        // the passenger's balance or ride limit
+        const QVector<Ride*> candidates = SeatMatcher(rideRepository, fareEngine).match(requests);
+        QVector<QPair<User*, Ride*>> bookings;
+        QVector<int> requestOf;
+        for (int i = 0; i < requests.size(); i++) {
+            if (!isPassenger(requests[i].passenger)) {
+                statuses[i] = NotAPassenger;
+            } else if (candidates[i]) {
+                bookings.append(qMakePair(requests[i].passenger, candidates[i]));
+                requestOf.append(i);
+            }
+        }
+        const QVector<Status> booked = bookRides(bookings);
+        for (int b = 0; b < booked.size(); b++) {
+            statuses[requestOf[b]] = booked[b];
+            if (booked[b] == Ok) picks[requestOf[b]] = bookings[b].second;
+        }
+    }
+
+    if (matched) *matched = picks;
+    return statuses;
+}
+
+void CarpoolService::appendBooking(QVector<Change> &changes, const Booking &booking) const
+{
+    // The captain is paid the fare minus the platform fee; without a
+    // captain account the whole fare stays with the platform
+    const User *passenger = booking.passenger;
+    const Ride *ride = booking.ride;
+    // The BookingEngine checked the balance against the same quote, made
+    // before any booking of the batch is applied
+    Money fare = fareEngine.quote(ride, booking.leg);
+    Money fee = qRound64(fare * PlatformFeePercent / 100.0);
+    bool hasCaptain = userDirectory.find(ride->getCaptain(), "captain") != nullptr;
+
+    Ledger::Transaction payment;
+    payment.kind = "fare";
+    payment.post(Ledger::userAccount("passenger", passenger->getUsername()), -fare);
+    if (hasCaptain) {
+        payment.post(Ledger::userAccount("captain", ride->getCaptain()), fare - fee);
+        payment.post(Ledger::platformFees(), fee);
+    } else {
+        payment.post(Ledger::platformFees(), fare);
+    }
+    changes.append(transaction(payment));
+    changes.append(Change("BOOK", {QString::number(ride->getId()), passenger->getUsername(),
+                                   QString::number(booking.leg.from), QString::number(booking.leg.to),
+                                   QString::number(fare)}));
+}
+
+CarpoolService::Status CarpoolService::cancelBooking(User *passenger, Ride *ride, double *refund, double *penalty)
+{
+    if (client) {
+        QStringList amounts;
+        Status status = remoteCall("CANCEL", {rideArg(ride)}, &amounts);
+        if (refund) *refund = toRupees(amounts.value(0).toLongLong());
+        if (penalty) *penalty = toRupees(amounts.value(1).toLongLong());
+        return status;
+    }
+    if (!isPassenger(passenger)) return NotAPassenger;
+    if (!ride || rideRepository.find(ride->getId()) != ride || ride->getIsCompleted()) return RideNotFound;
+    if (!ride->hasPassenger(passenger->getUsernameId())) return NotBooked;
+
+    Money refundAmount = paidFare(ride, passenger->getUsernameId());
+    Money fee = 0;
+    if (passenger->getCancelCount() >= FreeCancellations) {
+        fee = CancellationPenalty;
+        refundAmount -= fee;
+    }
+
+    // The captain returns what the passenger gets back and keeps the fee
+    Ledger::Transaction refundment;
+    refundment.kind = "refund";
+    refundment.post(Ledger::userAccount("passenger", passenger->getUsername()), refundAmount);
+    if (userDirectory.find(ride->getCaptain(), "captain")) {
+        refundment.post(Ledger::userAccount("captain", ride->getCaptain()), -refundAmount);
+    } else {
+        refundment.post(Ledger::platformRefunds(), -refundAmount);
+    }
+
+    commit({transaction(refundment),
+            Change("CANCELCOUNT", {"passenger", passenger->getUsername()}),
+            Change("RELEASE", {QString::number(ride->getId()), passenger->getUsername()})});
+
+    if (refund) *refund = toRupees(refundAmount);
+    if (penalty) *penalty = toRupees(fee);
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::cancelRide(User *captain, Ride *ride)
+{
+    if (client) return remoteCall("CANCELRIDE", {rideArg(ride)});
+    if (!isCaptain(captain)) return NotACaptain;
+    if (!ride || rideRepository.find(ride->getId()) != ride) return RideNotFound;
+    if (ride->getCaptainId() != captain->getUsernameId()) return NotRideCaptain;
+
+    QString rideId = QString::number(ride->getId());
+    if (ride->getPassengerId() == 0) {
+        // Nobody booked it yet, so the ride simply goes away
+        commit("DELETE", {rideId});
+        return Ok;
+    }
+
+    QVector<Change> changes;
+    if (captain->getCancelCount() >= FreeCancellations) {
+        Ledger::Transaction penalty;
+        penalty.kind = "penalty";
+        penalty.post(Ledger::userAccount("captain", captain->getUsername()), -CancellationPenalty);
+        penalty.post(Ledger::platformPenalties(), CancellationPenalty);
+        changes.append(transaction(penalty));
+    }
+    changes.append(Change("CANCELCOUNT", {"captain", captain->getUsername()}));
+
+    // Every passenger gets the full fare back; the platform funds it, as
+    // the captain's share was already paid out
+    Ledger::Transaction refunds;
+    refunds.kind = "refund";
+    Money total = 0;
+    const QStringList passengers = ride->getPassengers();
+    for (int p = 0; p < passengers.size(); p++) {
+        if (userDirectory.find(passengers[p], "passenger")) {
+            Money fare = paidFare(ride, ride->getPassengerIds()[p]);
+            refunds.post(Ledger::userAccount("passenger", passengers[p]), fare);
+            total += fare;
+        }
+    }
+    if (total > 0) {
+        refunds.post(Ledger::platformRefunds(), -total);
+        changes.append(transaction(refunds));
+    }
+    changes.append(Change("RELEASE", {rideId}));
+    commit(changes);
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::completeRide(User *captain, Ride *ride)
+{
+    if (client) return remoteCall("COMPLETE", {rideArg(ride)});
+    if (!isCaptain(captain)) return NotACaptain;
+    if (!ride || rideRepository.find(ride->getId()) != ride || ride->getIsCompleted()) return RideNotFound;
+    if (ride->getCaptainId() != captain->getUsernameId()) return NotRideCaptain;
+
+    commit("COMPLETE", {QString::number(ride->getId())});
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::ratePassenger(User *captain, Ride *ride, int stars)
+{
+    if (client) return remoteCall("RATE", {rideArg(ride), QString::number(stars)});
+    if (!isCaptain(captain)) return NotACaptain;
+    if (!ride || rideRepository.find(ride->getId()) != ride) return RideNotFound;
+    if (ride->getCaptainId() != captain->getUsernameId()) return NotRideCaptain;
+    if (stars < 1 || stars > 5) return InvalidRating;
+
+    User* passenger = ride->getPassengerId() == 0 ? nullptr
+                                                  : userDirectory.find(ride->getPassenger(), "passenger");
+    if (!passenger) return NoPassengerToRate;
+
+    commit("RATING", {"passenger", passenger->getUsername(), QString::number(stars)});
+    return Ok;
+}
+
+CarpoolService::Status CarpoolService::rateCaptain(User *passenger, Ride *ride, int stars)
+{
+    if (client) return remoteCall("RATE", {rideArg(ride), QString::number(stars)});
+    if (!isPassenger(passenger)) return NotAPassenger;
+    if (!ride || rideRepository.find(ride->getId()) != ride) return RideNotFound;
+    if (!ride->hasPassenger(passenger->getUsernameId())) return NotBooked;
+    if (!ride->getIsCompleted()) return RideNotCompleted;
+    if (ride->getIsRated()) return AlreadyRated;
+    if (stars < 1 || stars > 5) return InvalidRating;
+
+    User* captain = userDirectory.find(ride->getCaptain(), "captain");
+    if (!captain) return RideNotFound;
+
+    // One batch, so a crash can't leave the captain rated and the ride not
+    commit({Change("RATING", {"captain", captain->getUsername(), QString::number(stars)}),
+            Change("RATED", {QString::number(ride->getId())})});
+    return Ok;
+}
+
+void CarpoolService::loadSnapshot() {
+    quint64 sequence = 0;
+    if (Snapshot::load(snapshotPath, userDirectory, rideRepository, &sequence, &accounts, &rideSchedules)) {
+        usersSnapshotSequence = sequence;
+        ridesSnapshotSequence = sequence;
+        return;
+    }
+
+    // No binary snapshot yet: import users.txt/rides.txt. The journal replay
+    // and the next save bring both into carpool.dat.
+    Snapshot::loadUsersText("users.txt", userDirectory, &usersSnapshotSequence, [this](int done, int total) {
+        loadPercent.storeRelaxed(50 * done / total);
+    });
+    Snapshot::loadRidesText("rides.txt", rideRepository, &ridesSnapshotSequence, [this](int done, int total) {
+        loadPercent.storeRelaxed(50 + 50 * done / total);
+    });
+}
+
+void CarpoolService::saveSnapshot() {
+    // Completed rides leave memory for the archive; only those the archive
+    // doesn't have in their current state are written to it
+    QByteArray archived;
+    const QList<Ride*> completed = rideRepository.completedRides().values();
+    for (Ride* ride : completed) {
+        if (!rideRepository.isArchived(ride)) {
+            archived += Journal::format(journalSequence, "RIDE", ride->toRecord().split(","));
+        }
+        emit rideAboutToBeRemoved(ride);
+        rideRepository.remove(ride);
+    }
+    historyLoaded.clear();
+    if (!archived.isEmpty()) {
+        unsavedArchive[journalSequence] += archived;
+    }
+
+    // Lines from a checkpoint that failed are handed over again, as the
+    // rides are no longer in memory or in the new snapshot
+    QByteArray archive;
+    for (const QByteArray &lines : unsavedArchive) {
+        archive += lines;
+    }
+
+    // Serializing on the owning thread needs no locking; the worker writes
+    // it after every journal entry queued before it
+    checkpointSequence = journalSequence;
+    persistence.checkpoint(journalSequence,
+                           Snapshot::serialize(userDirectory, rideRepository, journalSequence, &accounts,
+                                               &rideSchedules),
+                           archive);
+}
+
+bool CarpoolService::isRideOperation(const QString &op) {
+    return op == "RIDE" || op == "BOOK" || op == "RELEASE" ||
+           op == "COMPLETE" || op == "RATED" || op == "DELETE" ||
+           op == "SCHEDULE" || op == "UNSCHEDULE" || op == "SCHEDULED";
+}
+
+void CarpoolService::commit(const QVector<Change> &changes) {
+    if (changes.isEmpty()) return;
+
+    QVector<JournalEntry> entries;
+    entries.reserve(changes.size());
+    QByteArray lines;
+    for (const Change &change : changes) {
+        JournalEntry entry;
+        entry.op = change.first;
+        entry.args = change.second;
+        entry.sequence = ++journalSequence;
+        lines += Journal::format(entry.sequence, entry.op, entry.args);
+        entries.append(entry);
+    }
+
+    // One hand-over for the whole batch; the worker writes it with a single sync
+    persistence.append(journalSequence, lines);
+    Metrics::count(Metrics::JournalEntries, entries.size());
+    for (const JournalEntry &entry : entries) {
+        applyJournalEntry(entry);
+    }
+    emit committed(entries);
+}
+
+void CarpoolService::applyJournalEntry(const JournalEntry &entry) {
+    const QString &op = entry.op;
+    const QStringList &args = entry.args;
+
+    if (op == "USER") {
+        // USER,<users.txt record>
+        User* user = userDirectory.createFromRecord(args);
+        if (user && !userDirectory.add(user)) {
+            userDirectory.destroy(user);
+        }
+    } else if (op == "TXN") {
+        // TXN,<kind>,<account>,<amount>,<account>,<amount>...; amounts in minor units
+        Ledger::Transaction transaction;
+        if (Ledger::fromArgs(args, &transaction)) {
+            accounts.apply(transaction);
+        }
+    } else if (op == "BALANCE" && args.size() >= 3) {
+        // BALANCE,<type>,<username>,<signed rupees>; written before the ledger
+        if (User* user = userDirectory.find(args[1], args[0])) {
+            user->adjustBalance(toMoney(args[2].toDouble()));
+        }
+    } else if (op == "CANCELCOUNT" && args.size() >= 2) {
+        // CANCELCOUNT,<type>,<username>
+        if (User* user = userDirectory.find(args[1], args[0])) {
+            user->incrementCancelCount();
+        }
+    } else if (op == "RATING" && args.size() >= 3) {
+        // RATING,<type>,<username>,<stars>
+        if (User* user = userDirectory.find(args[1], args[0])) {
+            user->addRating(args[2].toInt());
+        }
+    } else if (op == "RIDE") {
+        // RIDE,<rides.txt record>
+        Ride* ride = rideRepository.createFromRecord(args);
+        if (ride && (ride->getId() <= 0 || !rideRepository.add(ride))) {
+            rideRepository.destroy(ride);
+        } else if (ride) {
+            emit rideChanged(ride);
+        }
+    } else if (op == "SCHEDULE") {
+        // SCHEDULE,<RideSchedule::toArgs() fields>
+        RideSchedule schedule;
+        if (RideSchedule::fromArgs(args, &schedule)) {
+            rideSchedules.add(schedule);
+        }
+    } else if (op == "UNSCHEDULE" && !args.isEmpty()) {
+        // UNSCHEDULE,<schedule id>; its rides are deleted by their own entries
+        rideSchedules.remove(args[0].toInt());
+    } else if (op == "SCHEDULED" && args.size() >= 2) {
+        // SCHEDULED,<schedule id>,<last day that has its ride>
+        RideSchedule *schedule = rideSchedules.find(args[0].toInt());
+        qint64 day = 0;
+        if (schedule && RideSchedule::parseDay(args[1], &day)) {
+            schedule->materializedThrough = day;
+        }
+    } else if (isRideOperation(op) && !args.isEmpty()) {
+        // Only a rating can reach a ride that was archived meanwhile
+        Ride* ride = op == "RATED" ? findRide(args[0].toInt()) : rideRepository.find(args[0].toInt());
+        if (!ride) return;
+
+        if (op == "BOOK" && args.size() >= 5) {
+            // BOOK,<ride id>,<passenger>,<from stop>,<to stop>,<paid in paisa>
+            rideRepository.book(ride, internString(args[1]), Ride::Leg{args[2].toInt(), args[3].toInt()},
+                                args[4].toLongLong());
+        } else if (op == "BOOK" && args.size() >= 4) {
+            // BOOK,<ride id>,<passenger>,<from stop>,<to stop>
+            rideRepository.book(ride, internString(args[1]), Ride::Leg{args[2].toInt(), args[3].toInt()});
+        } else if (op == "BOOK" && args.size() >= 2) {
+            // BOOK,<ride id>,<passenger>; the whole trip
+            rideRepository.book(ride, internString(args[1]));
+        } else if (op == "RELEASE") {
+            // RELEASE,<ride id>[,<passenger>]; without a passenger every seat is freed
+            if (args.size() >= 2) {
+                int passengerId = StringPool::instance().find(args[1]);
+                if (passengerId > 0) {
+                    rideRepository.release(ride, passengerId);
+                }
+            } else {
+                rideRepository.releaseAll(ride);
+            }
+        } else if (op == "COMPLETE") {
+            rideRepository.complete(ride);
+        } else if (op == "RATED") {
+            rideRepository.markRated(ride);
+        } else if (op == "DELETE") {
+            emit rideAboutToBeRemoved(ride);
+            rideRepository.remove(ride);
+            return;
+        }
+        emit rideChanged(ride);
+    }
+}
+
+void CarpoolService::replayJournal() {
+    quint64 lastSequence = qMax(usersSnapshotSequence, ridesSnapshotSequence);
+
+    for (const JournalEntry &entry : Journal::readAll(journalPath)) {
+        // Each snapshot records the last entry it already contains; a crash
+        // between writing users.txt and rides.txt leaves them at different points
+        quint64 snapshotSequence = isRideOperation(entry.op) ? ridesSnapshotSequence
+                                                             : usersSnapshotSequence;
+        if (entry.sequence > snapshotSequence) {
+            applyJournalEntry(entry);
+        }
+        lastSequence = qMax(lastSequence, entry.sequence);
+    }
+
+    journalSequence = lastSequence;
+    // Entries newer than either snapshot still need a checkpoint
+    checkpointSequence = qMin(usersSnapshotSequence, ridesSnapshotSequence);
+}
+
+void CarpoolService::compactJournal() {
+    if (checkpointSequence == journalSequence) {
+        return;
+    }
+    saveSnapshot();
+}
+
+void CarpoolService::onChangesDurable(quint64 sequence) {
+    if (sequence == journalSequence) {
+        emit allChangesSaved();
+    }
+}
+
+void CarpoolService::onCheckpointed(quint64 sequence) {
+    usersSnapshotSequence = sequence;
+    ridesSnapshotSequence = sequence;
+    while (!unsavedArchive.isEmpty() && unsavedArchive.firstKey() <= sequence) {
+        unsavedArchive.erase(unsavedArchive.begin());
+    }
+}
@@ -0,0 +1,267 @@
+#ifndef CARPOOLSERVICE_H
+#define CARPOOLSERVICE_H
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QPair>
+#include <QVector>
+#include "user.h"
+#include "userdirectory.h"
+#include "ride.h"
+#include "riderepository.h"
+#include "rideschedules.h"
+#include "fareengine.h"
+#include "journal.h"
+#include "ledger.h"
+#include "persistenceworker.h"
+#include "seatmatcher.h"
+#include <functional>
+
+class CarpoolClient;
+class QThread;
+
+// The headless core of the application: owns every user and ride and
+// implements the business rules (fares and the platform fee, refunds,
+// cancellation penalties, ratings) behind plain calls that return a Status,
+// so it runs and can be driven without a display.
+//
+// Operations validate first, then record their effects as journal entries
+// through commit(), which hands the lines to the persistence thread and
+// applies them in memory. Money only moves through Ledger transactions.
+// Replaying the journal at startup goes through the same apply path.
+// Checkpoints move completed rides out of memory into the ride archive
+// (an append-only file of RIDE entries), so memory and scans follow the
+// active rides; loadRideHistory() and findRide() page archived rides in.
+// Recurring rides are kept as RideSchedule templates, and their rides are
+// only created once they fall within ScheduleLookAheadDays.
+// rideChanged()/rideAboutToBeRemoved() let views follow ride state without
+// rescanning the repository.
+//
+// Connected to a CarpoolServer instead of opening the files, the service is
+// a client: its users and rides are a replica kept current by the changes
+// the server pushes, and every operation is carried out by the server.
+class CarpoolService : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Status {
+        Ok,
+        EmptyCredentials,
+        UsernameTaken,
+        InvalidCredentials,
+        NotAPassenger,
+        NotACaptain,
+        InvalidAmount,
+        MissingRouteOrDeparture,
+        InvalidTimeFormat,
+        ReturnBeforeDeparture,
+        RideNotFound,
+        AlreadyBooked,
+        TooManyActiveRides,
+        RideFull,
+        InsufficientBalance,
+        NotBooked,
+        NotRideCaptain,
+        RideNotCompleted,
+        AlreadyRated,
+        InvalidRating,
+        NoPassengerToRate,
+        NoMatchingRide,
+        BadRequest,
+        ServerUnavailable,
+        InvalidStops,
+        NoScheduleDays,
+        ScheduleNotFound,
+        InvalidCharacters
+    };
+    // A user-facing sentence for a failed status
+    static QString describe(Status status);
+
+    static const int PlatformFeePercent = 5;
+    static const Money CancellationPenalty = 50 * 100;
+    static const int FreeCancellations = 2;
+    static const int MaxActiveRides = 2;
+    // How far ahead a schedule's rides exist to be found and booked
+    static const int ScheduleLookAheadDays = 7;
+
+    // One seat request. Leg stop indexes refer to the ride's getStops();
+    // Ride::wholeTrip() books the whole ride.
+    struct Booking {
+        User *passenger;
+        Ride *ride;
+        Ride::Leg leg;
+    };
+    // The captain's fare for a leg: the ride's fare split evenly over its
+    // segments. Bookings made before fares were quoted paid this.
+    static Money legFare(const Ride *ride, const Ride::Leg &leg);
+
+    CarpoolService(const QString &journalPath, const QString &snapshotPath,
+                   QObject *parent = nullptr);
+    ~CarpoolService();
+
+    // Loads the snapshot, replays the journal and starts persisting
+    void open();
+    // Does the same loading on a background thread and returns at once;
+    // opened() follows on this thread. Nothing else may be called before
+    // that, and no change signals are sent for the loaded state.
+    void openInBackground();
+    bool isLoading() const { return loader != nullptr; }
+    // How far the load has got, 0-100; polled while isLoading()
+    int loadProgress() const { return loadPercent.loadRelaxed(); }
+    // Writes a final snapshot and waits for the persistence thread
+    void close();
+    // Becomes a client of the server instead of open(); false if no server
+    // answers. The replica is loaded by the first successful authenticate().
+    bool connectToServer(const QString &serverName);
+    bool isRemote() const { return client != nullptr; }
+    // viewer's view of the state in the binary snapshot format, for its
+    // replica; see Snapshot::serialize
+    QByteArray replicaSnapshot(const User *viewer) const;
+
+    const UserDirectory &users() const { return userDirectory; }
+    const RideRepository &rides() const { return rideRepository; }
+    const Ledger &ledger() const { return accounts; }
+    const RideSchedules &schedules() const { return rideSchedules; }
+    // Prices seats; bookings charge its quote for the ride as it stands
+    const FareEngine &fares() const { return fareEngine; }
+    // What the passenger paid for their seat on the ride, and so what
+    // cancelling refunds before any penalty
+    Money paidFare(const Ride *ride, int passengerId) const;
+
+    // Brings the user's archived rides, as captain or passenger, back into
+    // rides() until the next checkpoint, e.g. to rate one of them
+    void loadRideHistory(const User *user);
+    // The ride with this id, paged in from the archive if it was moved there
+    Ride* findRide(int id);
+
+    // Remotely this also logs the connection in; later operations act as
+    // that user whatever user they are passed
+    User* authenticate(const QString &username, const QString &password, const QString &userType);
+    Status registerPassenger(const QString &username, const QString &password);
+    Status registerCaptain(const QString &username, const QString &password,
+                           const QString &vehicleType, const QString &vehicleClass);
+    Status addBalance(User *user, double amount);
+
+    // Times are "yyyy-MM-dd hh:mm"; the return time is optional, and so are
+    // the pickup and drop-off points that rides().openRidesNear() searches
+    Status createRide(User *captain, const QString &route, const QString &departureTime,
+                      const QString &returnTime, int seats, double fare,
+                      const GeoPoint &origin = GeoPoint(), const GeoPoint &destination = GeoPoint());
+    // Repeats a ride on the weekdays in the RideSchedule mask, from the day
+    // of firstDeparture on, at its time of day. The return time, if given,
+    // keeps its distance from the departure on every day.
+    Status createSchedule(User *captain, const QString &route, const QString &firstDeparture,
+                          const QString &returnTime, int weekdays, int seats, double fare,
+                          const GeoPoint &origin = GeoPoint(), const GeoPoint &destination = GeoPoint());
+    // Stops a schedule and deletes its upcoming rides nobody has booked;
+    // booked ones stay until cancelled on their own
+    Status cancelSchedule(User *captain, int scheduleId);
+    // Charges the quoted fare, pays the captain their share and takes a
+    // seat, for the whole trip or between two of a multi-stop ride's stops
+    Status bookRide(User *passenger, Ride *ride);
+    Status bookRide(User *passenger, Ride *ride, const Ride::Leg &leg);
+    // Books many (passenger, ride) pairs at once, e.g. everything that
+    // arrived from concurrent sessions. The decisions are made in parallel
+    // by a BookingEngine and never oversell a ride; the accepted bookings
+    // are then committed in request order. Returns one status per pair.
+    QVector<Status> bookRides(const QVector<QPair<User*, Ride*>> &bookings);
+    // The same for bookings that may each be for a leg of their ride
+    QVector<Status> bookSeats(const QVector<Booking> &bookings);
+    // Fills seats for a queue of requests at once: a SeatMatcher picks a
+    // ride for each and the picks are booked as by bookRides(). Requests
+    // nothing fits get NoMatchingRide. matched, if given, receives the
+    // booked ride per request (nullptr where none was booked).
+    QVector<Status> matchRides(const QVector<SeatMatcher::Request> &requests,
+                               QVector<Ride*> *matched = nullptr);
+    // Frees the passenger's seat and refunds the fare, minus the penalty
+    // once they have used up their free cancellations
+    Status cancelBooking(User *passenger, Ride *ride, double *refund = nullptr, double *penalty = nullptr);
+    // Deletes an unbooked ride; a booked one is released and every
+    // passenger refunded, with a penalty for repeat cancellations
+    Status cancelRide(User *captain, Ride *ride);
+    Status completeRide(User *captain, Ride *ride);
+    // Rates the ride's (primary) passenger
+    Status ratePassenger(User *captain, Ride *ride, int stars);
+    // Rates the captain of a completed ride and marks it rated
+    Status rateCaptain(User *passenger, Ride *ride, int stars);
+
+signals:
+    void opened();
+    void rideChanged(const Ride *ride);
+    void rideAboutToBeRemoved(const Ride *ride);
+    // Every change made so far is on disk
+    void allChangesSaved();
+    void persistenceFailed(const QString &message);
+    // Entries just committed, in order (e.g. for a server to forward)
+    void committed(const QVector<JournalEntry> &entries);
+
+private:
+    void load();
+    void startPersisting();
+    void finishOpening();
+    void loadSnapshot();
+    void saveSnapshot();
+    // Adds the newest archived state of every ride wanted accepts (given
+    // its rides.txt record) that isn't in memory
+    void pageInArchive(const std::function<bool(const QStringList &)> &wanted);
+
+    typedef QPair<QString, QStringList> Change;     // journal op and arguments
+
+    // Appends changes to the journal as one batch and applies them to the
+    // in-memory state in order
+    void commit(const QVector<Change> &changes);
+    void commit(const QString &op, const QStringList &args) { commit({Change(op, args)}); }
+    static Change transaction(const Ledger::Transaction &transaction) {
+        return Change("TXN", Ledger::toArgs(transaction));
+    }
+    void applyJournalEntry(const JournalEntry &entry);
+    static bool isRideOperation(const QString &op);
+    void replayJournal();
+    void compactJournal();
+    void onChangesDurable(quint64 sequence);
+    void onCheckpointed(quint64 sequence);
+    Status remoteCall(const QString &op, const QStringList &args, QStringList *result = nullptr);
+    // (Re)loads the replica from the server's snapshot, which is the view
+    // of the user the connection is logged in as; called after every login
+    bool subscribe();
+    void onServerChange(const JournalEntry &entry);
+    // Creates the rides schedules have coming up within the look-ahead
+    // window and drops past ones that were never booked
+    void materializeSchedules();
+    // The fare transaction and seat for a booking the BookingEngine accepted
+    void appendBooking(QVector<Change> &changes, const Booking &booking) const;
+
+    UserDirectory userDirectory;
+    RideRepository rideRepository;
+    Ledger accounts;
+    RideSchedules rideSchedules;
+    FareEngine fareEngine;
+
+    QString journalPath;
+    QString snapshotPath;
+    QString archivePath;
+    PersistenceWorker persistence;
+    bool isOpen = false;
+    QThread *loader = nullptr;          // runs load() for openInBackground()
+    QAtomicInt loadPercent;
+    quint64 journalSequence = 0;        // last entry handed to the worker
+    quint64 checkpointSequence = 0;     // last entry covered by a queued snapshot
+    quint64 usersSnapshotSequence = 0;
+    quint64 ridesSnapshotSequence = 0;
+    QTimer compactionTimer;
+    QTimer scheduleTimer;
+    QMap<quint64, QByteArray> unsavedArchive;  // archive lines per checkpoint not yet written
+    QSet<int> historyLoaded;                   // users paged in since the last checkpoint
+
+    CarpoolClient *client = nullptr;
+    bool replicaLoaded = false;
+    QVector<JournalEntry> queuedChanges;   // pushed before the replica's snapshot was in
+};
+
+#endif // CARPOOLSERVICE_H
@@ -0,0 +1,159 @@
+#ifndef ENTITYPOOL_H
+#define ENTITYPOOL_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Slab allocator for entities (users, rides). Objects live in large chunks
+// instead of individual heap blocks: reserve() sizes a whole load with one
+// allocation and teardown frees a handful of chunks.
+//
+// Each slot carries a generation counter, so a Handle taken from an object
+// stays safe to hold (e.g. in a list widget item) after the object is
+// destroyed: get() simply returns nullptr for a stale handle, even if the
+// slot has been reused since.
+//
+// SlotSize lets one pool hold several subclasses of T (Passenger and
+// Captain in the user pool); create<U>() checks that U fits.
+template <typename T, std::size_t SlotSize = sizeof(T)>
+class EntityPool {
+public:
+    struct Handle {
+        quint32 index = 0;
+        quint32 generation = 0;     // even generations are never live
+
+        bool isNull() const { return generation == 0; }
+        bool operator==(const Handle &other) const {
+            return index == other.index && generation == other.generation;
+        }
+        bool operator!=(const Handle &other) const { return !(*this == other); }
+    };
+
+    EntityPool() {}
+    ~EntityPool() {
+        clear();
+        for (Slot *chunk : chunks) {
+            delete[] chunk;
+        }
+    }
+
+    EntityPool(const EntityPool &) = delete;
+    EntityPool &operator=(const EntityPool &) = delete;
+
+    // Makes room for capacity live objects with a single chunk allocation
+    void reserve(int capacity) {
+        int missing = capacity - (slots.size() - liveCount);
+        if (missing > 0) {
+            addChunk(missing);
+        }
+    }
+
+    template <typename U = T, typename... Args>
+    U* create(Args&&... args) {
+        static_assert(std::is_base_of<T, U>::value, "pool only holds T and its subclasses");
+        static_assert(sizeof(U) <= SlotSize, "type does not fit the pool slot");
+        static_assert(alignof(U) <= alignof(std::max_align_t), "over-aligned type");
+
+        if (freeSlots.isEmpty()) {
+            addChunk(qMax(MinChunkSize, int(slots.size())));
+        }
+
+        quint32 index = freeSlots.takeLast();
+        Slot *slot = slots[index];
+        U *object = new (slot->storage) U(std::forward<Args>(args)...);
+        // Slots are found from object pointers, so T must sit at the start
+        Q_ASSERT(static_cast<void*>(static_cast<T*>(object)) == static_cast<void*>(slot->storage));
+
+        generations[index]++;
+        liveCount++;
+        return object;
+    }
+
+    void destroy(T *object) {
+        if (!object) return;
+
+        quint32 index = slotOf(object)->index;
+        object->~T();
+        generations[index]++;
+        freeSlots.append(index);
+        liveCount--;
+    }
+
+    Handle handleOf(const T *object) const {
+        Handle handle;
+        if (object) {
+            handle.index = slotOf(object)->index;
+            handle.generation = generations[handle.index];
+        }
+        return handle;
+    }
+
+    T* get(const Handle &handle) const {
+        if (handle.isNull() || handle.index >= quint32(generations.size()) ||
+            generations[handle.index] != handle.generation) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(slots[handle.index]->storage);
+    }
+
+    // Destroys every live object; the chunks are kept for reuse
+    void clear() {
+        for (int i = 0; i < slots.size(); i++) {
+            if (generations[i] & 1) {
+                reinterpret_cast<T*>(slots[i]->storage)->~T();
+                generations[i]++;
+            }
+        }
+        freeSlots.clear();
+        for (int i = slots.size() - 1; i >= 0; i--) {
+            freeSlots.append(i);
+        }
+        liveCount = 0;
+    }
+
+    int size() const { return liveCount; }
+    int capacity() const { return slots.size(); }
+
+private:
+    static constexpr int MinChunkSize = 256;
+
+    struct Slot {
+        alignas(std::max_align_t) unsigned char storage[SlotSize];
+        quint32 index;
+    };
+
+    static const Slot *slotOf(const T *object) {
+        return reinterpret_cast<const Slot*>(object);
+    }
+
+    void addChunk(int count) {
+        Slot *chunk = new Slot[count];
+        chunks.append(chunk);
+
+        int first = slots.size();
+        slots.reserve(first + count);
+        generations.reserve(first + count);
+        freeSlots.reserve(freeSlots.size() + count);
+        for (int i = 0; i < count; i++) {
+            chunk[i].index = first + i;
+            slots.append(&chunk[i]);
+            generations.append(0);
+        }
+        // Hand out low indexes first
+        for (int i = count - 1; i >= 0; i--) {
+            freeSlots.append(first + i);
+        }
+    }
+
+    QVector<Slot*> chunks;
+    QVector<Slot*> slots;
+    QVector<quint32> generations;   // odd while the slot holds a live object
+    QVector<quint32> freeSlots;
+    int liveCount = 0;
+};
+
+#endif // ENTITYPOOL_H
@@ -0,0 +1,130 @@
+#include "fareengine.h"
+#include "metrics.h"
+
+namespace {
+struct Factor {
+    const char *name;
+    double factor;
+};
+
+// Vehicles the app offers; any other type or class prices as 1
+const Factor VehicleTypeFactors[] = {{"Bike", 0.6}, {"Car", 1.0}, {"Van", 1.3}};
+const Factor VehicleClassFactors[] = {{"Non-AC", 1.0}, {"AC", 1.2}, {"Economy", 1.0},
+                                      {"Standard", 1.1}, {"Luxury", 1.5}};
+
+// Departures in the commuting peaks and at night cost more
+const double PeakHourFactor = 1.25;
+const double NightHourFactor = 1.1;
+}
+
+FareEngine::FareEngine()
+{
+    for (const Factor &type : VehicleTypeFactors) {
+        vehicleTypeFactors.insert(internString(type.name), type.factor);
+    }
+    for (const Factor &vehicleClass : VehicleClassFactors) {
+        vehicleClassFactors.insert(internString(vehicleClass.name), vehicleClass.factor);
+    }
+
+    for (int hour = 0; hour < 25; hour++) {
+        hourFactors[hour] = 1.0;
+    }
+    for (int hour : {7, 8, 9, 17, 18, 19}) {
+        hourFactors[hour] = PeakHourFactor;
+    }
+    for (int hour : {22, 23, 0, 1, 2, 3, 4, 5}) {
+        hourFactors[hour] = NightHourFactor;
+    }
+}
+
+Money FareEngine::quote(const Ride *ride) const
+{
+    const Inputs inputs = inputsOf(ride);
+    Money fare = 0;
+    compute(&inputs.askingFare, &inputs.distanceKm, &inputs.vehicleFactor, &inputs.hourFactor,
+            &inputs.load, 1, &fare);
+    return fare;
+}
+
+Money FareEngine::quote(const Ride *ride, const Ride::Leg &leg) const
+{
+    return legShare(quote(ride), ride, leg);
+}
+
+void FareEngine::quote(const QVector<const Ride*> &rides, QVector<Money> *fares) const
+{
+    Metrics::Timer timer(Metrics::FareBatchNs);
+    const int count = rides.size();
+    Metrics::count(Metrics::FaresQuoted, count);
+    QVector<double> askingFare(count);
+    QVector<double> distanceKm(count);
+    QVector<double> vehicleFactor(count);
+    QVector<double> hourFactor(count);
+    QVector<double> load(count);
+
+    // Gathering chases each ride's pointers once; compute() then only
+    // streams through the columns
+    double *asking = askingFare.data();
+    double *distance = distanceKm.data();
+    double *vehicle = vehicleFactor.data();
+    double *hour = hourFactor.data();
+    double *taken = load.data();
+    for (int i = 0; i < count; i++) {
+        const Inputs inputs = inputsOf(rides[i]);
+        asking[i] = inputs.askingFare;
+        distance[i] = inputs.distanceKm;
+        vehicle[i] = inputs.vehicleFactor;
+        hour[i] = inputs.hourFactor;
+        taken[i] = inputs.load;
+    }
+
+    fares->resize(count);
+    compute(asking, distance, vehicle, hour, taken, count, fares->data());
+}
+
+Money FareEngine::legShare(Money wholeTrip, const Ride *ride, const Ride::Leg &leg)
+{
+    if (leg == ride->wholeTrip()) return wholeTrip;
+    return qRound64(double(wholeTrip) * (leg.to - leg.from) / ride->getSegmentCount());
+}
+
+FareEngine::Inputs FareEngine::inputsOf(const Ride *ride) const
+{
+    Inputs inputs;
+    inputs.askingFare = ride->getFare();
+
+    const GeoPoint &origin = ride->getOrigin();
+    const GeoPoint &destination = ride->getDestination();
+    inputs.distanceKm = origin.isValid() && destination.isValid()
+                            ? GeoPoint::distance(origin, destination) / 1000.0 * RoadFactor
+                            : 0.0;
+
+    inputs.vehicleFactor = vehicleTypeFactors.value(ride->getVehicleTypeId(), 1.0) *
+                           vehicleClassFactors.value(ride->getVehicleClassId(), 1.0);
+
+    const qint64 departure = ride->getDepartureEpoch();
+    const int hour = departure == Ride::NoTime ? 24 : int((departure % 86400 + 86400) % 86400 / 3600);
+    inputs.hourFactor = hourFactors[hour];
+
+    const int seats = ride->getTotalSeats();
+    inputs.load = seats > 0 ? qBound(0.0, double(ride->getPeakOccupancy()) / seats, 1.0) : 0.0;
+    return inputs;
+}
+
+void FareEngine::compute(const double *askingFare, const double *distanceKm, const double *vehicleFactor,
+                         const double *hourFactor, const double *load, int count, Money *fares)
+{
+    // Selects instead of branches, so every iteration is the same
+    // arithmetic and the loop vectorizes
+    for (int i = 0; i < count; i++) {
+        const double byDistance = distanceKm[i] > 0.0
+                                      ? (FlagFallRupees + PerKmRupees * distanceKm[i]) * vehicleFactor[i]
+                                      : 0.0;
+        const double base = askingFare[i] > byDistance ? askingFare[i] : byDistance;
+        double fare = base * hourFactor[i] * (1.0 + Surge * load[i] * load[i]);
+        // A negative or NaN fare becomes 0, a huge one the cap
+        fare = fare > 0.0 ? fare : 0.0;
+        fare = fare < MaxFareRupees ? fare : MaxFareRupees;
+        fares[i] = Money(fare * 100.0 + 0.5);
+    }
+}
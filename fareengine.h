@@ -0,0 +1,71 @@
+#ifndef FAREENGINE_H
+#define FAREENGINE_H
+
+#include <QHash>
+#include <QVector>
+#include "money.h"
+#include "ride.h"
+
+// Prices a seat from the ride's distance, vehicle, time of day and how full
+// it is. The captain's fare is the asking price and the floor: a ride long
+// enough that the distance rate comes to more is priced by distance, and
+// the result is raised at peak hours and as the seats fill up.
+//
+//   base  = max(captain's fare, (FlagFall + PerKm * road km) * vehicle)
+//   fare  = base * hour factor * (1 + Surge * load^2), to the paisa
+//
+// where road km is the pickup to drop-off distance times RoadFactor (0
+// without both points), vehicle the type and class factors multiplied,
+// and load the busiest segment's seats taken over the total.
+//
+// Prices are computed in batches. quote() for a list gathers each ride's
+// inputs into one double column per factor (structure of arrays), looking
+// the vehicle and hour factors up in tables built once; a single loop over
+// the columns then computes every fare with no branches or calls, which the
+// compiler vectorizes. A single quote runs the same loop over one ride, so
+// the list and the booking agree to the paisa. Doubles keep a captain's
+// asking fare exact to the paisa, and a fare is capped at MaxFareRupees so
+// rounding it into Money can't overflow.
+//
+// The tables are only read after construction, so one engine can quote
+// from any number of threads while the rides don't change.
+class FareEngine {
+public:
+    static constexpr double FlagFallRupees = 50.0;
+    static constexpr double PerKmRupees = 12.0;
+    static constexpr double RoadFactor = 1.3;       // road distance over straight-line distance
+    static constexpr double Surge = 0.5;            // extra at a full ride, as a fraction
+    static constexpr double MaxFareRupees = 1e9;
+
+    FareEngine();
+
+    // The fare for a seat for the whole trip, or a leg's share of it
+    Money quote(const Ride *ride) const;
+    Money quote(const Ride *ride, const Ride::Leg &leg) const;
+    // Whole-trip fares for every ride in one pass; fares gets one per ride
+    void quote(const QVector<const Ride*> &rides, QVector<Money> *fares) const;
+
+    // A leg's share of a whole-trip fare: split evenly over the segments
+    static Money legShare(Money wholeTrip, const Ride *ride, const Ride::Leg &leg);
+
+private:
+    // A ride's pricing inputs; a batch keeps each field in its own column
+    struct Inputs {
+        double askingFare;
+        double distanceKm;
+        double vehicleFactor;
+        double hourFactor;
+        double load;
+    };
+
+    Inputs inputsOf(const Ride *ride) const;
+    // fares[i] = the fare for the inputs at index i of each column
+    static void compute(const double *askingFare, const double *distanceKm, const double *vehicleFactor,
+                        const double *hourFactor, const double *load, int count, Money *fares);
+
+    QHash<int, double> vehicleTypeFactors;      // StringPool id -> factor; 1 if absent
+    QHash<int, double> vehicleClassFactors;
+    double hourFactors[25];                      // by departure hour; [24] without a time
+};
+
+#endif // FAREENGINE_H
@@ -0,0 +1,54 @@
+#include "gazetteer.h"
+#include <QFile>
+#include <QTextStream>
+
+bool Gazetteer::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+
+    places.clear();
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        // Names may contain commas; the coordinates are the last two fields
+        const int lonComma = line.lastIndexOf(',');
+        const int latComma = lonComma > 0 ? line.lastIndexOf(',', lonComma - 1) : -1;
+        if (latComma <= 0) continue;
+
+        const QString name = line.left(latComma).trimmed();
+        bool latitudeOk = false;
+        bool longitudeOk = false;
+        double latitude = line.mid(latComma + 1, lonComma - latComma - 1).toDouble(&latitudeOk);
+        double longitude = line.mid(lonComma + 1).toDouble(&longitudeOk);
+        GeoPoint point = latitudeOk && longitudeOk ? GeoPoint::fromDegrees(latitude, longitude) : GeoPoint();
+        if (!name.isEmpty() && point.isValid()) {
+            places.insert(name.toLower(), qMakePair(name, point));
+        }
+    }
+    return true;
+}
+
+GeoPoint Gazetteer::find(const QString &name) const
+{
+    return places.value(name.trimmed().toLower()).second;
+}
+
+GeoPoint Gazetteer::resolve(const QString &text) const
+{
+    GeoPoint point = find(text);
+    return point.isValid() ? point : GeoPoint::fromText(text);
+}
+
+QStringList Gazetteer::names() const
+{
+    QStringList result;
+    result.reserve(places.size());
+    for (const auto &place : places) {
+        result.append(place.first);
+    }
+    result.sort(Qt::CaseInsensitive);
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef GAZETTEER_H
+#define GAZETTEER_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include "geopoint.h"
+
+// Named places read from a local text file (places.txt), one
+// "<name>,<latitude>,<longitude>" line each; blank lines and lines starting
+// with '#' are skipped. Lets pickup and drop-off points be picked by name
+// instead of typed as coordinates.
+class Gazetteer {
+public:
+    static QString defaultPath() { return "places.txt"; }
+
+    // Replaces the places with the file's; false if it can't be read
+    bool load(const QString &path = defaultPath());
+
+    // Case-insensitive; an invalid point for an unknown name
+    GeoPoint find(const QString &name) const;
+    // A place name, or coordinates as GeoPoint::fromText() reads them
+    GeoPoint resolve(const QString &text) const;
+    // Names as written in the file, sorted
+    QStringList names() const;
+    int size() const { return places.size(); }
+
+private:
+    QHash<QString, QPair<QString, GeoPoint>> places;    // lower-cased name -> (name, point)
+};
+
+#endif // GAZETTEER_H
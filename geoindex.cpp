@@ -0,0 +1,106 @@
+#include "geoindex.h"
+#include <QPair>
+#include <algorithm>
+#include <cmath>
+
+int GeoIndex::rowOf(qint32 latitudeE6)
+{
+    // Floor division, so cells don't double up around the equator
+    return int(std::floor(double(latitudeE6) / CellMicrodegrees));
+}
+
+int GeoIndex::columnOf(qint32 longitudeE6)
+{
+    int column = int(std::floor((double(longitudeE6) + 180 * 1000000.0) / CellMicrodegrees));
+    return ((column % ColumnCount) + ColumnCount) % ColumnCount;
+}
+
+void GeoIndex::insert(int rideId, const GeoPoint &origin, const GeoPoint &destination)
+{
+    if (!origin.isValid()) return;
+    cells[cellKey(rowOf(origin.latitudeE6), columnOf(origin.longitudeE6))].append({rideId, origin, destination});
+    count++;
+}
+
+void GeoIndex::remove(int rideId, const GeoPoint &origin)
+{
+    if (!origin.isValid()) return;
+
+    auto it = cells.find(cellKey(rowOf(origin.latitudeE6), columnOf(origin.longitudeE6)));
+    if (it == cells.end()) return;
+
+    // Cells hold a handful of rides; order within one doesn't matter
+    QVector<Entry> &entries = *it;
+    for (int i = 0; i < entries.size(); i++) {
+        if (entries[i].rideId == rideId) {
+            entries[i] = entries.last();
+            entries.removeLast();
+            count--;
+            break;
+        }
+    }
+    if (entries.isEmpty()) {
+        cells.erase(it);
+    }
+}
+
+void GeoIndex::clear()
+{
+    cells.clear();
+    count = 0;
+}
+
+QVector<int> GeoIndex::search(const GeoPoint &origin, const GeoPoint &destination, double radiusMetres) const
+{
+    QVector<int> result;
+    if (!origin.isValid() || !(radiusMetres >= 0) || cells.isEmpty()) return result;
+
+    // The cell range covering a square around origin; a degree of longitude
+    // is cos(latitude) times shorter, measured at the edge nearest a pole
+    const double latitudeSpan = radiusMetres / GeoPoint::MetresPerDegree;
+    const double farthestLatitude = qMin(89.0, std::fabs(origin.latitude()) + latitudeSpan);
+    const double longitudeSpan = latitudeSpan / std::cos(farthestLatitude * GeoPoint::RadiansPerDegree);
+
+    const int firstRow = rowOf(qint32(qMax(-90.0, origin.latitude() - latitudeSpan) * 1e6));
+    const int lastRow = rowOf(qint32(qMin(90.0, origin.latitude() + latitudeSpan) * 1e6));
+    const int columnSpan = int(std::ceil(longitudeSpan * 1e6 / CellMicrodegrees));
+    const int columns = qMin(ColumnCount, 2 * columnSpan + 1);
+    const int firstColumn = columnOf(origin.longitudeE6) - (columns == ColumnCount ? 0 : columnSpan);
+
+    QVector<QPair<double, int>> found;     // (origin distance, ride id)
+    auto check = [&](const QVector<Entry> &entries) {
+        for (const Entry &entry : entries) {
+            double distance = GeoPoint::distance(origin, entry.origin);
+            if (distance > radiusMetres) continue;
+            if (destination.isValid() &&
+                (!entry.destination.isValid() || GeoPoint::distance(destination, entry.destination) > radiusMetres)) {
+                continue;
+            }
+            found.append(qMakePair(distance, entry.rideId));
+        }
+    };
+
+    if (qint64(lastRow - firstRow + 1) * columns > cells.size()) {
+        // A radius wider than the occupied cells: walking them all is cheaper
+        for (const QVector<Entry> &entries : cells) {
+            check(entries);
+        }
+    } else {
+        for (int row = firstRow; row <= lastRow; row++) {
+            for (int c = 0; c < columns; c++) {
+                int column = ((firstColumn + c) % ColumnCount + ColumnCount) % ColumnCount;
+                auto it = cells.constFind(cellKey(row, column));
+                if (it != cells.constEnd()) {
+                    check(*it);
+                }
+            }
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    result.reserve(found.size());
+    for (const auto &hit : found) {
+        result.append(hit.second);
+    }
+    return result;
+}
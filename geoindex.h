@@ -0,0 +1,44 @@
+#ifndef GEOINDEX_H
+#define GEOINDEX_H
+
+#include <QHash>
+#include <QVector>
+#include "geopoint.h"
+
+// Uniform grid over ride pickup points. Each cell is CellMicrodegrees of
+// latitude by as much longitude and lists the rides whose origin falls in
+// it, together with both endpoints, so a radius query visits the few cells
+// the radius touches and checks distances without looking the rides up.
+// Longitude cells shrink towards the poles, so the query widens its column
+// range by the latitude; columns wrap at the antimeridian.
+class GeoIndex {
+public:
+    static constexpr qint32 CellMicrodegrees = 10000;    // 0.01 degrees, about 1.1 km of latitude
+
+    void insert(int rideId, const GeoPoint &origin, const GeoPoint &destination);
+    void remove(int rideId, const GeoPoint &origin);
+    void clear();
+    int size() const { return count; }
+
+    // Ride ids whose origin is within radiusMetres of origin and, when
+    // destination is valid, whose destination is within radiusMetres of
+    // destination too. Nearest origin first, ties by ride id.
+    QVector<int> search(const GeoPoint &origin, const GeoPoint &destination, double radiusMetres) const;
+
+private:
+    struct Entry {
+        int rideId;
+        GeoPoint origin;
+        GeoPoint destination;
+    };
+    static constexpr int ColumnCount = 360 * 1000000 / CellMicrodegrees;
+
+    static int rowOf(qint32 latitudeE6);
+    static int columnOf(qint32 longitudeE6);
+    static quint64 cellKey(int row, int column) { return (quint64(quint32(row)) << 32) | quint32(column); }
+
+    QHash<quint64, QVector<Entry>> cells;
+    int count = 0;
+};
+
+#endif // GEOINDEX_H
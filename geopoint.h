@@ -0,0 +1,72 @@
+#ifndef GEOPOINT_H
+#define GEOPOINT_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+#include <cmath>
+#include <limits>
+
+// A latitude/longitude in whole microdegrees (about 11 cm), so points
+// compare exactly and round-trip through the "lat;lon" text form used in
+// rides.txt and the journal. A default-constructed point is "no location".
+struct GeoPoint {
+    static const qint32 NoCoordinate = std::numeric_limits<qint32>::min();
+    static constexpr double EarthRadiusMetres = 6371000.0;
+    static constexpr double RadiansPerDegree = 3.14159265358979323846 / 180.0;
+    static constexpr double MetresPerDegree = EarthRadiusMetres * RadiansPerDegree;    // of latitude
+
+    qint32 latitudeE6 = NoCoordinate;
+    qint32 longitudeE6 = NoCoordinate;
+
+    GeoPoint() {}
+    GeoPoint(qint32 latitudeE6, qint32 longitudeE6) : latitudeE6(latitudeE6), longitudeE6(longitudeE6) {}
+
+    // Out of range degrees give an invalid point
+    static GeoPoint fromDegrees(double latitude, double longitude) {
+        if (!(latitude >= -90 && latitude <= 90 && longitude >= -180 && longitude <= 180)) {
+            return GeoPoint();
+        }
+        return GeoPoint(qint32(std::lround(latitude * 1e6)), qint32(std::lround(longitude * 1e6)));
+    }
+
+    bool isValid() const { return latitudeE6 != NoCoordinate; }
+    double latitude() const { return latitudeE6 / 1e6; }
+    double longitude() const { return longitudeE6 / 1e6; }
+
+    bool operator==(const GeoPoint &other) const {
+        return latitudeE6 == other.latitudeE6 && longitudeE6 == other.longitudeE6;
+    }
+    bool operator!=(const GeoPoint &other) const { return !(*this == other); }
+
+    // "12.971600;77.594600", or "" for no location
+    QString toText() const {
+        if (!isValid()) return QString();
+        return QString::number(latitude(), 'f', 6) + ";" + QString::number(longitude(), 'f', 6);
+    }
+    // Reads toText()'s form; as typed by a user the two numbers may also be
+    // separated by a comma or spaces. Anything else is no location.
+    static GeoPoint fromText(const QString &text) {
+        static const QRegularExpression separator("\\s*[;,]\\s*|\\s+");
+        const QStringList parts = text.trimmed().split(separator);
+        if (parts.size() != 2) return GeoPoint();
+        bool latitudeOk = false;
+        bool longitudeOk = false;
+        double latitude = parts[0].toDouble(&latitudeOk);
+        double longitude = parts[1].toDouble(&longitudeOk);
+        return latitudeOk && longitudeOk ? fromDegrees(latitude, longitude) : GeoPoint();
+    }
+
+    // Great-circle distance in metres (haversine)
+    static double distance(const GeoPoint &a, const GeoPoint &b) {
+        double dLat = (b.latitude() - a.latitude()) * RadiansPerDegree;
+        double dLon = (b.longitude() - a.longitude()) * RadiansPerDegree;
+        double h = std::sin(dLat / 2) * std::sin(dLat / 2) +
+                   std::cos(a.latitude() * RadiansPerDegree) * std::cos(b.latitude() * RadiansPerDegree) *
+                   std::sin(dLon / 2) * std::sin(dLon / 2);
+        return 2 * EarthRadiusMetres * std::asin(std::sqrt(qMin(1.0, h)));
+    }
+};
+
+#endif // GEOPOINT_H
@@ -0,0 +1,135 @@
+#include "journal.h"
+#include <QDebug>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+bool syncToDisk(QFile &file)
+{
+    if (!file.flush()) return false;
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+}
+
+Journal::Journal(const QString &path) : path(path), file(path) {}
+
+Journal::~Journal()
+{
+    close();
+}
+
+bool Journal::open()
+{
+    if (file.isOpen()) return true;
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Cannot open journal" << path << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void Journal::close()
+{
+    if (file.isOpen()) {
+        file.flush();
+        file.close();
+    }
+}
+
+bool Journal::write(const QByteArray &lines)
+{
+    if (!open()) return false;
+
+    if (file.write(lines) != lines.size() || !syncToDisk(file)) {
+        qWarning() << "Journal write failed" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool Journal::truncate()
+{
+    if (!open()) return false;
+    return file.resize(0) && file.seek(0);
+}
+
+QByteArray Journal::format(quint64 sequence, const QString &op, const QStringList &args)
+{
+    QString line = QString::number(sequence) + "," + op;
+    for (const QString &arg : args) {
+        line += "," + arg;
+    }
+    line += "\n";
+    return line.toUtf8();
+}
+
+QList<JournalEntry> Journal::readAll(const QString &path)
+{
+    QList<JournalEntry> entries;
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return entries;
+    }
+
+    while (!in.atEnd()) {
+        QByteArray raw = in.readLine();
+        if (!raw.endsWith('\n')) {
+            break; // torn write at the tail
+        }
+        JournalEntry entry;
+        if (parse(raw.chopped(1), &entry)) {
+            entries.append(entry);
+        }
+    }
+    return entries;
+}
+
+quint64 Journal::lastSequence(const QString &path)
+{
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    // Entries are short, so a few KB from the end nearly always hold the
+    // last complete one; anything after the last newline is a torn write
+    const qint64 size = in.size();
+    for (qint64 tail = 4096; ; tail *= 2) {
+        const qint64 from = qMax<qint64>(0, size - tail);
+        if (!in.seek(from)) return 0;
+        const QByteArray data = in.read(size - from);
+
+        int end = data.lastIndexOf('\n');
+        while (end >= 0) {
+            int start = end > 0 ? data.lastIndexOf('\n', end - 1) + 1 : 0;
+            // The line may begin before the part read
+            if (start == 0 && from > 0) break;
+            JournalEntry entry;
+            if (parse(data.mid(start, end - start), &entry)) {
+                return entry.sequence;
+            }
+            end = start - 1;
+        }
+        if (from == 0) return 0;
+    }
+}
+
+bool Journal::parse(const QByteArray &line, JournalEntry *entry)
+{
+    QStringList parts = QString::fromUtf8(line).split(",");
+    if (parts.size() < 2) return false;
+
+    bool ok = false;
+    entry->sequence = parts[0].toULongLong(&ok);
+    if (!ok) return false;
+    entry->op = parts[1];
+    entry->args = parts.mid(2);
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// One replayable change, e.g. "BALANCE passenger ali 500" or "BOOK 12 ali"
+struct JournalEntry {
+    quint64 sequence = 0;
+    QString op;
+    QStringList args;
+};
+
+// Append-only operation log kept next to the snapshot file. Every state
+// change is appended as a single line instead of rewriting the snapshot;
+// startup replays the entries newer than the snapshot and checkpoints fold
+// them back into a fresh snapshot. Writing happens on the persistence
+// worker thread, which is the only user of an open Journal.
+class Journal {
+public:
+    explicit Journal(const QString &path);
+    ~Journal();
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    bool open();
+    void close();
+    QString filePath() const { return path; }
+
+    // Appends already formatted lines and forces them to disk
+    bool write(const QByteArray &lines);
+    // Empties the journal once everything in it is part of a snapshot
+    bool truncate();
+
+    // "seq,OP,arg1,arg2...\n"
+    static QByteArray format(quint64 sequence, const QString &op, const QStringList &args);
+    // Parses one line without its newline; false if it isn't an entry
+    static bool parse(const QByteArray &line, JournalEntry *entry);
+
+    // Reads every complete entry in the file; a torn final line left by a
+    // crash is ignored
+    static QList<JournalEntry> readAll(const QString &path);
+    // Sequence of the last complete entry in the file, 0 if there is none;
+    // reads only as much of the tail as it needs
+    static quint64 lastSequence(const QString &path);
+
+private:
+    QString path;
+    QFile file;
+};
+
+#endif // JOURNAL_H
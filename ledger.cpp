@@ -0,0 +1,82 @@
+#include "ledger.h"
+
+bool Ledger::Transaction::isBalanced() const
+{
+    Money sum = 0;
+    for (const Posting &posting : postings) {
+        sum += posting.amount;
+    }
+    return !postings.isEmpty() && sum == 0;
+}
+
+bool Ledger::apply(const Transaction &transaction)
+{
+    if (!transaction.isBalanced()) return false;
+
+    // Resolve every account first so a bad posting can't half-apply
+    QVector<User*> owners(transaction.postings.size(), nullptr);
+    for (int i = 0; i < transaction.postings.size(); i++) {
+        const QString &account = transaction.postings[i].account;
+        if (isUserAccount(account)) {
+            owners[i] = userFor(account);
+            if (!owners[i]) return false;
+        }
+    }
+
+    for (int i = 0; i < transaction.postings.size(); i++) {
+        const Posting &posting = transaction.postings[i];
+        if (owners[i]) {
+            owners[i]->adjustBalance(posting.amount);
+        } else {
+            system[posting.account] += posting.amount;
+        }
+    }
+    return true;
+}
+
+Money Ledger::balance(const QString &account) const
+{
+    if (isUserAccount(account)) {
+        User* user = userFor(account);
+        return user ? user->getBalanceMinor() : 0;
+    }
+    return system.value(account, 0);
+}
+
+QStringList Ledger::toArgs(const Transaction &transaction)
+{
+    QStringList args;
+    args.reserve(1 + 2 * transaction.postings.size());
+    args.append(transaction.kind);
+    for (const Posting &posting : transaction.postings) {
+        args.append(posting.account);
+        args.append(QString::number(posting.amount));
+    }
+    return args;
+}
+
+bool Ledger::fromArgs(const QStringList &args, Transaction *transaction)
+{
+    if (args.size() < 3 || args.size() % 2 != 1) return false;
+
+    transaction->kind = args[0];
+    transaction->postings.clear();
+    for (int i = 1; i + 1 < args.size(); i += 2) {
+        bool ok = false;
+        Money amount = args[i + 1].toLongLong(&ok);
+        if (!ok) return false;
+        transaction->post(args[i], amount);
+    }
+    return true;
+}
+
+bool Ledger::isUserAccount(const QString &account)
+{
+    return account.startsWith("passenger:") || account.startsWith("captain:");
+}
+
+User* Ledger::userFor(const QString &account) const
+{
+    int separator = account.indexOf(':');
+    return users.find(account.mid(separator + 1), account.left(separator));
+}
@@ -0,0 +1,74 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "money.h"
+#include "userdirectory.h"
+
+// Double-entry ledger for every movement of money. A transaction is a set of
+// postings to named accounts that sums to zero, so money is only ever moved,
+// never created or lost: a booking debits the passenger and credits the
+// captain and the platform fee account, a top-up is funded by the external
+// deposits account, and so on.
+//
+// Accounts are "<user type>:<username>" for users and "platform:..." /
+// "external:..." for the system accounts. Running totals are materialized:
+// a user's total is their User balance, system totals live in the ledger,
+// so reading any balance is O(1). Transactions reach the journal as TXN
+// entries; the persistence worker archives them into the audit log before
+// a checkpoint empties the journal.
+class Ledger {
+public:
+    struct Posting {
+        QString account;
+        Money amount;       // positive credits the account, negative debits it
+    };
+
+    struct Transaction {
+        QString kind;       // "topup", "fare", "refund", "penalty"
+        QVector<Posting> postings;
+
+        void post(const QString &account, Money amount) { postings.append({account, amount}); }
+        bool isBalanced() const;
+    };
+
+    static QString userAccount(const QString &userType, const QString &username) {
+        return userType + ":" + username;
+    }
+    static QString platformFees() { return "platform:fees"; }
+    static QString platformPenalties() { return "platform:penalties"; }
+    // Refunds the platform pays out itself, e.g. when a captain cancels
+    static QString platformRefunds() { return "platform:refunds"; }
+    // Money paid in from outside (balance top-ups)
+    static QString deposits() { return "external:deposits"; }
+    // Every account a replica's user may not see, folded into one so the
+    // transactions it is sent still balance
+    static QString others() { return "external:others"; }
+
+    explicit Ledger(UserDirectory &users) : users(users) {}
+
+    // Applies a balanced transaction whose accounts all exist; anything
+    // else is rejected as a whole and leaves every balance untouched
+    bool apply(const Transaction &transaction);
+
+    Money balance(const QString &account) const;
+    const QHash<QString, Money> &systemBalances() const { return system; }
+    void restoreSystemBalance(const QString &account, Money amount) { system.insert(account, amount); }
+    void clear() { system.clear(); }
+
+    // TXN journal arguments: kind, then account/amount pairs
+    static QStringList toArgs(const Transaction &transaction);
+    static bool fromArgs(const QStringList &args, Transaction *transaction);
+
+private:
+    static bool isUserAccount(const QString &account);
+    User* userFor(const QString &account) const;
+
+    UserDirectory &users;
+    QHash<QString, Money> system;
+};
+
+#endif // LEDGER_H
@@ -1,9 +1,19 @@
 #include "mainwindow.h"
+#include "snapshot.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // Offline conversion between carpool.dat and users.txt/rides.txt
+    if (a.arguments().contains("--export-text")) {
+        return Snapshot::exportText(Snapshot::defaultPath(), "users.txt", "rides.txt") ? 0 : 1;
+    }
+    if (a.arguments().contains("--import-text")) {
+        return Snapshot::importText("users.txt", "rides.txt", Snapshot::defaultPath()) ? 0 : 1;
+    }
+
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,18 +1,62 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "snapshot.h"
+#include "carpoolserver.h"
+#include "metrics.h"
+#include <QApplication>
+#include <QCompleter>
 #include <QInputDialog>
-#include <QDebug>
-#include <QDateTime>
+#include <QProgressBar>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
-#include <windows.h>
+#include <algorithm>
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , service("journal.txt", Snapshot::defaultPath())
 {
     ui->setupUi(this);
-    loadUsers();
-    loadRides();
+    setupRideLists();
+
+    // Pickup and drop-off points can be picked by name from places.txt
+    places.load();
+    for (QLineEdit *edit : {ui->pickupEdit, ui->dropoffEdit}) {
+        QCompleter *completer = new QCompleter(places.names(), edit);
+        completer->setCaseSensitivity(Qt::CaseInsensitive);
+        edit->setCompleter(completer);
+    }
+
+    connect(&service, &CarpoolService::rideChanged, this, &MainWindow::notifyRideChanged);
+    connect(&service, &CarpoolService::rideAboutToBeRemoved, this, &MainWindow::notifyRideRemoved);
+    connect(&service, &CarpoolService::allChangesSaved, this, [this]() {
+        statusBar()->showMessage("All changes saved", 2000);
+    });
+    connect(&service, &CarpoolService::persistenceFailed, this, &MainWindow::onPersistenceFailed);
+    // Share a running carpool server's data; without one this window owns the files
+    if (service.connectToServer(CarpoolServer::defaultName())) {
+        statusBar()->showMessage("Connected to the carpool server", 2000);
+    } else {
+        // The window is usable once the data is in; until then it shows
+        // how far loading has got
+        loadProgressBar = new QProgressBar(this);
+        loadProgressBar->setRange(0, 100);
+        loadProgressBar->setMaximumWidth(200);
+        statusBar()->addPermanentWidget(loadProgressBar);
+        statusBar()->showMessage("Loading carpool data...");
+        ui->stackedWidget->setEnabled(false);
+
+        connect(&loadProgressTimer, &QTimer::timeout, this, [this]() {
+            loadProgressBar->setValue(service.loadProgress());
+        });
+        loadProgressTimer.start(100);
+        connect(&service, &CarpoolService::opened, this, &MainWindow::onServiceOpened);
+        service.openInBackground();
+
+        // A connected window's work happens in the server, which reports it
+        MetricsReporter *metrics = new MetricsReporter(MetricsReporter::defaultPath(), this);
+        metrics->start();
+    }
 
     // Set initial page
     ui->stackedWidget->setCurrentIndex(0);
@@ -20,145 +64,37 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
-    saveUsers();
-    saveRides();
+    // Writes a final snapshot and waits for the persistence thread
+    service.close();
 
-    // Clean up memory
-    for (User* user : users) {
-        delete user;
-    }
-    for (Ride* ride : rides) {
-        delete ride;
-    }
+    // The service frees the users and rides it owns; empty the list models
+    // first since they outlive it as child objects
+    clearRideLists();
 
     delete ui;
 }
 
-void MainWindow::loadUsers() {
-    QFile file("users.txt");
-    if (file.open(QIODevice::ReadOnly)) {
-        QTextStream in(&file);
-        while (!in.atEnd()) {
-            QString line = in.readLine();
-            QStringList parts = line.split(",");
-            if (parts.size() >= 7) {
-                QString type = parts[0];
-                QString username = parts[1];
-                QString password = parts[2];
-                double balance = parts[3].toDouble();
-                int cancelCount = parts[4].toInt();
-                float rating = parts[5].toFloat();
-                int ratingCount = parts[6].toInt();
-
-                User* user = nullptr;
-                if (type == "Passenger") {
-                    user = new Passenger(username, password);
-                } else if (type == "Captain" && parts.size() >= 9) {
-                    QString vehicleType = parts[7];
-                    QString vehicleClass = parts[8];
-                    user = new Captain(username, password, vehicleType, vehicleClass);
-                }
-
-                if (user) {
-                    user->addBalance(balance);
-                    for (int i = 0; i < cancelCount; i++) user->incrementCancelCount();
-                    for (int i = 0; i < ratingCount; i++) user->addRating(rating);
-                    users.append(user);
-                }
-            }
-        }
-        file.close();
-    }
-}
-
-void MainWindow::loadRides() {
-    QFile file("rides.txt");
-    if (file.open(QIODevice::ReadOnly)) {
-        QTextStream in(&file);
-        while (!in.atEnd()) {
-            QString line = in.readLine();
-            QStringList parts = line.split(",");
-            if (parts.size() >= 13) {
-                QString captain = parts[0];
-                QString passenger = parts[1];
-                QString route = parts[2];
-                QString depTime = parts[3];
-                QString retTime = parts[4];
-                QString vType = parts[5];
-                QString vClass = parts[6];
-                int totalSeats = parts[7].toInt();
-                int occupiedSeats = parts[8].toInt();
-                bool completed = parts[9] == "1";
-                double fare = parts[10].toDouble();
-                bool isRated = parts[11] == "1";
-                QString passengersStr = parts[12];
-                QStringList passengers = passengersStr.split(";");
-
-                Ride* ride = new Ride(captain, passenger, route, depTime, retTime,
-                                      vType, vClass, totalSeats, fare);
-                ride->setOccupiedSeats(occupiedSeats);
-                ride->setIsCompleted(completed);
-                rides.append(ride);
-                ride->setIsRated(isRated);
-            }
-        }
-        file.close();
+bool MainWindow::reportStatus(CarpoolService::Status status) {
+    if (status != CarpoolService::Ok) {
+        QMessageBox::warning(this, "Error", CarpoolService::describe(status));
+        return false;
     }
+    return true;
 }
 
-void MainWindow::saveUsers() {
-    QFile file("users.txt");
-    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        for (User* user : users) {
-            user->saveToFile(file);
-        }
-        file.close();
-    }
-}
-
-void MainWindow::saveRides() {
-    QFile file("rides.txt");
-    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        QTextStream out(&file);
-        for (Ride* ride : rides) {
-            // Write all ride data in CSV format
-            out << ride->getCaptain() << ","
-                << ride->getPassengers().join(";") << ","  // Store all passengers separated by ;
-                << ride->getRoute() << ","
-                << ride->getDepartureTime() << ","
-                << ride->getReturnTime() << ","
-                << ride->getVehicleType() << ","
-                << ride->getVehicleClass() << ","
-                << ride->getTotalSeats() << ","
-                << ride->getOccupiedSeats() << ","
-                << (ride->getIsCompleted() ? "1" : "0") << ","
-                << ride->getFare() << ","
-                << (ride->getIsRated() ? "1" : "0") << "\n";
-        }
-        file.close();
-    }
+void MainWindow::onPersistenceFailed(const QString &message) {
+    statusBar()->showMessage("Saving failed: " + message);
 }
 
-bool MainWindow::usernameExists(QString username) {
-    for (User* user : users) {
-        if (user->getUsername() == username) {
-            return true;
-        }
+void MainWindow::onServiceOpened() {
+    loadProgressTimer.stop();
+    if (loadProgressBar) {
+        statusBar()->removeWidget(loadProgressBar);
+        loadProgressBar->deleteLater();
+        loadProgressBar = nullptr;
     }
-    return false;
-}
-
-User* MainWindow::authenticateUser(QString username, QString password, QString userType) {
-    for (User* user : users) {
-        if (user->getUsername() == username &&
-            user->getUserType() == userType) {
-            // In a real app, we'd hash the password and compare hashes
-            if (user->getPassword() == password) { // Simplified for this example
-                return user;
-            }
-        }
-    }
-    return nullptr;
+    ui->stackedWidget->setEnabled(true);
+    statusBar()->showMessage("Carpool data loaded", 2000);
 }
 
 void MainWindow::on_loginButton_clicked()
@@ -192,20 +128,10 @@ void MainWindow::on_passengerRegisterButton_clicked()
     QString username = ui->passengerRegUsername->text();
     QString password = ui->passengerRegPassword->text();
 
-    if (username.isEmpty() || password.isEmpty()) {
-        QMessageBox::warning(this, "Error", "Username and password cannot be empty");
+    if (!reportStatus(service.registerPassenger(username, password))) {
         return;
     }
 
-    if (usernameExists(username)) {
-        QMessageBox::warning(this, "Error", "Username already exists");
-        return;
-    }
-
-    Passenger* newPassenger = new Passenger(username, password);
-    users.append(newPassenger);
-    saveUsers();
-
     QMessageBox::information(this, "Success", "Passenger account created successfully");
     ui->stackedWidget->setCurrentIndex(0);
     ui->passengerRegUsername->clear();
@@ -226,20 +152,10 @@ void MainWindow::on_captainRegisterButton_clicked()
     QString vehicleType = ui->vehicleTypeComboBox->currentText();
     QString vehicleClass = ui->vehicleClassComboBox->currentText();
 
-    if (username.isEmpty() || password.isEmpty()) {
-        QMessageBox::warning(this, "Error", "Username and password cannot be empty");
-        return;
-    }
-
-    if (usernameExists(username)) {
-        QMessageBox::warning(this, "Error", "Username already exists");
+    if (!reportStatus(service.registerCaptain(username, password, vehicleType, vehicleClass))) {
         return;
     }
 
-    Captain* newCaptain = new Captain(username, password, vehicleType, vehicleClass);
-    users.append(newCaptain);
-    saveUsers();
-
     QMessageBox::information(this, "Success", "Captain account created successfully");
     ui->stackedWidget->setCurrentIndex(0);
     ui->captainRegUsername->clear();
@@ -270,7 +186,7 @@ void MainWindow::on_passengerLoginButton_clicked()
     QString username = ui->passengerLoginUsername->text();
     QString password = ui->passengerLoginPassword->text();
 
-    currentUser = authenticateUser(username, password, "passenger");
+    currentUser = service.authenticate(username, password, "passenger");
     if (currentUser) {
         showPassengerDashboard();
         updatePassengerBalanceDisplay();
@@ -291,7 +207,7 @@ void MainWindow::on_captainLoginButton_clicked()
     QString username = ui->captainLoginUsername->text();
     QString password = ui->captainLoginPassword->text();
 
-    currentUser = authenticateUser(username, password, "captain");
+    currentUser = service.authenticate(username, password, "captain");
     if (currentUser) {
         showCaptainDashboard();
         ui->captainLoginUsername->clear();
@@ -323,27 +239,24 @@ void MainWindow::showCaptainDashboard() {
     ui->stackedWidget->setCurrentIndex(6);
     displayCaptainRides();
     // Show captain's rating
-    if (currentUser && currentUser->getUserType() == "captain") {
-        QString ratingText = QString("Your Rating: ★%1 (%2 ratings)")
-                                 .arg(currentUser->getAverageRating(), 0, 'f', 1)
-                                 .arg(currentUser->getRatingCount());
-        ui->captainRatingLabel->setText(ratingText);
-    }
+    updateCaptainRatingDisplay();
 }
 
 void MainWindow::updateCaptainBalanceDisplay() {
-    ui->captainLiveBalanceLabel->setText("Balance Rs " + QString::number(currentUser->getBalance(), 'f', 2));
+    ui->captainLiveBalanceLabel->setText("Balance Rs " + formatMoney(currentUser->getBalanceMinor()));
 }
 
 void MainWindow::on_passengerDashboardBackButton_clicked()
 {
     currentUser = nullptr;
+    clearRideLists();
     ui->stackedWidget->setCurrentIndex(0);
 }
 
 void MainWindow::on_captainDashboardBackButton_clicked()
 {
     currentUser = nullptr;
+    clearRideLists();
     ui->stackedWidget->setCurrentIndex(0);
 }
 
@@ -359,10 +272,8 @@ void MainWindow::on_addBalanceButton_clicked()
                                             2,    // decimals
                                             &ok);
 
-    if (ok && amount > 0) {
-        currentUser->addBalance(amount);
+    if (ok && service.addBalance(currentUser, amount) == CarpoolService::Ok) {
         updatePassengerBalanceDisplay();
-        saveUsers();
         QMessageBox::information(this, "Success",
                                  QString("Added Rs %1 to your balance").arg(amount));
     }
@@ -372,11 +283,9 @@ void MainWindow::updatePassengerBalanceDisplay()
 {
     if (currentUser && currentUser->getUserType() == "passenger") {
         QString balanceText = QString("Balance: Rs %1")
-                                  .arg(currentUser->getBalance(), 0, 'f', 2);
+                                  .arg(formatMoney(currentUser->getBalanceMinor()));
 
         ui->passengerBalanceLabel->setText(balanceText);
-
-        qApp->processEvents();
     }
 }
 
@@ -384,10 +293,8 @@ void MainWindow::on_addCaptainBalanceButton_clicked()
 {
     bool ok;
     double amount = QInputDialog::getDouble(this, "Add Balance", "Enter amount to add:", 0, 0, 10000, 2, &ok);
-    if (ok) {
-        currentUser->addBalance(amount);
+    if (ok && service.addBalance(currentUser, amount) == CarpoolService::Ok) {
         updateCaptainBalanceDisplay();
-        saveUsers();
     }
 }
 
@@ -403,29 +310,53 @@ void MainWindow::on_createRideButton_clicked()
     QString retTime = ui->returnTimeEdit->text();
     int seats = ui->seatsSpinBox->value();
     double fare = ui->fareSpinBox->value();
-
-    if (route.isEmpty() || depTime.isEmpty()) {
-        QMessageBox::warning(this, "Error", "Route and departure time are required");
+    GeoPoint origin;
+    GeoPoint destination;
+    if (!resolvePlace(ui->pickupEdit->text(), "pickup", &origin) ||
+        !resolvePlace(ui->dropoffEdit->text(), "drop-off", &destination)) {
         return;
     }
 
-    Captain* captain = dynamic_cast<Captain*>(currentUser);
-    if (!captain) return;
+    // Anything but "Once" repeats the ride from a schedule; weekly rides
+    // repeat on the first departure's weekday
+    int weekdays = 0;
+    switch (ui->repeatComboBox->currentIndex()) {
+    case 1: weekdays = 0x7F; break;
+    case 2: weekdays = 0x1F; break;
+    case 3: {
+        qint64 departure = Ride::parseTime(depTime);
+        if (departure != Ride::NoTime) {
+            weekdays = RideSchedule::weekdayBit(RideSchedule::dayOfWeek(RideSchedule::dayOf(departure)));
+        }
+        break;
+    }
+    }
 
-    Ride* newRide = new Ride(currentUser->getUsername(), "", route, depTime, retTime,
-                             captain->getVehicleType(), captain->getVehicleClass(), seats, fare);
-    rides.append(newRide);
-    saveRides();
+    if (ui->repeatComboBox->currentIndex() == 0) {
+        if (!reportStatus(service.createRide(currentUser, route, depTime, retTime, seats, fare,
+                                             origin, destination))) {
+            return;
+        }
+    } else if (!reportStatus(service.createSchedule(currentUser, route, depTime, retTime, weekdays,
+                                                    seats, fare, origin, destination))) {
+        return;
+    }
 
-    Beep(800, 200);
-    Beep(1000, 200);
-    QMessageBox::information(this, "Success", "Ride created successfully");
+    QApplication::beep();
+    QMessageBox::information(this, "Success",
+                             ui->repeatComboBox->currentIndex() == 0
+                                 ? "Ride created successfully"
+                                 : QString("Ride schedule created; its rides appear %1 days ahead")
+                                       .arg(CarpoolService::ScheduleLookAheadDays));
     ui->stackedWidget->setCurrentIndex(6);
     ui->rideRouteEdit->clear();
     ui->departureTimeEdit->clear();
     ui->returnTimeEdit->clear();
+    ui->pickupEdit->clear();
+    ui->dropoffEdit->clear();
     ui->seatsSpinBox->setValue(0);
     ui->fareSpinBox->setValue(0.0);
+    ui->repeatComboBox->setCurrentIndex(0);
 }
 
 void MainWindow::on_createRideBackButton_clicked()
@@ -438,42 +369,177 @@ void MainWindow::on_captainRidesBackButton_clicked()
     ui->stackedWidget->setCurrentIndex(6);
 }
 
+void MainWindow::setupRideLists() {
+    // Open rides show the fare a booking would charge now, quoted for the
+    // whole list at once whenever it is rebuilt
+    availableRidesModel = new RideListModel(service.rides(), [this](const QVector<const Ride*> &rides,
+                                                                    QVector<Money> *fares) {
+        service.fares().quote(rides, fares);
+    }, [](const Ride* ride, Money fare) {
+        return QString("Route: %1 | Departure: %2 | Vehicle: %3 %4 | Seats: %5/%6 | Fare: Rs %7")
+        .arg(ride->getRoute())
+            .arg(ride->getDepartureTime())
+            .arg(ride->getVehicleType())
+            .arg(ride->getVehicleClass())
+            .arg(ride->getOccupiedSeats())
+            .arg(ride->getTotalSeats())
+            .arg(formatMoney(fare));
+    }, this);
+
+    captainRidesModel = new RideListModel(service.rides(), [this](const Ride* ride) {
+        // Find passenger to get rating
+        float passengerRating = 0;
+        if (User* passenger = service.users().find(ride->getPassenger(), "passenger")) {
+            passengerRating = passenger->getAverageRating();
+        }
+
+        QString status = ride->getPassengerId() == 0
+                             ? "Available"
+                             : QString("Booked by %1 (Rating: %2)")
+                                   .arg(ride->getPassenger())
+                                   .arg(passengerRating, 0, 'f', 1);
+
+        return QString("Route: %1 | %2 | Seats: %3/%4")
+            .arg(ride->getRoute())
+            .arg(status)
+            .arg(ride->getOccupiedSeats())
+            .arg(ride->getTotalSeats());
+    }, this);
+
+    myRidesModel = new RideListModel(service.rides(), [](const Ride* ride) {
+        return QString("Route: %1 | Captain: %2 | Departure: %3 | Status: %4")
+        .arg(ride->getRoute())
+            .arg(ride->getCaptain())
+            .arg(ride->getDepartureTime())
+            .arg(ride->getOccupiedSeats() > 0 ? "Booked" : "Pending");
+    }, this);
+
+    ui->availableRidesList->setModel(availableRidesModel);
+    ui->captainRidesList->setModel(captainRidesModel);
+    ui->myRidesList->setModel(myRidesModel);
+}
+
+void MainWindow::clearRideLists() {
+    availableRidesModel->clear();
+    captainRidesModel->clear();
+    myRidesModel->clear();
+}
+
+void MainWindow::notifyRideChanged(const Ride *ride) {
+    availableRidesModel->rideChanged(ride);
+    captainRidesModel->rideChanged(ride);
+    myRidesModel->rideChanged(ride);
+}
+
+void MainWindow::notifyRideRemoved(const Ride *ride) {
+    availableRidesModel->rideRemoved(ride);
+    captainRidesModel->rideRemoved(ride);
+    myRidesModel->rideRemoved(ride);
+}
+
 void MainWindow::displayAvailableRides() {
-    ui->availableRidesList->clear();
+    // Open rides, minus the ones the current user already booked. With a
+    // route query the candidates come from the route index; the filter
+    // re-checks the query so rides created or cancelled meanwhile are
+    // placed correctly by rideChanged().
+    int userId = currentUser->getUsernameId();
+    if (nearbyOrigin.isValid()) {
+        // The nearby search; the filter re-checks the distances the same way
+        GeoPoint origin = nearbyOrigin;
+        GeoPoint destination = nearbyDestination;
+        double radius = nearbyRadiusMetres;
+        RideListModel::Filter filter = [userId, origin, destination, radius](const Ride* ride) {
+            return !ride->getIsCompleted() && !ride->isFull() && !ride->hasPassenger(userId) &&
+                   ride->getOrigin().isValid() && GeoPoint::distance(origin, ride->getOrigin()) <= radius &&
+                   (!destination.isValid() || (ride->getDestination().isValid() &&
+                                               GeoPoint::distance(destination, ride->getDestination()) <= radius));
+        };
+        // The model keeps its rows by ride id, not by distance
+        QList<Ride*> nearby = service.rides().openRidesNear(origin, destination, radius);
+        std::sort(nearby.begin(), nearby.end(),
+                  [](const Ride* a, const Ride* b) { return a->getId() < b->getId(); });
+        availableRidesModel->reset(nearby, filter);
+        return;
+    }
 
-    for (Ride* ride : rides) {
+    QString query = ui->routeSearchEdit->text();
+    QStringList queryWords = RouteIndex::words(query);
+    RideListModel::Filter filter = [userId, queryWords](const Ride* ride) {
+        return !ride->getIsCompleted() && !ride->isFull() && !ride->hasPassenger(userId) &&
+               RouteIndex::matches(ride->getRoute(), queryWords);
+    };
 
-        if (ride->getIsCompleted() || ride->isFull()) {
-            continue;
-        }
+    if (queryWords.isEmpty()) {
+        availableRidesModel->reset(service.rides().openRides(), filter);
+    } else {
+        availableRidesModel->reset(service.rides().searchOpenRides(query), filter);
+    }
+}
 
-        // Skip if current user already booked this ride
-        if (ride->getPassengers().contains(currentUser->getUsername())) {
-            continue;
-        }
+void MainWindow::on_routeSearchEdit_textChanged(const QString &text)
+{
+    Q_UNUSED(text);
+    // Typing a route query ends a nearby search
+    nearbyOrigin = GeoPoint();
+    if (currentUser) {
+        displayAvailableRides();
+    }
+}
 
-        if (!ride->getIsCompleted() && ride->getOccupiedSeats() < ride->getTotalSeats()) {
-            QString rideInfo = QString("Route: %1 | Departure: %2 | Vehicle: %3 %4 | Seats: %5/%6 | Fare: Rs %7")
-            .arg(ride->getRoute())
-                .arg(ride->getDepartureTime())
-                .arg(ride->getVehicleType())
-                .arg(ride->getVehicleClass())
-                .arg(ride->getOccupiedSeats())
-                .arg(ride->getTotalSeats())
-                .arg(ride->getFare());
-
-            QListWidgetItem* item = new QListWidgetItem(rideInfo);
-            item->setData(Qt::UserRole, QVariant::fromValue(ride));
-            ui->availableRidesList->addItem(item);
-        }
+void MainWindow::on_nearbySearchButton_clicked()
+{
+    bool ok;
+    QString pickup = QInputDialog::getItem(this, "Nearby Rides", "Your pickup (place or lat lon):",
+                                           places.names(), -1, true, &ok);
+    GeoPoint origin;
+    if (!ok || pickup.trimmed().isEmpty() || !resolvePlace(pickup, "pickup", &origin)) return;
+
+    QString dropoff = QInputDialog::getItem(this, "Nearby Rides", "Your destination (optional):",
+                                            places.names(), -1, true, &ok);
+    GeoPoint destination;
+    if (!ok || !resolvePlace(dropoff, "destination", &destination)) return;
+
+    double radiusKm = QInputDialog::getDouble(this, "Nearby Rides", "Within (km):",
+                                              nearbyRadiusMetres / 1000, 0.1, 100, 1, &ok);
+    if (!ok) return;
+
+    // Clearing the route query first, as that ends a nearby search
+    ui->routeSearchEdit->blockSignals(true);
+    ui->routeSearchEdit->clear();
+    ui->routeSearchEdit->blockSignals(false);
+
+    nearbyOrigin = origin;
+    nearbyDestination = destination;
+    nearbyRadiusMetres = radiusKm * 1000;
+    displayAvailableRides();
+    statusBar()->showMessage(QString("%1 rides within %2 km").arg(availableRidesModel->rowCount()).arg(radiusKm), 3000);
+}
+
+bool MainWindow::resolvePlace(const QString &text, const QString &what, GeoPoint *point)
+{
+    *point = GeoPoint();
+    if (text.trimmed().isEmpty()) return true;
+
+    *point = places.resolve(text);
+    if (!point->isValid()) {
+        QMessageBox::warning(this, "Error", QString("Unknown %1 \"%2\". Enter a place from %3 "
+                                                    "or a latitude and longitude.")
+                                               .arg(what, text, Gazetteer::defaultPath()));
+        return false;
     }
+    return true;
 }
 
 void MainWindow::on_bookRideButton_clicked()
 {
     ui->stackedWidget->setCurrentIndex(8);
-    displayAvailableRides();
-    qDebug() << "Book Ride button clicked - showing available rides";
+    nearbyOrigin = GeoPoint();
+    // Clearing the query refreshes the list through textChanged
+    if (ui->routeSearchEdit->text().isEmpty()) {
+        displayAvailableRides();
+    } else {
+        ui->routeSearchEdit->clear();
+    }
 }
 
 void MainWindow::on_viewMyRidesButton_clicked()
@@ -483,27 +549,15 @@ void MainWindow::on_viewMyRidesButton_clicked()
         return;
     }
 
-    ui->myRidesList->clear();
-
-    for (Ride* ride : rides) {
-        if (ride->getPassenger() == currentUser->getUsername() && !ride->getIsCompleted()) {
-            QString rideInfo = QString("Route: %1 | Captain: %2 | Departure: %3 | Status: %4")
-            .arg(ride->getRoute())
-                .arg(ride->getCaptain())
-                .arg(ride->getDepartureTime())
-                .arg(ride->getOccupiedSeats() > 0 ? "Booked" : "Pending");
-
-            QListWidgetItem* item = new QListWidgetItem(rideInfo);
-            item->setData(Qt::UserRole, QVariant::fromValue(ride));
-            ui->myRidesList->addItem(item);
-        }
-    }
-    if (ui->myRidesList->count() > 0) {
-        ui->myRidesList->setCurrentRow(0);
+    int userId = currentUser->getUsernameId();
+    myRidesModel->reset(service.rides().activeRidesForPassenger(userId), [userId](const Ride* ride) {
+        return !ride->getIsCompleted() && ride->hasPassenger(userId);
+    });
+    if (myRidesModel->rowCount() > 0) {
+        ui->myRidesList->setCurrentIndex(myRidesModel->index(0));
     }
 
     ui->stackedWidget->setCurrentIndex(10);
-    qDebug() << "Showing" << ui->myRidesList->count() << "active rides";
 }
 
 void MainWindow::on_myRidesBackButton_clicked()
@@ -513,23 +567,6 @@ void MainWindow::on_myRidesBackButton_clicked()
 
 void MainWindow::on_viewRidesButton_clicked()
 {
-    ui->captainRidesList->clear();
-
-    for (Ride* ride : rides) {
-        if (ride->getCaptain() == currentUser->getUsername() && !ride->getIsCompleted()) {
-            QString status = ride->getPassenger().isEmpty() ? "Available" : "Booked by " + ride->getPassenger();
-            QString rideInfo = QString("Route: %1 | %2 | Seats: %3/%4 | Fare: Rs %5")
-                                   .arg(ride->getRoute())
-                                   .arg(status)
-                                   .arg(ride->getOccupiedSeats())
-                                   .arg(ride->getTotalSeats())
-                                   .arg(ride->getFare());
-
-            QListWidgetItem* item = new QListWidgetItem(rideInfo);
-            item->setData(Qt::UserRole, QVariant::fromValue(ride));
-            ui->captainRidesList->addItem(item);
-        }
-    }
     displayCaptainRides();
     ui->stackedWidget->setCurrentIndex(9);
 }
@@ -543,12 +580,7 @@ void MainWindow::on_passengerCancelRideButton_clicked()
     }
 
     // 2. Find all active rides for this passenger
-    QList<Ride*> passengerRides;
-    for (Ride* ride : rides) {
-        if (ride->getPassenger() == currentUser->getUsername() && !ride->getIsCompleted()) {
-            passengerRides.append(ride);
-        }
-    }
+    QList<Ride*> passengerRides = service.rides().activeRidesForPassenger(currentUser->getUsernameId());
 
     // 3. Check if passenger has any active rides
     if (passengerRides.isEmpty()) {
@@ -569,43 +601,21 @@ void MainWindow::on_passengerCancelRideButton_clicked()
                              .arg(rideToCancel->getRoute())
                              .arg(rideToCancel->getCaptain())
                              .arg(rideToCancel->getDepartureTime())
-                             .arg(rideToCancel->getFare(), 0, 'f', 2);
+                             .arg(formatMoney(service.paidFare(rideToCancel, currentUser->getUsernameId())));
 
     if (QMessageBox::question(this, "Confirm Cancellation", confirmMsg,
                               QMessageBox::Yes | QMessageBox::No) != QMessageBox::Yes) {
         return;
     }
 
-    // 6. Calculate refund amount (with penalty if applicable)
-    double refundAmount = rideToCancel->getFare();
+    // 6. Refund the fare (minus any penalty) and free the seat
+    double refundAmount = 0.0;
     double penalty = 0.0;
-
-    if (currentUser->getCancelCount() >= 2) {
-        penalty = 50.0; // Rs 50 penalty after 2 cancellations
-        refundAmount -= penalty;
-    }
-
-    // 7. Update passenger balance
-    currentUser->addBalance(refundAmount);
-    currentUser->incrementCancelCount();
-
-    // 8. Update ride status
-    rideToCancel->setPassenger("");
-    rideToCancel->setOccupiedSeats(rideToCancel->getOccupiedSeats() - 1);
-
-    // 9. Update captain's balance
-    for (User* user : users) {
-        if (user->getUsername() == rideToCancel->getCaptain()) {
-            user->deductBalance(refundAmount);
-            break;
-        }
+    if (!reportStatus(service.cancelBooking(currentUser, rideToCancel, &refundAmount, &penalty))) {
+        return;
     }
 
-    // 10. Save all changes
-    saveUsers();
-    saveRides();
-
-    // 11. Show success message
+    // 7. Show success message
     QString resultMsg = QString("Ride cancelled successfully!\n\n"
                                 "Refunded: Rs %1")
                             .arg(refundAmount, 0, 'f', 2);
@@ -616,7 +626,7 @@ void MainWindow::on_passengerCancelRideButton_clicked()
 
     QMessageBox::information(this, "Cancellation Complete", resultMsg);
 
-    // 12. Update UI
+    // 8. Update UI
     updatePassengerBalanceDisplay();
 }
 
@@ -626,98 +636,61 @@ void MainWindow::on_availableRidesBackButton_clicked()
 
 }
 
-void MainWindow::on_availableRidesList_itemDoubleClicked(QListWidgetItem *item)
+void MainWindow::on_availableRidesList_doubleClicked(const QModelIndex &index)
 {
-    Ride* ride = item->data(Qt::UserRole).value<Ride*>();
+    Ride* ride = availableRidesModel->rideAt(index);
     if (!ride) return;
 
-    // Check if passenger already has 2 active rides
-    int activeRides = 0;
-    for (Ride* r : rides) {
-        if (r->getPassenger() == currentUser->getUsername() && !r->getIsCompleted()) {
-            activeRides++;
-        }
-    }
-
-    if (ride->getPassengers().contains(currentUser->getUsername())) {
-        QMessageBox::warning(this, "Error", "You already booked this ride");
-        return;
-    }
-
-    if (activeRides >= 2) {
-        QMessageBox::warning(this, "Error", "You can only have 2 active rides at a time");
-        return;
-    }
-    if (ride->getOccupiedSeats() >= ride->getTotalSeats()) {
-        QMessageBox::warning(this, "Error", "No seats available on this ride");
+    // A multi-stop ride can be booked for part of its route
+    Ride::Leg leg = ride->wholeTrip();
+    const QStringList stops = ride->getStops();
+    if (stops.size() > 2) {
+        bool ok;
+        QString from = QInputDialog::getItem(this, "Book Seat", "Board at:", stops.mid(0, stops.size() - 1),
+                                             0, false, &ok);
+        if (!ok) return;
+        leg.from = stops.indexOf(from);
+        QString to = QInputDialog::getItem(this, "Book Seat", "Get off at:", stops.mid(leg.from + 1),
+                                           stops.size() - leg.from - 2, false, &ok);
+        if (!ok) return;
+        leg.to = leg.from + 1 + stops.mid(leg.from + 1).indexOf(to);
+    }
+
+    // The service checks the seat, the active ride limit and the balance
+    if (!reportStatus(service.bookRide(currentUser, ride, leg))) {
         return;
     }
-    // Check balance
-    double totalFare = ride->getFare();
-    if (currentUser->getBalance() < totalFare) {
-        QMessageBox::warning(this, "Error", "Insufficient balance");
-        return;
-    }
-
-    // Deduct fare with 5% platform fee
-    double platformFee = totalFare * 0.05;
-    double captainEarning = totalFare - platformFee;
-
-    currentUser->deductBalance(totalFare);
-
-    // Find captain and add balance
-    for (User* user : users) {
-        if (user->getUsername() == ride->getCaptain()) {
-            user->addBalance(captainEarning);
-            break;
-        }
-    }
-
-    // Update ride
-    ride->setOccupiedSeats(ride->getOccupiedSeats() + 1);
-
-    if (ride->getPassenger().isEmpty()) {
-        ride->setPassenger(currentUser->getUsername());
-    }
-    ride->addPassenger(currentUser->getUsername());
 
-    saveUsers();
-    saveRides();
     updatePassengerBalanceDisplay();
-    displayAvailableRides();
-    Beep(500, 150);
-    Beep(600, 150);
+    QApplication::beep();
     QMessageBox::information(this, "Success",
-                             QString("Booked seat on %1's ride\nSeats: %2/%3")
+                             QString("Booked seat on %1's ride\nSeats: %2/%3\nFare paid: Rs %4")
                                  .arg(ride->getCaptain())
                                  .arg(ride->getOccupiedSeats())
-                                 .arg(ride->getTotalSeats()));
+                                 .arg(ride->getTotalSeats())
+                                 .arg(formatMoney(service.paidFare(ride, currentUser->getUsernameId()))));
     ui->stackedWidget->setCurrentIndex(5);
 }
 
 void MainWindow::on_completeRideButton_clicked()
 {
-    QListWidgetItem* item = ui->captainRidesList->currentItem();
-    if (!item) {
+    QModelIndex index = ui->captainRidesList->currentIndex();
+    if (!index.isValid()) {
         QMessageBox::warning(this, "Error", "No ride selected");
         return;
     }
 
-    Ride* ride = item->data(Qt::UserRole).value<Ride*>();
+    Ride* ride = captainRidesModel->rideAt(index);
     if (!ride) {
         QMessageBox::critical(this, "Error", "Invalid ride data");
         return;
     }
 
     // Mark as completed but don't delete
-    ride->setIsCompleted(true);
-
-    // Save changes
-    saveRides();
-
-    // Refresh displays (will hide completed rides from active lists)
-    displayCaptainRides();
-    displayAvailableRides();
+    // The ride lists drop completed rides as the change is applied
+    if (!reportStatus(service.completeRide(currentUser, ride))) {
+        return;
+    }
 
     QMessageBox::information(this, "Completed",
                              "Ride marked as completed. Passengers can now rate this ride.");
@@ -725,38 +698,23 @@ void MainWindow::on_completeRideButton_clicked()
 
 void MainWindow::on_cancelRideButton_clicked()
 {
-    QListWidgetItem* item = ui->captainRidesList->currentItem();
-    if (!item) return;
-
-    Ride* ride = item->data(Qt::UserRole).value<Ride*>();
+    Ride* ride = captainRidesModel->rideAt(ui->captainRidesList->currentIndex());
     if (!ride) return;
 
-    if (ride->getPassenger().isEmpty()) {
-        // Captain is canceling an available ride
-        rides.removeOne(ride);
-        delete ride;
-    } else {
-        // Captain is canceling a booked ride
-        if (currentUser->getCancelCount() >= 2) {
-            // Apply penalty after 2 cancellations
-            currentUser->deductBalance(50);
-        }
-        currentUser->incrementCancelCount();
-
-        // Refund passenger (simplified - in reality would need proper transaction handling)
-        for (User* user : users) {
-            if (user->getUsername() == ride->getPassenger()) {
-                user->addBalance(ride->getFare());
-                break;
-            }
-        }
+    // A scheduled ride can take the rest of its schedule with it
+    const int scheduleId = ride->getScheduleId();
+    bool stopSchedule = scheduleId != 0 &&
+        QMessageBox::question(this, "Repeating Ride",
+                              "This ride repeats on a schedule. Stop the schedule and its upcoming rides too?",
+                              QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes;
 
-        ride->setPassenger("");
-        ride->setOccupiedSeats(0);
+    // Unbooked rides are deleted; booked ones are released with refunds
+    if (!reportStatus(service.cancelRide(currentUser, ride))) {
+        return;
+    }
+    if (stopSchedule && !reportStatus(service.cancelSchedule(currentUser, scheduleId))) {
+        return;
     }
-
-    saveUsers();
-    saveRides();
 
     if (currentUser->getUserType() == "passenger") {
         updatePassengerBalanceDisplay();
@@ -776,27 +734,21 @@ void MainWindow::on_cancelRideButton_clicked()
 void MainWindow::on_rateUserButton_clicked()
 {
     // 1. Get currently selected ride
-    QListWidgetItem* item = ui->captainRidesList->currentItem();
-    if (!item) {
+    QModelIndex index = ui->captainRidesList->currentIndex();
+    if (!index.isValid()) {
         QMessageBox::warning(this, "Error", "Please select a ride first");
         return;
     }
 
     // 2. Get the Ride object
-    Ride* ride = item->data(Qt::UserRole).value<Ride*>();
-    if (!ride || ride->getPassenger().isEmpty()) {
+    Ride* ride = captainRidesModel->rideAt(index);
+    if (!ride || ride->getPassengerId() == 0) {
         QMessageBox::warning(this, "Error", "No passenger to rate for this ride");
         return;
     }
 
-    // 3. Find the passenger in users list
-    User* passenger = nullptr;
-    for (User* user : users) {
-        if (user->getUsername() == ride->getPassenger()) {
-            passenger = user;
-            break;
-        }
-    }
+    // 3. Find the passenger in the user directory
+    User* passenger = service.users().find(ride->getPassenger(), "passenger");
 
     if (!passenger) {
         QMessageBox::critical(this, "Error", "Passenger not found");
@@ -813,13 +765,12 @@ void MainWindow::on_rateUserButton_clicked()
     if (!ok) return; // User cancelled
 
     // 5. Add the rating
-    passenger->addRating(rating);
-
-    // 6. Save changes
-    saveUsers();
+    if (!reportStatus(service.ratePassenger(currentUser, ride, rating))) {
+        return;
+    }
 
     updatePassengerRatingDisplay();
-    // 7. Show confirmation
+    // 6. Show confirmation
     QMessageBox::information(this, "Rating Submitted",
                              QString("You rated %1 with %2 stars")
                                  .arg(passenger->getUsername())
@@ -827,36 +778,10 @@ void MainWindow::on_rateUserButton_clicked()
 }
 void MainWindow::displayCaptainRides()
 {
-    ui->captainRidesList->clear();
-
-    for (Ride* ride : rides) {
-        if (ride->getCaptain() == currentUser->getUsername() && !ride->getIsCompleted() ) {
-            // Find passenger to get rating
-            float passengerRating = 0;
-            for (User* user : users) {
-                if (user->getUsername() == ride->getPassenger()) {
-                    passengerRating = user->getAverageRating();
-                    break;
-                }
-            }
-
-            QString status = ride->getPassenger().isEmpty()
-                                 ? "Available"
-                                 : QString("Booked by %1 (Rating: %2)")
-                                       .arg(ride->getPassenger())
-                                       .arg(passengerRating, 0, 'f', 1);
-
-            QString rideInfo = QString("Route: %1 | %2 | Seats: %3/%4")
-                                   .arg(ride->getRoute())
-                                   .arg(status)
-                                   .arg(ride->getOccupiedSeats())
-                                   .arg(ride->getTotalSeats());
-
-            QListWidgetItem* item = new QListWidgetItem(rideInfo);
-            item->setData(Qt::UserRole, QVariant::fromValue(ride));
-            ui->captainRidesList->addItem(item);
-        }
-    }
+    int captainId = currentUser->getUsernameId();
+    captainRidesModel->reset(service.rides().activeRidesForCaptain(captainId), [captainId](const Ride* ride) {
+        return !ride->getIsCompleted() && ride->getCaptainId() == captainId;
+    });
 }
 
 void MainWindow::updatePassengerRatingDisplay()
@@ -870,34 +795,18 @@ void MainWindow::updatePassengerRatingDisplay()
 
 void MainWindow::on_rateCaptainButton_clicked()
 {
-    // Find completed rides that haven't been rated yet
-    QList<Ride*> rateableRides;
-    for (Ride* ride : rides) {
-        if (ride->getPassenger() == currentUser->getUsername() &&
-            ride->getIsCompleted() && !ride->getIsRated()) {
-            rateableRides.append(ride);
-        }
-    }
+    // Rate the most recent completed ride; the repository keeps each
+    // passenger's unrated rides ordered by departure. Older ones may only
+    // be in the ride archive.
+    service.loadRideHistory(currentUser);
+    Ride* rideToRate = service.rides().latestUnratedRideForPassenger(currentUser->getUsernameId());
 
-    if (rateableRides.isEmpty()) {
+    if (!rideToRate) {
         QMessageBox::information(this, "No Rides", "No completed rides available to rate");
         return;
     }
 
-    // For simplicity, let's rate the most recent completed ride
-    Ride* rideToRate = nullptr;
-    QDateTime latestTime;
-    for (Ride* ride : rateableRides) {
-        QDateTime rideTime = QDateTime::fromString(ride->getDepartureTime(), "yyyy-MM-dd hh:mm");
-        if (!rideToRate || rideTime > latestTime) {
-            rideToRate = ride;
-            latestTime = rideTime;
-        }
-    }
-
-    if (rideToRate) {
-        showCaptainRatingDialog(rideToRate);
-    }
+    showCaptainRatingDialog(rideToRate);
 }
 
 void MainWindow::showCaptainRatingDialog(Ride* ride)
@@ -917,12 +826,18 @@ void MainWindow::showCaptainRatingDialog(Ride* ride)
     QWidget* starWidget = new QWidget(&ratingDialog);
     QHBoxLayout* starLayout = new QHBoxLayout(starWidget);
 
+    // A checkpoint while the dialog is open can move the ride to the
+    // archive; it is paged back in by id then
+    RideHandle handle = service.rides().handleOf(ride);
+    int rideId = ride->getId();
+
     for (int i = 1; i <= 5; i++) {
         QPushButton* star = new QPushButton("☆", starWidget);
         star->setProperty("rating", i);
         star->setStyleSheet("font-size: 24px; border: none;");
-        connect(star, &QPushButton::clicked, [this, &ratingDialog, ride, i]() {
-            processCaptainRating(ride, i);
+        connect(star, &QPushButton::clicked, [this, &ratingDialog, handle, rideId, i]() {
+            Ride* current = service.rides().get(handle);
+            processCaptainRating(current ? current : service.findRide(rideId), i);
             ratingDialog.accept();
         });
         starLayout->addWidget(star);
@@ -938,29 +853,20 @@ void MainWindow::processCaptainRating(Ride* ride, int rating)
     if (!ride || !currentUser) return;
 
     // Find captain user
-    User* captain = nullptr;
-    for (User* user : users) {
-        if (user->getUsername() == ride->getCaptain()) {
-            captain = user;
-            break;
-        }
-    }
+    User* captain = service.users().find(ride->getCaptain(), "captain");
 
     if (!captain) {
         QMessageBox::critical(this, "Error", "Captain not found");
         return;
     }
 
-    // Add rating
-    captain->addRating(rating);
-    ride->setIsRated(true);
-
-    // Save changes
-    saveUsers();
-    saveRides();
+    // Add rating; this also marks the ride as rated
+    if (!reportStatus(service.rateCaptain(currentUser, ride, rating))) {
+        return;
+    }
 
     // Update captain's rating display if we're on their dashboard
-    if (currentUser->getUsername() == captain->getUsername()) {
+    if (currentUser->getUsernameId() == captain->getUsernameId()) {
         updateCaptainRatingDisplay();
     }
 
@@ -977,5 +883,12 @@ void MainWindow::updateCaptainRatingDisplay()
                                  .arg(currentUser->getAverageRating(), 0, 'f', 1)
                                  .arg(currentUser->getRatingCount());
         ui->captainRatingLabel->setText(ratingText);
+
+        // Breakdown by star value, best first
+        QStringList breakdown;
+        for (int stars = User::MaxStars; stars >= 1; stars--) {
+            breakdown << QString("%1★: %2").arg(stars).arg(currentUser->getStarCount(stars));
+        }
+        ui->captainRatingLabel->setToolTip(breakdown.join("\n"));
     }
 }
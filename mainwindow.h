@@ -1,152 +1,24 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
-#include "qlistwidget.h"
+#include <QModelIndex>
 #include <QMainWindow>
 #include <QMessageBox>
+#include <QTimer>
 #include <QFile>
 #include <QTextStream>
+#include <QStringList>
+#include "user.h"
+#include "ride.h"
+#include "carpoolservice.h"
+#include "gazetteer.h"
+#include "ridelistmodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
+class QProgressBar;
 QT_END_NAMESPACE
 
-class User {
-protected:
-    QString username;
-    QString password;
-    QString userType;
-    double balance;
-    int cancelCount;
-    float rating;
-    int ratingCount;
-    float totalRating = 0;
-
-public:
-    User(QString uname, QString pwd, QString type) : username(uname), password(pwd), userType(type), balance(0), cancelCount(0), rating(0), ratingCount(0) {}
-    virtual ~User() {}
-
-    QString getUsername() const { return username; }
-    QString getUserType() const { return userType; }
-    QString getPassword() const { return password; }
-    double getBalance() const { return balance; }
-    int getCancelCount() const { return cancelCount; }
-    float getRating() const { return ratingCount > 0 ? rating / ratingCount : 0; }
-    float getAverageRating() const {
-        return ratingCount > 0 ? totalRating / ratingCount : 0;
-    }
-    int getRatingCount() const {
-        return ratingCount;
-    }
-
-    void addBalance(double amount) { balance += amount; }
-    void deductBalance(double amount) { balance -= amount; }
-    void incrementCancelCount() { cancelCount++; }
-    void addRating(int stars) {
-        totalRating += stars;
-        ratingCount++;
-    }
-    virtual void saveToFile(QFile &file) = 0;
-};
-
-class Passenger : public User {
-public:
-    Passenger(QString uname, QString pwd) : User(uname, pwd, "passenger") {}
-
-    void saveToFile(QFile &file) override {
-        QTextStream out(&file);
-        out << "Passenger," << username << "," << password << "," << balance << ","
-            << cancelCount << "," << rating << "," << ratingCount << "\n";
-    }
-};
-
-class Captain : public User {
-    QString vehicleType;
-    QString vehicleClass;
-
-public:
-    Captain(QString uname, QString pwd, QString vType, QString vClass)
-        : User(uname, pwd, "captain"), vehicleType(vType), vehicleClass(vClass) {}
-
-    QString getVehicleType() const { return vehicleType; }
-    QString getVehicleClass() const { return vehicleClass; }
-
-    void saveToFile(QFile &file) override {
-        QTextStream out(&file);
-        out << "Captain," << username << "," << password << "," << balance << ","
-            << cancelCount << "," << rating << "," << ratingCount << ","
-            << vehicleType << "," << vehicleClass << "\n";
-    }
-};
-
-class Ride {
-    QString captainUsername;
-    QString passengerUsername;
-    QString route;
-    QString departureTime;
-    QString returnTime;
-    QString vehicleType;
-    QString vehicleClass;
-    QStringList passengers;
-    int totalSeats;
-    int occupiedSeats;
-    bool isCompleted;
-    double fare;
-    bool isRated = false;
-
-public:
-    Ride(QString capUser, QString passUser, QString rt, QString depTime, QString retTime,
-         QString vType, QString vClass, int seats, double fr)
-        : captainUsername(capUser), passengerUsername(passUser), route(rt),
-        departureTime(depTime), returnTime(retTime), vehicleType(vType),
-        vehicleClass(vClass), totalSeats(seats), occupiedSeats(0), isCompleted(false), fare(fr) {}
-
-    bool addPassenger(const QString &username) {
-        if (passengers.size() < totalSeats && !passengers.contains(username)) {
-            passengers.append(username);
-            return true;
-        }
-        return false;
-    }
-
-    QString getPassengersString() const {
-        return passengers.join(", ");
-    }
-
-    void saveToFile(QFile &file) {
-        QTextStream out(&file);
-        out << captainUsername << "," << passengerUsername << ","
-            << route << "," << departureTime << ","
-            << returnTime << "," << vehicleType << ","
-            << vehicleClass << "," << totalSeats << ","
-            << occupiedSeats << "," << (isCompleted ? "1" : "0") << ","
-            << fare << "," << (isRated ? "1" : "0") << "\n";
-    }
-
-    // Getters
-    QString getCaptain() const { return captainUsername; }
-    QString getPassenger() const { return passengerUsername; }
-    QString getRoute() const { return route; }
-    QString getDepartureTime() const { return departureTime; }
-    QString getReturnTime() const { return returnTime; }
-    QString getVehicleType() const { return vehicleType; }
-    QStringList getPassengers() const { return passengers; }
-    QString getVehicleClass() const { return vehicleClass; }
-    int getTotalSeats() const { return totalSeats; }
-    int getOccupiedSeats() const { return occupiedSeats; }
-    int getAvailableSeats() const { return totalSeats - passengers.size(); }
-    bool getIsCompleted() const { return isCompleted; }
-    double getFare() const { return fare; }
-    bool getIsRated() const { return isRated; }
-    bool isFull() const { return passengers.size() >= totalSeats; }
-
-    // Setters
-    void setPassenger(const QString &passenger) { passengerUsername = passenger; }
-    void setOccupiedSeats(int seats) { occupiedSeats = seats; }
-    void setIsCompleted(bool completed) { isCompleted = completed; }
-    void setIsRated(bool rated) { isRated = rated; }
-};
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -174,7 +46,9 @@ private slots:
     void on_completeRideButton_clicked();
     void on_cancelRideButton_clicked();
     void on_rateUserButton_clicked();
-    void on_availableRidesList_itemDoubleClicked(QListWidgetItem *item);
+    void on_availableRidesList_doubleClicked(const QModelIndex &index);
+    void on_routeSearchEdit_textChanged(const QString &text);
+    void on_nearbySearchButton_clicked();
     void on_passengerRegisterSelectionButton_clicked();
     void on_captainRegisterSelectionButton_clicked();
     void on_registerSelectionBackButton_clicked();
@@ -196,24 +70,39 @@ private:
     User* currentUser;
     Ride* currentRide;
 
-    void loadUsers();
-    void loadRides();
-    void saveUsers();
-    void saveRides();
+    // Shows a failed operation's message; returns true if it succeeded
+    bool reportStatus(CarpoolService::Status status);
+    void onPersistenceFailed(const QString &message);
+    void onServiceOpened();
     void showPassengerDashboard();
     void showCaptainDashboard();
     void updatePassengerBalanceDisplay();
     void updateCaptainBalanceDisplay();
     void displayAvailableRides();
     void displayCaptainRides();
+    void setupRideLists();
+    void clearRideLists();
+    // Keep the ride list models in step with a ride that changed or is about to be removed
+    void notifyRideChanged(const Ride *ride);
+    void notifyRideRemoved(const Ride *ride);
     void updatePassengerRatingDisplay();
     void updateCaptainRatingDisplay();
-
-    User* authenticateUser(QString username, QString password, QString userType);
-    bool usernameExists(QString username);
-
-    QList<User*> users;
-    QList<Ride*> rides;
+    // A place name from the gazetteer or typed coordinates; false (after
+    // telling the user) if text is neither. Empty text is no location.
+    bool resolvePlace(const QString &text, const QString &what, GeoPoint *point);
+
+    CarpoolService service;
+    RideListModel *availableRidesModel;
+    RideListModel *captainRidesModel;
+    RideListModel *myRidesModel;
+    Gazetteer places;
+    // Set by the Nearby search; the available rides list shows rides close
+    // to these points instead of matching the route query while it is
+    GeoPoint nearbyOrigin;
+    GeoPoint nearbyDestination;
+    double nearbyRadiusMetres = 2000;
+    QProgressBar *loadProgressBar = nullptr;   // shown while the service loads
+    QTimer loadProgressTimer;
 };
 
 #endif // MAINWINDOW_H
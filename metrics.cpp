@@ -0,0 +1,193 @@
+#include "metrics.h"
+#include <QDateTime>
+#include <QMutex>
+#include <QSaveFile>
+#include <QVector>
+#include <QtAlgorithms>
+
+namespace {
+const char *const CounterNames[Metrics::CounterCount] = {
+    "user_lookups",
+    "user_lookup_misses",
+    "ride_lookups",
+    "ride_lookup_misses",
+    "route_searches",
+    "route_search_results",
+    "nearby_searches",
+    "nearby_search_results",
+    "archive_page_ins",
+    "archived_rides_loaded",
+    "bookings_accepted",
+    "bookings_rejected",
+    "fares_quoted",
+    "journal_entries",
+    "journal_bytes",
+    "snapshot_bytes",
+};
+
+const char *const HistogramNames[Metrics::HistogramCount] = {
+    "load_ns",
+    "snapshot_save_ns",
+    "snapshot_size_bytes",
+    "journal_sync_ns",
+    "list_refresh_ns",
+    "booking_batch_ns",
+    "fare_batch_ns",
+};
+
+QByteArray line(const char *name, const char *suffix, quint64 value)
+{
+    return QByteArray(name) + suffix + ' ' + QByteArray::number(value) + '\n';
+}
+
+QByteArray ratio(const char *name, quint64 part, quint64 whole)
+{
+    return QByteArray(name) + ' ' + QByteArray::number(whole ? double(part) / whole : 0.0, 'f', 4) + '\n';
+}
+}
+
+// Every slab ever handed out. A thread's slab goes back to the free list
+// when it exits and is reused by the next new thread, so its totals are
+// kept and pool threads coming and going don't grow the list.
+struct Metrics::Registry {
+    QMutex mutex;
+    QVector<Slab *> slabs;
+    QVector<Slab *> spare;
+
+    static Registry &instance() {
+        static Registry registry;
+        return registry;
+    }
+};
+
+struct Metrics::SlabOwner {
+    Slab *slab = nullptr;
+
+    ~SlabOwner() {
+        if (!slab) return;
+        threadSlab = nullptr;
+        Registry &registry = Registry::instance();
+        QMutexLocker locker(&registry.mutex);
+        registry.spare.append(slab);
+    }
+};
+
+std::atomic<bool> Metrics::enabled(true);
+thread_local Metrics::Slab *Metrics::threadSlab = nullptr;
+thread_local Metrics::SlabOwner Metrics::slabOwner;
+
+Metrics::Slab *Metrics::attachThread()
+{
+    Registry &registry = Registry::instance();
+    QMutexLocker locker(&registry.mutex);
+    Slab *slab = nullptr;
+    if (!registry.spare.isEmpty()) {
+        slab = registry.spare.takeLast();
+    } else {
+        slab = new Slab();
+        registry.slabs.append(slab);
+    }
+    slabOwner.slab = slab;
+    threadSlab = slab;
+    return slab;
+}
+
+void Metrics::record(Histogram histogram, quint64 value)
+{
+    if (!isEnabled()) return;
+
+    HistogramData &data = slab()->histograms[histogram];
+    bump(data.buckets[value ? 64 - qCountLeadingZeroBits(value) : 0], 1);
+    bump(data.count, 1);
+    bump(data.sum, value);
+    if (value > data.max.load(std::memory_order_relaxed)) {
+        data.max.store(value, std::memory_order_relaxed);
+    }
+}
+
+QByteArray Metrics::report()
+{
+    quint64 counters[CounterCount] = {};
+    quint64 buckets[HistogramCount][BucketCount] = {};
+    quint64 counts[HistogramCount] = {};
+    quint64 sums[HistogramCount] = {};
+    quint64 maxima[HistogramCount] = {};
+    {
+        Registry &registry = Registry::instance();
+        QMutexLocker locker(&registry.mutex);
+        for (const Slab *slab : registry.slabs) {
+            for (int c = 0; c < CounterCount; c++) {
+                counters[c] += slab->counters[c].load(std::memory_order_relaxed);
+            }
+            for (int h = 0; h < HistogramCount; h++) {
+                const HistogramData &data = slab->histograms[h];
+                for (int b = 0; b < BucketCount; b++) {
+                    buckets[h][b] += data.buckets[b].load(std::memory_order_relaxed);
+                }
+                counts[h] += data.count.load(std::memory_order_relaxed);
+                sums[h] += data.sum.load(std::memory_order_relaxed);
+                maxima[h] = qMax(maxima[h], data.max.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    QByteArray out = "# carpool metrics " + QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8() + "\n";
+    for (int c = 0; c < CounterCount; c++) {
+        out += line(CounterNames[c], "", counters[c]);
+    }
+    out += ratio("user_lookup_hit_rate", counters[UserLookups] - counters[UserLookupMisses], counters[UserLookups]);
+    out += ratio("ride_lookup_hit_rate", counters[RideLookups] - counters[RideLookupMisses], counters[RideLookups]);
+    out += ratio("route_search_results_mean", counters[RouteSearchResults], counters[RouteSearches]);
+    out += ratio("nearby_search_results_mean", counters[NearbySearchResults], counters[NearbySearches]);
+    out += ratio("booking_accept_rate", counters[BookingsAccepted],
+                 counters[BookingsAccepted] + counters[BookingsRejected]);
+
+    for (int h = 0; h < HistogramCount; h++) {
+        const char *name = HistogramNames[h];
+        out += line(name, "_count", counts[h]);
+        out += line(name, "_mean", counts[h] ? sums[h] / counts[h] : 0);
+
+        // The first bucket that reaches each percentile's rank
+        const double percentiles[] = {0.5, 0.9, 0.99};
+        const char *const suffixes[] = {"_p50", "_p90", "_p99"};
+        for (int p = 0; p < 3; p++) {
+            quint64 rank = quint64(percentiles[p] * counts[h] + 0.999999);
+            quint64 seen = 0;
+            quint64 bound = 0;
+            for (int b = 0; b < BucketCount && counts[h] > 0; b++) {
+                seen += buckets[h][b];
+                if (seen >= rank) {
+                    bound = b == 0 ? 0 : b == 64 ? maxima[h] : (quint64(1) << b) - 1;
+                    break;
+                }
+            }
+            out += line(name, suffixes[p], qMin(bound, maxima[h]));
+        }
+        out += line(name, "_max", maxima[h]);
+    }
+    return out;
+}
+
+MetricsReporter::MetricsReporter(const QString &path, QObject *parent)
+    : QObject(parent), path(path)
+{
+    connect(&timer, &QTimer::timeout, this, &MetricsReporter::flush);
+}
+
+void MetricsReporter::start(int intervalMs)
+{
+    timer.start(intervalMs);
+}
+
+void MetricsReporter::stop()
+{
+    timer.stop();
+}
+
+bool MetricsReporter::flush()
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    file.write(Metrics::report());
+    return file.commit();
+}
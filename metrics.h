@@ -0,0 +1,132 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <atomic>
+
+// Process-wide counters and histograms for the hot paths (lookups, booking,
+// loading, saving, list refreshes).
+//
+// Every thread updates its own slab of plain relaxed atomics, so an event
+// costs a thread-local load and an uncontended store, with no locking or
+// shared cache lines. report() sums the slabs of all threads, live or gone.
+// Histograms have power-of-two buckets; percentiles are reported as the
+// upper bound of the bucket they fall in.
+class Metrics {
+public:
+    enum Counter {
+        UserLookups,
+        UserLookupMisses,
+        RideLookups,
+        RideLookupMisses,
+        RouteSearches,
+        RouteSearchResults,
+        NearbySearches,
+        NearbySearchResults,
+        ArchivePageIns,
+        ArchivedRidesLoaded,
+        BookingsAccepted,
+        BookingsRejected,
+        FaresQuoted,
+        JournalEntries,
+        JournalBytes,
+        SnapshotBytes,
+        CounterCount
+    };
+    enum Histogram {
+        LoadNs,
+        SnapshotSaveNs,
+        SnapshotSize,           // bytes per snapshot written
+        JournalSyncNs,
+        ListRefreshNs,
+        BookingBatchNs,         // one bookRides() call
+        FareBatchNs,            // one batch of FareEngine quotes
+        HistogramCount
+    };
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+
+    static void count(Counter counter, quint64 amount = 1) {
+        if (!isEnabled()) return;
+        bump(slab()->counters[counter], amount);
+    }
+    static void record(Histogram histogram, quint64 value);
+
+    // Records the time from construction to destruction in a histogram
+    class Timer {
+    public:
+        explicit Timer(Histogram histogram) : histogram(histogram) {
+            if (isEnabled()) clock.start();
+        }
+        ~Timer() {
+            if (clock.isValid()) record(histogram, quint64(clock.nsecsElapsed()));
+        }
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+    private:
+        Histogram histogram;
+        QElapsedTimer clock;
+    };
+
+    // "name value" lines for every counter, hit rate and histogram
+    static QByteArray report();
+
+private:
+    static const int BucketCount = 65;      // bucket b holds values below 2^b
+
+    struct HistogramData {
+        std::atomic<quint64> buckets[BucketCount];
+        std::atomic<quint64> count;
+        std::atomic<quint64> sum;
+        std::atomic<quint64> max;
+    };
+    struct Slab {
+        std::atomic<quint64> counters[CounterCount];
+        HistogramData histograms[HistogramCount];
+    };
+
+    // Only the owning thread writes a slab, so a load and a store will do
+    static void bump(std::atomic<quint64> &value, quint64 amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    static Slab *slab() {
+        Slab *current = threadSlab;
+        return current ? current : attachThread();
+    }
+    static Slab *attachThread();
+
+    struct Registry;
+    struct SlabOwner;
+
+    static std::atomic<bool> enabled;
+    static thread_local Slab *threadSlab;
+    static thread_local SlabOwner slabOwner;    // returns the slab when the thread exits
+};
+
+// Writes Metrics::report() to a file at a fixed interval, replacing it
+// atomically each time, so it can be watched or scraped while running
+class MetricsReporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QString defaultPath() { return "metrics.txt"; }
+
+    explicit MetricsReporter(const QString &path = defaultPath(), QObject *parent = nullptr);
+
+    void start(int intervalMs = 10000);
+    void stop();
+    bool flush();
+
+private:
+    QString path;
+    QTimer timer;
+};
+
+#endif // METRICS_H
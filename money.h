@@ -0,0 +1,24 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <QString>
+#include <QtGlobal>
+
+// Amounts of money are kept as integer minor units (paisa, Rs 1 = 100) so
+// balances add up exactly. Fares and user input arrive as rupee doubles and
+// are rounded once, at the boundary.
+typedef qint64 Money;
+
+inline Money toMoney(double rupees) { return qRound64(rupees * 100); }
+inline double toRupees(Money amount) { return amount / 100.0; }
+
+// "1234.50"; exact for any amount, unlike formatting the double
+inline QString formatMoney(Money amount)
+{
+    QString sign = amount < 0 ? "-" : "";
+    quint64 magnitude = amount < 0 ? quint64(0) - quint64(amount) : quint64(amount);
+    return sign + QString::number(magnitude / 100) + "." +
+           QString::number(magnitude % 100).rightJustified(2, '0');
+}
+
+#endif // MONEY_H
@@ -0,0 +1,162 @@
+#include "persistenceworker.h"
+#include "metrics.h"
+#include "snapshot.h"
+
+PersistenceWorker::PersistenceWorker(const QString &journalPath, const QString &snapshotPath,
+                                     const QString &auditPath, const QString &archivePath,
+                                     QObject *parent)
+    : QObject(parent), journal(journalPath), audit(auditPath), archive(archivePath),
+      snapshotPath(snapshotPath), head(nullptr), stopping(0)
+{
+}
+
+PersistenceWorker::~PersistenceWorker()
+{
+    stop();
+}
+
+void PersistenceWorker::start()
+{
+    if (thread) return;
+
+    stopping.storeRelease(0);
+    thread = QThread::create([this]() { run(); });
+    thread->setObjectName("PersistenceWorker");
+    thread->start();
+}
+
+void PersistenceWorker::stop()
+{
+    if (!thread) return;
+
+    stopping.storeRelease(1);
+    wakeup.release();
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+}
+
+void PersistenceWorker::append(quint64 sequence, const QByteArray &line)
+{
+    push(new Task{Task::Entry, sequence, line, QByteArray(), nullptr});
+}
+
+void PersistenceWorker::checkpoint(quint64 sequence, const QByteArray &snapshot, const QByteArray &archived)
+{
+    push(new Task{Task::Checkpoint, sequence, snapshot, archived, nullptr});
+}
+
+void PersistenceWorker::push(Task *task)
+{
+    Task *old = head.loadRelaxed();
+    do {
+        task->next = old;
+    } while (!head.testAndSetOrdered(old, task, old));
+    wakeup.release();
+}
+
+PersistenceWorker::Task* PersistenceWorker::takeAll()
+{
+    // Detach the whole stack and reverse it into queue order
+    Task *task = head.fetchAndStoreAcquire(nullptr);
+    Task *ordered = nullptr;
+    while (task) {
+        Task *next = task->next;
+        task->next = ordered;
+        ordered = task;
+        task = next;
+    }
+    return ordered;
+}
+
+void PersistenceWorker::run()
+{
+    journal.open();
+
+    while (true) {
+        wakeup.acquire();
+        // Everything pushed so far is handled by this pass
+        wakeup.tryAcquire(wakeup.available());
+
+        process(takeAll());
+
+        if (stopping.loadAcquire() && !head.loadAcquire()) {
+            break;
+        }
+    }
+
+    journal.close();
+    audit.close();
+    archive.close();
+}
+
+void PersistenceWorker::process(Task *tasks)
+{
+    QByteArray pending;
+    quint64 pendingSequence = 0;
+
+    auto flush = [&]() {
+        if (pending.isEmpty()) return;
+        Metrics::count(Metrics::JournalBytes, pending.size());
+        Metrics::Timer timer(Metrics::JournalSyncNs);
+        if (journal.write(pending)) {
+            emit durable(pendingSequence);
+        } else {
+            emit writeFailed("Could not write journal");
+        }
+        pending.clear();
+    };
+
+    while (tasks) {
+        Task *task = tasks;
+        tasks = task->next;
+
+        if (task->kind == Task::Entry) {
+            pending += task->data;
+            pendingSequence = task->sequence;
+        } else {
+            flush();
+            Metrics::Timer timer(Metrics::SnapshotSaveNs);
+            Metrics::count(Metrics::SnapshotBytes, task->data.size());
+            Metrics::record(Metrics::SnapshotSize, task->data.size());
+            // The archived rides must be safe before the snapshot drops them
+            if ((task->archived.isEmpty() || archive.write(task->archived)) &&
+                archiveTransactions() && Snapshot::writeFile(snapshotPath, task->data) &&
+                journal.truncate()) {
+                emit checkpointed(task->sequence);
+            } else {
+                emit writeFailed("Could not write snapshot");
+            }
+        }
+        delete task;
+    }
+
+    flush();
+}
+
+bool PersistenceWorker::archiveTransactions()
+{
+    if (audit.filePath().isEmpty()) return true;
+
+    // A crash between writing the audit log and truncating the journal
+    // leaves entries in both; the next checkpoint must not copy them again
+    if (!auditRead) {
+        auditedSequence = Journal::lastSequence(audit.filePath());
+        auditRead = true;
+    }
+
+    // The journal holds exactly the entries since the last checkpoint, all
+    // of them synced by now
+    QByteArray lines;
+    quint64 lastSequence = auditedSequence;
+    for (const JournalEntry &entry : Journal::readAll(journal.filePath())) {
+        if (entry.op == "TXN" && entry.sequence > auditedSequence) {
+            lines += Journal::format(entry.sequence, entry.op, entry.args);
+            lastSequence = entry.sequence;
+        }
+    }
+    if (lines.isEmpty()) return true;
+    if (!audit.write(lines)) return false;
+    auditedSequence = lastSequence;
+    return true;
+}
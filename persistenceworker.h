@@ -0,0 +1,80 @@
+#ifndef PERSISTENCEWORKER_H
+#define PERSISTENCEWORKER_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QObject>
+#include <QSemaphore>
+#include <QString>
+#include <QThread>
+#include "journal.h"
+
+// Owns all disk writes so UI handlers never wait on the file system.
+//
+// The GUI thread hands over immutable, already formatted journal lines and
+// snapshot checkpoints through a lock-free queue. The worker thread drains
+// whatever has accumulated, writes each burst of journal lines with a single
+// write + sync, and writes checkpoints in queue order, so a checkpoint only
+// truncates the journal after every entry it covers is on disk. Rides a
+// checkpoint moves out of the snapshot are appended to the ride archive
+// before the snapshot is replaced.
+class PersistenceWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Ledger transactions (TXN entries) are copied to auditPath before a
+    // checkpoint empties the journal; an empty auditPath keeps no audit log.
+    // archivePath receives the archived rides handed to checkpoint().
+    PersistenceWorker(const QString &journalPath, const QString &snapshotPath,
+                      const QString &auditPath = QString(), const QString &archivePath = QString(),
+                      QObject *parent = nullptr);
+    ~PersistenceWorker();
+
+    void start();
+    // Writes everything still queued, then joins the thread
+    void stop();
+
+    // Both are safe to call from any thread and never block
+    void append(quint64 sequence, const QByteArray &line);
+    // archived holds journal-formatted RIDE lines for the ride archive
+    void checkpoint(quint64 sequence, const QByteArray &snapshot,
+                    const QByteArray &archived = QByteArray());
+
+signals:
+    // Every entry up to sequence has been synced to the journal
+    void durable(quint64 sequence);
+    // The snapshot for sequence is written and the journal was emptied
+    void checkpointed(quint64 sequence);
+    void writeFailed(const QString &message);
+
+private:
+    struct Task {
+        enum Kind { Entry, Checkpoint };
+        Kind kind;
+        quint64 sequence;
+        QByteArray data;
+        QByteArray archived;    // Checkpoint: lines for the ride archive
+        Task *next;
+    };
+
+    void push(Task *task);
+    Task* takeAll();
+    void run();
+    void process(Task *tasks);
+    bool archiveTransactions();
+
+    Journal journal;
+    Journal audit;
+    Journal archive;
+    QString snapshotPath;
+    quint64 auditedSequence = 0;    // last TXN entry in the audit log
+    bool auditRead = false;         // auditedSequence is read on the first checkpoint
+    QThread *thread = nullptr;
+    QAtomicPointer<Task> head;  // newest first; producers push, the worker takes all
+    QSemaphore wakeup;
+    QAtomicInt stopping;
+};
+
+#endif // PERSISTENCEWORKER_H
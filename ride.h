@@ -0,0 +1,292 @@
+#ifndef RIDE_H
+#define RIDE_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+#include <QTextStream>
+#include <QVector>
+#include <QDate>
+#include <QTime>
+#include <QDateTime>
+#include <limits>
+#include "geopoint.h"
+#include "money.h"
+#include "seatsegments.h"
+#include "stringpool.h"
+
+// Rides owned by a RideRepository must be mutated through the repository
+// so its indexes stay current. Names, routes and vehicle strings are kept as
+// StringPool ids; the QString getters resolve them for display.
+//
+// Departure and return times are parsed once, when the ride is created or
+// loaded, into seconds since 1970-01-01 00:00 of the entered wall-clock
+// time (no time zone is applied, so they round-trip exactly through the
+// "yyyy-MM-dd hh:mm" text form). A missing or unparseable time is NoTime.
+//
+// Origin and destination are optional pickup and drop-off points, set once
+// when the ride is created; rides without them are only found by route.
+//
+// A route naming more than two places ("Lahore to Okara to Multan") is a
+// multi-stop ride. Each passenger holds a seat over a leg between two of
+// its stops, and seats are counted per segment between consecutive stops,
+// so one seat can carry A->B and then B->C. A passenger booked without a
+// leg rides the whole trip.
+//
+// A ride created from a RideSchedule keeps the schedule's id; other rides
+// have scheduleId 0.
+//
+// The fare is the captain's asking price; passengers pay what the
+// FareEngine quotes when they book, and that amount is kept per passenger
+// so a cancellation refunds exactly what was paid.
+class Ride {
+public:
+    struct Leg {
+        int from;       // stop indexes, from < to
+        int to;
+        bool operator==(const Leg &other) const { return from == other.from && to == other.to; }
+    };
+
+private:
+    int captainId;
+    int passengerId;
+    int routeId;
+    qint64 departureTime;
+    qint64 returnTime;
+    int vehicleTypeId;
+    int vehicleClassId;
+    QVector<int> passengers;
+    QVector<Leg> legs;              // per passenger
+    QVector<Money> paidFares;       // per passenger; 0 if not recorded
+    int totalSeats;
+    int occupiedSeats;
+    bool isCompleted;
+    double fare;
+    bool isRated = false;
+    int id = 0;
+    GeoPoint origin;
+    GeoPoint destination;
+    SeatSegments segmentSeats;
+    int scheduleId = 0;
+
+public:
+    static const qint64 NoTime = std::numeric_limits<qint64>::min();
+
+    // "yyyy-MM-dd hh:mm" -> seconds, or NoTime if text isn't a valid time
+    static qint64 parseTime(const QString &text) {
+        QDate date = QDate::fromString(text.left(10), "yyyy-MM-dd");
+        QTime time = QTime::fromString(text.mid(11), "hh:mm");
+        if (text.size() != 16 || text[10] != ' ' || !date.isValid() || !time.isValid()) {
+            return NoTime;
+        }
+        return QDate(1970, 1, 1).daysTo(date) * 86400 + time.msecsSinceStartOfDay() / 1000;
+    }
+    static QString formatTime(qint64 seconds) {
+        if (seconds == NoTime) return QString();
+        qint64 days = seconds / 86400;
+        qint64 rest = seconds % 86400;
+        if (rest < 0) {
+            days--;
+            rest += 86400;
+        }
+        return QDate(1970, 1, 1).addDays(days).toString("yyyy-MM-dd") + " " +
+               QTime(0, 0).addSecs(int(rest)).toString("hh:mm");
+    }
+    // The current wall-clock time on the same scale as parseTime()
+    static qint64 currentTime() {
+        QDateTime now = QDateTime::currentDateTime();
+        return QDate(1970, 1, 1).daysTo(now.date()) * 86400 + now.time().msecsSinceStartOfDay() / 1000;
+    }
+
+    // The places a route passes through, in order; " to " separates them
+    static QStringList stopsOf(const QString &route) {
+        QStringList stops = route.split(" to ", Qt::KeepEmptyParts, Qt::CaseInsensitive);
+        for (QString &stop : stops) {
+            stop = stop.trimmed();
+        }
+        return stops;
+    }
+    static int segmentCountOf(const QString &route) {
+        return qMax(1, int(route.count(" to ", Qt::CaseInsensitive)));
+    }
+
+    Ride(QString capUser, QString passUser, QString rt, qint64 depTime, qint64 retTime,
+         QString vType, QString vClass, int seats, double fr)
+        : captainId(internString(capUser)), passengerId(internString(passUser)), routeId(internString(rt)),
+        departureTime(depTime), returnTime(retTime), vehicleTypeId(internString(vType)),
+        vehicleClassId(internString(vClass)), totalSeats(seats), occupiedSeats(0), isCompleted(false), fare(fr),
+        segmentSeats(segmentCountOf(rt)) {}
+
+    // Takes a seat on every segment of the leg, if one is free on all of them
+    bool addPassenger(int usernameId, const Leg &leg) {
+        if (!segmentSeats.isValidRange(leg.from, leg.to) || passengers.contains(usernameId) ||
+            seatsFreeBetween(leg.from, leg.to) <= 0) {
+            return false;
+        }
+        passengers.append(usernameId);
+        legs.append(leg);
+        paidFares.append(0);
+        segmentSeats.add(leg.from, leg.to, 1);
+        return true;
+    }
+    bool addPassenger(int usernameId) { return addPassenger(usernameId, wholeTrip()); }
+    bool addPassenger(const QString &username, const Leg &leg) { return addPassenger(internString(username), leg); }
+    bool addPassenger(const QString &username) { return addPassenger(internString(username)); }
+
+    bool removePassenger(int usernameId) {
+        int index = passengers.indexOf(usernameId);
+        if (index < 0) {
+            return false;
+        }
+        segmentSeats.add(legs[index].from, legs[index].to, -1);
+        passengers.remove(index);
+        legs.remove(index);
+        paidFares.remove(index);
+        // The first remaining passenger becomes the one shown to the captain
+        if (passengerId == usernameId) {
+            passengerId = passengers.isEmpty() ? 0 : passengers.first();
+        }
+        return true;
+    }
+    bool removePassenger(const QString &username) {
+        int usernameId = StringPool::instance().find(username);
+        return usernameId > 0 && removePassenger(usernameId);
+    }
+
+    bool hasPassenger(int usernameId) const { return passengers.contains(usernameId); }
+
+    void clearPassengers() {
+        passengers.clear();
+        legs.clear();
+        paidFares.clear();
+        segmentSeats.reset(segmentSeats.segments());
+        passengerId = 0;
+    }
+
+    QString getPassengersString() const {
+        return getPassengers().join(", ");
+    }
+
+    // One rides.txt line (without the trailing newline). Passengers are
+    // separated by ';'; the ride id follows them, then the origin and
+    // destination as "lat;lon" (empty when unset), then each passenger's
+    // leg as "from-to", ';'-separated (empty when all ride the whole trip),
+    // then the schedule id (0 for a one-off ride), then what each passenger
+    // paid in paisa, ';'-separated (empty when none was recorded).
+    QString toRecord() const {
+        QString line;
+        QTextStream out(&line);
+        out << getCaptain() << "," << getPassenger() << ","
+            << getRoute() << "," << getDepartureTime() << ","
+            << getReturnTime() << "," << getVehicleType() << ","
+            << getVehicleClass() << "," << totalSeats << ","
+            << occupiedSeats << "," << (isCompleted ? "1" : "0") << ","
+            << fare << "," << (isRated ? "1" : "0") << ","
+            << getPassengers().join(";") << "," << id << ","
+            << origin.toText() << "," << destination.toText() << "," << getLegsText() << ","
+            << scheduleId << "," << getPaidFaresText();
+        out.flush();
+        return line;
+    }
+
+    void saveToFile(QFile &file) {
+        QTextStream out(&file);
+        out << toRecord() << "\n";
+    }
+
+    // Getters
+    int getId() const { return id; }
+    QString getCaptain() const { return pooledString(captainId); }
+    QString getPassenger() const { return pooledString(passengerId); }
+    QString getRoute() const { return pooledString(routeId); }
+    QString getDepartureTime() const { return formatTime(departureTime); }
+    QString getReturnTime() const { return formatTime(returnTime); }
+    QString getVehicleType() const { return pooledString(vehicleTypeId); }
+    QStringList getPassengers() const {
+        QStringList names;
+        names.reserve(passengers.size());
+        for (int passenger : passengers) {
+            names.append(pooledString(passenger));
+        }
+        return names;
+    }
+    QString getVehicleClass() const { return pooledString(vehicleClassId); }
+    int getCaptainId() const { return captainId; }
+    int getPassengerId() const { return passengerId; }
+    int getRouteId() const { return routeId; }
+    int getVehicleTypeId() const { return vehicleTypeId; }
+    int getVehicleClassId() const { return vehicleClassId; }
+    qint64 getDepartureEpoch() const { return departureTime; }
+    qint64 getReturnEpoch() const { return returnTime; }
+    const QVector<int> &getPassengerIds() const { return passengers; }
+    int getTotalSeats() const { return totalSeats; }
+    int getOccupiedSeats() const { return occupiedSeats; }
+    // Seats free for the whole trip
+    int getAvailableSeats() const { return totalSeats - segmentSeats.peak(); }
+    // Seats free on every segment between two stops, in O(log segments)
+    int seatsFreeBetween(int fromStop, int toStop) const { return totalSeats - segmentSeats.maxOver(fromStop, toStop); }
+    // Seats taken on the busiest segment
+    int getPeakOccupancy() const { return segmentSeats.peak(); }
+    const SeatSegments &getSeatSegments() const { return segmentSeats; }
+    QStringList getStops() const { return stopsOf(getRoute()); }
+    int getSegmentCount() const { return segmentSeats.segments(); }
+    Leg wholeTrip() const { return Leg{0, segmentSeats.segments()}; }
+    bool isValidLeg(const Leg &leg) const { return segmentSeats.isValidRange(leg.from, leg.to); }
+    // The passenger's leg; the whole trip if they hold no seat
+    Leg getLeg(int usernameId) const {
+        int index = passengers.indexOf(usernameId);
+        return index < 0 ? wholeTrip() : legs[index];
+    }
+    const QVector<Leg> &getLegs() const { return legs; }
+    QString getLegsText() const {
+        QStringList parts;
+        bool partial = false;
+        for (const Leg &leg : legs) {
+            partial = partial || !(leg == wholeTrip());
+            parts.append(QString("%1-%2").arg(leg.from).arg(leg.to));
+        }
+        return partial ? parts.join(";") : QString();
+    }
+    // What the passenger paid for their seat; 0 if not recorded
+    Money getPaidFare(int usernameId) const {
+        int index = passengers.indexOf(usernameId);
+        return index < 0 ? 0 : paidFares[index];
+    }
+    const QVector<Money> &getPaidFares() const { return paidFares; }
+    QString getPaidFaresText() const {
+        QStringList parts;
+        bool recorded = false;
+        for (Money paid : paidFares) {
+            recorded = recorded || paid != 0;
+            parts.append(QString::number(paid));
+        }
+        return recorded ? parts.join(";") : QString();
+    }
+    bool getIsCompleted() const { return isCompleted; }
+    double getFare() const { return fare; }
+    bool getIsRated() const { return isRated; }
+    const GeoPoint &getOrigin() const { return origin; }
+    const GeoPoint &getDestination() const { return destination; }
+    int getScheduleId() const { return scheduleId; }
+    // No segment has a seat left
+    bool isFull() const { return segmentSeats.lowest() >= totalSeats; }
+
+    // Setters
+    void setId(int rideId) { id = rideId; }
+    void setScheduleId(int schedule) { scheduleId = schedule; }
+    void setPaidFare(int usernameId, Money paid) {
+        int index = passengers.indexOf(usernameId);
+        if (index >= 0) paidFares[index] = paid;
+    }
+    void setPassenger(int usernameId) { passengerId = usernameId; }
+    void setPassenger(const QString &passenger) { passengerId = internString(passenger); }
+    void setOccupiedSeats(int seats) { occupiedSeats = seats; }
+    void setIsCompleted(bool completed) { isCompleted = completed; }
+    void setIsRated(bool rated) { isRated = rated; }
+    void setEndpoints(const GeoPoint &from, const GeoPoint &to) {
+        origin = from;
+        destination = to;
+    }
+};
+
+#endif // RIDE_H
@@ -0,0 +1,140 @@
+#include "ridelistmodel.h"
+#include "metrics.h"
+#include <algorithm>
+
+RideListModel::RideListModel(const RideRepository &repository, Formatter formatter, QObject *parent)
+    : QAbstractListModel(parent), repository(repository),
+      formatter([formatter](const Ride *ride, Money) { return formatter(ride); })
+{
+}
+
+RideListModel::RideListModel(const RideRepository &repository, Pricer pricer, PricedFormatter formatter,
+                             QObject *parent)
+    : QAbstractListModel(parent), repository(repository), pricer(pricer), formatter(formatter)
+{
+}
+
+int RideListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+QVariant RideListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+
+    const Row &row = rows.at(index.row());
+    if (role == Qt::UserRole) {
+        return QVariant::fromValue(row.handle);
+    }
+    if (role == Qt::DisplayRole) {
+        const Ride* ride = repository.get(row.handle);
+        return ride ? formatter(ride, row.fare) : QVariant();
+    }
+    return QVariant();
+}
+
+void RideListModel::reset(const QList<Ride*> &candidates, Filter rowFilter)
+{
+    resetRows(candidates, rowFilter);
+}
+
+void RideListModel::reset(const QMap<int, Ride*> &candidates, Filter rowFilter)
+{
+    resetRows(candidates, rowFilter);
+}
+
+template <typename Container>
+void RideListModel::resetRows(const Container &candidates, Filter rowFilter)
+{
+    Metrics::Timer timer(Metrics::ListRefreshNs);
+    beginResetModel();
+    filter = rowFilter;
+    rows.clear();
+    rows.reserve(candidates.size());
+    for (Ride* ride : candidates) {
+        if (filter(ride)) {
+            rows.append({ride->getId(), repository.handleOf(ride), 0});
+        }
+    }
+    priceRows(0, rows.size());
+    endResetModel();
+}
+
+void RideListModel::priceRows(int first, int count)
+{
+    if (!pricer || count <= 0) return;
+
+    QVector<const Ride*> rides;
+    rides.reserve(count);
+    for (int i = first; i < first + count; i++) {
+        rides.append(repository.get(rows[i].handle));
+    }
+    QVector<Money> fares;
+    pricer(rides, &fares);
+    for (int i = 0; i < count && i < fares.size(); i++) {
+        rows[first + i].fare = fares[i];
+    }
+}
+
+void RideListModel::clear()
+{
+    beginResetModel();
+    filter = nullptr;
+    rows.clear();
+    endResetModel();
+}
+
+void RideListModel::rideChanged(const Ride *ride)
+{
+    if (!filter || !ride) return;
+
+    int position = lowerBound(ride->getId());
+    bool present = position < rows.size() && rows[position].rideId == ride->getId();
+    bool wanted = filter(ride);
+
+    if (present && wanted) {
+        // Bookings change the price along with the seats
+        priceRows(position, 1);
+        QModelIndex changed = index(position);
+        emit dataChanged(changed, changed, {Qt::DisplayRole});
+    } else if (present) {
+        beginRemoveRows(QModelIndex(), position, position);
+        rows.remove(position);
+        endRemoveRows();
+    } else if (wanted) {
+        beginInsertRows(QModelIndex(), position, position);
+        rows.insert(position, {ride->getId(), repository.handleOf(ride), 0});
+        priceRows(position, 1);
+        endInsertRows();
+    }
+}
+
+void RideListModel::rideRemoved(const Ride *ride)
+{
+    if (!ride) return;
+
+    int position = lowerBound(ride->getId());
+    if (position < rows.size() && rows[position].rideId == ride->getId()) {
+        beginRemoveRows(QModelIndex(), position, position);
+        rows.remove(position);
+        endRemoveRows();
+    }
+}
+
+Ride* RideListModel::rideAt(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return nullptr;
+    }
+    return repository.get(rows.at(index.row()).handle);
+}
+
+int RideListModel::lowerBound(int rideId) const
+{
+    auto it = std::lower_bound(rows.constBegin(), rows.constEnd(), rideId,
+                               [](const Row &row, int id) { return row.rideId < id; });
+    return int(it - rows.constBegin());
+}
@@ -0,0 +1,70 @@
+#ifndef RIDELISTMODEL_H
+#define RIDELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <functional>
+#include "money.h"
+#include "riderepository.h"
+
+// List model over a subset of the ride repository (open rides, a captain's
+// rides, a passenger's rides). Rows hold only ride ids and handles; the text
+// is formatted in data(), so the view only pays for the rows it paints.
+// rideChanged()/rideRemoved() keep the rows current with single-row
+// insert/remove signals instead of rebuilding the list.
+//
+// A model with a Pricer keeps a live fare per row: reset() prices every
+// row in one batch, and a changed or inserted row is priced on its own.
+class RideListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<bool(const Ride*)> Filter;
+    typedef std::function<QString(const Ride*)> Formatter;
+    // Sets fares to one price per ride (e.g. FareEngine::quote())
+    typedef std::function<void(const QVector<const Ride*> &rides, QVector<Money> *fares)> Pricer;
+    typedef std::function<QString(const Ride*, Money fare)> PricedFormatter;
+
+    RideListModel(const RideRepository &repository, Formatter formatter, QObject *parent = nullptr);
+    RideListModel(const RideRepository &repository, Pricer pricer, PricedFormatter formatter,
+                  QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Replaces the rows with the candidates that pass filter. Candidates
+    // must be ordered by ride id, as every RideRepository query but
+    // openRidesNear() is.
+    void reset(const QList<Ride*> &candidates, Filter rowFilter);
+    void reset(const QMap<int, Ride*> &candidates, Filter rowFilter);
+    void clear();
+
+    // Re-evaluates the filter for one ride and inserts, removes or
+    // refreshes its row accordingly
+    void rideChanged(const Ride *ride);
+    void rideRemoved(const Ride *ride);
+
+    Ride* rideAt(const QModelIndex &index) const;
+
+private:
+    struct Row {
+        int rideId;
+        RideHandle handle;
+        Money fare;
+    };
+
+    template <typename Container>
+    void resetRows(const Container &candidates, Filter rowFilter);
+    // Prices rows [first, first + count) in one batch
+    void priceRows(int first, int count);
+    int lowerBound(int rideId) const;
+
+    const RideRepository &repository;
+    Pricer pricer;
+    PricedFormatter formatter;
+    Filter filter;
+    QVector<Row> rows;      // sorted by ride id
+};
+
+#endif // RIDELISTMODEL_H
@@ -0,0 +1,306 @@
+#include "riderepository.h"
+
+RideRepository::~RideRepository()
+{
+    clear();
+}
+
+Ride* RideRepository::createFromRecord(const Record &record)
+{
+    Ride* ride = create(record.captain, record.passenger, record.route,
+                        record.departureTime, record.returnTime,
+                        record.vehicleType, record.vehicleClass, record.totalSeats, record.fare);
+    // Legs and paid fares only apply if there is one for every passenger
+    const bool withLegs = record.legs.size() == record.passengers.size();
+    const bool withPaid = record.paidFares.size() == record.passengers.size();
+    for (int i = 0; i < record.passengers.size(); i++) {
+        const bool added = withLegs ? ride->addPassenger(record.passengers[i], record.legs[i])
+                                    : ride->addPassenger(record.passengers[i]);
+        if (added && withPaid) {
+            ride->setPaidFare(internString(record.passengers[i]), record.paidFares[i]);
+        }
+    }
+    ride->setOccupiedSeats(record.occupiedSeats);
+    ride->setIsCompleted(record.completed);
+    ride->setIsRated(record.rated);
+    ride->setId(record.id);
+    ride->setEndpoints(record.origin, record.destination);
+    ride->setScheduleId(record.scheduleId);
+    return ride;
+}
+
+Ride* RideRepository::createFromRecord(const QStringList &parts)
+{
+    Record record;
+    return decodeRecord(parts, &record) ? createFromRecord(record) : nullptr;
+}
+
+void RideRepository::reserve(int count)
+{
+    pool.reserve(count);
+}
+
+bool RideRepository::add(Ride *ride)
+{
+    if (!ride) return false;
+
+    if (ride->getId() <= 0) {
+        ride->setId(nextRideId);
+    } else if (rides.contains(ride->getId())) {
+        return false;
+    }
+
+    rides.insert(ride->getId(), ride);
+    nextRideId = qMax(nextRideId, ride->getId() + 1);
+    index(ride);
+    return true;
+}
+
+void RideRepository::remove(Ride *ride)
+{
+    if (!ride || rides.value(ride->getId()) != ride) return;
+
+    unindex(ride);
+    rides.remove(ride->getId());
+    archived.remove(ride->getId());
+    pool.destroy(ride);
+}
+
+bool RideRepository::book(Ride *ride, int passengerId)
+{
+    return book(ride, passengerId, ride->wholeTrip());
+}
+
+bool RideRepository::book(Ride *ride, int passengerId, const Ride::Leg &leg, Money paid)
+{
+    unindex(ride);
+    // Occupied seats follow the busiest segment, which a short leg may not touch
+    const int peak = ride->getPeakOccupancy();
+    bool added = ride->addPassenger(passengerId, leg);
+    if (added) {
+        ride->setOccupiedSeats(ride->getOccupiedSeats() + ride->getPeakOccupancy() - peak);
+        ride->setPaidFare(passengerId, paid);
+        if (ride->getPassengerId() == 0) {
+            ride->setPassenger(passengerId);
+        }
+    }
+    index(ride);
+    return added;
+}
+
+bool RideRepository::release(Ride *ride, int passengerId)
+{
+    unindex(ride);
+    const int peak = ride->getPeakOccupancy();
+    bool removed = ride->removePassenger(passengerId);
+    if (removed) {
+        ride->setOccupiedSeats(qMax(0, ride->getOccupiedSeats() + ride->getPeakOccupancy() - peak));
+    }
+    index(ride);
+    return removed;
+}
+
+void RideRepository::releaseAll(Ride *ride)
+{
+    unindex(ride);
+    ride->clearPassengers();
+    ride->setOccupiedSeats(0);
+    index(ride);
+}
+
+void RideRepository::complete(Ride *ride)
+{
+    unindex(ride);
+    ride->setIsCompleted(true);
+    index(ride);
+}
+
+void RideRepository::markRated(Ride *ride)
+{
+    unindex(ride);
+    ride->setIsRated(true);
+    archived.remove(ride->getId());
+    index(ride);
+}
+
+QList<Ride*> RideRepository::searchOpenRides(const QString &query) const
+{
+    QList<Ride*> result;
+    const QVector<int> ids = routes.search(query);
+    Metrics::count(Metrics::RouteSearches);
+    Metrics::count(Metrics::RouteSearchResults, ids.size());
+    result.reserve(ids.size());
+    for (int id : ids) {
+        result.append(open.value(id));
+    }
+    return result;
+}
+
+QList<Ride*> RideRepository::openRidesNear(const GeoPoint &origin, const GeoPoint &destination,
+                                          double radiusMetres) const
+{
+    QList<Ride*> result;
+    const QVector<int> ids = nearby.search(origin, destination, radiusMetres);
+    Metrics::count(Metrics::NearbySearches);
+    Metrics::count(Metrics::NearbySearchResults, ids.size());
+    result.reserve(ids.size());
+    for (int id : ids) {
+        result.append(open.value(id));
+    }
+    return result;
+}
+
+QList<Ride*> RideRepository::activeRidesForCaptain(int captainId) const
+{
+    return activeByCaptain.value(captainId).values();
+}
+
+QList<Ride*> RideRepository::activeRidesForPassenger(int passengerId) const
+{
+    return activeByPassenger.value(passengerId).values();
+}
+
+int RideRepository::activeRideCount(int passengerId) const
+{
+    auto it = activeByPassenger.constFind(passengerId);
+    return it == activeByPassenger.constEnd() ? 0 : it->size();
+}
+
+QList<Ride*> RideRepository::openRidesDepartingBetween(qint64 from, qint64 to) const
+{
+    QList<Ride*> result;
+    auto end = openByDeparture.lowerBound(TimeKey(to, 0));
+    for (auto it = openByDeparture.lowerBound(TimeKey(from, 0)); it != end; ++it) {
+        result.append(it.value());
+    }
+    return result;
+}
+
+int RideRepository::routeKeyFor(const QString &route) const
+{
+    return StringPool::instance().find(normalizedRoute(route));
+}
+
+const RideRepository::RidesByDeparture &RideRepository::openRidesOnRoute(int routeKey) const
+{
+    static const RidesByDeparture none;
+    auto it = openByRoute.constFind(routeKey);
+    return it == openByRoute.constEnd() ? none : *it;
+}
+
+Ride* RideRepository::latestUnratedRideForPassenger(int passengerId) const
+{
+    auto it = unratedByPassenger.constFind(passengerId);
+    return it == unratedByPassenger.constEnd() ? nullptr : it->last();
+}
+
+void RideRepository::clear()
+{
+    pool.clear();
+    rides.clear();
+    open.clear();
+    routes.clear();
+    nearby.clear();
+    openByDeparture.clear();
+    openByRoute.clear();
+    activeByCaptain.clear();
+    activeByPassenger.clear();
+    unratedByPassenger.clear();
+    completed.clear();
+    archived.clear();
+    nextRideId = 1;
+}
+
+void RideRepository::index(Ride *ride)
+{
+    const QVector<int> &passengers = ride->getPassengerIds();
+
+    if (ride->getIsCompleted()) {
+        completed.insert(ride->getId(), ride);
+        if (!ride->getIsRated()) {
+            for (int passenger : passengers) {
+                insertInto(unratedByPassenger, passenger, ride);
+            }
+        }
+        return;
+    }
+
+    insertInto(activeByCaptain, ride->getCaptainId(), ride);
+    for (int passenger : passengers) {
+        insertInto(activeByPassenger, passenger, ride);
+    }
+    // Open while some segment has a seat free; single-segment rides also
+    // honour an occupied count above their passenger list, as older
+    // records may have one
+    if (!ride->isFull() && (ride->getSegmentCount() > 1 || ride->getOccupiedSeats() < ride->getTotalSeats())) {
+        open.insert(ride->getId(), ride);
+        routes.insert(ride->getId(), ride->getRouteId());
+        nearby.insert(ride->getId(), ride->getOrigin(), ride->getDestination());
+        if (ride->getDepartureEpoch() != Ride::NoTime) {
+            openByDeparture.insert(timeKey(ride), ride);
+            insertInto(openByRoute, routeKeyOf(ride->getRouteId()), ride);
+        }
+    }
+}
+
+void RideRepository::unindex(Ride *ride)
+{
+    // Mirrors index(): must run before the ride's state changes
+    const QVector<int> &passengers = ride->getPassengerIds();
+
+    if (open.remove(ride->getId())) {
+        routes.remove(ride->getId(), ride->getRouteId());
+        nearby.remove(ride->getId(), ride->getOrigin());
+        if (openByDeparture.remove(timeKey(ride))) {
+            removeFrom(openByRoute, routeKeyOf(ride->getRouteId()), ride);
+        }
+    }
+    completed.remove(ride->getId());
+    removeFrom(activeByCaptain, ride->getCaptainId(), ride);
+    for (int passenger : passengers) {
+        removeFrom(activeByPassenger, passenger, ride);
+        removeFrom(unratedByPassenger, passenger, ride);
+    }
+}
+
+int RideRepository::routeKeyOf(int routeId)
+{
+    // Routes are interned, so each distinct one is normalized once
+    auto it = routeKeys.constFind(routeId);
+    if (it == routeKeys.constEnd()) {
+        it = routeKeys.insert(routeId, internString(normalizedRoute(pooledString(routeId))));
+    }
+    return *it;
+}
+
+void RideRepository::insertInto(RideIndex &index, int key, Ride *ride)
+{
+    index[key].insert(ride->getId(), ride);
+}
+
+void RideRepository::removeFrom(RideIndex &index, int key, Ride *ride)
+{
+    auto it = index.find(key);
+    if (it == index.end()) return;
+
+    it->remove(ride->getId());
+    if (it->isEmpty()) {
+        index.erase(it);
+    }
+}
+
+void RideRepository::insertInto(TimedRideIndex &index, int key, Ride *ride)
+{
+    index[key].insert(timeKey(ride), ride);
+}
+
+void RideRepository::removeFrom(TimedRideIndex &index, int key, Ride *ride)
+{
+    auto it = index.find(key);
+    if (it == index.end()) return;
+
+    it->remove(timeKey(ride));
+    if (it->isEmpty()) {
+        index.erase(it);
+    }
+}
@@ -0,0 +1,221 @@
+#ifndef RIDEREPOSITORY_H
+#define RIDEREPOSITORY_H
+
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QMetaType>
+#include "entitypool.h"
+#include "geoindex.h"
+#include "metrics.h"
+#include "ride.h"
+#include "routeindex.h"
+#include "textrecord.h"
+
+// Owns every Ride and keeps secondary indexes so dashboard queries cost as
+// much as their result instead of a scan over all rides:
+//   captain   -> active (not completed) rides
+//   passenger -> active rides holding one of their seats
+//   open rides (not completed, a seat left on some segment)
+//   route token -> open rides (for the book-ride search)
+//   open rides by departure time
+//   route -> open rides by departure time (for the seat matcher)
+//   open rides with a pickup point, on a grid (for nearby searches)
+//   passenger -> completed rides that haven't been rated yet, by departure
+//   completed rides, which checkpoints move out to the ride archive
+// Index keys are StringPool ids and the inner maps are keyed by ride id,
+// so most lists come out in creation order; the time indexes are keyed by
+// (departure, ride id) so range and latest-ride queries are log-time.
+// Rides are allocated from a slab pool; UI code should hold RideHandles,
+// which go stale safely on removal.
+typedef EntityPool<Ride> RidePool;
+typedef RidePool::Handle RideHandle;
+
+class RideRepository {
+public:
+    typedef QPair<qint64, int> TimeKey;     // (departure, ride id)
+    typedef QMap<TimeKey, Ride*> RidesByDeparture;
+
+    RideRepository() {}
+    ~RideRepository();
+
+    RideRepository(const RideRepository &) = delete;
+    RideRepository &operator=(const RideRepository &) = delete;
+
+    // Allocates a ride in the pool; it isn't indexed until add()
+    template <typename... Args>
+    Ride* create(Args&&... args) { return pool.create(std::forward<Args>(args)...); }
+    // The values of one rides.txt line; like UserDirectory::Record, decoded
+    // without touching the repository
+    struct Record {
+        QString captain;
+        QString passenger;
+        QString route;
+        qint64 departureTime = Ride::NoTime;
+        qint64 returnTime = Ride::NoTime;
+        QString vehicleType;
+        QString vehicleClass;
+        int totalSeats = 0;
+        int occupiedSeats = 0;
+        bool completed = false;
+        double fare = 0;
+        bool rated = false;
+        QStringList passengers;
+        int id = 0;                     // 0 for records written before ride ids existed
+        GeoPoint origin;                // unset in records written before rides had locations
+        GeoPoint destination;
+        QVector<Ride::Leg> legs;        // per passenger; empty when all ride the whole trip
+        int scheduleId = 0;             // 0 for one-off rides
+        QVector<Money> paidFares;       // per passenger; empty when none was recorded
+    };
+    // Fields is a QStringList or a list of QByteArray views of the line;
+    // returns false for malformed records
+    template <typename Fields>
+    static bool decodeRecord(const Fields &parts, Record *record);
+    Ride* createFromRecord(const Record &record);
+    // Decodes and creates in one step; returns nullptr for malformed records
+    Ride* createFromRecord(const QStringList &parts);
+    // Frees a ride that was created but not (successfully) added
+    void destroy(Ride *ride) { pool.destroy(ride); }
+    void reserve(int count);
+
+    // Indexes a ride created by this repository. A ride without an id gets
+    // the next free one; returns false if the id is already taken.
+    bool add(Ride *ride);
+    void remove(Ride *ride);
+
+    RideHandle handleOf(const Ride *ride) const { return pool.handleOf(ride); }
+    Ride* get(const RideHandle &handle) const { return pool.get(handle); }
+    Ride* find(int id) const {
+        Ride* ride = rides.value(id, nullptr);
+        Metrics::count(Metrics::RideLookups);
+        if (!ride) Metrics::count(Metrics::RideLookupMisses);
+        return ride;
+    }
+    int nextId() const { return nextRideId; }
+    // Keeps ids below next from being reused by rides that aren't in
+    // memory (e.g. archived ones)
+    void reserveIds(int next) { nextRideId = qMax(nextRideId, next); }
+
+    // State changes; each one re-indexes only the affected ride. A booking
+    // without a leg is for the whole trip; paid is what the seat cost.
+    bool book(Ride *ride, int passengerId);
+    bool book(Ride *ride, int passengerId, const Ride::Leg &leg, Money paid = 0);
+    bool release(Ride *ride, int passengerId);
+    void releaseAll(Ride *ride);
+    void complete(Ride *ride);
+    void markRated(Ride *ride);
+
+    const QMap<int, Ride*> &all() const { return rides; }
+    const QMap<int, Ride*> &openRides() const { return open; }
+    // Open rides whose route matches every word of query, the last word as
+    // a prefix; ordered by ride id like openRides()
+    QList<Ride*> searchOpenRides(const QString &query) const;
+    // Open rides picking up within radiusMetres of origin and, if
+    // destination is valid, dropping off within radiusMetres of it;
+    // nearest pickup first. Rides without locations are never returned.
+    QList<Ride*> openRidesNear(const GeoPoint &origin, const GeoPoint &destination,
+                               double radiusMetres) const;
+    QList<Ride*> activeRidesForCaptain(int captainId) const;
+    QList<Ride*> activeRidesForPassenger(int passengerId) const;
+    int activeRideCount(int passengerId) const;
+    // Open rides departing in [from, to), earliest first; rides without a
+    // departure time are never returned
+    QList<Ride*> openRidesDepartingBetween(qint64 from, qint64 to) const;
+    // Routes that differ only in case and spacing share a key; 0 if no
+    // ride has had the route yet
+    int routeKeyFor(const QString &route) const;
+    // Open rides with a departure time on the route, earliest first
+    const RidesByDeparture &openRidesOnRoute(int routeKey) const;
+    // The unrated completed ride with the latest departure, or nullptr
+    Ride* latestUnratedRideForPassenger(int passengerId) const;
+
+    // Completed rides in memory, by id. Their state is kept in the ride
+    // archive once saved there, and they are paged back in on demand.
+    const QMap<int, Ride*> &completedRides() const { return completed; }
+    // True while the archive holds the ride's current state
+    bool isArchived(const Ride *ride) const { return archived.contains(ride->getId()); }
+    void setArchived(const Ride *ride) { archived.insert(ride->getId()); }
+
+    int size() const { return rides.size(); }
+    void clear();
+
+private:
+    typedef QHash<int, QMap<int, Ride*>> RideIndex;
+    typedef QHash<int, RidesByDeparture> TimedRideIndex;
+
+    void index(Ride *ride);
+    void unindex(Ride *ride);
+    static TimeKey timeKey(const Ride *ride) { return TimeKey(ride->getDepartureEpoch(), ride->getId()); }
+    static QString normalizedRoute(const QString &route) { return RouteIndex::words(route).join(' '); }
+    int routeKeyOf(int routeId);
+    static void insertInto(RideIndex &index, int key, Ride *ride);
+    static void removeFrom(RideIndex &index, int key, Ride *ride);
+    static void insertInto(TimedRideIndex &index, int key, Ride *ride);
+    static void removeFrom(TimedRideIndex &index, int key, Ride *ride);
+
+    RidePool pool;
+    QMap<int, Ride*> rides;
+    QMap<int, Ride*> open;
+    RouteIndex routes;
+    GeoIndex nearby;
+    QMap<TimeKey, Ride*> openByDeparture;
+    TimedRideIndex openByRoute;
+    QHash<int, int> routeKeys;              // route id -> route key, both StringPool ids
+    RideIndex activeByCaptain;
+    RideIndex activeByPassenger;
+    TimedRideIndex unratedByPassenger;
+    QMap<int, Ride*> completed;
+    QSet<int> archived;
+    int nextRideId = 1;
+};
+
+template <typename Fields>
+bool RideRepository::decodeRecord(const Fields &parts, Record *record)
+{
+    if (parts.size() < 13) return false;
+
+    record->captain = fieldText(parts[0]);
+    record->passenger = fieldText(parts[1]);
+    record->route = fieldText(parts[2]);
+    record->departureTime = Ride::parseTime(fieldText(parts[3]));
+    record->returnTime = Ride::parseTime(fieldText(parts[4]));
+    record->vehicleType = fieldText(parts[5]);
+    record->vehicleClass = fieldText(parts[6]);
+    record->totalSeats = fieldInt(parts[7]);
+    record->occupiedSeats = fieldInt(parts[8]);
+    record->completed = parts[9] == "1";
+    record->fare = fieldDouble(parts[10]);
+    record->rated = parts[11] == "1";
+    forEachPart(parts[12], ';', [record](const auto &name) {
+        if (!name.isEmpty()) record->passengers.append(fieldText(name));
+    });
+    record->id = parts.size() >= 14 ? fieldInt(parts[13]) : 0;
+    if (parts.size() >= 16) {
+        record->origin = GeoPoint::fromText(fieldText(parts[14]));
+        record->destination = GeoPoint::fromText(fieldText(parts[15]));
+    }
+    if (parts.size() >= 17) {
+        forEachPart(parts[16], ';', [record](const auto &leg) {
+            const int dash = leg.indexOf('-');
+            if (dash > 0) {
+                record->legs.append(Ride::Leg{fieldInt(fieldPart(leg, 0, dash)),
+                                              fieldInt(fieldPart(leg, dash + 1, leg.size() - dash - 1))});
+            }
+        });
+    }
+    record->scheduleId = parts.size() >= 18 ? fieldInt(parts[17]) : 0;
+    if (parts.size() >= 19) {
+        forEachPart(parts[18], ';', [record](const auto &paid) {
+            if (!paid.isEmpty()) record->paidFares.append(fieldInt64(paid));
+        });
+    }
+    return true;
+}
+
+Q_DECLARE_METATYPE(RideHandle)
+
+#endif // RIDEREPOSITORY_H
@@ -0,0 +1,86 @@
+#include "rideschedules.h"
+#include "ride.h"
+
+QString RideSchedule::formatDay(qint64 day)
+{
+    return Ride::formatTime(day * 86400).left(10);
+}
+
+bool RideSchedule::parseDay(const QString &text, qint64 *day)
+{
+    qint64 time = Ride::parseTime(text + " 00:00");
+    if (time == Ride::NoTime) return false;
+    *day = dayOf(time);
+    return true;
+}
+
+QString RideSchedule::formatWeekdays(int weekdays)
+{
+    QString days;
+    for (int d = 1; d <= 7; d++) {
+        if (weekdays & weekdayBit(d)) days += QString::number(d);
+    }
+    return days;
+}
+
+int RideSchedule::parseWeekdays(const QString &text)
+{
+    int weekdays = 0;
+    for (const QChar &d : text) {
+        if (d >= '1' && d <= '7') weekdays |= weekdayBit(d.digitValue());
+    }
+    return weekdays;
+}
+
+QStringList RideSchedule::toArgs() const
+{
+    return {QString::number(id), captain, route,
+            QString("%1:%2").arg(departureMinutes / 60, 2, 10, QChar('0')).arg(departureMinutes % 60, 2, 10, QChar('0')),
+            returnOffsetMinutes < 0 ? QString() : QString::number(returnOffsetMinutes),
+            formatWeekdays(weekdays), formatDay(firstDay), lastDay == NoLastDay ? QString() : formatDay(lastDay),
+            QString::number(seats), QString::number(fare, 'f', 2), origin.toText(), destination.toText(),
+            formatDay(materializedThrough)};
+}
+
+bool RideSchedule::fromArgs(const QStringList &args, RideSchedule *schedule)
+{
+    if (args.size() < 13) return false;
+
+    RideSchedule result;
+    result.id = args[0].toInt();
+    result.captain = args[1];
+    result.route = args[2];
+    const QStringList clock = args[3].split(':');
+    if (clock.size() != 2) return false;
+    result.departureMinutes = clock[0].toInt() * 60 + clock[1].toInt();
+    result.returnOffsetMinutes = args[4].isEmpty() ? -1 : args[4].toInt();
+    result.weekdays = parseWeekdays(args[5]);
+    if (!parseDay(args[6], &result.firstDay)) return false;
+    if (!args[7].isEmpty() && !parseDay(args[7], &result.lastDay)) return false;
+    result.seats = args[8].toInt();
+    result.fare = args[9].toDouble();
+    result.origin = GeoPoint::fromText(args[10]);
+    result.destination = GeoPoint::fromText(args[11]);
+    if (!parseDay(args[12], &result.materializedThrough)) return false;
+
+    *schedule = result;
+    return true;
+}
+
+bool RideSchedules::add(RideSchedule schedule)
+{
+    if (schedule.id <= 0) {
+        schedule.id = nextScheduleId;
+    } else if (schedules.contains(schedule.id)) {
+        return false;
+    }
+    nextScheduleId = qMax(nextScheduleId, schedule.id + 1);
+    schedules.insert(schedule.id, schedule);
+    return true;
+}
+
+void RideSchedules::clear()
+{
+    schedules.clear();
+    nextScheduleId = 1;
+}
@@ -0,0 +1,75 @@
+#ifndef RIDESCHEDULES_H
+#define RIDESCHEDULES_H
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <limits>
+#include "geopoint.h"
+
+// A recurring ride: a captain's route at the same time on chosen weekdays.
+// Days are counted from 1970-01-01 on the same wall-clock scale as Ride
+// times. Rides are created from the template a few days ahead as time
+// passes (see CarpoolService::ScheduleLookAheadDays), so a schedule costs
+// one record however long it runs; materializedThrough is the last day
+// that has had its ride created.
+struct RideSchedule {
+    static const qint64 NoLastDay = std::numeric_limits<qint64>::max();
+
+    int id = 0;
+    QString captain;
+    QString route;
+    int departureMinutes = 0;           // after midnight
+    int returnOffsetMinutes = -1;       // after departure; -1 without a return trip
+    int weekdays = 0;                   // bit 0 Monday ... bit 6 Sunday
+    qint64 firstDay = 0;
+    qint64 lastDay = NoLastDay;
+    int seats = 0;
+    double fare = 0;
+    GeoPoint origin;
+    GeoPoint destination;
+    qint64 materializedThrough = -1;
+
+    static int dayOfWeek(qint64 day) { return int(((day + 3) % 7 + 7) % 7) + 1; }     // 1 Monday ... 7 Sunday
+    static qint64 dayOf(qint64 rideTime) { return rideTime >= 0 ? rideTime / 86400 : (rideTime + 1) / 86400 - 1; }
+    static int weekdayBit(int dayOfWeek) { return 1 << (dayOfWeek - 1); }
+    // "yyyy-MM-dd" for a day and back; parseDay() returns false for bad text
+    static QString formatDay(qint64 day);
+    static bool parseDay(const QString &text, qint64 *day);
+    // A weekday mask as day numbers ("12345") and back
+    static QString formatWeekdays(int weekdays);
+    static int parseWeekdays(const QString &text);
+
+    bool runsOn(qint64 day) const {
+        return day >= firstDay && day <= lastDay && (weekdays & weekdayBit(dayOfWeek(day)));
+    }
+    qint64 departureOn(qint64 day) const { return day * 86400 + departureMinutes * 60; }
+
+    // Journal form: id, captain, route, departure "hh:mm", return offset in
+    // minutes (empty for none), weekdays as Qt day numbers ("12345"), first
+    // and last day as "yyyy-MM-dd" (last empty if open-ended), seats, fare,
+    // origin, destination, and the last materialized day
+    QStringList toArgs() const;
+    static bool fromArgs(const QStringList &args, RideSchedule *schedule);
+};
+
+// Every schedule, by id. Like RideRepository it hands out ids and never
+// reuses one.
+class RideSchedules {
+public:
+    // Assigns the next id to a schedule without one; false if the id is taken
+    bool add(RideSchedule schedule);
+    void remove(int id) { schedules.remove(id); }
+    RideSchedule* find(int id) { auto it = schedules.find(id); return it == schedules.end() ? nullptr : &*it; }
+    const QMap<int, RideSchedule> &all() const { return schedules; }
+    int size() const { return schedules.size(); }
+    int nextId() const { return nextScheduleId; }
+    void reserveIds(int next) { nextScheduleId = qMax(nextScheduleId, next); }
+    void clear();
+
+private:
+    QMap<int, RideSchedule> schedules;
+    int nextScheduleId = 1;
+};
+
+#endif // RIDESCHEDULES_H
@@ -0,0 +1,223 @@
+#include "routeindex.h"
+#include "stringpool.h"
+#include <QRegularExpression>
+#include <QSet>
+#include <algorithm>
+
+namespace {
+const QSet<QString> &stopwords()
+{
+    static const QSet<QString> words{"to", "from", "via", "and", "the", "of"};
+    return words;
+}
+
+bool isStopwordPrefix(const QString &prefix)
+{
+    for (const QString &stopword : stopwords()) {
+        if (stopword.startsWith(prefix)) return true;
+    }
+    return false;
+}
+
+void insertSorted(QVector<int> &ids, int id)
+{
+    // Ride ids grow, so a new ride almost always goes at the end
+    if (ids.isEmpty() || ids.last() < id) {
+        ids.append(id);
+        return;
+    }
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id) {
+        ids.insert(it, id);
+    }
+}
+
+template <typename Postings, typename Key>
+void removeSorted(Postings &postings, const Key &key, int id)
+{
+    auto it = postings.find(key);
+    if (it == postings.end()) return;
+
+    auto pos = std::lower_bound(it->begin(), it->end(), id);
+    if (pos != it->end() && *pos == id) {
+        it->erase(pos);
+    }
+    if (it->isEmpty()) {
+        postings.erase(it);
+    }
+}
+
+QVector<int> intersect(const QVector<int> &a, const QVector<int> &b)
+{
+    QVector<int> result;
+    std::set_intersection(a.constBegin(), a.constEnd(), b.constBegin(), b.constEnd(),
+                          std::back_inserter(result));
+    return result;
+}
+}
+
+void RouteIndex::insert(int rideId, int routeId)
+{
+    const RouteTokens &route = tokensForRoute(routeId);
+    for (const QString &token : route.tokens) {
+        insertSorted(postings[token], rideId);
+    }
+    for (const QString &prefix : route.shortPrefixes) {
+        insertSorted(prefixPostings[prefix], rideId);
+    }
+    rideRoutes.insert(rideId, routeId);
+}
+
+void RouteIndex::remove(int rideId, int routeId)
+{
+    const RouteTokens &route = tokensForRoute(routeId);
+    for (const QString &token : route.tokens) {
+        removeSorted(postings, token, rideId);
+    }
+    for (const QString &prefix : route.shortPrefixes) {
+        removeSorted(prefixPostings, prefix, rideId);
+    }
+    rideRoutes.remove(rideId);
+}
+
+void RouteIndex::clear()
+{
+    postings.clear();
+    prefixPostings.clear();
+    rideRoutes.clear();
+}
+
+QVector<int> RouteIndex::search(const QString &query) const
+{
+    QStringList queryWords = words(query);
+    if (queryWords.isEmpty()) return QVector<int>();
+
+    // Only whole words drop stopwords; the word still being typed may be
+    // the start of one. Exact tokens first, smallest posting list first, so
+    // the intersection shrinks as early as possible.
+    QString prefix = queryWords.takeLast();
+    QStringList tokens = tokenize(queryWords.join(' '));
+    if (tokens.isEmpty()) {
+        return isStopwordPrefix(prefix) ? scanPrefix(prefix) : prefixMatches(prefix);
+    }
+
+    QVector<const QVector<int>*> exact;
+    for (const QString &token : tokens) {
+        auto it = postings.constFind(token);
+        if (it == postings.constEnd()) return QVector<int>();
+        exact.append(&*it);
+    }
+    std::sort(exact.begin(), exact.end(),
+              [](const QVector<int> *a, const QVector<int> *b) { return a->size() < b->size(); });
+
+    QVector<int> result = *exact.first();
+    for (int i = 1; i < exact.size() && !result.isEmpty(); i++) {
+        result = intersect(result, *exact[i]);
+    }
+
+    // The few rides left are checked against the prefix one route at a
+    // time, rather than merging the lists of every token it matches
+    QHash<int, bool> routeMatches;
+    auto end = std::remove_if(result.begin(), result.end(), [&](int rideId) {
+        const int routeId = rideRoutes.value(rideId);
+        auto known = routeMatches.constFind(routeId);
+        if (known == routeMatches.constEnd()) {
+            known = routeMatches.insert(routeId, routeHasPrefix(routeId, prefix));
+        }
+        return !*known;
+    });
+    result.erase(end, result.end());
+    return result;
+}
+
+QStringList RouteIndex::words(const QString &text)
+{
+    static const QRegularExpression separators("[^\\w]+");
+    return text.toLower().split(separators, Qt::SkipEmptyParts);
+}
+
+QStringList RouteIndex::tokenize(const QString &text)
+{
+    const QSet<QString> &skip = stopwords();
+    QStringList tokens = words(text);
+    tokens.erase(std::remove_if(tokens.begin(), tokens.end(),
+                                [&skip](const QString &token) { return skip.contains(token); }),
+                 tokens.end());
+    return tokens;
+}
+
+bool RouteIndex::matches(const QString &route, const QStringList &queryWords)
+{
+    if (queryWords.isEmpty()) return true;
+
+    const QStringList routeWords = words(route);
+    for (int i = 0; i < queryWords.size() - 1; i++) {
+        if (!stopwords().contains(queryWords[i]) && !routeWords.contains(queryWords[i])) return false;
+    }
+    const QString &prefix = queryWords.last();
+    for (const QString &word : routeWords) {
+        if (word.startsWith(prefix)) return true;
+    }
+    return false;
+}
+
+const RouteIndex::RouteTokens &RouteIndex::tokensForRoute(int routeId)
+{
+    auto it = routeTokens.find(routeId);
+    if (it == routeTokens.end()) {
+        RouteTokens route;
+        route.words = words(pooledString(routeId));
+        route.words.removeDuplicates();
+        route.tokens = tokenize(route.words.join(' '));
+        for (const QString &token : route.tokens) {
+            for (int length = 1; length <= qMin(MergedPrefixLength, int(token.size())); length++) {
+                route.shortPrefixes.append(token.left(length));
+            }
+        }
+        route.shortPrefixes.removeDuplicates();
+        it = routeTokens.insert(routeId, route);
+    }
+    return *it;
+}
+
+QVector<int> RouteIndex::prefixMatches(const QString &prefix) const
+{
+    if (prefix.size() <= MergedPrefixLength) return prefixPostings.value(prefix);
+
+    // Longer prefixes match few tokens; their lists are gathered and
+    // sorted once instead of merged pairwise
+    QVector<int> result;
+    for (auto it = postings.lowerBound(prefix); it != postings.constEnd() && it.key().startsWith(prefix); ++it) {
+        result += it.value();
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// A prefix of a stopword matches words that are not in the postings, so
+// every indexed ride's route is checked; each distinct route once
+QVector<int> RouteIndex::scanPrefix(const QString &prefix) const
+{
+    QHash<int, bool> routeMatches;
+    QVector<int> result;
+    for (auto it = rideRoutes.constBegin(); it != rideRoutes.constEnd(); ++it) {
+        auto known = routeMatches.constFind(it.value());
+        if (known == routeMatches.constEnd()) {
+            known = routeMatches.insert(it.value(), routeHasPrefix(it.value(), prefix));
+        }
+        if (*known) {
+            result.append(it.key());
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool RouteIndex::routeHasPrefix(int routeId, const QString &prefix) const
+{
+    for (const QString &word : routeTokens.value(routeId).words) {
+        if (word.startsWith(prefix)) return true;
+    }
+    return false;
+}
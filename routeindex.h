@@ -0,0 +1,62 @@
+#ifndef ROUTEINDEX_H
+#define ROUTEINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+#include <QVector>
+
+// Inverted index from lower-cased route tokens to ride ids. Tokens are kept
+// in a sorted map so a prefix query is a lower-bound seek plus a walk over
+// the matching tokens. Routes are interned, so each distinct route is
+// tokenized once and re-indexing a ride is only a few set operations.
+//
+// Stopwords ("to", "via", ...) are left out of tokens: nearly every route
+// has one, so their posting lists would be the longest to update and would
+// narrow nothing. They are still words of the route, though: a query
+// only drops them as whole words, and the trailing prefix being typed
+// ("Lahore t") matches them too, so a ride does not drop out of the list
+// halfway through a word. Prefixes up to MergedPrefixLength characters,
+// which match the most tokens, keep their own merged posting list instead
+// of a union of every matching token's list. With exact tokens in the
+// query, the prefix is checked against each remaining ride's route
+// instead.
+class RouteIndex {
+public:
+    static constexpr int MergedPrefixLength = 2;
+
+    void insert(int rideId, int routeId);
+    void remove(int rideId, int routeId);
+    void clear();
+
+    // Ride ids whose route contains every query word; the last word also
+    // matches as a prefix so results narrow while the user types. Sorted
+    // ascending.
+    QVector<int> search(const QString &query) const;
+
+    // Lower-cased words of text; tokenize() drops the stopwords
+    static QStringList words(const QString &text);
+    static QStringList tokenize(const QString &text);
+    // Same rule as search() for one route, for re-checking a single ride;
+    // queryWords is words(query)
+    static bool matches(const QString &route, const QStringList &queryWords);
+
+private:
+    struct RouteTokens {
+        QStringList tokens;
+        QStringList words;                      // distinct, stopwords included
+        QStringList shortPrefixes;              // distinct, up to MergedPrefixLength long
+    };
+
+    const RouteTokens &tokensForRoute(int routeId);
+    QVector<int> prefixMatches(const QString &prefix) const;
+    QVector<int> scanPrefix(const QString &prefix) const;
+    bool routeHasPrefix(int routeId, const QString &prefix) const;
+
+    QMap<QString, QVector<int>> postings;       // token -> sorted ride ids
+    QHash<QString, QVector<int>> prefixPostings; // short prefix -> sorted ride ids
+    QHash<int, int> rideRoutes;                 // ride id -> StringPool route id
+    QHash<int, RouteTokens> routeTokens;        // StringPool route id -> tokens
+};
+
+#endif // ROUTEINDEX_H
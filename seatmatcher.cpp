@@ -0,0 +1,118 @@
+#include "seatmatcher.h"
+#include <QAtomicInt>
+#include <QHash>
+#include <QSemaphore>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <limits>
+#include "money.h"
+
+QVector<Ride*> SeatMatcher::match(const QVector<Request> &requests) const
+{
+    QVector<Ride*> matches(requests.size(), nullptr);
+
+    // Group the requests by route and resolve their filters to pool ids
+    // here, so the parallel part never touches a shared hash or the
+    // StringPool. A filter naming an unknown vehicle gets -1 and matches
+    // nothing.
+    struct Partition {
+        int routeKey;
+        QVector<int> requests;
+    };
+    QHash<int, int> partitionIndex;
+    QVector<Partition> partitions;
+    QVector<int> typeIds(requests.size(), 0);
+    QVector<int> classIds(requests.size(), 0);
+    StringPool &pool = StringPool::instance();
+    for (int i = 0; i < requests.size(); i++) {
+        const Request &request = requests[i];
+        int routeKey = request.passenger ? rides.routeKeyFor(request.route) : 0;
+        if (routeKey == 0) continue;
+
+        if (!request.vehicleType.isEmpty()) {
+            int id = pool.find(request.vehicleType);
+            typeIds[i] = id > 0 ? id : -1;
+        }
+        if (!request.vehicleClass.isEmpty()) {
+            int id = pool.find(request.vehicleClass);
+            classIds[i] = id > 0 ? id : -1;
+        }
+
+        auto it = partitionIndex.constFind(routeKey);
+        if (it == partitionIndex.constEnd()) {
+            it = partitionIndex.insert(routeKey, partitions.size());
+            partitions.append({routeKey, QVector<int>()});
+        }
+        partitions[*it].requests.append(i);
+    }
+
+    // Route popularity is skewed; starting with the biggest partitions keeps
+    // one late giant from serializing the tail
+    std::sort(partitions.begin(), partitions.end(), [](const Partition &a, const Partition &b) {
+        return a.requests.size() > b.requests.size();
+    });
+
+    Ride **results = matches.data();
+    auto matchPartition = [&](const Partition &partition) {
+        const RideRepository::RidesByDeparture &candidates = rides.openRidesOnRoute(partition.routeKey);
+        QHash<const Ride*, int> seatsTaken;
+        QSet<QPair<const Ride*, int>> assigned;     // (ride, passenger) picked in this pass
+
+        for (int i : partition.requests) {
+            const Request &request = requests[i];
+            const int passengerId = request.passenger->getUsernameId();
+            const Money budget = toMoney(request.maxFare);
+
+            auto end = candidates.upperBound(RideRepository::TimeKey(request.latest, std::numeric_limits<int>::max()));
+            for (auto it = candidates.lowerBound(RideRepository::TimeKey(request.earliest, 0)); it != end; ++it) {
+                Ride *ride = it.value();
+                if ((typeIds[i] && ride->getVehicleTypeId() != typeIds[i]) ||
+                    (classIds[i] && ride->getVehicleClassId() != classIds[i]) ||
+                    fares.quote(ride) > budget ||
+                    ride->hasPassenger(passengerId) ||
+                    assigned.contains(qMakePair(static_cast<const Ride*>(ride), passengerId))) {
+                    continue;
+                }
+
+                auto taken = seatsTaken.find(ride);
+                if (taken == seatsTaken.end()) {
+                    taken = seatsTaken.insert(ride, qMax(ride->getPeakOccupancy(), ride->getOccupiedSeats()));
+                }
+                if (*taken >= ride->getTotalSeats()) continue;
+
+                ++*taken;
+                assigned.insert(qMakePair(static_cast<const Ride*>(ride), passengerId));
+                results[i] = ride;
+                break;
+            }
+        }
+    };
+
+    const int threads = qMin(QThread::idealThreadCount(), int(partitions.size()));
+    if (requests.size() < ParallelThreshold || threads <= 1) {
+        for (const Partition &partition : partitions) {
+            matchPartition(partition);
+        }
+        return matches;
+    }
+
+    // Workers take the next unmatched partition until none are left; the
+    // calling thread works too
+    QAtomicInt nextPartition(0);
+    QSemaphore finished;
+    auto work = [&]() {
+        int p;
+        while ((p = nextPartition.fetchAndAddRelaxed(1)) < partitions.size()) {
+            matchPartition(partitions[p]);
+        }
+        finished.release();
+    };
+    for (int worker = 1; worker < threads; worker++) {
+        QThreadPool::globalInstance()->start([&work]() { work(); });
+    }
+    work();
+    finished.acquire(threads);
+    return matches;
+}
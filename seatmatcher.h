@@ -0,0 +1,51 @@
+#ifndef SEATMATCHER_H
+#define SEATMATCHER_H
+
+#include <QString>
+#include <QVector>
+#include "fareengine.h"
+#include "riderepository.h"
+#include "user.h"
+
+// Assigns a queue of passenger requests to open rides in one pass, instead
+// of each passenger picking a ride by hand.
+//
+// Requests are partitioned by route (RideRepository::routeKeyFor) and a
+// partition only looks at the open rides on its route, found through the
+// repository's route -> departure index, so a request costs a seek plus a
+// walk over the rides in its time window. A ride belongs to exactly one
+// route, which makes the partitions independent: they are matched in
+// parallel on the thread pool with no shared state. Within a partition,
+// requests are served in queue order, each getting the earliest departure
+// that fits.
+//
+// Like the BookingEngine it only decides, and the repository must not
+// change during match(). Balance and ride limits aren't checked here; the
+// booking of the matches does that.
+class SeatMatcher {
+public:
+    struct Request {
+        User *passenger = nullptr;
+        QString route;              // the whole route; case and spacing don't matter
+        qint64 earliest = 0;        // departure window, Ride epoch seconds
+        qint64 latest = 0;
+        QString vehicleType;        // empty accepts any
+        QString vehicleClass;
+        double maxFare = 0;         // against the FareEngine's quote
+    };
+
+    SeatMatcher(const RideRepository &rides, const FareEngine &fares) : rides(rides), fares(fares) {}
+
+    // The ride picked for each request, or nullptr if none has a seat
+    // that fits; never more picks per ride than it has free seats
+    QVector<Ride*> match(const QVector<Request> &requests) const;
+
+private:
+    // Below this many requests the batch is matched on the calling thread
+    static const int ParallelThreshold = 256;
+
+    const RideRepository &rides;
+    const FareEngine &fares;
+};
+
+#endif // SEATMATCHER_H
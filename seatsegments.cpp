@@ -0,0 +1,61 @@
+#include "seatsegments.h"
+#include <limits>
+
+void SeatSegments::reset(int segments)
+{
+    count = qMax(1, segments);
+    single = 0;
+    nodes.clear();
+    if (count > 1) {
+        nodes.resize(4 * count);
+    }
+}
+
+void SeatSegments::add(int from, int to, int delta)
+{
+    if (!isValidRange(from, to)) return;
+    if (nodes.isEmpty()) {
+        single += delta;
+    } else {
+        add(1, 0, count, from, to, delta);
+    }
+}
+
+int SeatSegments::maxOver(int from, int to) const
+{
+    if (!isValidRange(from, to)) return 0;
+    if (nodes.isEmpty()) return single;
+    return maxOver(1, 0, count, from, to);
+}
+
+void SeatSegments::add(int node, int lo, int hi, int from, int to, int delta)
+{
+    if (to <= lo || hi <= from) return;
+
+    Node &n = nodes[node];
+    if (from <= lo && hi <= to) {
+        n.max += delta;
+        n.min += delta;
+        n.added += delta;
+        return;
+    }
+
+    const int mid = (lo + hi) / 2;
+    add(2 * node, lo, mid, from, to, delta);
+    add(2 * node + 1, mid, hi, from, to, delta);
+    n.max = qMax(nodes[2 * node].max, nodes[2 * node + 1].max) + n.added;
+    n.min = qMin(nodes[2 * node].min, nodes[2 * node + 1].min) + n.added;
+}
+
+int SeatSegments::maxOver(int node, int lo, int hi, int from, int to) const
+{
+    const Node &n = nodes[node];
+    if (from <= lo && hi <= to) return n.max;
+
+    // At least one half overlaps [from, to), as this node does partly
+    const int mid = (lo + hi) / 2;
+    int result = std::numeric_limits<int>::min();
+    if (from < mid) result = maxOver(2 * node, lo, mid, from, to);
+    if (to > mid) result = qMax(result, maxOver(2 * node + 1, mid, hi, from, to));
+    return result + n.added;
+}
@@ -0,0 +1,47 @@
+#ifndef SEATSEGMENTS_H
+#define SEATSEGMENTS_H
+
+#include <QVector>
+
+// Seats taken on each segment of a multi-stop ride (segment i runs from
+// stop i to stop i + 1). A booking from stop a to stop b adds one seat to
+// segments [a, b), so passengers riding A->B and B->C can share a seat.
+//
+// A segment tree with range add and range max/min: every update and query
+// is O(log segments). Each node keeps the add that applies to its whole
+// range, so queries never push changes down and stay const. A ride with a
+// single segment (most of them) keeps one counter and allocates nothing.
+class SeatSegments {
+public:
+    explicit SeatSegments(int segments = 1) { reset(segments); }
+
+    // Drops every seat and sizes for segments (at least one)
+    void reset(int segments);
+    int segments() const { return count; }
+
+    // Adds delta seats on segments [from, to); the range must be valid
+    void add(int from, int to, int delta);
+    // Most seats taken on any segment in [from, to)
+    int maxOver(int from, int to) const;
+    // Seats taken on the busiest / least busy segment
+    int peak() const { return nodes.isEmpty() ? single : nodes[1].max; }
+    int lowest() const { return nodes.isEmpty() ? single : nodes[1].min; }
+
+    bool isValidRange(int from, int to) const { return from >= 0 && from < to && to <= count; }
+
+private:
+    struct Node {
+        int max = 0;
+        int min = 0;
+        int added = 0;      // applied to the node's whole range
+    };
+
+    void add(int node, int lo, int hi, int from, int to, int delta);
+    int maxOver(int node, int lo, int hi, int from, int to) const;
+
+    int count = 1;
+    int single = 0;             // the counter when there is one segment
+    QVector<Node> nodes;        // 1-based tree, empty for one segment
+};
+
+#endif // SEATSEGMENTS_H
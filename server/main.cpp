@@ -0,0 +1,78 @@
+// Carpool server: keeps the users and rides in memory and serves them to
+// any number of clients (MainWindow among them) over a local socket.
+//
+//   carpool_server [--name <socket name>]
+//
+// It reads and writes carpool.dat and journal.txt in the working directory,
+// exactly like a standalone MainWindow would, and refreshes metrics.txt
+// every 10 seconds (also available live through the METRICS request).
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QTimer>
+#include <csignal>
+#include "carpoolserver.h"
+#include "carpoolservice.h"
+#include "metrics.h"
+#include "snapshot.h"
+
+namespace {
+// Set by the signal handler, which can do nothing else safely; the event
+// loop notices it within StopPollMs
+volatile std::sig_atomic_t stopRequested = 0;
+const int StopPollMs = 200;
+
+void requestStop(int)
+{
+    stopRequested = 1;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString name = CarpoolServer::defaultName();
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i] == "--name" && i + 1 < args.size()) {
+            name = args[++i];
+        } else {
+            qWarning() << "usage: carpool_server [--name <socket name>]";
+            return 2;
+        }
+    }
+
+    CarpoolService service("journal.txt", Snapshot::defaultPath());
+    QObject::connect(&service, &CarpoolService::persistenceFailed, [](const QString &message) {
+        qWarning() << "Saving failed:" << message;
+    });
+    service.open();
+
+    CarpoolServer server(service);
+    if (!server.listen(name)) {
+        qWarning() << "Cannot listen on" << name << "(is another server running?)";
+        return 1;
+    }
+    MetricsReporter metrics;
+    metrics.start();
+
+    qInfo() << "Serving" << service.users().size() << "users and" << service.rides().size()
+            << "rides on" << name;
+
+    // Stop on Ctrl+C or a termination request; the final snapshot is
+    // written once the event loop has returned
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    QTimer stopPoll;
+    QObject::connect(&stopPoll, &QTimer::timeout, &app, []() {
+        if (stopRequested) QCoreApplication::quit();
+    });
+    stopPoll.start(StopPollMs);
+    int result = app.exec();
+
+    server.close();
+    service.close();
+    metrics.flush();
+    return result;
+}
@@ -0,0 +1,828 @@
+#include "snapshot.h"
+#include <QAtomicInt>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QDebug>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+const quint32 SnapshotMagic = 0x4E535043;     // "CPSN"
+const quint32 SnapshotVersion = 9;
+const quint32 SnapshotVersionStringTimes = 1;  // ride times stored as strings
+const quint32 SnapshotVersionRupeeBalances = 2; // double balances, no ledger accounts
+const quint32 SnapshotVersionFloatRatings = 3; // float rating, no star histogram
+const quint32 SnapshotVersionNoRideCounter = 4; // header ends before nextRideId
+const quint32 SnapshotVersionNoLocations = 5;  // rides without origin/destination
+const quint32 SnapshotVersionNoLegs = 6;       // passenger refs without legs
+const quint32 SnapshotVersionNoSchedules = 7;  // header ends before nextScheduleId
+const quint32 SnapshotVersionNoPaidFares = 8;  // passenger refs end after the stops
+const quint32 ByteOrderMark = 0x01020304;     // files are written in host byte order
+
+const quint32 UserTypePassenger = 0;
+const quint32 UserTypeCaptain = 1;
+
+const quint32 RideCompleted = 0x1;
+const quint32 RideRated = 0x2;
+
+// Text files are decoded in chunks of about this many bytes, but at least
+// a few per thread so uneven lines still balance
+const qint64 TextChunkBytes = 4 * 1024 * 1024;
+const int TextChunksPerThread = 4;
+
+struct SnapshotHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 byteOrder;
+    quint32 userCount;
+    quint64 journalSequence;
+    quint32 rideCount;
+    quint32 stringCount;
+    quint32 passengerRefCount;
+    quint32 accountCount;           // version 3 on; "reserved" (always 0) before
+    quint64 usersOffset;
+    quint64 ridesOffset;
+    quint64 passengerRefsOffset;
+    quint64 stringOffsetsOffset;    // stringCount + 1 quint32 offsets into the string data
+    quint64 stringDataOffset;
+    quint64 stringDataSize;
+    quint64 accountsOffset;         // version 3 on
+    qint32 nextRideId;              // version 5; archived rides hold ids below it
+    quint32 scheduleCount;          // version 8 on; "reserved" (always 0) before
+    qint32 nextScheduleId;          // version 8 on
+    quint32 reserved;
+    quint64 schedulesOffset;
+};
+
+// Versions 1 and 2 end the header before accountsOffset, 3 and 4 before
+// nextRideId, 5 to 7 before nextScheduleId
+const quint64 HeaderSizeV2 = 88;
+const quint64 HeaderSizeV4 = 96;
+const quint64 HeaderSizeV7 = 104;
+
+// All string fields are indexes into the string table; index 0 is ""
+struct UserRecord {
+    quint32 type;
+    quint32 username;
+    quint32 password;
+    quint32 vehicleType;
+    quint32 vehicleClass;
+    qint32 cancelCount;
+    qint32 ratingCount;
+    quint32 reserved;
+    qint64 balance;                 // Money
+    qint64 ratingSum;               // stars
+    quint32 starCounts[User::MaxStars];
+    quint32 reserved2;
+};
+
+// Version 3 kept a float rating in place of the sum and histogram
+struct UserRecordV3 {
+    quint32 type;
+    quint32 username;
+    quint32 password;
+    quint32 vehicleType;
+    quint32 vehicleClass;
+    qint32 cancelCount;
+    qint32 ratingCount;
+    float rating;
+    qint64 balance;
+};
+
+// Versions 1 and 2 also kept the balance in rupees
+struct UserRecordV2 {
+    quint32 type;
+    quint32 username;
+    quint32 password;
+    quint32 vehicleType;
+    quint32 vehicleClass;
+    qint32 cancelCount;
+    qint32 ratingCount;
+    float rating;
+    double balance;
+};
+
+// Ledger system account (platform fees etc.) and its running total
+struct AccountRecord {
+    quint32 name;
+    quint32 reserved;
+    qint64 balance;                 // Money
+};
+
+// Times are Ride epoch seconds (Ride::NoTime when unset); coordinates are
+// GeoPoint microdegrees (GeoPoint::NoCoordinate when unset)
+struct RideRecord {
+    qint32 id;
+    quint32 captain;
+    quint32 passenger;
+    quint32 route;
+    qint64 departureTime;
+    qint64 returnTime;
+    quint32 vehicleType;
+    quint32 vehicleClass;
+    qint32 totalSeats;
+    qint32 occupiedSeats;
+    quint32 flags;
+    quint32 firstPassengerRef;
+    quint32 passengerRefCount;
+    qint32 scheduleId;              // version 8 on; "reserved" (always 0) before
+    double fare;
+    qint32 originLatitude;          // version 6 on
+    qint32 originLongitude;
+    qint32 destinationLatitude;
+    qint32 destinationLongitude;
+};
+
+// Versions 2 to 5 end the ride record after the fare
+const quint64 RideRecordSizeV5 = offsetof(RideRecord, originLatitude);
+
+// A passenger of a ride, the stops they ride between and what they paid
+struct PassengerRef {
+    quint32 name;
+    quint16 fromStop;
+    quint16 toStop;
+    qint64 paid;                    // Money; version 9 on
+};
+
+// Versions 7 and 8 end the passenger ref after the stops
+const quint64 PassengerRefSizeV8 = offsetof(PassengerRef, paid);
+
+// Recurring ride template (RideSchedule); days count from 1970-01-01
+struct ScheduleRecord {
+    qint32 id;
+    quint32 captain;
+    quint32 route;
+    qint32 departureMinutes;
+    qint32 returnOffsetMinutes;
+    quint32 weekdays;
+    qint32 seats;
+    quint32 reserved;
+    double fare;
+    qint64 firstDay;
+    qint64 lastDay;
+    qint64 materializedThrough;
+    qint32 originLatitude;
+    qint32 originLongitude;
+    qint32 destinationLatitude;
+    qint32 destinationLongitude;
+};
+
+// Version 1 layout, still read so existing carpool.dat files load
+struct RideRecordV1 {
+    qint32 id;
+    quint32 captain;
+    quint32 passenger;
+    quint32 route;
+    quint32 departureTime;
+    quint32 returnTime;
+    quint32 vehicleType;
+    quint32 vehicleClass;
+    qint32 totalSeats;
+    qint32 occupiedSeats;
+    quint32 flags;
+    quint32 firstPassengerRef;
+    quint32 passengerRefCount;
+    quint32 reserved;
+    double fare;
+};
+
+static_assert(sizeof(SnapshotHeader) == 120, "snapshot header layout changed");
+static_assert(sizeof(UserRecord) == 72, "user record layout changed");
+static_assert(sizeof(UserRecordV3) == 40, "v3 user record layout changed");
+static_assert(sizeof(UserRecordV2) == 40, "v2 user record layout changed");
+static_assert(sizeof(AccountRecord) == 16, "account record layout changed");
+static_assert(sizeof(RideRecord) == 88, "ride record layout changed");
+static_assert(RideRecordSizeV5 == 72, "v5 ride record layout changed");
+static_assert(sizeof(RideRecordV1) == 64, "v1 ride record layout changed");
+static_assert(sizeof(PassengerRef) == 16, "passenger ref layout changed");
+static_assert(PassengerRefSizeV8 == 8, "v8 passenger ref layout changed");
+static_assert(sizeof(ScheduleRecord) == 80, "schedule record layout changed");
+
+class StringTableBuilder {
+public:
+    StringTableBuilder() { offsets.append(0); intern(QString()); }
+
+    quint32 intern(const QString &value) {
+        auto it = ids.constFind(value);
+        if (it != ids.constEnd()) return *it;
+
+        quint32 id = offsets.size() - 1;
+        data += value.toUtf8();
+        offsets.append(data.size());
+        ids.insert(value, id);
+        return id;
+    }
+
+    quint32 count() const { return offsets.size() - 1; }
+
+    QHash<QString, quint32> ids;
+    QVector<quint32> offsets;
+    QByteArray data;
+};
+
+template <typename T>
+void appendRaw(QByteArray &out, const T *items, qsizetype count) {
+    out.append(reinterpret_cast<const char *>(items), count * qsizetype(sizeof(T)));
+}
+
+bool sectionFits(quint64 offset, quint64 count, quint64 itemSize, quint64 fileSize) {
+    return offset <= fileSize && count <= (fileSize - offset) / itemSize;
+}
+
+quint64 readTextHeader(const QString &line) {
+    // Text snapshot header: "#journal,<last sequence folded into this file>"
+    QStringList parts = line.split(",");
+    return parts.size() >= 2 && parts[0] == "#journal" ? parts[1].toULongLong() : 0;
+}
+
+// Decodes every record line of a users.txt/rides.txt file with
+// decode(fields, &record), one vector of records per chunk in file order.
+// Lines starting with '#' are headers; the last one sets journalSequence.
+template <typename Record, typename Decode>
+bool decodeTextFile(const QString &path, Decode decode, QVector<QVector<Record>> *chunks,
+                    quint64 *journalSequence, const Snapshot::Progress &progress)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    const qint64 size = file.size();
+    if (size == 0) return true;
+    const uchar *base = file.map(0, size);
+    if (!base) return false;
+    const char *data = reinterpret_cast<const char *>(base);
+    const char *end = data + size;
+
+    // Chunks end just after a newline, so no line is split between two
+    const int threads = QThread::idealThreadCount();
+    const qint64 target = qMin(TextChunkBytes, size / (qMax(threads, 1) * TextChunksPerThread) + 1);
+    QVector<const char *> bounds{data};
+    while (bounds.last() < end) {
+        const char *cut = bounds.last() + qMin(target, qint64(end - bounds.last()));
+        const char *newline = cut < end ? static_cast<const char *>(std::memchr(cut, '\n', end - cut)) : nullptr;
+        bounds.append(newline ? newline + 1 : end);
+    }
+    const int chunkCount = bounds.size() - 1;
+    chunks->resize(chunkCount);
+    QVector<qint64> headers(chunkCount, -1);
+
+    auto decodeChunk = [&](int c) {
+        QVector<QByteArray> fields;
+        QVector<Record> &records = (*chunks)[c];
+        const char *line = bounds[c];
+        const char *chunkEnd = bounds[c + 1];
+        while (line < chunkEnd) {
+            const char *newline = static_cast<const char *>(std::memchr(line, '\n', chunkEnd - line));
+            const char *lineEnd = newline ? newline : chunkEnd;
+            const char *textEnd = lineEnd > line && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+            if (textEnd > line && *line == '#') {
+                headers[c] = readTextHeader(QString::fromUtf8(line, int(textEnd - line)));
+            } else if (textEnd > line) {
+                splitFields(line, textEnd, &fields);
+                Record record;
+                if (decode(fields, &record)) {
+                    records.append(record);
+                }
+            }
+            line = lineEnd + 1;
+        }
+    };
+
+    const int workers = qMin(threads, chunkCount);
+    if (workers <= 1) {
+        for (int c = 0; c < chunkCount; c++) {
+            decodeChunk(c);
+            if (progress) progress(c + 1, chunkCount);
+        }
+    } else {
+        // Workers take the next chunk until none are left; this thread
+        // counts finished chunks for progress and waits for the workers
+        QAtomicInt nextChunk(0);
+        QSemaphore chunkDone;
+        QSemaphore workersDone;
+        auto work = [&]() {
+            int c;
+            while ((c = nextChunk.fetchAndAddRelaxed(1)) < chunkCount) {
+                decodeChunk(c);
+                chunkDone.release();
+            }
+            workersDone.release();
+        };
+        for (int worker = 0; worker < workers; worker++) {
+            QThreadPool::globalInstance()->start([&work]() { work(); });
+        }
+        for (int c = 0; c < chunkCount; c++) {
+            chunkDone.acquire();
+            if (progress) progress(c + 1, chunkCount);
+        }
+        workersDone.acquire(workers);
+    }
+
+    for (qint64 header : headers) {
+        if (header >= 0 && journalSequence) *journalSequence = quint64(header);
+    }
+    file.unmap(const_cast<uchar *>(base));
+    return true;
+}
+}
+
+QByteArray Snapshot::serialize(const UserDirectory &users, const RideRepository &rides,
+                               quint64 journalSequence, const Ledger *ledger,
+                               const RideSchedules *schedules, const User *replicaFor)
+{
+    StringTableBuilder strings;
+    const int viewerId = replicaFor ? replicaFor->getUsernameId() : 0;
+
+    QVector<UserRecord> userRecords;
+    userRecords.reserve(users.size());
+    for (User* user : users.all()) {
+        UserRecord record = {};
+        record.username = strings.intern(user->getUsername());
+        const bool hidden = replicaFor && user != replicaFor;
+        record.password = replicaFor ? 0 : strings.intern(user->getPassword());
+        record.cancelCount = hidden ? 0 : user->getCancelCount();
+        record.ratingCount = user->getRatingCount();
+        record.ratingSum = user->getRatingSum();
+        for (int s = 0; s < User::MaxStars; s++) {
+            record.starCounts[s] = user->getStarCount(s + 1);
+        }
+        record.balance = hidden ? 0 : user->getBalanceMinor();
+        if (Captain* captain = dynamic_cast<Captain*>(user)) {
+            record.type = UserTypeCaptain;
+            record.vehicleType = strings.intern(captain->getVehicleType());
+            record.vehicleClass = strings.intern(captain->getVehicleClass());
+        } else {
+            record.type = UserTypePassenger;
+        }
+        userRecords.append(record);
+    }
+
+    QVector<RideRecord> rideRecords;
+    QVector<PassengerRef> passengerRefs;
+    rideRecords.reserve(rides.size());
+    for (Ride* ride : rides.all()) {
+        const bool captained = ride->getCaptainId() == viewerId;
+        if (replicaFor && ride->getIsCompleted() && !captained && !ride->hasPassenger(viewerId)) {
+            continue;
+        }
+
+        RideRecord record = {};
+        record.id = ride->getId();
+        record.captain = strings.intern(ride->getCaptain());
+        record.passenger = strings.intern(ride->getPassenger());
+        record.route = strings.intern(ride->getRoute());
+        record.departureTime = ride->getDepartureEpoch();
+        record.returnTime = ride->getReturnEpoch();
+        record.vehicleType = strings.intern(ride->getVehicleType());
+        record.vehicleClass = strings.intern(ride->getVehicleClass());
+        record.totalSeats = ride->getTotalSeats();
+        record.occupiedSeats = ride->getOccupiedSeats();
+        record.flags = (ride->getIsCompleted() ? RideCompleted : 0) |
+                       (ride->getIsRated() ? RideRated : 0);
+        record.fare = ride->getFare();
+        record.scheduleId = ride->getScheduleId();
+        record.originLatitude = ride->getOrigin().latitudeE6;
+        record.originLongitude = ride->getOrigin().longitudeE6;
+        record.destinationLatitude = ride->getDestination().latitudeE6;
+        record.destinationLongitude = ride->getDestination().longitudeE6;
+
+        const QStringList passengers = ride->getPassengers();
+        const QVector<Ride::Leg> &legs = ride->getLegs();
+        const QVector<Money> &paidFares = ride->getPaidFares();
+        record.firstPassengerRef = passengerRefs.size();
+        record.passengerRefCount = passengers.size();
+        for (int p = 0; p < passengers.size(); p++) {
+            PassengerRef ref = {};
+            ref.name = strings.intern(passengers[p]);
+            ref.fromStop = quint16(legs[p].from);
+            ref.toStop = quint16(legs[p].to);
+            ref.paid = !replicaFor || captained || passengers[p] == replicaFor->getUsername()
+                       ? paidFares[p] : 0;
+            passengerRefs.append(ref);
+        }
+        rideRecords.append(record);
+    }
+
+    QVector<AccountRecord> accountRecords;
+    if (ledger && !replicaFor) {
+        const QHash<QString, Money> &balances = ledger->systemBalances();
+        accountRecords.reserve(balances.size());
+        for (auto it = balances.constBegin(); it != balances.constEnd(); ++it) {
+            AccountRecord record = {};
+            record.name = strings.intern(it.key());
+            record.balance = it.value();
+            accountRecords.append(record);
+        }
+    }
+
+    QVector<ScheduleRecord> scheduleRecords;
+    if (schedules) {
+        scheduleRecords.reserve(schedules->size());
+        for (const RideSchedule &schedule : schedules->all()) {
+            ScheduleRecord record = {};
+            record.id = schedule.id;
+            record.captain = strings.intern(schedule.captain);
+            record.route = strings.intern(schedule.route);
+            record.departureMinutes = schedule.departureMinutes;
+            record.returnOffsetMinutes = schedule.returnOffsetMinutes;
+            record.weekdays = schedule.weekdays;
+            record.seats = schedule.seats;
+            record.fare = schedule.fare;
+            record.firstDay = schedule.firstDay;
+            record.lastDay = schedule.lastDay;
+            record.materializedThrough = schedule.materializedThrough;
+            record.originLatitude = schedule.origin.latitudeE6;
+            record.originLongitude = schedule.origin.longitudeE6;
+            record.destinationLatitude = schedule.destination.latitudeE6;
+            record.destinationLongitude = schedule.destination.longitudeE6;
+            scheduleRecords.append(record);
+        }
+    }
+
+    SnapshotHeader header = {};
+    header.magic = SnapshotMagic;
+    header.version = SnapshotVersion;
+    header.byteOrder = ByteOrderMark;
+    header.journalSequence = journalSequence;
+    header.userCount = userRecords.size();
+    header.rideCount = rideRecords.size();
+    header.stringCount = strings.count();
+    header.passengerRefCount = passengerRefs.size();
+    header.accountCount = accountRecords.size();
+    header.nextRideId = rides.nextId();
+    header.scheduleCount = scheduleRecords.size();
+    header.nextScheduleId = schedules ? schedules->nextId() : 1;
+    header.usersOffset = sizeof(SnapshotHeader);
+    header.ridesOffset = header.usersOffset + quint64(userRecords.size()) * sizeof(UserRecord);
+    header.passengerRefsOffset = header.ridesOffset + quint64(rideRecords.size()) * sizeof(RideRecord);
+    header.accountsOffset = header.passengerRefsOffset + quint64(passengerRefs.size()) * sizeof(PassengerRef);
+    header.schedulesOffset = header.accountsOffset + quint64(accountRecords.size()) * sizeof(AccountRecord);
+    header.stringOffsetsOffset = header.schedulesOffset + quint64(scheduleRecords.size()) * sizeof(ScheduleRecord);
+    header.stringDataOffset = header.stringOffsetsOffset + quint64(strings.offsets.size()) * sizeof(quint32);
+    header.stringDataSize = strings.data.size();
+
+    QByteArray out;
+    out.reserve(header.stringDataOffset + header.stringDataSize);
+    appendRaw(out, &header, 1);
+    appendRaw(out, userRecords.constData(), userRecords.size());
+    appendRaw(out, rideRecords.constData(), rideRecords.size());
+    appendRaw(out, passengerRefs.constData(), passengerRefs.size());
+    appendRaw(out, accountRecords.constData(), accountRecords.size());
+    appendRaw(out, scheduleRecords.constData(), scheduleRecords.size());
+    appendRaw(out, strings.offsets.constData(), strings.offsets.size());
+    out.append(strings.data);
+    return out;
+}
+
+bool Snapshot::load(const QString &path, UserDirectory &users, RideRepository &rides,
+                    quint64 *journalSequence, Ledger *ledger, RideSchedules *schedules)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    const qint64 fileSize = file.size();
+    const uchar *base = fileSize > 0 ? file.map(0, fileSize) : nullptr;
+    if (!base) return false;
+
+    // Decode straight from the mapping; fromRawData doesn't copy it
+    bool loaded = loadData(QByteArray::fromRawData(reinterpret_cast<const char *>(base), fileSize),
+                           users, rides, journalSequence, ledger, schedules);
+    file.unmap(const_cast<uchar *>(base));
+    return loaded;
+}
+
+bool Snapshot::loadData(const QByteArray &data, UserDirectory &users, RideRepository &rides,
+                        quint64 *journalSequence, Ledger *ledger, RideSchedules *schedules)
+{
+    const quint64 fileSize = data.size();
+    if (fileSize < HeaderSizeV2) return false;
+
+    const uchar *base = reinterpret_cast<const uchar *>(data.constData());
+
+    SnapshotHeader header = {};
+    std::memcpy(&header, base, HeaderSizeV2);
+    if (header.version > SnapshotVersionNoSchedules) {
+        if (fileSize < sizeof(SnapshotHeader)) return false;
+        std::memcpy(&header, base, sizeof(header));
+    } else if (header.version > SnapshotVersionNoRideCounter) {
+        if (fileSize < HeaderSizeV7) return false;
+        std::memcpy(&header, base, HeaderSizeV7);
+        header.scheduleCount = 0;
+    } else if (header.version > SnapshotVersionRupeeBalances) {
+        if (fileSize < HeaderSizeV4) return false;
+        std::memcpy(&header, base, HeaderSizeV4);
+    } else {
+        header.accountCount = 0;
+        header.accountsOffset = 0;
+    }
+
+    const bool stringTimes = header.version == SnapshotVersionStringTimes;
+    const bool rupeeBalances = header.version <= SnapshotVersionRupeeBalances;
+    const bool floatRatings = header.version <= SnapshotVersionFloatRatings;
+    const quint64 userRecordSize = floatRatings ? sizeof(UserRecordV3) : sizeof(UserRecord);
+    const bool noLocations = header.version <= SnapshotVersionNoLocations;
+    const bool noLegs = header.version <= SnapshotVersionNoLegs;
+    const quint64 passengerRefSize = noLegs ? sizeof(quint32)
+                                   : header.version <= SnapshotVersionNoPaidFares ? PassengerRefSizeV8
+                                   : sizeof(PassengerRef);
+    const quint64 rideRecordSize = stringTimes ? sizeof(RideRecordV1)
+                                 : noLocations ? RideRecordSizeV5 : sizeof(RideRecord);
+    bool valid = header.magic == SnapshotMagic &&
+                 header.version >= SnapshotVersionStringTimes && header.version <= SnapshotVersion &&
+                 header.byteOrder == ByteOrderMark &&
+                 sectionFits(header.usersOffset, header.userCount, userRecordSize, fileSize) &&
+                 sectionFits(header.ridesOffset, header.rideCount, rideRecordSize, fileSize) &&
+                 sectionFits(header.passengerRefsOffset, header.passengerRefCount, passengerRefSize, fileSize) &&
+                 sectionFits(header.accountsOffset, header.accountCount, sizeof(AccountRecord), fileSize) &&
+                 sectionFits(header.schedulesOffset, header.scheduleCount, sizeof(ScheduleRecord), fileSize) &&
+                 sectionFits(header.stringOffsetsOffset, quint64(header.stringCount) + 1, sizeof(quint32), fileSize) &&
+                 sectionFits(header.stringDataOffset, header.stringDataSize, 1, fileSize);
+
+    // Decode every distinct string once; records share the QStrings
+    QVector<QString> strings;
+    if (valid) {
+        strings.resize(header.stringCount);
+        const uchar *offsets = base + header.stringOffsetsOffset;
+        const char *data = reinterpret_cast<const char *>(base + header.stringDataOffset);
+        quint32 begin = 0;
+        std::memcpy(&begin, offsets, sizeof(begin));
+        for (quint32 i = 0; i < header.stringCount && valid; i++) {
+            quint32 end = 0;
+            std::memcpy(&end, offsets + (i + 1) * sizeof(quint32), sizeof(end));
+            if (begin > end || end > header.stringDataSize) {
+                valid = false;
+                break;
+            }
+            strings[i] = QString::fromUtf8(data + begin, end - begin);
+            begin = end;
+        }
+    }
+
+    if (!valid) return false;
+
+    // One bulk allocation for every entity in the file
+    users.reserve(users.size() + header.userCount);
+    rides.reserve(rides.size() + header.rideCount);
+
+    auto string = [&strings](quint32 id) {
+        return id < quint32(strings.size()) ? strings[id] : QString();
+    };
+
+    const uchar *userData = base + header.usersOffset;
+    for (quint32 i = 0; i < header.userCount; i++) {
+        UserRecord record;
+        if (floatRatings) {
+            UserRecordV3 old;
+            if (rupeeBalances) {
+                UserRecordV2 older;
+                std::memcpy(&older, userData + quint64(i) * sizeof(UserRecordV2), sizeof(older));
+                std::memcpy(&old, &older, offsetof(UserRecordV2, balance));
+                old.balance = toMoney(older.balance);
+            } else {
+                std::memcpy(&old, userData + quint64(i) * sizeof(UserRecordV3), sizeof(old));
+            }
+            record = {};
+            std::memcpy(&record, &old, offsetof(UserRecordV3, rating));
+            record.balance = old.balance;
+            record.ratingSum = qRound64(double(old.rating) * old.ratingCount);
+        } else {
+            std::memcpy(&record, userData + quint64(i) * sizeof(UserRecord), sizeof(record));
+        }
+
+        User* user = nullptr;
+        if (record.type == UserTypeCaptain) {
+            user = users.create<Captain>(string(record.username), string(record.password),
+                                         string(record.vehicleType), string(record.vehicleClass));
+        } else {
+            user = users.create<Passenger>(string(record.username), string(record.password));
+        }
+        user->adjustBalance(record.balance);
+        // Older versions had no histogram; their ratings stay out of it
+        user->restoreStats(record.cancelCount, record.ratingSum, record.ratingCount,
+                           floatRatings ? nullptr : record.starCounts);
+        if (!users.add(user)) {
+            users.destroy(user);
+        }
+    }
+
+    const uchar *rideData = base + header.ridesOffset;
+    const uchar *refData = base + header.passengerRefsOffset;
+    for (quint32 i = 0; i < header.rideCount; i++) {
+        RideRecord record = {};
+        record.originLatitude = record.originLongitude = GeoPoint::NoCoordinate;
+        record.destinationLatitude = record.destinationLongitude = GeoPoint::NoCoordinate;
+        if (stringTimes) {
+            RideRecordV1 old;
+            std::memcpy(&old, rideData + quint64(i) * sizeof(RideRecordV1), sizeof(old));
+            record.id = old.id;
+            record.captain = old.captain;
+            record.passenger = old.passenger;
+            record.route = old.route;
+            record.departureTime = Ride::parseTime(string(old.departureTime));
+            record.returnTime = Ride::parseTime(string(old.returnTime));
+            record.vehicleType = old.vehicleType;
+            record.vehicleClass = old.vehicleClass;
+            record.totalSeats = old.totalSeats;
+            record.occupiedSeats = old.occupiedSeats;
+            record.flags = old.flags;
+            record.firstPassengerRef = old.firstPassengerRef;
+            record.passengerRefCount = old.passengerRefCount;
+            record.fare = old.fare;
+        } else {
+            std::memcpy(&record, rideData + quint64(i) * rideRecordSize, rideRecordSize);
+        }
+
+        Ride* ride = rides.create(string(record.captain), string(record.passenger), string(record.route),
+                                  record.departureTime, record.returnTime,
+                                  string(record.vehicleType), string(record.vehicleClass),
+                                  record.totalSeats, record.fare);
+        if (quint64(record.firstPassengerRef) + record.passengerRefCount <= header.passengerRefCount) {
+            for (quint32 p = 0; p < record.passengerRefCount; p++) {
+                PassengerRef ref = {};
+                std::memcpy(&ref, refData + quint64(record.firstPassengerRef + p) * passengerRefSize, passengerRefSize);
+                const QString name = string(ref.name);
+                if (noLegs) {
+                    ride->addPassenger(name);
+                } else if (ride->addPassenger(name, Ride::Leg{ref.fromStop, ref.toStop})) {
+                    ride->setPaidFare(internString(name), ref.paid);
+                }
+            }
+        }
+        ride->setOccupiedSeats(record.occupiedSeats);
+        ride->setIsCompleted(record.flags & RideCompleted);
+        ride->setIsRated(record.flags & RideRated);
+        ride->setId(record.id);
+        ride->setScheduleId(record.scheduleId);
+        ride->setEndpoints(GeoPoint(record.originLatitude, record.originLongitude),
+                           GeoPoint(record.destinationLatitude, record.destinationLongitude));
+        if (!rides.add(ride)) {
+            rides.destroy(ride);
+        }
+    }
+
+    rides.reserveIds(header.nextRideId);
+
+    if (ledger) {
+        const uchar *accountData = base + header.accountsOffset;
+        for (quint32 i = 0; i < header.accountCount; i++) {
+            AccountRecord record;
+            std::memcpy(&record, accountData + quint64(i) * sizeof(AccountRecord), sizeof(record));
+            ledger->restoreSystemBalance(string(record.name), record.balance);
+        }
+    }
+
+    if (schedules) {
+        const uchar *scheduleData = base + header.schedulesOffset;
+        for (quint32 i = 0; i < header.scheduleCount; i++) {
+            ScheduleRecord record;
+            std::memcpy(&record, scheduleData + quint64(i) * sizeof(ScheduleRecord), sizeof(record));
+            RideSchedule schedule;
+            schedule.id = record.id;
+            schedule.captain = string(record.captain);
+            schedule.route = string(record.route);
+            schedule.departureMinutes = record.departureMinutes;
+            schedule.returnOffsetMinutes = record.returnOffsetMinutes;
+            schedule.weekdays = int(record.weekdays);
+            schedule.seats = record.seats;
+            schedule.fare = record.fare;
+            schedule.firstDay = record.firstDay;
+            schedule.lastDay = record.lastDay;
+            schedule.materializedThrough = record.materializedThrough;
+            schedule.origin = GeoPoint(record.originLatitude, record.originLongitude);
+            schedule.destination = GeoPoint(record.destinationLatitude, record.destinationLongitude);
+            schedules->add(schedule);
+        }
+        schedules->reserveIds(header.nextScheduleId);
+    }
+
+    if (journalSequence) {
+        *journalSequence = header.journalSequence;
+    }
+    return true;
+}
+
+QByteArray Snapshot::serializeUsersText(const UserDirectory &users, quint64 journalSequence)
+{
+    QString data = QString("#journal,%1\n").arg(journalSequence);
+    for (User* user : users.all()) {
+        data += user->toRecord() + "\n";
+    }
+    return data.toUtf8();
+}
+
+QByteArray Snapshot::serializeRidesText(const RideRepository &rides, quint64 journalSequence)
+{
+    QString data = QString("#journal,%1\n").arg(journalSequence);
+    for (Ride* ride : rides.all()) {
+        data += ride->toRecord() + "\n";
+    }
+    return data.toUtf8();
+}
+
+bool Snapshot::loadUsersText(const QString &path, UserDirectory &users, quint64 *journalSequence,
+                             const Progress &progress)
+{
+    QVector<QVector<UserDirectory::Record>> chunks;
+    if (!decodeTextFile(path, UserDirectory::decodeRecord<QVector<QByteArray>>, &chunks,
+                        journalSequence, progress)) {
+        return false;
+    }
+
+    int count = users.size();
+    for (const auto &records : chunks) count += records.size();
+    users.reserve(count);
+
+    for (const auto &records : chunks) {
+        for (const UserDirectory::Record &record : records) {
+            User* user = users.createFromRecord(record);
+            if (!users.add(user)) {
+                users.destroy(user);
+            }
+        }
+    }
+    return true;
+}
+
+bool Snapshot::loadRidesText(const QString &path, RideRepository &rides, quint64 *journalSequence,
+                             const Progress &progress)
+{
+    QVector<QVector<RideRepository::Record>> chunks;
+    if (!decodeTextFile(path, RideRepository::decodeRecord<QVector<QByteArray>>, &chunks,
+                        journalSequence, progress)) {
+        return false;
+    }
+
+    int count = rides.size();
+    for (const auto &records : chunks) count += records.size();
+    rides.reserve(count);
+
+    QList<Ride*> withoutId;
+    for (const auto &records : chunks) {
+        for (const RideRepository::Record &record : records) {
+            Ride* ride = rides.createFromRecord(record);
+            if (ride->getId() <= 0 || !rides.add(ride)) {
+                withoutId.append(ride);
+            }
+        }
+    }
+
+    // Rides saved before ids existed (or with clashing ids) get fresh ones
+    for (Ride* ride : withoutId) {
+        ride->setId(0);
+        rides.add(ride);
+    }
+    return true;
+}
+
+bool Snapshot::importText(const QString &usersPath, const QString &ridesPath,
+                          const QString &snapshotPath)
+{
+    UserDirectory users;
+    RideRepository rides;
+    quint64 usersSequence = 0;
+    quint64 ridesSequence = 0;
+    bool usersLoaded = loadUsersText(usersPath, users, &usersSequence);
+    bool ridesLoaded = loadRidesText(ridesPath, rides, &ridesSequence);
+    if (!usersLoaded && !ridesLoaded) {
+        return false;
+    }
+
+    // The binary format has a single journal position. Files left at
+    // different positions by an interrupted save can't be merged offline;
+    // starting the application once replays the journal and fixes them.
+    if (usersSequence != ridesSequence) {
+        qWarning() << "users.txt and rides.txt are at different journal positions";
+        return false;
+    }
+    return writeFile(snapshotPath, serialize(users, rides, usersSequence));
+}
+
+bool Snapshot::exportText(const QString &snapshotPath, const QString &usersPath,
+                          const QString &ridesPath)
+{
+    UserDirectory users;
+    RideRepository rides;
+    quint64 sequence = 0;
+    if (!load(snapshotPath, users, rides, &sequence)) {
+        return false;
+    }
+    return writeFile(usersPath, serializeUsersText(users, sequence)) &&
+           writeFile(ridesPath, serializeRidesText(rides, sequence));
+}
+
+bool Snapshot::writeFile(const QString &path, const QByteArray &data)
+{
+    // QSaveFile writes to a temporary file and renames it over the old one,
+    // so a crash never leaves a half-written snapshot
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(data);
+    return file.commit();
+}
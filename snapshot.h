@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+#include "userdirectory.h"
+#include "riderepository.h"
+#include "ledger.h"
+#include "rideschedules.h"
+
+// Reads and writes the full user/ride state.
+//
+// The primary format is a versioned binary file (carpool.dat): a fixed
+// header, fixed-width user and ride records, a passenger reference array
+// and a string table holding every username, route and vehicle string once.
+// Since version 3 it also holds the ledger's system account totals, and
+// user balances are integer Money. Version 4 keeps ratings as an exact
+// star sum plus a histogram of star values, restored without replaying.
+// Version 5 records the next ride id, as completed rides are no longer in
+// the snapshot once they have moved to the ride archive. Version 6 adds
+// each ride's origin and destination coordinates, version 7 the stops
+// each passenger rides between, version 8 the recurring ride schedules
+// and which schedule each ride was created from, and version 9 what each
+// passenger paid for their seat.
+// It is loaded by memory-mapping the file, so startup does no line
+// splitting and decodes each distinct string a single time.
+//
+// The users.txt/rides.txt text format is still supported for importing
+// older data and for exporting a human-readable copy. Text files are mapped
+// and cut into line-aligned chunks that the global thread pool decodes in
+// parallel; the calling thread then adds the records in file order.
+class Snapshot {
+public:
+    static QString defaultPath() { return "carpool.dat"; }
+
+    // Reports decoded chunks of a text file, on the loading thread
+    typedef std::function<void(int done, int total)> Progress;
+
+    // Binary snapshot. With replicaFor it is that user's view for a
+    // replica: no passwords, other users' balances and cancellation counts
+    // written as 0, what other passengers paid left out unless replicaFor
+    // captains the ride, no completed rides replicaFor took no part in and
+    // no system account totals.
+    static QByteArray serialize(const UserDirectory &users, const RideRepository &rides,
+                                quint64 journalSequence, const Ledger *ledger = nullptr,
+                                const RideSchedules *schedules = nullptr,
+                                const User *replicaFor = nullptr);
+    // Leaves users/rides untouched and returns false if the file is missing,
+    // truncated or from an unknown version. System account totals are
+    // restored into ledger, and schedules into schedules, when given.
+    static bool load(const QString &path, UserDirectory &users, RideRepository &rides,
+                     quint64 *journalSequence, Ledger *ledger = nullptr,
+                     RideSchedules *schedules = nullptr);
+    // Same, from a snapshot already in memory (e.g. received from a server)
+    static bool loadData(const QByteArray &data, UserDirectory &users, RideRepository &rides,
+                         quint64 *journalSequence, Ledger *ledger = nullptr,
+                         RideSchedules *schedules = nullptr);
+
+    // users.txt / rides.txt
+    static QByteArray serializeUsersText(const UserDirectory &users, quint64 journalSequence);
+    static QByteArray serializeRidesText(const RideRepository &rides, quint64 journalSequence);
+    static bool loadUsersText(const QString &path, UserDirectory &users, quint64 *journalSequence,
+                              const Progress &progress = Progress());
+    static bool loadRidesText(const QString &path, RideRepository &rides, quint64 *journalSequence,
+                              const Progress &progress = Progress());
+
+    // Offline conversion between the two formats
+    static bool importText(const QString &usersPath, const QString &ridesPath,
+                           const QString &snapshotPath);
+    static bool exportText(const QString &snapshotPath, const QString &usersPath,
+                           const QString &ridesPath);
+
+    // Atomically replaces path with data
+    static bool writeFile(const QString &path, const QByteArray &data);
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,66 @@
+#include "stringpool.h"
+
+StringPool &StringPool::instance()
+{
+    static StringPool pool;
+    return pool;
+}
+
+StringPool::StringPool()
+{
+    chunks[0].storeRelaxed(new QString[ChunkSize]);
+    count.storeRelease(1);
+    ids.insert(QString(), 0);
+}
+
+StringPool::~StringPool()
+{
+    for (QAtomicPointer<QString> &chunk : chunks) {
+        delete[] chunk.loadRelaxed();
+    }
+}
+
+int StringPool::intern(const QString &value)
+{
+    if (value.isEmpty()) return 0;
+
+    {
+        QReadLocker locker(&lock);
+        auto it = ids.constFind(value);
+        if (it != ids.constEnd()) return *it;
+    }
+
+    QWriteLocker locker(&lock);
+    // Another thread may have added it between the two locks
+    auto it = ids.constFind(value);
+    if (it != ids.constEnd()) return *it;
+
+    int id = count.loadRelaxed();
+    int chunk = id >> ChunkBits;
+    if (chunk >= MaxChunks) qFatal("StringPool: more than %d distinct strings", MaxChunks * ChunkSize);
+    if (!chunks[chunk].loadRelaxed()) chunks[chunk].storeRelease(new QString[ChunkSize]);
+    chunks[chunk].loadRelaxed()[id & (ChunkSize - 1)] = value;
+    ids.insert(value, id);
+    // Publishes the slot to value() on other threads
+    count.storeRelease(id + 1);
+    return id;
+}
+
+int StringPool::find(const QString &value) const
+{
+    if (value.isEmpty()) return 0;
+
+    QReadLocker locker(&lock);
+    return ids.value(value, -1);
+}
+
+QString StringPool::value(int id) const
+{
+    if (id < 0 || id >= count.loadAcquire()) return QString();
+    return chunks[id >> ChunkBits].loadAcquire()[id & (ChunkSize - 1)];
+}
+
+int StringPool::size() const
+{
+    return count.loadAcquire();
+}
@@ -0,0 +1,50 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+// Process-wide intern table for strings that repeat across users and rides
+// (usernames, user types, routes, vehicle types and classes). Each distinct
+// string is stored once and identified by a small integer, so entities keep
+// 4-byte ids and compare them instead of QStrings. Id 0 is always "".
+//
+// Strings are stored in fixed-size chunks that never move and are only
+// appended to, so value() reads without a lock: a slot is written before
+// the count that covers it is published. Interning still takes the lock.
+class StringPool {
+public:
+    static StringPool &instance();
+
+    // Returns the id for value, adding it on first use
+    int intern(const QString &value);
+    // Returns the id for value, or -1 if it was never interned
+    int find(const QString &value) const;
+    QString value(int id) const;
+
+    int size() const;
+
+private:
+    static const int ChunkBits = 10;
+    static const int ChunkSize = 1 << ChunkBits;
+    static const int MaxChunks = 4096;          // 4M distinct strings
+
+    StringPool();
+    ~StringPool();
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+
+    mutable QReadWriteLock lock;                // guards ids and appending
+    QAtomicPointer<QString> chunks[MaxChunks];
+    QAtomicInt count;                           // values published so far
+    QHash<QString, int> ids;
+};
+
+// Shorthands used by the entity classes
+inline int internString(const QString &value) { return StringPool::instance().intern(value); }
+inline QString pooledString(int id) { return StringPool::instance().value(id); }
+
+#endif // STRINGPOOL_H
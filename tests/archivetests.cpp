@@ -0,0 +1,129 @@
+// Tests for the ride archive: checkpoints move completed rides out of
+// memory, and they are paged back in on demand in their newest state.
+
+#include <QScopedPointer>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "carpoolservice.h"
+#include "testregistry.h"
+
+class ArchiveTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanupTestCase();
+    void completedRidesLeaveMemory();
+    void findRidePagesIn();
+    void historyPagesInOnlyTheUsersRides();
+    void newestArchivedStateWins();
+
+private:
+    CarpoolService* open();
+
+    QTemporaryDir *dir = nullptr;
+    int firstRide = 0;      // completed, booked by "archived-a"
+    int secondRide = 0;     // completed, booked by "archived-b"
+    int openRide = 0;
+};
+
+CarpoolService* ArchiveTests::open()
+{
+    CarpoolService *service = new CarpoolService(dir->filePath("journal.txt"), dir->filePath("carpool.dat"));
+    service->open();
+    return service;
+}
+
+void ArchiveTests::init()
+{
+    delete dir;
+    dir = new QTemporaryDir;
+
+    QScopedPointer<CarpoolService> service(open());
+    service->registerCaptain("archive-captain", "pw", "Car", "AC");
+    User *captain = service->users().find("archive-captain", "captain");
+    QVector<int> ids;
+    for (const QString &name : {QString("archived-a"), QString("archived-b")}) {
+        service->registerPassenger(name, "pw");
+        User *passenger = service->users().find(name, "passenger");
+        service->addBalance(passenger, 10000);
+        const int id = service->rides().nextId();
+        service->createRide(captain, "Lahore to Karachi", "2030-01-02 08:30", QString(), 1, 500);
+        QCOMPARE(service->bookRide(passenger, service->rides().find(id)), CarpoolService::Ok);
+        QCOMPARE(service->completeRide(captain, service->rides().find(id)), CarpoolService::Ok);
+        ids.append(id);
+    }
+    firstRide = ids[0];
+    secondRide = ids[1];
+    openRide = service->rides().nextId();
+    service->createRide(captain, "Lahore to Multan", "2030-01-03 08:30", QString(), 2, 500);
+    // close() checkpoints, which archives the completed rides
+    service->close();
+}
+
+void ArchiveTests::cleanupTestCase()
+{
+    delete dir;
+    dir = nullptr;
+}
+
+void ArchiveTests::completedRidesLeaveMemory()
+{
+    QScopedPointer<CarpoolService> service(open());
+    QVERIFY(!service->rides().find(firstRide));
+    QVERIFY(!service->rides().find(secondRide));
+    QVERIFY(service->rides().find(openRide));
+    QVERIFY(service->rides().completedRides().isEmpty());
+    service->close();
+}
+
+void ArchiveTests::findRidePagesIn()
+{
+    QScopedPointer<CarpoolService> service(open());
+    Ride *ride = service->findRide(firstRide);
+    QVERIFY(ride);
+    QVERIFY(ride->getIsCompleted());
+    QVERIFY(service->rides().isArchived(ride));
+    QVERIFY(!service->findRide(service->rides().nextId()));
+    // Only the ride asked for
+    QVERIFY(!service->rides().find(secondRide));
+    service->close();
+}
+
+void ArchiveTests::historyPagesInOnlyTheUsersRides()
+{
+    QScopedPointer<CarpoolService> service(open());
+    service->loadRideHistory(service->users().find("archived-b", "passenger"));
+    QVERIFY(service->rides().find(secondRide));
+    QVERIFY(!service->rides().find(firstRide));
+
+    service->loadRideHistory(service->users().find("archive-captain", "captain"));
+    QVERIFY(service->rides().find(firstRide));
+    service->close();
+}
+
+void ArchiveTests::newestArchivedStateWins()
+{
+    {
+        QScopedPointer<CarpoolService> service(open());
+        User *passenger = service->users().find("archived-a", "passenger");
+        Ride *ride = service->findRide(firstRide);
+        QVERIFY(ride);
+        QCOMPARE(service->rateCaptain(passenger, ride, 4), CarpoolService::Ok);
+        // Archived again, now rated
+        service->close();
+    }
+
+    QScopedPointer<CarpoolService> service(open());
+    QVERIFY(!service->rides().find(firstRide));
+    Ride *ride = service->findRide(firstRide);
+    QVERIFY(ride);
+    QVERIFY(ride->getIsRated());
+    QCOMPARE(service->rateCaptain(service->users().find("archived-a", "passenger"), ride, 4),
+             CarpoolService::AlreadyRated);
+    service->close();
+}
+
+CARPOOL_TEST(ArchiveTests)
+#include "archivetests.moc"
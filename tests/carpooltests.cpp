@@ -0,0 +1,681 @@
+// Unit tests for the headless core: booking under contention, the ledger's
+// balance invariants, journal replay after a crash and the snapshot format,
+// old versions included.
+//
+//   ctest --test-dir <build> --output-on-failure
+
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <cstring>
+#include "carpoolservice.h"
+#include "ledger.h"
+#include "persistenceworker.h"
+#include "snapshot.h"
+#include "testregistry.h"
+
+namespace {
+const QString Departure = "2030-01-02 08:30";
+
+// The sum of every account's running total; money only moves between
+// accounts, so it stays 0
+Money ledgerTotal(const CarpoolService &service)
+{
+    Money total = 0;
+    for (const User *user : service.users().all()) {
+        total += user->getBalanceMinor();
+    }
+    for (Money amount : service.ledger().systemBalances()) {
+        total += amount;
+    }
+    return total;
+}
+
+template <typename T>
+void put(QByteArray &data, quint64 offset, T value)
+{
+    std::memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+// A version 1 or 2 carpool.dat as those versions wrote it: a passenger
+// with a float rating and a rupee balance, a captain, and one ride the
+// passenger booked. Version 1 kept the ride times as strings.
+QByteArray legacySnapshot(quint32 version)
+{
+    const QStringList strings = {"", "pat", "secret", "cap", "pw", "Car", "AC", "Lahore to Karachi", Departure};
+    QByteArray stringData;
+    QVector<quint32> stringOffsets{0};
+    for (const QString &value : strings) {
+        stringData += value.toUtf8();
+        stringOffsets.append(quint32(stringData.size()));
+    }
+
+    const quint64 headerSize = 88;
+    const quint64 userSize = 40;
+    const quint64 rideSize = version == 1 ? 64 : 72;
+    const quint64 usersOffset = headerSize;
+    const quint64 ridesOffset = usersOffset + 2 * userSize;
+    const quint64 refsOffset = ridesOffset + rideSize;
+    const quint64 stringOffsetsOffset = refsOffset + sizeof(quint32);
+    const quint64 stringDataOffset = stringOffsetsOffset + stringOffsets.size() * sizeof(quint32);
+    QByteArray data(int(stringDataOffset + stringData.size()), '\0');
+
+    put<quint32>(data, 0, 0x4E535043);
+    put<quint32>(data, 4, version);
+    put<quint32>(data, 8, 0x01020304);
+    put<quint32>(data, 12, 2);                              // users
+    put<quint64>(data, 16, 5);                              // journal sequence
+    put<quint32>(data, 24, 1);                              // rides
+    put<quint32>(data, 28, quint32(strings.size()));
+    put<quint32>(data, 32, 1);                              // passenger refs
+    put<quint64>(data, 40, usersOffset);
+    put<quint64>(data, 48, ridesOffset);
+    put<quint64>(data, 56, refsOffset);
+    put<quint64>(data, 64, stringOffsetsOffset);
+    put<quint64>(data, 72, stringDataOffset);
+    put<quint64>(data, 80, quint64(stringData.size()));
+
+    // type, username, password, vehicle type, vehicle class, cancels,
+    // ratings, float rating, double balance
+    put<quint32>(data, usersOffset + 0, 0);
+    put<quint32>(data, usersOffset + 4, 1);
+    put<quint32>(data, usersOffset + 8, 2);
+    put<qint32>(data, usersOffset + 20, 1);
+    put<qint32>(data, usersOffset + 24, 2);
+    put<float>(data, usersOffset + 28, 4.0f);
+    put<double>(data, usersOffset + 32, 12.5);
+    put<quint32>(data, usersOffset + userSize + 0, 1);
+    put<quint32>(data, usersOffset + userSize + 4, 3);
+    put<quint32>(data, usersOffset + userSize + 8, 4);
+    put<quint32>(data, usersOffset + userSize + 12, 5);
+    put<quint32>(data, usersOffset + userSize + 16, 6);
+
+    put<qint32>(data, ridesOffset + 0, 7);
+    put<quint32>(data, ridesOffset + 4, 3);
+    put<quint32>(data, ridesOffset + 8, 1);
+    put<quint32>(data, ridesOffset + 12, 7);
+    quint64 field = ridesOffset + 16;
+    if (version == 1) {
+        put<quint32>(data, field, 8);                       // departure string
+        put<quint32>(data, field + 4, 0);                   // no return
+        field += 8;
+    } else {
+        put<qint64>(data, field, Ride::parseTime(Departure));
+        put<qint64>(data, field + 8, Ride::NoTime);
+        field += 16;
+    }
+    put<quint32>(data, field, 5);
+    put<quint32>(data, field + 4, 6);
+    put<qint32>(data, field + 8, 3);                        // seats
+    put<qint32>(data, field + 12, 1);                       // occupied
+    put<quint32>(data, field + 16, 0);                      // flags
+    put<quint32>(data, field + 20, 0);                      // first ref
+    put<quint32>(data, field + 24, 1);                      // ref count
+    put<double>(data, field + 32, 750.5);
+
+    put<quint32>(data, refsOffset, 1);
+    for (int i = 0; i < stringOffsets.size(); i++) {
+        put<quint32>(data, stringOffsetsOffset + i * sizeof(quint32), stringOffsets[i]);
+    }
+    std::memcpy(data.data() + stringDataOffset, stringData.constData(), size_t(stringData.size()));
+    return data;
+}
+
+bool writeText(const QString &path, const QByteArray &text)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(text) == text.size();
+}
+}
+
+class CarpoolTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void batchNeverOversellsARide();
+    void batchSharesSegmentsOfMultiStopRides();
+    void bookingAFullRideFails();
+    void batchDecidesEachPassengerInOrder();
+    void ledgerStaysBalanced();
+    void ledgerRejectsUnbalancedTransactions();
+    void auditLogSkipsCopiedTransactions();
+    void journalReplaysAfterCrash();
+    void separatorsAreRejected();
+    void snapshotRoundTrips();
+    void replicaSnapshotIsOneUsersView();
+    void legacySnapshotLoads_data();
+    void legacySnapshotLoads();
+    void legacyTextRecordsLoad();
+
+private:
+    // A captain with one ride, and passengers with money to book it
+    static Ride* addRide(CarpoolService &service, const QString &captain, const QString &route, int seats);
+    static QVector<User*> addPassengers(CarpoolService &service, const QString &prefix, int count);
+
+    QTemporaryDir workDir;
+};
+
+void CarpoolTests::initTestCase()
+{
+    // The service falls back to users.txt/rides.txt in the working directory
+    QVERIFY(workDir.isValid());
+    QVERIFY(QDir::setCurrent(workDir.path()));
+}
+
+Ride* CarpoolTests::addRide(CarpoolService &service, const QString &captain, const QString &route, int seats)
+{
+    if (service.registerCaptain(captain, "pw", "Car", "AC") != CarpoolService::Ok) return nullptr;
+    User *user = service.users().find(captain, "captain");
+    const int id = service.rides().nextId();
+    if (service.createRide(user, route, Departure, QString(), seats, 500) != CarpoolService::Ok) return nullptr;
+    return service.rides().find(id);
+}
+
+QVector<User*> CarpoolTests::addPassengers(CarpoolService &service, const QString &prefix, int count)
+{
+    QVector<User*> passengers;
+    for (int i = 0; i < count; i++) {
+        const QString name = prefix + QString::number(i);
+        service.registerPassenger(name, "pw");
+        User *user = service.users().find(name, "passenger");
+        service.addBalance(user, 100000);
+        passengers.append(user);
+    }
+    return passengers;
+}
+
+void CarpoolTests::batchNeverOversellsARide()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    // Enough requests for the BookingEngine to decide them on several
+    // threads, all racing for the same few seats
+    const int seats = 3;
+    QVector<Ride*> rides;
+    for (int r = 0; r < 4; r++) {
+        rides.append(addRide(service, QString("race-captain%1").arg(r), "Lahore to Karachi", seats));
+        QVERIFY(rides.last());
+    }
+    const QVector<User*> passengers = addPassengers(service, "racer", 300);
+
+    QVector<QPair<User*, Ride*>> bookings;
+    for (int i = 0; i < passengers.size(); i++) {
+        bookings.append(qMakePair(passengers[i], rides[i % rides.size()]));
+    }
+    // The same seat twice in one batch
+    bookings.append(qMakePair(passengers[0], rides[0]));
+
+    const QVector<CarpoolService::Status> statuses = service.bookRides(bookings);
+    QCOMPARE(statuses.size(), bookings.size());
+    QVector<int> accepted(rides.size(), 0);
+    for (int i = 0; i < statuses.size(); i++) {
+        const int ride = i < passengers.size() ? i % rides.size() : 0;
+        if (statuses[i] == CarpoolService::Ok) {
+            accepted[ride]++;
+        } else {
+            QVERIFY(statuses[i] == CarpoolService::RideFull || statuses[i] == CarpoolService::AlreadyBooked);
+        }
+    }
+    // Unless the first request lost the race for its seat
+    QCOMPARE(statuses.last(), statuses.first() == CarpoolService::Ok ? CarpoolService::AlreadyBooked
+                                                                     : CarpoolService::RideFull);
+    for (int r = 0; r < rides.size(); r++) {
+        QCOMPARE(accepted[r], seats);
+        QCOMPARE(rides[r]->getOccupiedSeats(), seats);
+        QCOMPARE(rides[r]->getPassengerIds().size(), seats);
+        QVERIFY(rides[r]->isFull());
+    }
+    service.close();
+}
+
+void CarpoolTests::batchSharesSegmentsOfMultiStopRides()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    // One seat: the two halves fit together, the whole trip then doesn't
+    Ride *ride = addRide(service, "legs-captain", "Lahore to Multan to Karachi", 1);
+    QVERIFY(ride);
+    const QVector<User*> passengers = addPassengers(service, "legs", 3);
+    const QVector<CarpoolService::Status> statuses = service.bookSeats({
+        {passengers[0], ride, Ride::Leg{0, 1}},
+        {passengers[1], ride, Ride::Leg{1, 2}},
+        {passengers[2], ride, Ride::Leg{0, 2}},
+    });
+    QCOMPARE(statuses, (QVector<CarpoolService::Status>{CarpoolService::Ok, CarpoolService::Ok,
+                                                        CarpoolService::RideFull}));
+    QCOMPARE(ride->getPeakOccupancy(), 1);
+    QCOMPARE(ride->getLeg(passengers[1]->getUsernameId()), (Ride::Leg{1, 2}));
+    service.close();
+}
+
+void CarpoolTests::bookingAFullRideFails()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    Ride *ride = addRide(service, "full-captain", "Lahore to Karachi", 1);
+    QVERIFY(ride);
+    const QVector<User*> passengers = addPassengers(service, "full", 2);
+    QCOMPARE(service.bookRide(passengers[0], ride), CarpoolService::Ok);
+    QCOMPARE(service.bookRide(passengers[1], ride), CarpoolService::RideFull);
+    QCOMPARE(service.bookRide(passengers[0], ride), CarpoolService::AlreadyBooked);
+
+    // A cancelled seat can be taken again
+    QCOMPARE(service.cancelBooking(passengers[0], ride), CarpoolService::Ok);
+    QCOMPARE(service.bookRide(passengers[1], ride), CarpoolService::Ok);
+    QCOMPARE(ride->getOccupiedSeats(), 1);
+    service.close();
+}
+
+void CarpoolTests::batchDecidesEachPassengerInOrder()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    Ride *first = addRide(service, "order-captain1", "Lahore to Karachi", 2);
+    Ride *second = addRide(service, "order-captain2", "Lahore to Karachi", 2);
+    QVERIFY(first && second);
+    QCOMPARE(service.registerPassenger("order-passenger", "pw"), CarpoolService::Ok);
+    User *passenger = service.users().find("order-passenger", "passenger");
+    // Enough for one seat only
+    QCOMPARE(service.addBalance(passenger, toRupees(service.fares().quote(first))), CarpoolService::Ok);
+
+    // The same passenger's requests compete for their balance; the earlier
+    // one wins, on one thread or many
+    QVector<CarpoolService::Booking> bookings;
+    bookings.append({passenger, second, second->wholeTrip()});
+    bookings.append({passenger, first, first->wholeTrip()});
+    const QVector<CarpoolService::Status> statuses = service.bookSeats(bookings);
+    QCOMPARE(statuses[0], CarpoolService::Ok);
+    QCOMPARE(statuses[1], CarpoolService::InsufficientBalance);
+    QVERIFY(second->hasPassenger(passenger->getUsernameId()));
+    QVERIFY(!first->hasPassenger(passenger->getUsernameId()));
+    QCOMPARE(passenger->getBalanceMinor(), Money(0));
+    service.close();
+}
+
+void CarpoolTests::ledgerStaysBalanced()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    Ride *first = addRide(service, "ledger-captain1", "Lahore to Karachi", 3);
+    Ride *second = addRide(service, "ledger-captain2", "Karachi to Quetta", 3);
+    QVERIFY(first && second);
+    const QVector<User*> passengers = addPassengers(service, "ledger", 3);
+    QCOMPARE(ledgerTotal(service), Money(0));
+
+    const Money before = passengers[0]->getBalanceMinor();
+    QCOMPARE(service.bookRide(passengers[0], first), CarpoolService::Ok);
+    const Money paid = first->getPaidFare(passengers[0]->getUsernameId());
+    QVERIFY(paid > 0);
+    QCOMPARE(passengers[0]->getBalanceMinor(), before - paid);
+    QCOMPARE(ledgerTotal(service), Money(0));
+
+    QCOMPARE(service.bookRide(passengers[1], first), CarpoolService::Ok);
+    QCOMPARE(service.bookRide(passengers[1], second), CarpoolService::Ok);
+    QCOMPARE(service.bookRide(passengers[2], second), CarpoolService::Ok);
+    QVERIFY(service.ledger().balance(Ledger::platformFees()) > 0);
+    QCOMPARE(ledgerTotal(service), Money(0));
+
+    // Refunds, penalties and a captain's cancellation move money around
+    // without creating or losing any
+    for (int i = 0; i <= CarpoolService::FreeCancellations; i++) {
+        QCOMPARE(service.cancelBooking(passengers[1], first), CarpoolService::Ok);
+        QCOMPARE(ledgerTotal(service), Money(0));
+        QCOMPARE(service.bookRide(passengers[1], first), CarpoolService::Ok);
+    }
+    QVERIFY(service.ledger().balance(Ledger::platformPenalties()) > 0);
+    QCOMPARE(service.cancelRide(service.users().find("ledger-captain2", "captain"), second), CarpoolService::Ok);
+    QCOMPARE(ledgerTotal(service), Money(0));
+
+    QCOMPARE(service.addBalance(passengers[2], -5), CarpoolService::InvalidAmount);
+    QCOMPARE(ledgerTotal(service), Money(0));
+    service.close();
+}
+
+void CarpoolTests::ledgerRejectsUnbalancedTransactions()
+{
+    UserDirectory users;
+    User *user = users.create<Passenger>("unbalanced", "pw");
+    QVERIFY(users.add(user));
+    Ledger ledger(users);
+
+    Ledger::Transaction unbalanced;
+    unbalanced.kind = "topup";
+    unbalanced.post(Ledger::userAccount("passenger", "unbalanced"), 1000);
+    unbalanced.post(Ledger::deposits(), -900);
+    QVERIFY(!unbalanced.isBalanced());
+    QVERIFY(!ledger.apply(unbalanced));
+
+    // One unknown account rejects the whole transaction
+    Ledger::Transaction unknownAccount;
+    unknownAccount.kind = "topup";
+    unknownAccount.post(Ledger::userAccount("passenger", "unbalanced"), 1000);
+    unknownAccount.post(Ledger::userAccount("passenger", "nobody"), -1000);
+    QVERIFY(!ledger.apply(unknownAccount));
+
+    QCOMPARE(user->getBalanceMinor(), Money(0));
+    QCOMPARE(ledger.balance(Ledger::deposits()), Money(0));
+
+    Ledger::Transaction topUp;
+    topUp.kind = "topup";
+    topUp.post(Ledger::userAccount("passenger", "unbalanced"), 1000);
+    topUp.post(Ledger::deposits(), -1000);
+    QVERIFY(ledger.apply(topUp));
+    QCOMPARE(user->getBalanceMinor(), Money(1000));
+    QCOMPARE(ledger.balance(Ledger::deposits()), Money(-1000));
+}
+
+void CarpoolTests::auditLogSkipsCopiedTransactions()
+{
+    QTemporaryDir dir;
+    const QString journalPath = dir.filePath("journal.txt");
+    const QString auditPath = dir.filePath("ledger.txt");
+    const QByteArray first = Journal::format(1, "TXN", {"topup", "passenger:a", "100", "external:deposits", "-100"});
+    const QByteArray second = Journal::format(3, "TXN", {"topup", "passenger:a", "50", "external:deposits", "-50"});
+
+    // A crash after copying the first transaction but before the journal
+    // was truncated
+    QVERIFY(writeText(journalPath, first + Journal::format(2, "CANCELCOUNT", {"passenger", "a"}) + second));
+    QVERIFY(writeText(auditPath, first));
+
+    PersistenceWorker worker(journalPath, dir.filePath("carpool.dat"), auditPath);
+    QSignalSpy checkpointed(&worker, &PersistenceWorker::checkpointed);
+    worker.start();
+    worker.checkpoint(3, QByteArray("snapshot"));
+    worker.stop();
+    QCOMPARE(checkpointed.count(), 1);
+
+    QList<quint64> sequences;
+    for (const JournalEntry &entry : Journal::readAll(auditPath)) {
+        sequences.append(entry.sequence);
+    }
+    QCOMPARE(sequences, (QList<quint64>{1, 3}));
+    QCOMPARE(Journal::lastSequence(auditPath), quint64(3));
+    QVERIFY(Journal::readAll(journalPath).isEmpty());
+}
+
+void CarpoolTests::journalReplaysAfterCrash()
+{
+    QTemporaryDir dir;
+    QTemporaryDir crashDir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    Ride *ride = addRide(service, "crash-captain", "Lahore to Multan to Karachi", 2);
+    QVERIFY(ride);
+    const QVector<User*> passengers = addPassengers(service, "crash", 3);
+    QCOMPARE(service.bookRide(passengers[0], ride), CarpoolService::Ok);
+    QCOMPARE(service.bookRide(passengers[1], ride, Ride::Leg{1, 2}), CarpoolService::Ok);
+    QCOMPARE(service.cancelBooking(passengers[0], ride), CarpoolService::Ok);
+
+    QSignalSpy saved(&service, &CarpoolService::allChangesSaved);
+    QCOMPARE(service.bookRide(passengers[2], ride, Ride::Leg{0, 1}), CarpoolService::Ok);
+    QVERIFY(saved.wait(5000));
+
+    // The files as a crash would leave them: no final snapshot, and a
+    // batch torn off halfway through its line
+    for (const QString &name : {"journal.txt", "carpool.dat", "ledger.txt", "archive.txt"}) {
+        if (QFile::exists(dir.filePath(name))) {
+            QVERIFY(QFile::copy(dir.filePath(name), crashDir.filePath(name)));
+        }
+    }
+    QFile journal(crashDir.filePath("journal.txt"));
+    QVERIFY(journal.open(QIODevice::Append));
+    journal.write("999999,TXN,fare,passenger:crash0,-50");
+    journal.close();
+
+    CarpoolService recovered(crashDir.filePath("journal.txt"), crashDir.filePath("carpool.dat"));
+    recovered.open();
+
+    QCOMPARE(recovered.users().size(), service.users().size());
+    for (const User *user : service.users().all()) {
+        const User *copy = recovered.users().find(user->getUsername(), user->getUserType());
+        QVERIFY(copy);
+        QCOMPARE(copy->getBalanceMinor(), user->getBalanceMinor());
+        QCOMPARE(copy->getCancelCount(), user->getCancelCount());
+    }
+    QCOMPARE(recovered.ledger().systemBalances(), service.ledger().systemBalances());
+    QCOMPARE(ledgerTotal(recovered), Money(0));
+
+    const Ride *copy = recovered.rides().find(ride->getId());
+    QVERIFY(copy);
+    QCOMPARE(copy->getPassengers(), ride->getPassengers());
+    QCOMPARE(copy->getLegs(), ride->getLegs());
+    QCOMPARE(copy->getPaidFares(), ride->getPaidFares());
+    QCOMPARE(copy->getOccupiedSeats(), ride->getOccupiedSeats());
+    QCOMPARE(copy->seatsFreeBetween(0, 1), ride->seatsFreeBetween(0, 1));
+    QCOMPARE(copy->seatsFreeBetween(1, 2), ride->seatsFreeBetween(1, 2));
+
+    recovered.close();
+    service.close();
+}
+
+void CarpoolTests::separatorsAreRejected()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    // Journal entries are not escaped, so these would split a record
+    const int userCount = service.users().size();
+    const CarpoolService::Status invalid = CarpoolService::InvalidCharacters;
+    QCOMPARE(service.registerPassenger("sep,one", "pw"), invalid);
+    QCOMPARE(service.registerPassenger("sep;one", "pw"), invalid);
+    QCOMPARE(service.registerPassenger("sep-one", "p\nw"), invalid);
+    QCOMPARE(service.registerCaptain("sep-captain", "pw", "Car,Van", "AC"), invalid);
+    QCOMPARE(service.registerCaptain("sep-captain", "pw", "Car", "AC\r"), invalid);
+    QCOMPARE(service.users().size(), userCount);
+
+    QCOMPARE(service.registerCaptain("sep-captain", "pw", "Car", "AC"), CarpoolService::Ok);
+    User *captain = service.users().find("sep-captain", "captain");
+    QCOMPARE(service.createRide(captain, "Lahore, Karachi", Departure, QString(), 2, 500), invalid);
+    QCOMPARE(service.createSchedule(captain, "Lahore\nKarachi", Departure, QString(),
+                                    RideSchedule::weekdayBit(1), 2, 500), invalid);
+    QVERIFY(service.rides().activeRidesForCaptain(captain->getUsernameId()).isEmpty());
+    QVERIFY(service.schedules().all().isEmpty());
+    service.close();
+
+    // What was accepted replays as it was written
+    CarpoolService reopened(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    reopened.open();
+    QCOMPARE(reopened.users().size(), userCount + 1);
+    QVERIFY(reopened.users().find("sep-captain", "captain"));
+    reopened.close();
+}
+
+void CarpoolTests::snapshotRoundTrips()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+
+    Ride *ride = addRide(service, "round-captain", "Lahore to Multan to Karachi", 3);
+    QVERIFY(ride);
+    const QVector<User*> passengers = addPassengers(service, "round", 2);
+    QCOMPARE(service.bookRide(passengers[0], ride, Ride::Leg{0, 1}), CarpoolService::Ok);
+    QCOMPARE(service.bookRide(passengers[1], ride), CarpoolService::Ok);
+    User *captain = service.users().find("round-captain", "captain");
+    QCOMPARE(service.createSchedule(captain, "Multan to Lahore", Departure, QString(),
+                                    RideSchedule::weekdayBit(1) | RideSchedule::weekdayBit(5), 4, 300,
+                                    GeoPoint(31520370, 74358749), GeoPoint(30157458, 71524915)),
+             CarpoolService::Ok);
+
+    const QByteArray data = Snapshot::serialize(service.users(), service.rides(), 42, &service.ledger(),
+                                                &service.schedules());
+    UserDirectory users;
+    RideRepository rides;
+    Ledger ledger(users);
+    RideSchedules schedules;
+    quint64 sequence = 0;
+    QVERIFY(Snapshot::loadData(data, users, rides, &sequence, &ledger, &schedules));
+    QCOMPARE(sequence, quint64(42));
+
+    QCOMPARE(users.size(), service.users().size());
+    for (const User *user : service.users().all()) {
+        const User *copy = users.find(user->getUsername(), user->getUserType());
+        QVERIFY(copy);
+        QCOMPARE(copy->getPassword(), user->getPassword());
+        QCOMPARE(copy->getBalanceMinor(), user->getBalanceMinor());
+        QCOMPARE(copy->getRatingSum(), user->getRatingSum());
+    }
+    QCOMPARE(ledger.systemBalances(), service.ledger().systemBalances());
+
+    QCOMPARE(rides.all().size(), service.rides().all().size());
+    QCOMPARE(rides.nextId(), service.rides().nextId());
+    for (const Ride *original : service.rides().all()) {
+        const Ride *copy = rides.find(original->getId());
+        QVERIFY(copy);
+        QCOMPARE(copy->getRoute(), original->getRoute());
+        QCOMPARE(copy->getDepartureEpoch(), original->getDepartureEpoch());
+        QCOMPARE(copy->getFare(), original->getFare());
+        QCOMPARE(copy->getPassengers(), original->getPassengers());
+        QCOMPARE(copy->getLegs(), original->getLegs());
+        QCOMPARE(copy->getPaidFares(), original->getPaidFares());
+        QCOMPARE(copy->getScheduleId(), original->getScheduleId());
+        QCOMPARE(copy->getOrigin().toText(), original->getOrigin().toText());
+    }
+
+    QCOMPARE(schedules.size(), 1);
+    const RideSchedule &schedule = schedules.all().first();
+    const RideSchedule &original = service.schedules().all().first();
+    QCOMPARE(schedule.toArgs(), original.toArgs());
+    QCOMPARE(schedules.nextId(), service.schedules().nextId());
+    service.close();
+}
+
+void CarpoolTests::replicaSnapshotIsOneUsersView()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    QVector<User*> passengers = addPassengers(service, "replica", 2);
+    Ride *ride = addRide(service, "replica-captain", "Lahore to Karachi", 2);
+    QVERIFY(ride);
+    QCOMPARE(service.bookRide(passengers[1], ride), CarpoolService::Ok);
+    const int rideId = ride->getId();
+    QCOMPARE(service.completeRide(service.users().find("replica-captain", "captain"), ride),
+             CarpoolService::Ok);
+
+    const QByteArray data = service.replicaSnapshot(passengers[0]);
+    UserDirectory users;
+    RideRepository rides;
+    Ledger ledger(users);
+    QVERIFY(Snapshot::loadData(data, users, rides, nullptr, &ledger));
+    QCOMPARE(users.size(), service.users().size());
+    for (const User *user : users.all()) {
+        QVERIFY(user->getPassword().isEmpty());
+        const Money expected = user->getUsername() == passengers[0]->getUsername()
+                               ? passengers[0]->getBalanceMinor() : 0;
+        QCOMPARE(user->getBalanceMinor(), expected);
+    }
+    QVERIFY(!data.contains("pw"));
+    QVERIFY(ledger.systemBalances().isEmpty());
+    // Someone else's finished ride is not part of the view
+    QVERIFY(!rides.find(rideId));
+
+    UserDirectory riderUsers;
+    RideRepository riderRides;
+    QVERIFY(Snapshot::loadData(service.replicaSnapshot(passengers[1]), riderUsers, riderRides, nullptr));
+    QVERIFY(riderRides.find(rideId));
+    service.close();
+}
+
+void CarpoolTests::legacySnapshotLoads_data()
+{
+    QTest::addColumn<quint32>("version");
+    QTest::newRow("v1 string times") << quint32(1);
+    QTest::newRow("v2 rupee balances") << quint32(2);
+}
+
+void CarpoolTests::legacySnapshotLoads()
+{
+    QFETCH(quint32, version);
+
+    UserDirectory users;
+    RideRepository rides;
+    Ledger ledger(users);
+    RideSchedules schedules;
+    quint64 sequence = 0;
+    QVERIFY(Snapshot::loadData(legacySnapshot(version), users, rides, &sequence, &ledger, &schedules));
+    QCOMPARE(sequence, quint64(5));
+
+    const User *passenger = users.find("pat", "passenger");
+    QVERIFY(passenger);
+    QCOMPARE(passenger->getPassword(), QString("secret"));
+    QCOMPARE(passenger->getBalanceMinor(), Money(1250));
+    QCOMPARE(passenger->getCancelCount(), 1);
+    QCOMPARE(passenger->getRatingCount(), 2);
+    QCOMPARE(passenger->getRatingSum(), qint64(8));
+    const Captain *captain = dynamic_cast<const Captain*>(users.find("cap", "captain"));
+    QVERIFY(captain);
+    QCOMPARE(captain->getVehicleType(), QString("Car"));
+    QCOMPARE(captain->getVehicleClass(), QString("AC"));
+
+    const Ride *ride = rides.find(7);
+    QVERIFY(ride);
+    QCOMPARE(ride->getCaptain(), QString("cap"));
+    QCOMPARE(ride->getRoute(), QString("Lahore to Karachi"));
+    QCOMPARE(ride->getDepartureTime(), Departure);
+    QCOMPARE(ride->getReturnEpoch(), qint64(Ride::NoTime));
+    QCOMPARE(ride->getFare(), 750.5);
+    QCOMPARE(ride->getTotalSeats(), 3);
+    QCOMPARE(ride->getOccupiedSeats(), 1);
+    QVERIFY(ride->hasPassenger(passenger->getUsernameId()));
+    QCOMPARE(ride->getLeg(passenger->getUsernameId()), ride->wholeTrip());
+    QVERIFY(!ride->getOrigin().isValid());
+    QVERIFY(ledger.systemBalances().isEmpty());
+    QCOMPARE(schedules.size(), 0);
+}
+
+void CarpoolTests::legacyTextRecordsLoad()
+{
+    // users.txt with a float rating and no star histogram, and a rides.txt
+    // line from before ride ids, locations, legs, schedules and paid fares
+    QTemporaryDir dir;
+    QVERIFY(writeText(dir.filePath("users.txt"),
+                      "#journal,3\nPassenger,tpat,secret,12.50,1,4.5,2\nCaptain,tcap,pw,0,0,0,0,Car,AC\n"));
+    QVERIFY(writeText(dir.filePath("rides.txt"),
+                      "#journal,3\r\ntcap,tpat,Lahore to Karachi," + Departure.toUtf8() +
+                      ",,Car,AC,3,1,0,750.5,0,tpat\r\n"));
+
+    UserDirectory users;
+    RideRepository rides;
+    quint64 usersSequence = 0;
+    quint64 ridesSequence = 0;
+    QVERIFY(Snapshot::loadUsersText(dir.filePath("users.txt"), users, &usersSequence));
+    QVERIFY(Snapshot::loadRidesText(dir.filePath("rides.txt"), rides, &ridesSequence));
+    QCOMPARE(usersSequence, quint64(3));
+    QCOMPARE(ridesSequence, quint64(3));
+
+    const User *passenger = users.find("tpat", "passenger");
+    QVERIFY(passenger);
+    QCOMPARE(passenger->getBalanceMinor(), Money(1250));
+    QCOMPARE(passenger->getRatingSum(), qint64(9));
+    QVERIFY(users.find("tcap", "captain"));
+
+    QCOMPARE(rides.all().size(), 1);
+    const Ride *ride = rides.all().first();
+    QCOMPARE(ride->getRoute(), QString("Lahore to Karachi"));
+    QCOMPARE(ride->getDepartureTime(), Departure);
+    QCOMPARE(ride->getFare(), 750.5);
+    QCOMPARE(ride->getOccupiedSeats(), 1);
+    QVERIFY(ride->hasPassenger(passenger->getUsernameId()));
+}
+
+CARPOOL_TEST(CarpoolTests)
+
+#include "carpooltests.moc"
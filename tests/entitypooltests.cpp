@@ -0,0 +1,100 @@
+// Tests for the slab allocator behind the user and ride repositories:
+// growth past the first chunk, slot reuse and stale handles.
+
+#include <QtTest>
+#include "entitypool.h"
+#include "testregistry.h"
+
+namespace {
+struct Counted {
+    static int alive;
+    int value;
+
+    explicit Counted(int value) : value(value) { alive++; }
+    virtual ~Counted() { alive--; }
+};
+int Counted::alive = 0;
+
+struct Wider : Counted {
+    double extra[4] = {};
+
+    explicit Wider(int value) : Counted(value) {}
+};
+
+using Pool = EntityPool<Counted, sizeof(Wider)>;
+}
+
+class EntityPoolTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void growsPastFirstChunk();
+    void staleHandleReturnsNull();
+    void reserveUsesOneChunk();
+    void clearDestroysEveryObject();
+};
+
+void EntityPoolTests::growsPastFirstChunk()
+{
+    Pool pool;
+    QVector<Counted*> objects;
+    for (int i = 0; i < 1000; i++) {
+        objects.append(i % 2 ? pool.create<Wider>(i) : pool.create(i));
+    }
+    QCOMPARE(pool.size(), 1000);
+    QVERIFY(pool.capacity() >= 1000);
+    for (int i = 0; i < objects.size(); i++) {
+        QCOMPARE(objects[i]->value, i);
+        QCOMPARE(pool.get(pool.handleOf(objects[i])), objects[i]);
+    }
+}
+
+void EntityPoolTests::staleHandleReturnsNull()
+{
+    Pool pool;
+    Counted *first = pool.create(1);
+    Pool::Handle handle = pool.handleOf(first);
+    pool.destroy(first);
+    QVERIFY(!pool.get(handle));
+
+    // The slot is reused, but the old handle must not see the new object
+    Counted *second = pool.create(2);
+    QCOMPARE(pool.handleOf(second).index, handle.index);
+    QVERIFY(pool.handleOf(second) != handle);
+    QVERIFY(!pool.get(handle));
+    QVERIFY(pool.get(Pool::Handle()) == nullptr);
+}
+
+void EntityPoolTests::reserveUsesOneChunk()
+{
+    Pool pool;
+    pool.reserve(5000);
+    int capacity = pool.capacity();
+    QVERIFY(capacity >= 5000);
+    for (int i = 0; i < 5000; i++) {
+        pool.create(i);
+    }
+    QCOMPARE(pool.capacity(), capacity);
+}
+
+void EntityPoolTests::clearDestroysEveryObject()
+{
+    int before = Counted::alive;
+    {
+        Pool pool;
+        for (int i = 0; i < 300; i++) {
+            pool.create<Wider>(i);
+        }
+        QCOMPARE(Counted::alive, before + 300);
+        pool.clear();
+        QCOMPARE(Counted::alive, before);
+        QCOMPARE(pool.size(), 0);
+
+        pool.create(1);
+    }
+    QCOMPARE(Counted::alive, before);
+}
+
+CARPOOL_TEST(EntityPoolTests)
+#include "entitypooltests.moc"
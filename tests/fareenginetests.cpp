@@ -0,0 +1,169 @@
+// Tests for FareEngine: each pricing factor, clamping, leg shares, and
+// that a batch quotes every ride exactly as a single quote does.
+
+#include <QRandomGenerator>
+#include <QtTest>
+#include <limits>
+#include "fareengine.h"
+#include "testregistry.h"
+
+namespace {
+const GeoPoint Lahore = GeoPoint::fromDegrees(31.5204, 74.3587);
+const GeoPoint Karachi = GeoPoint::fromDegrees(24.8607, 67.0011);
+
+Ride makeRide(double fare, const QString &departure = "2030-01-02 12:00", int seats = 4,
+              const QString &type = "Car", const QString &vehicleClass = "Non-AC",
+              const QString &route = "Lahore to Karachi")
+{
+    return Ride("fare-captain", "", route, Ride::parseTime(departure), Ride::NoTime, type, vehicleClass, seats, fare);
+}
+
+Money quote(const Ride &ride)
+{
+    return FareEngine().quote(&ride);
+}
+}
+
+class FareEngineTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void askingFareIsTheFloor();
+    void longRidesArePricedByDistance();
+    void hourOfDay_data();
+    void hourOfDay();
+    void surgeFollowsBusiestSegment();
+    void faresAreClamped();
+    void legsShareTheWholeTripFare();
+    void batchAgreesWithSingleQuotes();
+};
+
+void FareEngineTests::askingFareIsTheFloor()
+{
+    FareEngine engine;
+    QCOMPARE(quote(makeRide(333.33)), Money(33333));
+    QCOMPARE(quote(makeRide(0.01)), Money(1));
+
+    // Short enough that distance comes to less than the asking fare
+    Ride ride = makeRide(500);
+    ride.setEndpoints(Lahore, GeoPoint::fromDegrees(31.53, 74.3587));
+    QCOMPARE(engine.quote(&ride), Money(50000));
+}
+
+void FareEngineTests::longRidesArePricedByDistance()
+{
+    FareEngine engine;
+    Ride car = makeRide(500);
+    car.setEndpoints(Lahore, Karachi);
+    const double roadKm = GeoPoint::distance(Lahore, Karachi) / 1000.0 * FareEngine::RoadFactor;
+    const Money byDistance = toMoney(FareEngine::FlagFallRupees + FareEngine::PerKmRupees * roadKm);
+    QVERIFY(qAbs(engine.quote(&car) - byDistance) <= 1);
+
+    // Vehicle type and class factors multiply; unknown vehicles price as 1
+    Ride van = makeRide(500, "2030-01-02 12:00", 4, "Van", "AC");
+    van.setEndpoints(Lahore, Karachi);
+    QVERIFY(qAbs(double(engine.quote(&van)) / engine.quote(&car) - 1.3 * 1.2) < 1e-6);
+    Ride unknown = makeRide(500, "2030-01-02 12:00", 4, "Rickshaw", "Open");
+    unknown.setEndpoints(Lahore, Karachi);
+    QCOMPARE(engine.quote(&unknown), engine.quote(&car));
+}
+
+void FareEngineTests::hourOfDay_data()
+{
+    QTest::addColumn<QString>("departure");
+    QTest::addColumn<Money>("fare");
+    QTest::newRow("midday") << QString("2030-01-02 12:00") << Money(40000);
+    QTest::newRow("morning peak") << QString("2030-01-02 08:30") << Money(50000);
+    QTest::newRow("evening peak") << QString("2030-01-02 19:59") << Money(50000);
+    QTest::newRow("night") << QString("2030-01-02 23:00") << Money(44000);
+    QTest::newRow("early morning") << QString("2030-01-02 05:59") << Money(44000);
+    QTest::newRow("no time") << QString("") << Money(40000);
+}
+
+void FareEngineTests::hourOfDay()
+{
+    QFETCH(QString, departure);
+    QFETCH(Money, fare);
+    QCOMPARE(quote(makeRide(400, departure)), fare);
+}
+
+void FareEngineTests::surgeFollowsBusiestSegment()
+{
+    FareEngine engine;
+    Ride ride = makeRide(400, "2030-01-02 12:00", 4, "Car", "Non-AC", "Lahore to Multan to Karachi");
+    QVERIFY(ride.addPassenger("fare-a", Ride::Leg{0, 1}));
+    QVERIFY(ride.addPassenger("fare-b", Ride::Leg{1, 2}));
+    // A quarter full on each segment: 1 + 0.5 * 0.25^2
+    QCOMPARE(engine.quote(&ride), Money(41250));
+    QVERIFY(ride.addPassenger("fare-c", Ride::Leg{0, 1}));
+    QCOMPARE(engine.quote(&ride), Money(45000));
+    QVERIFY(ride.addPassenger("fare-d", Ride::Leg{0, 1}));
+    QVERIFY(ride.addPassenger("fare-e", Ride::Leg{0, 1}));
+    QCOMPARE(engine.quote(&ride), Money(60000));
+}
+
+void FareEngineTests::faresAreClamped()
+{
+    const Money cap = toMoney(FareEngine::MaxFareRupees);
+    QCOMPARE(quote(makeRide(-250)), Money(0));
+    QCOMPARE(quote(makeRide(std::numeric_limits<double>::quiet_NaN())), Money(0));
+    QCOMPARE(quote(makeRide(1e15)), cap);
+    QCOMPARE(quote(makeRide(std::numeric_limits<double>::infinity())), cap);
+    // No seats means no load, not a division by zero
+    QCOMPARE(quote(makeRide(400, "2030-01-02 12:00", 0)), Money(40000));
+}
+
+void FareEngineTests::legsShareTheWholeTripFare()
+{
+    FareEngine engine;
+    Ride ride = makeRide(100, "2030-01-02 12:00", 4, "Car", "Non-AC", "Lahore to Multan to Sukkur to Karachi");
+    QCOMPARE(engine.quote(&ride, ride.wholeTrip()), Money(10000));
+    QCOMPARE(engine.quote(&ride, Ride::Leg{0, 1}), Money(3333));
+    QCOMPARE(engine.quote(&ride, Ride::Leg{1, 3}), Money(6667));
+    QCOMPARE(FareEngine::legShare(10001, &ride, ride.wholeTrip()), Money(10001));
+    QCOMPARE(FareEngine::legShare(Money(1) << 40, &ride, Ride::Leg{0, 1}),
+             qRound64(double(Money(1) << 40) / 3));
+}
+
+void FareEngineTests::batchAgreesWithSingleQuotes()
+{
+    FareEngine engine;
+    QVector<Money> fares{1, 2, 3};
+    engine.quote(QVector<const Ride*>(), &fares);
+    QVERIFY(fares.isEmpty());
+
+    const QStringList types{"Bike", "Car", "Van", "Truck"};
+    const QStringList classes{"Non-AC", "AC", "Economy", "Standard", "Luxury", "Other"};
+    QRandomGenerator random(42);
+    QList<Ride> owned;
+    for (int i = 0; i < 257; i++) {
+        const QString departure = i % 17 == 0 ? QString()
+                                              : QString("2030-01-02 %1:%2").arg(random.bounded(24), 2, 10, QChar('0'))
+                                                    .arg(random.bounded(60), 2, 10, QChar('0'));
+        Ride ride = makeRide(random.bounded(100000) / 100.0, departure, 1 + random.bounded(6),
+                             types[random.bounded(int(types.size()))], classes[random.bounded(int(classes.size()))]);
+        if (i % 3 != 0) {
+            ride.setEndpoints(GeoPoint::fromDegrees(24 + random.bounded(10.0), 67 + random.bounded(8.0)),
+                              GeoPoint::fromDegrees(24 + random.bounded(10.0), 67 + random.bounded(8.0)));
+        }
+        const int taken = random.bounded(ride.getTotalSeats() + 1);
+        for (int p = 0; p < taken; p++) {
+            ride.addPassenger(QString("fare-batch-%1").arg(p));
+        }
+        owned.append(ride);
+    }
+    QVector<const Ride*> rides;
+    for (const Ride &ride : owned) {
+        rides.append(&ride);
+    }
+
+    engine.quote(rides, &fares);
+    QCOMPARE(fares.size(), rides.size());
+    for (int i = 0; i < rides.size(); i++) {
+        QCOMPARE(fares[i], engine.quote(rides[i]));
+    }
+}
+
+CARPOOL_TEST(FareEngineTests)
+#include "fareenginetests.moc"
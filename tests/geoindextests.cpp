@@ -0,0 +1,125 @@
+// Tests for pickup/drop-off locations: the text form, distances and the
+// grid index behind nearby ride searches.
+
+#include <QTemporaryDir>
+#include <QtTest>
+#include "carpoolservice.h"
+#include "geoindex.h"
+#include "testregistry.h"
+
+namespace {
+const GeoPoint Lahore = GeoPoint::fromDegrees(31.5204, 74.3587);
+const GeoPoint Karachi = GeoPoint::fromDegrees(24.8607, 67.0011);
+
+// A point metres north of from; a degree of latitude is MetresPerDegree
+GeoPoint north(const GeoPoint &from, double metres)
+{
+    return GeoPoint::fromDegrees(from.latitude() + metres / GeoPoint::MetresPerDegree, from.longitude());
+}
+}
+
+class GeoIndexTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void textRoundTrips();
+    void distances();
+    void nearestOriginFirst();
+    void destinationMustAlsoBeNear();
+    void searchWrapsAtAntimeridian();
+    void removedRideIsNotFound();
+    void serviceFindsOpenRidesNear();
+};
+
+void GeoIndexTests::textRoundTrips()
+{
+    QCOMPARE(Lahore.toText(), QString("31.520400;74.358700"));
+    QCOMPARE(GeoPoint::fromText(Lahore.toText()), Lahore);
+    QCOMPARE(GeoPoint::fromText(" 31.5204, 74.3587 "), Lahore);
+    QCOMPARE(GeoPoint::fromText("31.5204 74.3587"), Lahore);
+    QVERIFY(!GeoPoint::fromText("95;10").isValid());
+    QVERIFY(!GeoPoint::fromText("31.5;north").isValid());
+    QVERIFY(!GeoPoint::fromText(QString()).isValid());
+    QCOMPARE(GeoPoint().toText(), QString());
+}
+
+void GeoIndexTests::distances()
+{
+    QCOMPARE(GeoPoint::distance(Lahore, Lahore), 0.0);
+    const double metres = GeoPoint::distance(Lahore, Karachi);
+    QVERIFY2(metres > 1020000 && metres < 1040000, qPrintable(QString::number(metres)));
+    QVERIFY(qAbs(GeoPoint::distance(Lahore, north(Lahore, 1000)) - 1000) < 1);
+}
+
+void GeoIndexTests::nearestOriginFirst()
+{
+    GeoIndex index;
+    index.insert(1, north(Lahore, 2000), GeoPoint());
+    index.insert(2, north(Lahore, 500), GeoPoint());
+    index.insert(3, north(Lahore, 5000), GeoPoint());
+    index.insert(4, north(Lahore, 500), GeoPoint());
+    index.insert(5, Karachi, GeoPoint());
+    QCOMPARE(index.size(), 5);
+
+    // Ties by ride id
+    QCOMPARE(index.search(Lahore, GeoPoint(), 3000), (QVector<int>{2, 4, 1}));
+    QCOMPARE(index.search(Lahore, GeoPoint(), 100), QVector<int>());
+}
+
+void GeoIndexTests::destinationMustAlsoBeNear()
+{
+    GeoIndex index;
+    index.insert(1, Lahore, Karachi);
+    index.insert(2, Lahore, north(Lahore, 50000));
+    QCOMPARE(index.search(Lahore, north(Karachi, 1000), 2000), QVector<int>{1});
+    QCOMPARE(index.search(Lahore, GeoPoint(), 2000), (QVector<int>{1, 2}));
+}
+
+void GeoIndexTests::searchWrapsAtAntimeridian()
+{
+    GeoIndex index;
+    index.insert(1, GeoPoint::fromDegrees(0, -179.999), GeoPoint());
+    // About 220 m away, on the other side of the date line
+    QCOMPARE(index.search(GeoPoint::fromDegrees(0, 179.999), GeoPoint(), 1000), QVector<int>{1});
+}
+
+void GeoIndexTests::removedRideIsNotFound()
+{
+    GeoIndex index;
+    index.insert(1, Lahore, GeoPoint());
+    index.insert(2, Lahore, GeoPoint());
+    index.remove(1, Lahore);
+    QCOMPARE(index.size(), 1);
+    QCOMPARE(index.search(Lahore, GeoPoint(), 100), QVector<int>{2});
+}
+
+void GeoIndexTests::serviceFindsOpenRidesNear()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    service.registerCaptain("geo-captain", "pw", "Car", "AC");
+    User *captain = service.users().find("geo-captain", "captain");
+    const int near = service.rides().nextId();
+    service.createRide(captain, "Lahore to Karachi", "2030-01-02 08:30", QString(), 2, 500,
+                       north(Lahore, 300), Karachi);
+    const int far = service.rides().nextId();
+    service.createRide(captain, "Lahore to Karachi", "2030-01-02 09:30", QString(), 2, 500,
+                       north(Lahore, 30000), Karachi);
+
+    QList<Ride*> found = service.rides().openRidesNear(Lahore, Karachi, 1000);
+    QCOMPARE(found.size(), 1);
+    QCOMPARE(found.first()->getId(), near);
+    QCOMPARE(found.first()->getOrigin(), north(Lahore, 300));
+
+    // Cancelled rides leave the index
+    QCOMPARE(service.cancelRide(captain, service.rides().find(near)), CarpoolService::Ok);
+    QVERIFY(service.rides().openRidesNear(Lahore, Karachi, 1000).isEmpty());
+    QCOMPARE(service.rides().openRidesNear(Lahore, GeoPoint(), 50000).size(), 1);
+    QVERIFY(service.rides().find(far));
+    service.close();
+}
+
+CARPOOL_TEST(GeoIndexTests)
+#include "geoindextests.moc"
@@ -0,0 +1,85 @@
+// Tests for the metrics surface: per-thread slabs summed into one report,
+// the enable switch and histogram percentiles.
+
+#include <QHash>
+#include <QThread>
+#include <QtTest>
+#include "metrics.h"
+#include "testregistry.h"
+
+namespace {
+// "name value" report lines by name
+QHash<QByteArray, quint64> reportValues()
+{
+    QHash<QByteArray, quint64> values;
+    for (const QByteArray &line : Metrics::report().split('\n')) {
+        const int space = line.lastIndexOf(' ');
+        if (line.isEmpty() || line.startsWith('#') || space < 0) continue;
+        values.insert(line.left(space), line.mid(space + 1).toULongLong());
+    }
+    return values;
+}
+}
+
+class MetricsTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void countsFromFinishedThreadsAreKept();
+    void disabledMetricsCountNothing();
+    void histogramPercentilesUseBucketBounds();
+};
+
+void MetricsTests::countsFromFinishedThreadsAreKept()
+{
+    const quint64 before = reportValues().value("bookings_rejected");
+
+    QList<QThread*> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.append(QThread::create([]() {
+            for (int i = 0; i < 1000; i++) Metrics::count(Metrics::BookingsRejected);
+        }));
+        threads.last()->start();
+    }
+    for (QThread *thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+    Metrics::count(Metrics::BookingsRejected, 5);
+
+    QCOMPARE(reportValues().value("bookings_rejected"), before + 4005);
+}
+
+void MetricsTests::disabledMetricsCountNothing()
+{
+    const quint64 before = reportValues().value("bookings_rejected");
+    Metrics::setEnabled(false);
+    Metrics::count(Metrics::BookingsRejected, 100);
+    Metrics::setEnabled(true);
+    QVERIFY(Metrics::isEnabled());
+    QCOMPARE(reportValues().value("bookings_rejected"), before);
+}
+
+void MetricsTests::histogramPercentilesUseBucketBounds()
+{
+    // Only the widgets' list model records list refreshes
+    QHash<QByteArray, quint64> values = reportValues();
+    QCOMPARE(values.value("list_refresh_ns_count"), quint64(0));
+
+    for (int i = 0; i < 90; i++) Metrics::record(Metrics::ListRefreshNs, 10);
+    for (int i = 0; i < 10; i++) Metrics::record(Metrics::ListRefreshNs, 1000);
+
+    values = reportValues();
+    QCOMPARE(values.value("list_refresh_ns_count"), quint64(100));
+    QCOMPARE(values.value("list_refresh_ns_mean"), quint64(109));
+    // 10 falls in the bucket below 16, 1000 in the one below 1024, which is
+    // capped at the maximum seen
+    QCOMPARE(values.value("list_refresh_ns_p50"), quint64(15));
+    QCOMPARE(values.value("list_refresh_ns_p90"), quint64(15));
+    QCOMPARE(values.value("list_refresh_ns_p99"), quint64(1000));
+    QCOMPARE(values.value("list_refresh_ns_max"), quint64(1000));
+}
+
+CARPOOL_TEST(MetricsTests)
+#include "metricstests.moc"
@@ -0,0 +1,114 @@
+// Tests for rating aggregates: exact sums and per-star counts that
+// survive a restart.
+
+#include <QTemporaryDir>
+#include <QtTest>
+#include "carpoolservice.h"
+#include "testregistry.h"
+
+class RatingTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void aggregatesAreExact();
+    void aggregatesSurviveRestart();
+    void passengerIsRatedByCaptain();
+
+private:
+    // Books passenger onto a new ride of captain and completes it
+    static Ride* completedRide(CarpoolService &service, User *captain, User *passenger);
+    static void rateCaptain(CarpoolService &service, const QList<int> &stars);
+};
+
+Ride* RatingTests::completedRide(CarpoolService &service, User *captain, User *passenger)
+{
+    const int id = service.rides().nextId();
+    service.createRide(captain, "Lahore to Karachi", "2030-01-02 08:30", QString(), 1, 500);
+    Ride *ride = service.rides().find(id);
+    if (!ride || service.bookRide(passenger, ride) != CarpoolService::Ok ||
+        service.completeRide(captain, ride) != CarpoolService::Ok) {
+        return nullptr;
+    }
+    return ride;
+}
+
+void RatingTests::rateCaptain(CarpoolService &service, const QList<int> &stars)
+{
+    service.registerCaptain("rated-captain", "pw", "Car", "AC");
+    User *captain = service.users().find("rated-captain", "captain");
+    for (int i = 0; i < stars.size(); i++) {
+        const QString name = QString("rater%1").arg(i);
+        service.registerPassenger(name, "pw");
+        User *passenger = service.users().find(name, "passenger");
+        service.addBalance(passenger, 10000);
+        Ride *ride = completedRide(service, captain, passenger);
+        QVERIFY(ride);
+        QCOMPARE(service.rateCaptain(passenger, ride, stars[i]), CarpoolService::Ok);
+        // One rating per ride
+        QCOMPARE(service.rateCaptain(passenger, ride, stars[i]), CarpoolService::AlreadyRated);
+    }
+}
+
+void RatingTests::aggregatesAreExact()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    rateCaptain(service, {5, 4, 4});
+
+    const User *captain = service.users().find("rated-captain", "captain");
+    QCOMPARE(captain->getRatingCount(), 3);
+    QCOMPARE(captain->getRatingSum(), qint64(13));
+    QCOMPARE(captain->getAverageRating(), float(13.0 / 3));
+    QCOMPARE(captain->getStarCount(4), quint32(2));
+    QCOMPARE(captain->getStarCount(5), quint32(1));
+    QCOMPARE(captain->getStarCount(1), quint32(0));
+    service.close();
+}
+
+void RatingTests::aggregatesSurviveRestart()
+{
+    QTemporaryDir dir;
+    {
+        CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+        service.open();
+        rateCaptain(service, {1, 2, 5});
+        service.close();
+    }
+
+    CarpoolService reopened(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    reopened.open();
+    const User *captain = reopened.users().find("rated-captain", "captain");
+    QVERIFY(captain);
+    QCOMPARE(captain->getRatingCount(), 3);
+    QCOMPARE(captain->getRatingSum(), qint64(8));
+    for (int stars : {1, 2, 5}) {
+        QCOMPARE(captain->getStarCount(stars), quint32(1));
+    }
+    reopened.close();
+}
+
+void RatingTests::passengerIsRatedByCaptain()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    service.registerCaptain("rating-captain", "pw", "Car", "AC");
+    service.registerPassenger("rated-passenger", "pw");
+    User *captain = service.users().find("rating-captain", "captain");
+    User *passenger = service.users().find("rated-passenger", "passenger");
+    service.addBalance(passenger, 10000);
+    Ride *ride = completedRide(service, captain, passenger);
+    QVERIFY(ride);
+
+    QCOMPARE(service.ratePassenger(captain, ride, 0), CarpoolService::InvalidRating);
+    QCOMPARE(service.ratePassenger(captain, ride, 6), CarpoolService::InvalidRating);
+    QCOMPARE(service.ratePassenger(captain, ride, 3), CarpoolService::Ok);
+    QCOMPARE(passenger->getRatingCount(), 1);
+    QCOMPARE(passenger->getAverageRating(), 3.0f);
+    service.close();
+}
+
+CARPOOL_TEST(RatingTests)
+#include "ratingtests.moc"
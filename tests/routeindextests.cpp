@@ -0,0 +1,86 @@
+// Tests for the book-ride route search: the inverted index and the
+// single-route re-check the ride list uses must agree while a query is
+// typed one character at a time.
+
+#include <QtTest>
+#include "routeindex.h"
+#include "stringpool.h"
+#include "testregistry.h"
+
+class RouteIndexTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void typingKeepsRideListed_data();
+    void typingKeepsRideListed();
+    void stopwordQueryNeedsMatchingWord();
+    void exactWordsNarrowResults();
+    void removedRideIsNotFound();
+
+private:
+    RouteIndex index;
+};
+
+void RouteIndexTests::init()
+{
+    index.clear();
+    index.insert(1, internString("Lahore to Karachi"));
+    index.insert(2, internString("Lahore via Multan"));
+    index.insert(3, internString("Islamabad from Peshawar"));
+    index.insert(4, internString("Quetta Gwadar"));
+}
+
+void RouteIndexTests::typingKeepsRideListed_data()
+{
+    QTest::addColumn<QString>("query");
+    QTest::addColumn<int>("rideId");
+
+    QTest::newRow("to") << "Lahore to Karachi" << 1;
+    QTest::newRow("via") << "Lahore via Multan" << 2;
+    QTest::newRow("from") << "Islamabad from Peshawar" << 3;
+}
+
+void RouteIndexTests::typingKeepsRideListed()
+{
+    QFETCH(QString, query);
+    QFETCH(int, rideId);
+    const QString route = pooledString(internString(query));
+
+    for (int length = 1; length <= query.size(); length++) {
+        const QString typed = query.left(length);
+        QVERIFY2(index.search(typed).contains(rideId), qPrintable(typed));
+        QVERIFY2(RouteIndex::matches(route, RouteIndex::words(typed)), qPrintable(typed));
+    }
+}
+
+void RouteIndexTests::stopwordQueryNeedsMatchingWord()
+{
+    QCOMPARE(index.search("via"), QVector<int>{2});
+    QCOMPARE(index.search("t"), QVector<int>{1});
+    QCOMPARE(index.search("fr"), QVector<int>{3});
+    QVERIFY(!RouteIndex::matches("Quetta Gwadar", RouteIndex::words("via")));
+    QVERIFY(RouteIndex::matches("Lahore via Multan", RouteIndex::words("via")));
+}
+
+void RouteIndexTests::exactWordsNarrowResults()
+{
+    QCOMPARE(index.search("lahore"), (QVector<int>{1, 2}));
+    QCOMPARE(index.search("Lahore to K"), QVector<int>{1});
+    QCOMPARE(index.search("Lahore to M"), QVector<int>{2});
+    QCOMPARE(index.search("to Karachi"), QVector<int>{1});
+    QVERIFY(index.search("Lahore to Quetta").isEmpty());
+    QVERIFY(!RouteIndex::matches("Lahore via Multan", RouteIndex::words("Lahore to K")));
+}
+
+void RouteIndexTests::removedRideIsNotFound()
+{
+    index.remove(1, internString("Lahore to Karachi"));
+    QVERIFY(!index.search("Lahore t").contains(1));
+    QVERIFY(!index.search("k").contains(1));
+    QCOMPARE(index.search("lahore"), QVector<int>{2});
+}
+
+CARPOOL_TEST(RouteIndexTests)
+#include "routeindextests.moc"
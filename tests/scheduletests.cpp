@@ -0,0 +1,310 @@
+// Tests for recurring rides: RideSchedule day arithmetic and journal form,
+// RideSchedules ids, and the rides CarpoolService creates from schedules.
+
+#include <QTemporaryDir>
+#include <QtTest>
+#include "carpoolservice.h"
+#include "testregistry.h"
+
+namespace {
+const int AllDays = 0x7F;
+
+QString tomorrowAt(const QString &clock)
+{
+    return RideSchedule::formatDay(RideSchedule::dayOf(Ride::currentTime()) + 1) + " " + clock;
+}
+
+QList<Ride*> ridesOf(CarpoolService &service, int scheduleId)
+{
+    QList<Ride*> rides;
+    for (Ride *ride : service.rides().openRides()) {
+        if (ride->getScheduleId() == scheduleId) rides.append(ride);
+    }
+    return rides;
+}
+}
+
+class ScheduleTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void dayArithmetic();
+    void weekdayText();
+    void runsOnlyWithinItsDays();
+    void argsRoundTrip();
+    void malformedArgsAreRejected();
+    void idsAreNeverReused();
+    void invalidSchedulesAreRejected();
+    void ridesAreCreatedWithinLookAhead();
+    void onlyChosenWeekdaysGetRides();
+    void reopeningDoesNotDuplicateRides();
+    void cancelKeepsBookedRides();
+};
+
+void ScheduleTests::dayArithmetic()
+{
+    // 1970-01-01 was a Thursday
+    QCOMPARE(RideSchedule::dayOfWeek(0), 4);
+    QCOMPARE(RideSchedule::dayOfWeek(4), 1);
+    QCOMPARE(RideSchedule::dayOfWeek(-1), 3);
+    QCOMPARE(RideSchedule::dayOf(0), qint64(0));
+    QCOMPARE(RideSchedule::dayOf(86399), qint64(0));
+    QCOMPARE(RideSchedule::dayOf(-1), qint64(-1));
+    QCOMPARE(RideSchedule::dayOf(-86400), qint64(-1));
+    QCOMPARE(RideSchedule::dayOf(-86401), qint64(-2));
+
+    qint64 day = 0;
+    QVERIFY(RideSchedule::parseDay("2030-01-02", &day));
+    QCOMPARE(RideSchedule::formatDay(day), QString("2030-01-02"));
+    QCOMPARE(RideSchedule::dayOfWeek(day), 3);
+    QCOMPARE(RideSchedule::dayOf(Ride::parseTime("2030-01-02 23:59")), day);
+    QVERIFY(!RideSchedule::parseDay("2030-13-02", &day));
+    QVERIFY(!RideSchedule::parseDay("next week", &day));
+}
+
+void ScheduleTests::weekdayText()
+{
+    const int weekdays = RideSchedule::weekdayBit(1) | RideSchedule::weekdayBit(3) | RideSchedule::weekdayBit(7);
+    QCOMPARE(RideSchedule::formatWeekdays(weekdays), QString("137"));
+    QCOMPARE(RideSchedule::parseWeekdays("137"), weekdays);
+    QCOMPARE(RideSchedule::parseWeekdays("7, 3, 1, 1, 0, 8"), weekdays);
+    QCOMPARE(RideSchedule::formatWeekdays(AllDays), QString("1234567"));
+    QCOMPARE(RideSchedule::parseWeekdays(QString()), 0);
+}
+
+void ScheduleTests::runsOnlyWithinItsDays()
+{
+    RideSchedule schedule;
+    QVERIFY(RideSchedule::parseDay("2030-01-07", &schedule.firstDay));     // a Monday
+    schedule.lastDay = schedule.firstDay + 13;
+    schedule.weekdays = RideSchedule::weekdayBit(1) | RideSchedule::weekdayBit(5);
+
+    QVector<qint64> days;
+    for (qint64 day = schedule.firstDay - 7; day <= schedule.lastDay + 7; day++) {
+        if (schedule.runsOn(day)) days.append(day - schedule.firstDay);
+    }
+    QCOMPARE(days, (QVector<qint64>{0, 4, 7, 11}));
+
+    schedule.departureMinutes = 8 * 60 + 30;
+    QCOMPARE(Ride::formatTime(schedule.departureOn(schedule.firstDay)), QString("2030-01-07 08:30"));
+}
+
+void ScheduleTests::argsRoundTrip()
+{
+    RideSchedule schedule;
+    schedule.id = 7;
+    schedule.captain = "schedule-captain";
+    schedule.route = "Lahore to Multan";
+    schedule.departureMinutes = 7 * 60 + 5;
+    schedule.returnOffsetMinutes = 600;
+    schedule.weekdays = RideSchedule::weekdayBit(2) | RideSchedule::weekdayBit(6);
+    QVERIFY(RideSchedule::parseDay("2030-01-02", &schedule.firstDay));
+    schedule.lastDay = schedule.firstDay + 30;
+    schedule.seats = 3;
+    schedule.fare = 450.5;
+    schedule.origin = GeoPoint::fromDegrees(31.5204, 74.3587);
+    schedule.materializedThrough = schedule.firstDay + 6;
+
+    const QStringList args = schedule.toArgs();
+    QCOMPARE(args[3], QString("07:05"));
+    QCOMPARE(args[5], QString("26"));
+    QCOMPARE(args[11], QString());
+
+    RideSchedule copy;
+    QVERIFY(RideSchedule::fromArgs(args, &copy));
+    QCOMPARE(copy.toArgs(), args);
+    QCOMPARE(copy.lastDay, schedule.lastDay);
+    QCOMPARE(copy.origin, schedule.origin);
+    QVERIFY(!copy.destination.isValid());
+
+    // Open-ended and without a return trip
+    schedule.lastDay = RideSchedule::NoLastDay;
+    schedule.returnOffsetMinutes = -1;
+    QVERIFY(RideSchedule::fromArgs(schedule.toArgs(), &copy));
+    QCOMPARE(copy.lastDay, qint64(RideSchedule::NoLastDay));
+    QCOMPARE(copy.returnOffsetMinutes, -1);
+}
+
+void ScheduleTests::malformedArgsAreRejected()
+{
+    RideSchedule schedule;
+    QVERIFY(RideSchedule::parseDay("2030-01-02", &schedule.firstDay));
+    schedule.materializedThrough = schedule.firstDay - 1;
+    const QStringList args = schedule.toArgs();
+
+    RideSchedule copy;
+    QVERIFY(!RideSchedule::fromArgs(args.mid(0, 12), &copy));
+    QStringList bad = args;
+    bad[3] = "0830";
+    QVERIFY(!RideSchedule::fromArgs(bad, &copy));
+    bad = args;
+    bad[6] = "someday";
+    QVERIFY(!RideSchedule::fromArgs(bad, &copy));
+}
+
+void ScheduleTests::idsAreNeverReused()
+{
+    RideSchedules schedules;
+    QVERIFY(schedules.add(RideSchedule()));
+    QVERIFY(schedules.add(RideSchedule()));
+    QCOMPARE(schedules.all().keys(), (QList<int>{1, 2}));
+
+    schedules.remove(2);
+    RideSchedule taken;
+    taken.id = 1;
+    QVERIFY(!schedules.add(taken));
+    QVERIFY(schedules.add(RideSchedule()));
+    QCOMPARE(schedules.all().keys(), (QList<int>{1, 3}));
+
+    schedules.reserveIds(10);
+    schedules.reserveIds(5);
+    QCOMPARE(schedules.nextId(), 10);
+    schedules.clear();
+    QCOMPARE(schedules.size(), 0);
+    QCOMPARE(schedules.nextId(), 1);
+}
+
+void ScheduleTests::invalidSchedulesAreRejected()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    service.registerCaptain("schedule-captain", "pw", "Car", "AC");
+    service.registerPassenger("schedule-passenger", "pw");
+    User *captain = service.users().find("schedule-captain", "captain");
+    User *passenger = service.users().find("schedule-passenger", "passenger");
+    const QString departure = tomorrowAt("08:30");
+
+    QCOMPARE(service.createSchedule(passenger, "Lahore to Multan", departure, QString(), AllDays, 2, 500),
+             CarpoolService::NotACaptain);
+    QCOMPARE(service.createSchedule(captain, QString(), departure, QString(), AllDays, 2, 500),
+             CarpoolService::MissingRouteOrDeparture);
+    QCOMPARE(service.createSchedule(captain, "Lahore to Multan", "tomorrow", QString(), AllDays, 2, 500),
+             CarpoolService::InvalidTimeFormat);
+    QCOMPARE(service.createSchedule(captain, "Lahore to Multan", departure, tomorrowAt("07:00"), AllDays, 2, 500),
+             CarpoolService::ReturnBeforeDeparture);
+    QCOMPARE(service.createSchedule(captain, "Lahore to Multan", departure, QString(), 0, 2, 500),
+             CarpoolService::NoScheduleDays);
+    QCOMPARE(service.schedules().size(), 0);
+    QVERIFY(service.rides().openRides().isEmpty());
+    service.close();
+}
+
+void ScheduleTests::ridesAreCreatedWithinLookAhead()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    service.registerCaptain("schedule-captain", "pw", "Car", "AC");
+    User *captain = service.users().find("schedule-captain", "captain");
+
+    const int id = service.schedules().nextId();
+    QCOMPARE(service.createSchedule(captain, "Lahore to Multan", tomorrowAt("08:30"), tomorrowAt("18:00"),
+                                    AllDays, 2, 500), CarpoolService::Ok);
+    QVERIFY(service.schedules().all().contains(id));
+
+    // Tomorrow through the last look-ahead day, one ride each
+    const QList<Ride*> rides = ridesOf(service, id);
+    QCOMPARE(rides.size(), int(CarpoolService::ScheduleLookAheadDays));
+    const qint64 tomorrow = RideSchedule::dayOf(Ride::currentTime()) + 1;
+    for (int i = 0; i < rides.size(); i++) {
+        QCOMPARE(rides[i]->getDepartureEpoch(), (tomorrow + i) * 86400 + (8 * 60 + 30) * 60);
+        QCOMPARE(rides[i]->getReturnEpoch() - rides[i]->getDepartureEpoch(), qint64(570 * 60));
+        QCOMPARE(rides[i]->getRoute(), QString("Lahore to Multan"));
+        QCOMPARE(rides[i]->getTotalSeats(), 2);
+    }
+    QCOMPARE(service.schedules().all().value(id).materializedThrough,
+             tomorrow + CarpoolService::ScheduleLookAheadDays - 1);
+
+    // A schedule starting past the look-ahead has no rides yet
+    const int later = service.schedules().nextId();
+    QCOMPARE(service.createSchedule(captain, "Lahore to Multan", "2030-01-02 08:30", QString(), AllDays, 2, 500),
+             CarpoolService::Ok);
+    QVERIFY(ridesOf(service, later).isEmpty());
+    service.close();
+}
+
+void ScheduleTests::onlyChosenWeekdaysGetRides()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    service.registerCaptain("schedule-captain", "pw", "Car", "AC");
+    User *captain = service.users().find("schedule-captain", "captain");
+
+    const int weekdays = RideSchedule::weekdayBit(1) | RideSchedule::weekdayBit(4);
+    const int id = service.schedules().nextId();
+    QCOMPARE(service.createSchedule(captain, "Lahore to Multan", tomorrowAt("08:30"), QString(),
+                                    weekdays, 2, 500), CarpoolService::Ok);
+
+    // Seven consecutive days hold each weekday once
+    const QList<Ride*> rides = ridesOf(service, id);
+    QCOMPARE(rides.size(), 2);
+    for (const Ride *ride : rides) {
+        const int day = RideSchedule::dayOfWeek(RideSchedule::dayOf(ride->getDepartureEpoch()));
+        QVERIFY(weekdays & RideSchedule::weekdayBit(day));
+        QCOMPARE(ride->getReturnEpoch(), qint64(Ride::NoTime));
+    }
+    service.close();
+}
+
+void ScheduleTests::reopeningDoesNotDuplicateRides()
+{
+    QTemporaryDir dir;
+    int id = 0;
+    int count = 0;
+    {
+        CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+        service.open();
+        service.registerCaptain("schedule-captain", "pw", "Car", "AC");
+        User *captain = service.users().find("schedule-captain", "captain");
+        id = service.schedules().nextId();
+        QCOMPARE(service.createSchedule(captain, "Lahore to Multan", tomorrowAt("08:30"), QString(),
+                                        AllDays, 2, 500), CarpoolService::Ok);
+        count = ridesOf(service, id).size();
+        service.close();
+    }
+
+    CarpoolService reopened(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    reopened.open();
+    QCOMPARE(reopened.schedules().size(), 1);
+    QCOMPARE(ridesOf(reopened, id).size(), count);
+    reopened.close();
+}
+
+void ScheduleTests::cancelKeepsBookedRides()
+{
+    QTemporaryDir dir;
+    CarpoolService service(dir.filePath("journal.txt"), dir.filePath("carpool.dat"));
+    service.open();
+    service.registerCaptain("schedule-captain", "pw", "Car", "AC");
+    service.registerCaptain("schedule-other", "pw", "Car", "AC");
+    service.registerPassenger("schedule-passenger", "pw");
+    User *captain = service.users().find("schedule-captain", "captain");
+    User *other = service.users().find("schedule-other", "captain");
+    User *passenger = service.users().find("schedule-passenger", "passenger");
+    service.addBalance(passenger, 100000);
+
+    const int id = service.schedules().nextId();
+    QCOMPARE(service.createSchedule(captain, "Lahore to Multan", tomorrowAt("08:30"), QString(),
+                                    AllDays, 2, 500), CarpoolService::Ok);
+    Ride *booked = ridesOf(service, id).value(2);
+    QVERIFY(booked);
+    const int bookedId = booked->getId();
+    QCOMPARE(service.bookRide(passenger, booked), CarpoolService::Ok);
+
+    QCOMPARE(service.cancelSchedule(other, id), CarpoolService::NotRideCaptain);
+    QCOMPARE(service.cancelSchedule(captain, id + 1), CarpoolService::ScheduleNotFound);
+    QCOMPARE(service.cancelSchedule(captain, id), CarpoolService::Ok);
+    QCOMPARE(service.schedules().size(), 0);
+
+    const QList<Ride*> left = ridesOf(service, id);
+    QCOMPARE(left.size(), 1);
+    QCOMPARE(left.first()->getId(), bookedId);
+    QVERIFY(left.first()->hasPassenger(passenger->getUsernameId()));
+    service.close();
+}
+
+CARPOOL_TEST(ScheduleTests)
+#include "scheduletests.moc"
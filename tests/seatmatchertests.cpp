@@ -0,0 +1,140 @@
+// Tests for the SeatMatcher: which ride a request is given, and that a
+// batch never assigns more passengers to a ride than it has seats.
+
+#include <QTemporaryDir>
+#include <QtTest>
+#include "carpoolservice.h"
+#include "seatmatcher.h"
+#include "testregistry.h"
+
+class SeatMatcherTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void earliestFittingDepartureWins();
+    void neverPicksMoreThanFreeSeats();
+    void vehicleAndFareFilter();
+    void matchRidesBooksThePicks();
+
+private:
+    Ride* addRide(const QString &captain, const QString &route, const QString &departure, int seats,
+                  const QString &vehicleClass = "AC");
+    User* addPassenger(const QString &name);
+    SeatMatcher::Request request(User *passenger, const QString &route) const;
+
+    QTemporaryDir *dir = nullptr;
+    CarpoolService *service = nullptr;
+};
+
+void SeatMatcherTests::init()
+{
+    dir = new QTemporaryDir;
+    service = new CarpoolService(dir->filePath("journal.txt"), dir->filePath("carpool.dat"));
+    service->open();
+}
+
+void SeatMatcherTests::cleanup()
+{
+    service->close();
+    delete service;
+    delete dir;
+}
+
+Ride* SeatMatcherTests::addRide(const QString &captain, const QString &route, const QString &departure,
+                                int seats, const QString &vehicleClass)
+{
+    if (!service->users().find(captain, "captain")) {
+        service->registerCaptain(captain, "pw", "Car", vehicleClass);
+    }
+    const int id = service->rides().nextId();
+    service->createRide(service->users().find(captain, "captain"), route, departure, QString(), seats, 500);
+    return service->rides().find(id);
+}
+
+User* SeatMatcherTests::addPassenger(const QString &name)
+{
+    service->registerPassenger(name, "pw");
+    User *user = service->users().find(name, "passenger");
+    service->addBalance(user, 100000);
+    return user;
+}
+
+SeatMatcher::Request SeatMatcherTests::request(User *passenger, const QString &route) const
+{
+    SeatMatcher::Request request;
+    request.passenger = passenger;
+    request.route = route;
+    request.earliest = Ride::parseTime("2030-01-02 00:00");
+    request.latest = Ride::parseTime("2030-01-02 23:59");
+    request.maxFare = 100000;
+    return request;
+}
+
+void SeatMatcherTests::earliestFittingDepartureWins()
+{
+    addRide("early-captain", "Lahore to Karachi", "2030-01-02 08:30", 2);
+    Ride *wanted = addRide("mid-captain", "Lahore to Karachi", "2030-01-02 10:30", 2);
+    addRide("late-captain", "Lahore to Karachi", "2030-01-02 12:30", 2);
+    addRide("other-captain", "Lahore to Multan", "2030-01-02 09:30", 2);
+
+    // Case and spacing of the route don't matter
+    SeatMatcher::Request wants = request(addPassenger("window"), "lahore  TO karachi");
+    wants.earliest = Ride::parseTime("2030-01-02 09:00");
+    wants.latest = Ride::parseTime("2030-01-02 13:00");
+    const QVector<Ride*> picks = SeatMatcher(service->rides(), service->fares()).match({wants});
+    QCOMPARE(picks, QVector<Ride*>{wanted});
+}
+
+void SeatMatcherTests::neverPicksMoreThanFreeSeats()
+{
+    Ride *ride = addRide("seats-captain", "Quetta to Gwadar", "2030-01-02 08:30", 2);
+    QVector<SeatMatcher::Request> requests;
+    for (int i = 0; i < 5; i++) {
+        requests.append(request(addPassenger(QString("seats%1").arg(i)), "Quetta to Gwadar"));
+    }
+
+    // Requests are served in queue order
+    const QVector<Ride*> picks = SeatMatcher(service->rides(), service->fares()).match(requests);
+    QCOMPARE(picks, (QVector<Ride*>{ride, ride, nullptr, nullptr, nullptr}));
+}
+
+void SeatMatcherTests::vehicleAndFareFilter()
+{
+    Ride *ride = addRide("filter-captain", "Sukkur to Hyderabad", "2030-01-02 08:30", 3, "Economy");
+    User *passenger = addPassenger("filter");
+    const SeatMatcher matcher(service->rides(), service->fares());
+
+    SeatMatcher::Request wrongClass = request(passenger, "Sukkur to Hyderabad");
+    wrongClass.vehicleClass = "AC";
+    SeatMatcher::Request unknownType = request(passenger, "Sukkur to Hyderabad");
+    unknownType.vehicleType = "Hovercraft";
+    SeatMatcher::Request tooCheap = request(passenger, "Sukkur to Hyderabad");
+    tooCheap.maxFare = toRupees(service->fares().quote(ride)) - 1;
+    SeatMatcher::Request fits = request(passenger, "Sukkur to Hyderabad");
+    fits.vehicleType = "Car";
+    fits.vehicleClass = "Economy";
+
+    QCOMPARE(matcher.match({wrongClass, unknownType, tooCheap, fits}),
+             (QVector<Ride*>{nullptr, nullptr, nullptr, ride}));
+}
+
+void SeatMatcherTests::matchRidesBooksThePicks()
+{
+    Ride *ride = addRide("book-captain", "Lahore to Quetta", "2030-01-02 08:30", 1);
+    User *first = addPassenger("book1");
+    User *second = addPassenger("book2");
+
+    QVector<Ride*> matched;
+    const QVector<CarpoolService::Status> statuses =
+        service->matchRides({request(first, "Lahore to Quetta"), request(second, "Lahore to Quetta")}, &matched);
+    QCOMPARE(statuses, (QVector<CarpoolService::Status>{CarpoolService::Ok, CarpoolService::NoMatchingRide}));
+    QCOMPARE(matched, (QVector<Ride*>{ride, nullptr}));
+    QVERIFY(ride->hasPassenger(first->getUsernameId()));
+    QVERIFY(ride->isFull());
+}
+
+CARPOOL_TEST(SeatMatcherTests)
+#include "seatmatchertests.moc"
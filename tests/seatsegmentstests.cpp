@@ -0,0 +1,135 @@
+// Tests for per-segment seat counting on multi-stop rides: SeatSegments
+// against a plain array, and the leg bookkeeping in Ride.
+
+#include <QRandomGenerator>
+#include <algorithm>
+#include <QtTest>
+#include "ride.h"
+#include "testregistry.h"
+
+class SeatSegmentsTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void singleSegment();
+    void matchesPlainCounts_data();
+    void matchesPlainCounts();
+    void invalidRangesAreIgnored();
+    void routeStops();
+    void passengersShareSeatsAcrossStops();
+    void removingPassengerFreesTheirLeg();
+};
+
+void SeatSegmentsTests::singleSegment()
+{
+    SeatSegments seats;
+    QCOMPARE(seats.segments(), 1);
+    seats.add(0, 1, 2);
+    QCOMPARE(seats.peak(), 2);
+    QCOMPARE(seats.lowest(), 2);
+    QCOMPARE(seats.maxOver(0, 1), 2);
+
+    seats.reset(0);
+    QCOMPARE(seats.segments(), 1);
+    QCOMPARE(seats.peak(), 0);
+}
+
+void SeatSegmentsTests::matchesPlainCounts_data()
+{
+    QTest::addColumn<int>("segments");
+    QTest::newRow("2") << 2;
+    QTest::newRow("5") << 5;
+    QTest::newRow("16") << 16;
+    QTest::newRow("37") << 37;
+}
+
+void SeatSegmentsTests::matchesPlainCounts()
+{
+    QFETCH(int, segments);
+    SeatSegments seats(segments);
+    QVector<int> plain(segments, 0);
+    QRandomGenerator random(segments);
+
+    for (int step = 0; step < 500; step++) {
+        int from = random.bounded(segments);
+        int to = from + 1 + random.bounded(segments - from);
+        int delta = random.bounded(5) - 2;
+        seats.add(from, to, delta);
+        for (int s = from; s < to; s++) {
+            plain[s] += delta;
+        }
+
+        from = random.bounded(segments);
+        to = from + 1 + random.bounded(segments - from);
+        QCOMPARE(seats.maxOver(from, to), *std::max_element(plain.begin() + from, plain.begin() + to));
+        QCOMPARE(seats.peak(), *std::max_element(plain.begin(), plain.end()));
+        QCOMPARE(seats.lowest(), *std::min_element(plain.begin(), plain.end()));
+    }
+}
+
+void SeatSegmentsTests::invalidRangesAreIgnored()
+{
+    SeatSegments seats(3);
+    QVERIFY(!seats.isValidRange(1, 1));
+    QVERIFY(!seats.isValidRange(2, 1));
+    QVERIFY(!seats.isValidRange(-1, 2));
+    QVERIFY(!seats.isValidRange(0, 4));
+    seats.add(2, 1, 1);
+    seats.add(0, 4, 1);
+    QCOMPARE(seats.peak(), 0);
+    QCOMPARE(seats.maxOver(0, 4), 0);
+}
+
+void SeatSegmentsTests::routeStops()
+{
+    QCOMPARE(Ride::stopsOf("Lahore TO Multan to  Karachi"), (QStringList{"Lahore", "Multan", "Karachi"}));
+    QCOMPARE(Ride::segmentCountOf("Lahore to Multan to Karachi"), 2);
+    QCOMPARE(Ride::segmentCountOf("Lahore"), 1);
+    QCOMPARE(Ride::segmentCountOf(QString()), 1);
+}
+
+void SeatSegmentsTests::passengersShareSeatsAcrossStops()
+{
+    Ride ride("segments-captain", "", "Lahore to Multan to Sukkur to Karachi", 0, 0, "Car", "AC", 1, 100);
+    QCOMPARE(ride.getSegmentCount(), 3);
+    QCOMPARE(ride.wholeTrip(), (Ride::Leg{0, 3}));
+
+    // One seat serves three passengers who never overlap
+    QVERIFY(ride.addPassenger("segments-a", Ride::Leg{0, 1}));
+    QVERIFY(!ride.isFull());
+    QVERIFY(ride.addPassenger("segments-b", Ride::Leg{1, 2}));
+    QCOMPARE(ride.seatsFreeBetween(2, 3), 1);
+    QCOMPARE(ride.seatsFreeBetween(0, 3), 0);
+    QVERIFY(!ride.addPassenger("segments-c", Ride::Leg{1, 3}));
+    QVERIFY(ride.addPassenger("segments-c", Ride::Leg{2, 3}));
+    QVERIFY(ride.isFull());
+    QCOMPARE(ride.getAvailableSeats(), 0);
+
+    QVERIFY(!ride.addPassenger("segments-d", Ride::Leg{0, 0}));
+    QVERIFY(!ride.addPassenger("segments-d", Ride::Leg{2, 4}));
+    QVERIFY(!ride.addPassenger("segments-a", Ride::Leg{0, 1}));
+    QCOMPARE(ride.getLegsText(), QString("0-1;1-2;2-3"));
+}
+
+void SeatSegmentsTests::removingPassengerFreesTheirLeg()
+{
+    Ride ride("segments-captain", "", "Lahore to Multan to Karachi", 0, 0, "Car", "AC", 2, 100);
+    QVERIFY(ride.addPassenger("segments-a"));
+    QVERIFY(ride.addPassenger("segments-b", Ride::Leg{1, 2}));
+    QCOMPARE(ride.getLegsText(), QString("0-2;1-2"));
+    QCOMPARE(ride.seatsFreeBetween(1, 2), 0);
+
+    QVERIFY(ride.removePassenger("segments-b"));
+    QCOMPARE(ride.seatsFreeBetween(1, 2), 1);
+    QCOMPARE(ride.getLeg(StringPool::instance().find("segments-a")), (Ride::Leg{0, 2}));
+    // Only whole-trip legs left, so the record keeps the old format
+    QCOMPARE(ride.getLegsText(), QString());
+
+    ride.clearPassengers();
+    QCOMPARE(ride.getPeakOccupancy(), 0);
+    QCOMPARE(ride.seatsFreeBetween(0, 2), 2);
+}
+
+CARPOOL_TEST(SeatSegmentsTests)
+#include "seatsegmentstests.moc"
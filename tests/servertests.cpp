@@ -0,0 +1,158 @@
+// Tests for the local socket server: what a subscriber's replica is sent
+// about other users.
+
+#include <QDir>
+#include <QSemaphore>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QtTest>
+#include "carpoolclient.h"
+#include "carpoolserver.h"
+#include "carpoolservice.h"
+#include "snapshot.h"
+#include "testregistry.h"
+
+class ServerTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void snapshotHidesOtherUsers();
+    void changesHideOtherUsers();
+    void rateOnlyFindsOwnRides();
+
+private:
+    // A client logged in as username; passengers unless captain is set
+    bool login(CarpoolClient &client, const QString &username, bool captain = false);
+
+    QTemporaryDir workDir;
+    QString serverName;
+    QThread *serverThread = nullptr;
+    QEventLoop *serverLoop = nullptr;
+    int rideId = 0;
+};
+
+void ServerTests::initTestCase()
+{
+    QVERIFY(workDir.isValid());
+    QVERIFY(QDir::setCurrent(workDir.path()));
+    serverName = "carpool-tests-" + QString::number(QCoreApplication::applicationPid());
+
+    // The server runs its own event loop while the test thread makes
+    // blocking client calls
+    QSemaphore ready;
+    bool listening = false;
+    serverThread = QThread::create([this, &ready, &listening]() {
+        CarpoolService service(workDir.filePath("journal.txt"), workDir.filePath("carpool.dat"));
+        service.open();
+        service.registerCaptain("alice", "pw", "Car", "AC");
+        service.registerPassenger("bob", "pw");
+        service.registerPassenger("carol", "pw");
+        service.addBalance(service.users().find("bob", "passenger"), 5000);
+        service.addBalance(service.users().find("carol", "passenger"), 7000);
+        rideId = service.rides().nextId();
+        service.createRide(service.users().find("alice", "captain"), "Lahore to Karachi",
+                           "2030-01-02 08:30", QString(), 3, 500);
+
+        CarpoolServer server(service);
+        QEventLoop loop;
+        serverLoop = &loop;
+        listening = server.listen(serverName);
+        ready.release();
+        if (listening) loop.exec();
+        server.close();
+        service.close();
+    });
+    serverThread->start();
+    ready.acquire();
+    QVERIFY(listening);
+}
+
+void ServerTests::cleanupTestCase()
+{
+    if (!serverThread) return;
+    QMetaObject::invokeMethod(serverLoop, "quit", Qt::QueuedConnection);
+    serverThread->wait();
+    delete serverThread;
+}
+
+bool ServerTests::login(CarpoolClient &client, const QString &username, bool captain)
+{
+    return client.connectToServer(serverName) &&
+           client.call("LOGIN", {captain ? "captain" : "passenger", username, "pw"}).isOk();
+}
+
+void ServerTests::snapshotHidesOtherUsers()
+{
+    CarpoolClient client;
+    QVERIFY(login(client, "bob"));
+    CarpoolClient::Reply reply = client.call("SUBSCRIBE");
+    QCOMPARE(reply.op, QString("SNAPSHOT"));
+
+    UserDirectory users;
+    RideRepository rides;
+    Ledger ledger(users);
+    QVERIFY(Snapshot::loadData(reply.data, users, rides, nullptr, &ledger));
+    QCOMPARE(users.find("bob", "passenger")->getBalanceMinor(), toMoney(5000));
+    QCOMPARE(users.find("carol", "passenger")->getBalanceMinor(), Money(0));
+    for (const User *user : users.all()) {
+        QVERIFY(user->getPassword().isEmpty());
+    }
+    QVERIFY(ledger.systemBalances().isEmpty());
+    QVERIFY(rides.find(rideId));
+}
+
+void ServerTests::changesHideOtherUsers()
+{
+    CarpoolClient bob;
+    QVERIFY(login(bob, "bob"));
+    QCOMPARE(bob.call("SUBSCRIBE").op, QString("SNAPSHOT"));
+    QVector<JournalEntry> changes;
+    connect(&bob, &CarpoolClient::changeReceived, this,
+            [&changes](const JournalEntry &entry) { changes.append(entry); });
+
+    // Carol's booking reaches bob as a taken seat without the money
+    CarpoolClient carol;
+    QVERIFY(login(carol, "carol"));
+    QVERIFY(carol.call("BOOK", {QString::number(rideId)}).isOk());
+    QVERIFY(carol.call("TOPUP", {"100"}).isOk());
+
+    // Changes reach a subscriber before the reply to its own request
+    QVERIFY(bob.call("TOPUP", {"250"}).isOk());
+    QStringList ops;
+    for (const JournalEntry &entry : changes) {
+        ops << entry.op;
+        if (entry.op == "BOOK") {
+            QCOMPARE(entry.args.value(1), QString("carol"));
+            QCOMPARE(entry.args.value(4), QString("0"));
+        }
+    }
+    QCOMPARE(ops, (QStringList{"BOOK", "TXN"}));
+    QCOMPARE(changes.last().args, (QStringList{"topup", "passenger:bob", "250",
+                                               Ledger::others(), "-250"}));
+}
+
+void ServerTests::rateOnlyFindsOwnRides()
+{
+    const QString rideNotFound = QString::number(CarpoolService::RideNotFound);
+
+    // Bob has no part in the ride, and no ride has id 999
+    CarpoolClient bob;
+    QVERIFY(login(bob, "bob"));
+    CarpoolClient::Reply reply = bob.call("RATE", {QString::number(rideId), "5"});
+    QCOMPARE(reply.op, QString("ERR"));
+    QCOMPARE(reply.args.value(0), rideNotFound);
+    reply = bob.call("RATE", {"999", "5"});
+    QCOMPARE(reply.args.value(0), rideNotFound);
+
+    // Carol booked it, so she gets as far as the ride not being finished
+    CarpoolClient carol;
+    QVERIFY(login(carol, "carol"));
+    reply = carol.call("RATE", {QString::number(rideId), "5"});
+    QCOMPARE(reply.args.value(0), QString::number(CarpoolService::RideNotCompleted));
+}
+
+CARPOOL_TEST(ServerTests)
+#include "servertests.moc"
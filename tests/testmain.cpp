@@ -0,0 +1,27 @@
+// Runs every QtTest class registered with CARPOOL_TEST. Command-line
+// options are passed to each class, so e.g. "-v2" or a test function name
+// work as with a single QtTest executable; the exit code is the number of
+// classes that had a failure.
+
+#include <QCoreApplication>
+#include <QScopedPointer>
+#include <QtTest>
+#include "testregistry.h"
+
+QList<std::function<QObject*()>> &testClasses()
+{
+    static QList<std::function<QObject*()>> classes;
+    return classes;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    int failedClasses = 0;
+    for (const std::function<QObject*()> &create : testClasses()) {
+        QScopedPointer<QObject> tests(create());
+        if (QTest::qExec(tests.data(), argc, argv) != 0) failedClasses++;
+    }
+    return failedClasses;
+}
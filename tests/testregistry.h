@@ -0,0 +1,20 @@
+#ifndef TESTREGISTRY_H
+#define TESTREGISTRY_H
+
+#include <QList>
+#include <QObject>
+#include <functional>
+
+// carpool_tests is one executable holding a QtTest class per area. Each
+// class registers itself with CARPOOL_TEST(Class) next to its definition,
+// and main() runs every registered class in turn.
+QList<std::function<QObject*()>> &testClasses();
+
+template <typename T>
+struct TestRegistration {
+    TestRegistration() { testClasses().append([]() -> QObject* { return new T; }); }
+};
+
+#define CARPOOL_TEST(Class) static TestRegistration<Class> registration##Class;
+
+#endif // TESTREGISTRY_H
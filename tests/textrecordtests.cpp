@@ -0,0 +1,116 @@
+// Tests for bulk loading of users.txt/rides.txt: the in-place field
+// parsers must agree with Qt's, and a file decoded in parallel chunks must
+// load in file order.
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "snapshot.h"
+#include "testregistry.h"
+#include "textrecord.h"
+
+class TextRecordTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void numbersMatchQt_data();
+    void numbersMatchQt();
+    void partsMatchSplit_data();
+    void partsMatchSplit();
+    void splitFieldsKeepsEmptyFields();
+    void parallelLoadKeepsFileOrder();
+};
+
+void TextRecordTests::numbersMatchQt_data()
+{
+    QTest::addColumn<QByteArray>("text");
+
+    for (const char *text : {"0", "-12", "+7", "750.5", "12.50", "-0.25", "123456789012345678",
+                             "1234567890123456789", "99999.999999999999", "1e3", " 5", "5 ", "abc",
+                             "1.2.3", "", "-", "."}) {
+        QTest::newRow(*text ? text : "(empty)") << QByteArray(text);
+    }
+}
+
+void TextRecordTests::numbersMatchQt()
+{
+    QFETCH(QByteArray, text);
+
+    // A view into a longer line, as the bulk loader passes them
+    const QByteArray line = text + ",9";
+    const QByteArray view = QByteArray::fromRawData(line.constData(), text.size());
+    QCOMPARE(fieldInt64(view), text.toLongLong());
+    QCOMPARE(fieldDouble(view), text.toDouble());
+    QCOMPARE(fieldInt64(QString::fromUtf8(text)), text.toLongLong());
+}
+
+void TextRecordTests::partsMatchSplit_data()
+{
+    QTest::addColumn<QByteArray>("field");
+
+    QTest::newRow("several") << QByteArray("ali;sara;omar");
+    QTest::newRow("one") << QByteArray("ali");
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("trailing") << QByteArray("1;2;");
+    QTest::newRow("only separators") << QByteArray(";;");
+}
+
+void TextRecordTests::partsMatchSplit()
+{
+    QFETCH(QByteArray, field);
+
+    QStringList fromView;
+    forEachPart(field, ';', [&fromView](const QByteArray &part) { fromView.append(QString::fromUtf8(part)); });
+    QStringList fromString;
+    forEachPart(QString::fromUtf8(field), ';', [&fromString](const QString &part) { fromString.append(part); });
+    QCOMPARE(fromView, QString::fromUtf8(field).split(';'));
+    QCOMPARE(fromString, fromView);
+}
+
+void TextRecordTests::splitFieldsKeepsEmptyFields()
+{
+    const QByteArray line = "tcap,,Lahore to Karachi,,";
+    QVector<QByteArray> fields;
+    splitFields(line.constData(), line.constData() + line.size(), &fields);
+    QCOMPARE(fields, (QVector<QByteArray>{"tcap", "", "Lahore to Karachi", "", ""}));
+}
+
+void TextRecordTests::parallelLoadKeepsFileOrder()
+{
+    // Large enough to be cut into several chunks on any machine
+    const int count = 20000;
+    QByteArray text = "#journal,7\n";
+    for (int i = 0; i < count; i++) {
+        text += "Passenger,bulk" + QByteArray::number(i) + ",pw," + QByteArray::number(i % 1000) +
+                ".25,0,0,0,0;0;0;0;0\r\n";
+    }
+    QTemporaryDir dir;
+    QFile file(dir.filePath("users.txt"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(text), qint64(text.size()));
+    file.close();
+
+    UserDirectory users;
+    quint64 sequence = 0;
+    int lastDone = 0;
+    int chunks = 0;
+    QVERIFY(Snapshot::loadUsersText(file.fileName(), users, &sequence, [&](int done, int total) {
+        QVERIFY(done > lastDone && done <= total);
+        lastDone = done;
+        chunks = total;
+    }));
+    QCOMPARE(sequence, quint64(7));
+    QVERIFY(chunks > 1);
+    QCOMPARE(lastDone, chunks);
+
+    QCOMPARE(users.size(), count);
+    for (int i = 0; i < count; i += 997) {
+        const User *user = users.all().at(i);
+        QCOMPARE(user->getUsername(), "bulk" + QString::number(i));
+        QCOMPARE(user->getBalanceMinor(), Money((i % 1000) * 100 + 25));
+    }
+}
+
+CARPOOL_TEST(TextRecordTests)
+#include "textrecordtests.moc"
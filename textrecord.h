@@ -0,0 +1,118 @@
+#ifndef TEXTRECORD_H
+#define TEXTRECORD_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <cstring>
+
+// Helpers for the users.txt/rides.txt record decoders. A record's fields
+// come either as a QStringList (journal entries, server replies) or as
+// QByteArray views into a mapped file (bulk loading), so the decoders are
+// templates and read fields through the overloads below. Text fields are
+// decoded into a QString each; numbers and ';' lists are read in place.
+inline QString fieldText(const QString &field) { return field; }
+inline QString fieldText(const QByteArray &field) { return QString::fromUtf8(field); }
+
+// QByteArray::toLongLong() and toDouble() copy a raw-data view to
+// null-terminate it, so views are parsed here instead. Like Qt, malformed
+// numbers read as 0; anything the fast paths don't cover (whitespace,
+// exponents, long mantissas) falls back to Qt.
+inline qint64 fieldInt64(const QString &field) { return field.toLongLong(); }
+inline qint64 fieldInt64(const QByteArray &field)
+{
+    const char *p = field.constData();
+    const char *end = p + field.size();
+    const bool negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+')) p++;
+    if (p == end || end - p > 18) return field.toLongLong();
+
+    qint64 value = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') return field.toLongLong();
+        value = value * 10 + (*p - '0');
+    }
+    return negative ? -value : value;
+}
+template <typename Field>
+inline int fieldInt(const Field &field) { return int(fieldInt64(field)); }
+
+inline double fieldDouble(const QString &field) { return field.toDouble(); }
+inline double fieldDouble(const QByteArray &field)
+{
+    static const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+                                        1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+    const char *p = field.constData();
+    const char *end = p + field.size();
+    const bool negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+')) p++;
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    bool point = false;
+    for (; p < end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            mantissa = mantissa * 10 + quint64(*p - '0');
+            digits++;
+            if (point) decimals++;
+        } else if (*p == '.' && !point) {
+            point = true;
+        } else {
+            break;
+        }
+    }
+    // Up to 15 digits the mantissa and the power of ten are exact doubles,
+    // so the one division rounds exactly like Qt's conversion
+    if (p != end || digits == 0 || digits > 15) return field.toDouble();
+    const double value = double(mantissa) / powersOf10[decimals];
+    return negative ? -value : value;
+}
+
+// Calls part(subfield) for each separator-delimited piece of field, an
+// empty field giving one empty piece like QString::split(). Pieces of a
+// view are views into the same line.
+template <typename Part>
+inline void forEachPart(const QString &field, char separator, Part part)
+{
+    for (const QString &piece : field.split(QLatin1Char(separator))) {
+        part(piece);
+    }
+}
+template <typename Part>
+inline void forEachPart(const QByteArray &field, char separator, Part part)
+{
+    const char *begin = field.constData();
+    const char *end = begin + field.size();
+    while (true) {
+        const char *next = static_cast<const char *>(std::memchr(begin, separator, end - begin));
+        const char *pieceEnd = next ? next : end;
+        part(QByteArray::fromRawData(begin, int(pieceEnd - begin)));
+        if (!next) break;
+        begin = next + 1;
+    }
+}
+
+// length characters of field from index from; a view for a view
+inline QString fieldPart(const QString &field, int from, int length) { return field.mid(from, length); }
+inline QByteArray fieldPart(const QByteArray &field, int from, int length)
+{
+    return QByteArray::fromRawData(field.constData() + from, length);
+}
+
+// Splits [begin, end) at commas into fields that point into the line
+// rather than copying it; the line must outlive them. fields is reused
+// from line to line, so its storage is allocated once.
+inline void splitFields(const char *begin, const char *end, QVector<QByteArray> *fields)
+{
+    fields->clear();
+    while (true) {
+        const char *comma = static_cast<const char *>(std::memchr(begin, ',', end - begin));
+        const char *fieldEnd = comma ? comma : end;
+        fields->append(QByteArray::fromRawData(begin, int(fieldEnd - begin)));
+        if (!comma) break;
+        begin = comma + 1;
+    }
+}
+
+#endif // TEXTRECORD_H
@@ -0,0 +1,125 @@
+#ifndef USER_H
+#define USER_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+#include <QTextStream>
+#include "money.h"
+#include "stringpool.h"
+
+class User {
+public:
+    static const int MaxStars = 5;
+
+protected:
+    int usernameId;     // StringPool ids
+    QString password;
+    int userTypeId;
+    Money balance;      // minor units; changed only through the Ledger
+    int cancelCount;
+    qint64 ratingSum;   // stars, so the average is exact
+    int ratingCount;
+    quint32 starCounts[MaxStars] = {};  // ratings received per star value, 1 first
+
+public:
+    User(QString uname, QString pwd, QString type) : usernameId(internString(uname)), password(pwd), userTypeId(internString(type)), balance(0), cancelCount(0), ratingSum(0), ratingCount(0) {}
+    virtual ~User() {}
+
+    QString getUsername() const { return pooledString(usernameId); }
+    QString getUserType() const { return pooledString(userTypeId); }
+    int getUsernameId() const { return usernameId; }
+    int getUserTypeId() const { return userTypeId; }
+    QString getPassword() const { return password; }
+    double getBalance() const { return toRupees(balance); }
+    Money getBalanceMinor() const { return balance; }
+    int getCancelCount() const { return cancelCount; }
+    qint64 getRatingSum() const { return ratingSum; }
+    float getAverageRating() const {
+        return ratingCount > 0 ? float(double(ratingSum) / ratingCount) : 0;
+    }
+    int getRatingCount() const {
+        return ratingCount;
+    }
+    // Ratings of 1..MaxStars stars received; ratings restored from files
+    // written before the histogram was kept count only in the totals
+    quint32 getStarCount(int stars) const {
+        return stars >= 1 && stars <= MaxStars ? starCounts[stars - 1] : 0;
+    }
+
+    void adjustBalance(Money amount) { balance += amount; }
+    void incrementCancelCount() { cancelCount++; }
+    void addRating(int stars) {
+        ratingSum += stars;
+        ratingCount++;
+        if (stars >= 1 && stars <= MaxStars) starCounts[stars - 1]++;
+    }
+
+    // Restores the counters saved by toRecord() in one step; stars holds
+    // MaxStars histogram counts, or is null when the record had none
+    void restoreStats(int cancels, qint64 sum, int ratings, const quint32 *stars = nullptr) {
+        cancelCount = cancels;
+        ratingSum = sum;
+        ratingCount = ratings;
+        for (int i = 0; i < MaxStars; i++) {
+            starCounts[i] = stars ? stars[i] : 0;
+        }
+    }
+
+    // "<1 star count>;<2 star count>;...": the last users.txt field
+    QString starCountsRecord() const {
+        QStringList counts;
+        for (int i = 0; i < MaxStars; i++) {
+            counts << QString::number(starCounts[i]);
+        }
+        return counts.join(";");
+    }
+
+    // One users.txt line (without the trailing newline)
+    virtual QString toRecord() const = 0;
+
+    void saveToFile(QFile &file) {
+        QTextStream out(&file);
+        out << toRecord() << "\n";
+    }
+};
+
+class Passenger : public User {
+public:
+    Passenger(QString uname, QString pwd) : User(uname, pwd, "passenger") {}
+
+    QString toRecord() const override {
+        QString line;
+        QTextStream out(&line);
+        out << "Passenger," << getUsername() << "," << password << "," << formatMoney(balance) << ","
+            << cancelCount << "," << ratingSum << "," << ratingCount << "," << starCountsRecord();
+        out.flush();
+        return line;
+    }
+};
+
+class Captain : public User {
+    int vehicleTypeId;
+    int vehicleClassId;
+
+public:
+    Captain(QString uname, QString pwd, QString vType, QString vClass)
+        : User(uname, pwd, "captain"), vehicleTypeId(internString(vType)), vehicleClassId(internString(vClass)) {}
+
+    QString getVehicleType() const { return pooledString(vehicleTypeId); }
+    QString getVehicleClass() const { return pooledString(vehicleClassId); }
+    int getVehicleTypeId() const { return vehicleTypeId; }
+    int getVehicleClassId() const { return vehicleClassId; }
+
+    QString toRecord() const override {
+        QString line;
+        QTextStream out(&line);
+        out << "Captain," << getUsername() << "," << password << "," << formatMoney(balance) << ","
+            << cancelCount << "," << ratingSum << "," << ratingCount << ","
+            << getVehicleType() << "," << getVehicleClass() << "," << starCountsRecord();
+        out.flush();
+        return line;
+    }
+};
+
+#endif // USER_H
@@ -0,0 +1,75 @@
+#include "userdirectory.h"
+
+UserDirectory::~UserDirectory()
+{
+    clear();
+}
+
+User* UserDirectory::createFromRecord(const Record &record)
+{
+    User* user = nullptr;
+    if (record.type == "Captain") {
+        user = create<Captain>(record.username, record.password, record.vehicleType, record.vehicleClass);
+    } else {
+        user = create<Passenger>(record.username, record.password);
+    }
+    user->adjustBalance(record.balance);
+    user->restoreStats(record.cancelCount, record.ratingSum, record.ratingCount,
+                       record.hasStarCounts ? record.starCounts : nullptr);
+    return user;
+}
+
+User* UserDirectory::createFromRecord(const QStringList &parts)
+{
+    Record record;
+    return decodeRecord(parts, &record) ? createFromRecord(record) : nullptr;
+}
+
+void UserDirectory::reserve(int count)
+{
+    pool.reserve(count);
+    users.reserve(count);
+    byUsername.reserve(count);
+    byTypedUsername.reserve(count);
+}
+
+bool UserDirectory::add(User *user)
+{
+    if (!user) return false;
+
+    quint64 key = typedKey(user->getUsernameId(), user->getUserTypeId());
+    if (byTypedUsername.contains(key)) {
+        return false;
+    }
+
+    users.append(user);
+    byTypedUsername.insert(key, user);
+    // Keep the first user registered under a name if older files contain
+    // the same username as both passenger and captain
+    if (!byUsername.contains(user->getUsernameId())) {
+        byUsername.insert(user->getUsernameId(), user);
+    }
+    return true;
+}
+
+User* UserDirectory::find(const QString &username) const
+{
+    // A name that was never interned can't belong to any user
+    int usernameId = StringPool::instance().find(username);
+    return usernameId > 0 ? find(usernameId) : lookedUp(nullptr);
+}
+
+User* UserDirectory::find(const QString &username, const QString &userType) const
+{
+    int usernameId = StringPool::instance().find(username);
+    int userTypeId = StringPool::instance().find(userType);
+    return usernameId > 0 && userTypeId > 0 ? find(usernameId, userTypeId) : lookedUp(nullptr);
+}
+
+void UserDirectory::clear()
+{
+    pool.clear();
+    users.clear();
+    byUsername.clear();
+    byTypedUsername.clear();
+}
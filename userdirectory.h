@@ -0,0 +1,137 @@
+#ifndef USERDIRECTORY_H
+#define USERDIRECTORY_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <algorithm>
+#include "entitypool.h"
+#include "metrics.h"
+#include "textrecord.h"
+#include "user.h"
+
+// Slot large enough for any User subclass
+const std::size_t UserSlotSize = std::max(sizeof(Passenger), sizeof(Captain));
+typedef EntityPool<User, UserSlotSize> UserPool;
+typedef UserPool::Handle UserHandle;
+
+// Owns every User and indexes them by username (and by username + type) so
+// login, registration and balance transfers don't walk the whole list.
+// Users are allocated from a slab pool; create them through the directory.
+class UserDirectory {
+public:
+    UserDirectory() {}
+    ~UserDirectory();
+
+    UserDirectory(const UserDirectory &) = delete;
+    UserDirectory &operator=(const UserDirectory &) = delete;
+
+    // Allocates a user in the pool; it isn't visible to lookups until add()
+    template <typename U, typename... Args>
+    U* create(Args&&... args) { return pool.template create<U>(std::forward<Args>(args)...); }
+    // The values of one users.txt line. Decoding doesn't touch the
+    // directory, so bulk loads decode on worker threads and only create
+    // the users on the owning one.
+    struct Record {
+        QString type;
+        QString username;
+        QString password;
+        Money balance = 0;
+        int cancelCount = 0;
+        qint64 ratingSum = 0;
+        int ratingCount = 0;
+        bool hasStarCounts = false;     // false for records written before the histogram
+        quint32 starCounts[User::MaxStars] = {};
+        QString vehicleType;
+        QString vehicleClass;
+    };
+    // Fields is a QStringList or a list of QByteArray views of the line;
+    // returns false for malformed or unknown records
+    template <typename Fields>
+    static bool decodeRecord(const Fields &parts, Record *record);
+    User* createFromRecord(const Record &record);
+    // Decodes and creates in one step; returns nullptr for malformed or
+    // unknown records
+    User* createFromRecord(const QStringList &parts);
+    // Frees a user that was created but not (successfully) added
+    void destroy(User *user) { pool.destroy(user); }
+    void reserve(int count);
+
+    // Indexes a user created by this directory. Returns false if a user with
+    // the same username and type is already present; the caller then
+    // destroys it.
+    bool add(User *user);
+
+    User* find(const QString &username) const;
+    User* find(const QString &username, const QString &userType) const;
+    bool contains(const QString &username) const { return find(username) != nullptr; }
+
+    // Lookups by StringPool id, used where the caller already holds one
+    User* find(int usernameId) const { return lookedUp(byUsername.value(usernameId, nullptr)); }
+    User* find(int usernameId, int userTypeId) const {
+        return lookedUp(byTypedUsername.value(typedKey(usernameId, userTypeId), nullptr));
+    }
+
+    UserHandle handleOf(const User *user) const { return pool.handleOf(user); }
+    User* get(const UserHandle &handle) const { return pool.get(handle); }
+
+    // Users in insertion order, used when writing snapshots
+    const QList<User*> &all() const { return users; }
+    int size() const { return users.size(); }
+    void clear();
+
+private:
+    static User* lookedUp(User *user) {
+        Metrics::count(Metrics::UserLookups);
+        if (!user) Metrics::count(Metrics::UserLookupMisses);
+        return user;
+    }
+    static quint64 typedKey(int usernameId, int userTypeId) {
+        return (quint64(quint32(userTypeId)) << 32) | quint32(usernameId);
+    }
+
+    UserPool pool;
+    QList<User*> users;
+    QHash<int, User*> byUsername;
+    QHash<quint64, User*> byTypedUsername;
+};
+
+template <typename Fields>
+bool UserDirectory::decodeRecord(const Fields &parts, Record *record)
+{
+    if (parts.size() < 7) return false;
+
+    record->type = fieldText(parts[0]);
+    int starsField = 7;
+    if (record->type == "Captain") {
+        if (parts.size() < 9) return false;
+        record->vehicleType = fieldText(parts[7]);
+        record->vehicleClass = fieldText(parts[8]);
+        starsField = 9;
+    } else if (record->type != "Passenger") {
+        return false;
+    }
+
+    record->username = fieldText(parts[1]);
+    record->password = fieldText(parts[2]);
+    record->balance = toMoney(fieldDouble(parts[3]));
+    record->cancelCount = fieldInt(parts[4]);
+    record->ratingCount = fieldInt(parts[6]);
+
+    // Records with the star histogram hold the exact star sum in field 5;
+    // older ones held a float "rating" there, restored as before
+    int counts = 0;
+    forEachPart(parts.value(starsField), ';', [record, &counts](const auto &count) {
+        if (counts < User::MaxStars) record->starCounts[counts] = quint32(fieldInt64(count));
+        counts++;
+    });
+    record->hasStarCounts = counts == User::MaxStars;
+    if (record->hasStarCounts) {
+        record->ratingSum = fieldInt64(parts[5]);
+    } else {
+        record->ratingSum = qRound64(double(float(fieldDouble(parts[5]))) * record->ratingCount);
+    }
+    return true;
+}
+
+#endif // USERDIRECTORY_H